@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+
+namespace arena
+{
+
+    // Bytes an arena starts with
+    constexpr std::size_t DEFAULT_BYTES = 64 << 10;
+
+    // Bump allocator for the temporaries of one request, freed all at once
+    // by reset(). What does not fit in the block comes from the heap and
+    // makes reset() grow the block to the size the request needed, so after
+    // the first requests of each size the arena no longer touches the heap
+    class Arena : public std::pmr::memory_resource
+    {
+    private:
+        // Heap chunks of the current request, linked through a header at
+        // their start
+        struct Overflow
+        {
+            Overflow *next;
+            std::size_t alignment;
+        };
+
+        std::unique_ptr<std::byte[]> block_;
+        std::size_t capacity_;
+        std::size_t used_ = 0;
+        Overflow *overflow_ = nullptr;
+        std::size_t overflow_bytes_ = 0;
+
+        static std::size_t round_up(std::size_t value, std::size_t alignment)
+        {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+        void free_overflow()
+        {
+            while (overflow_ != nullptr)
+            {
+                Overflow *next = overflow_->next;
+                ::operator delete(static_cast<void *>(overflow_), std::align_val_t(overflow_->alignment));
+                overflow_ = next;
+            }
+            overflow_bytes_ = 0;
+        }
+
+    protected:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            auto base = reinterpret_cast<std::uintptr_t>(block_.get());
+            std::size_t start = round_up(base + used_, alignment) - base;
+            if (start + bytes <= capacity_)
+            {
+                used_ = start + bytes;
+                return block_.get() + start;
+            }
+
+            // The header is padded to the alignment so the bytes after it keep it
+            alignment = std::max(alignment, alignof(Overflow));
+            std::size_t header = round_up(sizeof(Overflow), alignment);
+            void *chunk = ::operator new(header + bytes, std::align_val_t(alignment));
+            overflow_ = new (chunk) Overflow{overflow_, alignment};
+            overflow_bytes_ += header + bytes;
+            return static_cast<std::byte *>(chunk) + header;
+        }
+
+        // Memory is only given back by reset()
+        void do_deallocate(void *, std::size_t, std::size_t) override
+        {
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    public:
+        explicit Arena(std::size_t bytes = DEFAULT_BYTES)
+            : block_(new std::byte[std::max<std::size_t>(bytes, 1)]), capacity_(std::max<std::size_t>(bytes, 1))
+        {
+        }
+
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        ~Arena() override
+        {
+            free_overflow();
+        }
+
+        // Free everything allocated since the last reset. Containers still
+        // using the arena must not be touched afterwards
+        void reset()
+        {
+            if (overflow_bytes_ > 0)
+            {
+                std::size_t needed = used_ + overflow_bytes_;
+                free_overflow();
+                capacity_ = std::max(needed, capacity_ * 2);
+                block_.reset(new std::byte[capacity_]);
+            }
+            used_ = 0;
+        }
+
+        // Bytes handed out from the block since the last reset
+        std::size_t used() const
+        {
+            return used_;
+        }
+
+        std::size_t capacity() const
+        {
+            return capacity_;
+        }
+    };
+
+    // Resets an arena when the request using it is done
+    class Scope
+    {
+    private:
+        Arena &arena_;
+
+    public:
+        explicit Scope(Arena &arena) : arena_(arena)
+        {
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        ~Scope()
+        {
+            arena_.reset();
+        }
+    };
+
+    // Memory resource the elements of `container` come from, the heap for
+    // containers with the default allocator
+    template <typename Container>
+    std::pmr::memory_resource *resource_of(const Container &container)
+    {
+        using Allocator = typename Container::allocator_type;
+        if constexpr (std::is_same_v<Allocator, std::pmr::polymorphic_allocator<typename Container::value_type>>)
+        {
+            return container.get_allocator().resource();
+        }
+        else
+        {
+            return std::pmr::new_delete_resource();
+        }
+    }
+
+} // namespace arena
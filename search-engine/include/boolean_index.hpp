@@ -1,151 +1,1616 @@
 #pragma once
 
+#include <array>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <functional>
 #include <algorithm>
+#include <chrono>
+#include <limits>
+#include <type_traits>
 
 #include "skiplist.hpp"
 #include "hashmap.hpp"
+#include "posting_list.hpp"
+#include "roaring.hpp"
+#include "arena.hpp"
+#include "intersection.hpp"
+#include "deadline.hpp"
+#include "parallel_executor.hpp"
+#include "pair_cache.hpp"
+#include "cardinality.hpp"
+#include "term_dictionary.hpp"
+#include "fuzzy.hpp"
+#include "completion_trie.hpp"
+#include "doc_values.hpp"
+#include "position_index.hpp"
 #include "log.hpp"
 
 namespace boolean_index
 {
 
+    struct IndexOptions
+    {
+        // Keep per-document term positions for phrase and proximity queries
+        bool positions = false;
+        // Terms found in at least this share of documents are stored as
+        // roaring bitmaps by compress(), rarer ones as delta-encoded lists
+        double bitmap_min_density = 1.0 / 32;
+        // Materialized intersections of popular term pairs, off by default
+        pair_cache::PairCacheOptions pair_cache;
+        // Total postings a prefix query may expand to, the most frequent
+        // matching terms are kept first
+        std::size_t prefix_max_postings = 1 << 20;
+        // Terms a prefix query may expand to, the most frequent ones
+        std::size_t prefix_max_terms = 64;
+        // Completions kept per trie node for search-as-you-type, 0 disables them
+        std::size_t completion_top_k = 8;
+        // Rarer terms are mostly typos and are never suggested
+        std::size_t completion_min_frequency = 2;
+    };
+
+    // Terms a prefix expanded to
+    struct PrefixExpansion
+    {
+        std::vector<std::string> terms;
+        // Document frequencies of the kept terms added up
+        std::size_t postings = 0;
+        // Terms in the dictionary starting with the prefix
+        std::size_t matched_terms = 0;
+        // Some matching terms were dropped to stay within the term or
+        // posting budget
+        bool truncated = false;
+    };
+
+    // Posting lists of the terms of a batch of queries, each distinct term
+    // looked up once. Missing terms map to nullptr
+    template <typename DocId>
+    using ResolvedTerms = hashmap::HashMap<std::string, const posting_list::PostingList<DocId> *>;
+
+    // Restrictions applied on top of the terms of a query
+    template <typename DocId>
+    struct QueryFilter
+    {
+        // Documents whose lastmod lies in a range, nullptr for any
+        const doc_values::RangeFilter<DocId, int64_t> *lastmod = nullptr;
+        // Postings of facet values every document must have
+        std::vector<const posting_list::PostingList<DocId> *> facets;
+        // Terms already looked up for a batch of queries, nullptr to look
+        // them up in the index. Restricts nothing
+        const ResolvedTerms<DocId> *terms = nullptr;
+        // Evaluation stops once it passes, the result is then incomplete
+        const deadline::Deadline *deadline = nullptr;
+    };
+
+    // Dictionary term close to a query term
+    struct FuzzyMatch
+    {
+        std::string term;
+        uint32_t distance;
+        std::size_t frequency;
+    };
+
     template <typename DocId = uint32_t>
     class BooleanIndex
     {
     private:
         using SkipListType = skiplist::SkipList<DocId>;
-        using HashMapType = hashmap::HashMap<std::string, std::unique_ptr<SkipListType>>;
+        using PostingListType = posting_list::PostingList<DocId>;
+        using HashMapType = hashmap::HashMap<std::string, std::unique_ptr<PostingListType>>;
+        using PositionIndexType = position_index::PositionIndex<DocId>;
+        // Set of live documents, a bitmap whenever ids fit in 32 bits
+        using DocumentSetType = std::conditional_t<posting_list::is_compressible_v<DocId>,
+                                                   roaring::RoaringBitmap, SkipListType>;
+        using RangeFilterType = doc_values::RangeFilter<DocId, int64_t>;
+        using QueryFilterType = QueryFilter<DocId>;
 
         HashMapType index_;
-        SkipListType all_documents_;
+        DocumentSetType all_documents_;
         std::size_t total_documents_;
         std::size_t max_responses_;
+        std::unique_ptr<PositionIndexType> positions_;
+        double bitmap_min_density_;
+        const parallel_executor::ParallelExecutor<DocId> *executor_ = nullptr;
+        // Bumped by every change that can alter query results
+        uint64_t generation_ = 0;
+        std::unique_ptr<pair_cache::PairCache<PostingListType>> pair_cache_;
+        // Last id given to a term posting list, pairs are cached by term ids
+        uint32_t last_term_id_ = 0;
+        // Sorted copy of the term dictionary, rebuilt by compress()
+        term_dictionary::FrontCodedDictionary term_dictionary_;
+        // Document frequencies by dictionary rank, taken at the last rebuild
+        std::vector<uint32_t> term_frequencies_;
+        std::size_t prefix_max_postings_;
+        std::size_t prefix_max_terms_;
+        // Most frequent words under every prefix, rebuilt with the dictionary
+        completion::CompletionTrie completions_;
+        // Words the terms were stemmed from, a term is suggested as its most
+        // frequent word
+        hashmap::HashMap<std::string, completion::SurfaceForms> surface_forms_;
+        std::size_t completion_top_k_;
+        std::size_t completion_min_frequency_;
+
+        // Frequent terms whose adjacent pairs get their own posting lists
+        hashmap::HashMap<std::string, bool> common_terms_;
+        HashMapType bigrams_;
+
+        static std::string bigram_key(const std::string &first, const std::string &second)
+        {
+            // Terms never contain spaces, so the key is unambiguous
+            std::string key;
+            key.reserve(first.size() + second.size() + 1);
+            key += first;
+            key += ' ';
+            key += second;
+            return key;
+        }
+
+        bool is_common_bigram(const std::string &first, const std::string &second) const
+        {
+            return common_terms_.find(first) != nullptr || common_terms_.find(second) != nullptr;
+        }
+
+        // Posting list of `term`, from the batch resolution of `filter` when
+        // it has the term. Any string type is looked up without a copy
+        template <typename Term>
+        const PostingListType *find_list(const Term &term, const QueryFilterType *filter) const
+        {
+            std::string_view key(term);
+            if (filter != nullptr && filter->terms != nullptr)
+            {
+                const auto *resolved = filter->terms->find_as(key);
+                if (resolved != nullptr)
+                {
+                    return *resolved;
+                }
+            }
+            const auto *posting_list_ptr = index_.find_as(key);
+            return posting_list_ptr == nullptr ? nullptr : posting_list_ptr->get();
+        }
+
+        // Collect posting lists for all terms, false if some term is missing
+        template <typename Terms, typename Lists>
+        bool collect_posting_lists(const Terms &terms, Lists &posting_lists,
+                                   const QueryFilterType *filter = nullptr) const
+        {
+            for (const auto &term : terms)
+            {
+                const auto *posting_list = find_list(term, filter);
+                if (posting_list == nullptr)
+                {
+                    return false;
+                }
+
+                posting_lists.push_back(posting_list);
+            }
+
+            return true;
+        }
+
+        // Choose posting lists for a phrase: adjacent pairs with a common term
+        // are read from their bigram list, other terms from their own list
+        bool plan_phrase(const std::vector<std::string> &terms, uint32_t slop,
+                         std::vector<const PostingListType *> &posting_lists,
+                         bool &covered_by_bigrams, const QueryFilterType *filter = nullptr) const
+        {
+            std::vector<bool> covered(terms.size(), false);
+            std::size_t bigram_count = 0;
+
+            if (slop == 0 && !common_terms_.empty())
+            {
+                for (std::size_t i = 0; i + 1 < terms.size(); i++)
+                {
+                    if (!is_common_bigram(terms[i], terms[i + 1]))
+                    {
+                        continue;
+                    }
+
+                    const auto *bigram_ptr = bigrams_.find(bigram_key(terms[i], terms[i + 1]));
+                    if (bigram_ptr == nullptr)
+                    {
+                        // Indexed pair never occurs, neither does the phrase
+                        posting_lists.clear();
+                        return false;
+                    }
+
+                    posting_lists.push_back(bigram_ptr->get());
+                    covered[i] = covered[i + 1] = true;
+                    bigram_count++;
+                }
+            }
+
+            for (std::size_t i = 0; i < terms.size(); i++)
+            {
+                if (covered[i])
+                {
+                    continue;
+                }
+
+                const auto *posting_list = find_list(terms[i], filter);
+                if (posting_list == nullptr)
+                {
+                    posting_lists.clear();
+                    return false;
+                }
+                posting_lists.push_back(posting_list);
+            }
+
+            // A single bigram list answers a two-term phrase on its own
+            covered_by_bigrams = terms.size() == 2 && bigram_count == 1;
+            return true;
+        }
+
+        // Range filters index dense columns, so they only apply to integral doc ids
+        static bool in_lastmod_range(const QueryFilterType *filter, const DocId &doc_id)
+        {
+            if constexpr (std::is_integral_v<DocId>)
+            {
+                return filter == nullptr || filter->lastmod == nullptr || filter->lastmod->contains(doc_id);
+            }
+            else
+            {
+                return true;
+            }
+        }
+
+        // Intersect posting lists only over the doc id ranges of the blocks
+        // that can hold values inside `filter`, checking single values only in
+        // blocks that straddle its bounds
+        template <typename Lists, typename MakeAccept, typename Result>
+        void intersect_filtered(Lists &posting_lists, MakeAccept make_accept, intersection::IntersectionStats *stats,
+                                const RangeFilterType &filter, const deadline::Deadline *deadline, Result &result) const
+        {
+            bool cached_pair = stats != nullptr && stats->cached_pair;
+            filter.column->for_each_range(filter.min, filter.max,
+                                          [&](DocId first, DocId last, bool exact)
+                                          {
+                                              auto accept = make_accept();
+                                              auto accept_in_range = [&](const DocId &doc_id)
+                                              { return (exact || filter.contains(doc_id)) && accept(doc_id); };
+
+                                              intersection::IntersectionStats range_stats;
+                                              std::size_t limit = max_responses_ == 0 ? 0 : max_responses_ - result.size();
+                                              intersection::intersect_into<DocId>(posting_lists, accept_in_range, limit, result,
+                                                                                  stats != nullptr ? &range_stats : nullptr,
+                                                                                  &first, &last, deadline);
+                                              if (stats != nullptr)
+                                              {
+                                                  stats->merge(range_stats);
+                                              }
+                                              bool out_of_time = deadline != nullptr && deadline->expired();
+                                              return (max_responses_ == 0 || result.size() < max_responses_) && !out_of_time;
+                                          });
+            if (stats != nullptr)
+            {
+                stats->cached_pair = cached_pair;
+            }
+        }
+
+        // Probes a serial intersection of `posting_lists` is expected to make.
+        // Every candidate of the smallest list is probed in each other list,
+        // but with a response limit the scan stops once enough candidates
+        // matched. Lists are taken as independent, so a candidate matches
+        // with the product of the other lists' densities
+        template <typename Lists>
+        std::size_t estimated_probes(const Lists &posting_lists) const
+        {
+            if (posting_lists.empty())
+            {
+                return 0;
+            }
+            std::size_t smallest = 0;
+            for (std::size_t i = 1; i < posting_lists.size(); i++)
+            {
+                if (posting_lists[i]->size() < posting_lists[smallest]->size())
+                {
+                    smallest = i;
+                }
+            }
+
+            double candidates = static_cast<double>(posting_lists[smallest]->size());
+            if (max_responses_ != 0 && total_documents_ != 0)
+            {
+                double match = 1.0;
+                for (std::size_t i = 0; i < posting_lists.size(); i++)
+                {
+                    if (i != smallest)
+                    {
+                        match *= std::min(1.0, static_cast<double>(posting_lists[i]->size()) / static_cast<double>(total_documents_));
+                    }
+                }
+                if (match > 0.0)
+                {
+                    candidates = std::min(candidates, static_cast<double>(max_responses_) / match);
+                }
+            }
+            return static_cast<std::size_t>(candidates) * posting_lists.size();
+        }
+
+        // Intersect posting lists into `result`, splitting the doc id space
+        // across the parallel executor when the query is expensive enough.
+        // `make_accept` creates the document filter, once per range since
+        // filters keep state. Facets of `filter` join the lists, they are
+        // bitmaps and get probed. Serial runs allocate like `result`
+        template <typename Lists, typename MakeAccept, typename Result>
+        void intersect_into(Lists &posting_lists, MakeAccept make_accept, intersection::IntersectionStats *stats,
+                            const QueryFilterType *filter, Result &result) const
+        {
+            const deadline::Deadline *deadline = filter != nullptr ? filter->deadline : nullptr;
+            if (filter != nullptr)
+            {
+                posting_lists.insert(posting_lists.end(), filter->facets.begin(), filter->facets.end());
+                if (posting_lists.empty())
+                {
+                    return;
+                }
+            }
+
+            if constexpr (std::is_integral_v<DocId>)
+            {
+                if (filter != nullptr && filter->lastmod != nullptr)
+                {
+                    intersect_filtered(posting_lists, make_accept, stats, *filter->lastmod, filter->deadline, result);
+                    return;
+                }
+            }
+
+            if constexpr (posting_list::is_compressible_v<DocId>)
+            {
+                if (executor_ != nullptr && !all_documents_.empty() && executor_->should_parallelize(estimated_probes(posting_lists)))
+                {
+                    std::vector<intersection::IntersectionStats> partition_stats(executor_->partition_count());
+                    auto ids = executor_->run(static_cast<DocId>(all_documents_.maximum() + 1), max_responses_,
+                                                 [&](std::size_t partition, DocId first, DocId last)
+                                                 {
+                                                     std::vector<const PostingListType *> lists(posting_lists.begin(), posting_lists.end());
+                                                     return intersection::intersect<DocId>(std::move(lists), make_accept(), max_responses_,
+                                                                                           &partition_stats[partition], &first, &last, deadline);
+                                                 });
+
+                    if (stats != nullptr)
+                    {
+                        bool cached_pair = stats->cached_pair;
+                        *stats = intersection::IntersectionStats();
+                        for (const auto &partition : partition_stats)
+                        {
+                            stats->merge(partition);
+                        }
+                        stats->partitions = partition_stats.size();
+                        stats->cached_pair = cached_pair;
+                    }
+                    result.insert(result.end(), ids.begin(), ids.end());
+                    return;
+                }
+            }
+
+            intersection::intersect_into<DocId>(posting_lists, make_accept(), max_responses_, result, stats,
+                                                nullptr, nullptr, deadline);
+        }
+
+        // intersect_into a new vector
+        template <typename MakeAccept>
+        std::vector<DocId> intersect(std::vector<const PostingListType *> posting_lists, MakeAccept make_accept,
+                                     intersection::IntersectionStats *stats, const QueryFilterType *filter = nullptr) const
+        {
+            std::vector<DocId> result;
+            intersect_into(posting_lists, make_accept, stats, filter, result);
+            return result;
+        }
+
+        // Replace the two lists of the most selective cached pair with their
+        // materialized intersection, which `holder` keeps alive. Every pair
+        // of the query is counted, and a pair seen often enough is queued for
+        // materialization on the executor's pool for the queries that follow.
+        // The query itself never waits for it. Without an executor nothing
+        // gets cached
+        template <typename Lists>
+        void substitute_cached_pair(Lists &posting_lists, std::shared_ptr<const PostingListType> &holder,
+                                    intersection::IntersectionStats *stats) const
+        {
+            if constexpr (posting_list::is_compressible_v<DocId>)
+            {
+                if (!pair_cache_ || posting_lists.size() < 2)
+                {
+                    return;
+                }
+
+                auto found = pair_cache_->lookup(posting_lists, generation_);
+                if (found.admit_first != nullptr)
+                {
+                    materialize_pair(found.admit_first, found.admit_second);
+                }
+                if (found.result == nullptr)
+                {
+                    return;
+                }
+
+                holder = std::move(found.result);
+                posting_lists.erase(posting_lists.begin() + found.second);
+                posting_lists.erase(posting_lists.begin() + found.first);
+                posting_lists.push_back(holder.get());
+                if (stats != nullptr)
+                {
+                    stats->cached_pair = true;
+                }
+            }
+        }
+
+        // Intersect a pair handed out by the cache on the executor's pool and
+        // cache the result. Updates wait for it, since it reads both lists
+        void materialize_pair(const PostingListType *first, const PostingListType *second) const
+        {
+            auto *cache = pair_cache_.get();
+            if (executor_ == nullptr)
+            {
+                cache->abandon(first->term_id(), second->term_id());
+                return;
+            }
+
+            uint64_t generation = generation_;
+            executor_->submit([cache, first, second, generation]
+                              {
+                                  try
+                                  {
+                                      auto ids = intersection::intersect<DocId>({first, second}, accept_all(), 0);
+                                      cache->insert(first->term_id(), second->term_id(), generation,
+                                                    std::make_shared<const PostingListType>(PostingListType::from_sorted(ids)));
+                                  }
+                                  catch (...)
+                                  {
+                                      cache->abandon(first->term_id(), second->term_id());
+                                  } });
+        }
+
+        // Check sampled ids of the smallest list against the other lists and
+        // `accept`, then scale the share of hits to the whole list. Samples
+        // are allocated like `posting_lists`
+        template <typename Lists, typename Accept>
+        cardinality::Estimate estimate_sampled(Lists posting_lists, Accept accept, std::size_t samples) const
+        {
+            auto smallest = std::min_element(posting_lists.begin(), posting_lists.end(),
+                                             [](const PostingListType *a, const PostingListType *b)
+                                             { return a->size() < b->size(); });
+            const PostingListType *base = *smallest;
+            posting_lists.erase(smallest);
+
+            std::pmr::vector<DocId> ids(arena::resource_of(posting_lists));
+            base->sample_into(samples, ids);
+            std::size_t hits = 0;
+            for (const auto &doc_id : ids)
+            {
+                bool in_all = std::all_of(posting_lists.begin(), posting_lists.end(),
+                                          [&](const PostingListType *list)
+                                          { return list->contains(doc_id); });
+                if (in_all && accept(doc_id))
+                {
+                    hits++;
+                }
+            }
+            return cardinality::from_sample(base->size(), ids.size(), hits);
+        }
+
+        static auto accept_all()
+        {
+            return [](const DocId &)
+            { return true; };
+        }
+
+        // Call `visit(doc_id)` in ascending order for every id in ANY of
+        // `any_of` and ALL of `required`, until it returns false. Each list is
+        // read through one cursor: the union is merged through a heap, the
+        // required lists are sought to each candidate, and a required list
+        // that skips past a candidate moves the whole union along with it
+        template <typename Visit>
+        static void for_each_in_union(const std::vector<const PostingListType *> &any_of,
+                                      const std::vector<const PostingListType *> &required, Visit visit)
+        {
+            using Cursor = typename PostingListType::Cursor;
+            std::vector<Cursor> merged;
+            merged.reserve(any_of.size());
+            for (const auto *list : any_of)
+            {
+                auto cursor = list->cursor();
+                if (cursor.valid())
+                {
+                    merged.push_back(cursor);
+                }
+            }
+            std::vector<Cursor> probes;
+            probes.reserve(required.size());
+            for (const auto *list : required)
+            {
+                probes.push_back(list->cursor());
+            }
+
+            // The cursor on the smallest id stays on top
+            auto later = [](const Cursor &a, const Cursor &b)
+            { return b.doc() < a.doc(); };
+            std::make_heap(merged.begin(), merged.end(), later);
+            while (!merged.empty())
+            {
+                DocId candidate = merged.front().doc();
+                DocId target = candidate;
+                bool matched = true;
+                for (auto &probe : probes)
+                {
+                    probe.seek(target);
+                    if (!probe.valid())
+                    {
+                        return;
+                    }
+                    if (target < probe.doc())
+                    {
+                        target = probe.doc();
+                        matched = false;
+                        break;
+                    }
+                }
+                if (matched && !visit(candidate))
+                {
+                    return;
+                }
+
+                // Past the candidate, or on to the id a required list is at
+                while (!merged.empty() && (matched ? !(candidate < merged.front().doc()) : merged.front().doc() < target))
+                {
+                    std::pop_heap(merged.begin(), merged.end(), later);
+                    if (matched)
+                    {
+                        merged.back().next();
+                    }
+                    else
+                    {
+                        merged.back().seek(target);
+                    }
+                    if (merged.back().valid())
+                    {
+                        std::push_heap(merged.begin(), merged.end(), later);
+                    }
+                    else
+                    {
+                        merged.pop_back();
+                    }
+                }
+            }
+        }
+
+        // Collect posting lists of the `terms` the index has, skipping the others
+        template <typename Terms, typename Lists>
+        void collect_existing_lists(const Terms &terms, Lists &posting_lists, const QueryFilterType *filter = nullptr) const
+        {
+            for (const auto &term : terms)
+            {
+                const auto *posting_list = find_list(term, filter);
+                if (posting_list != nullptr)
+                {
+                    posting_lists.push_back(posting_list);
+                }
+            }
+        }
+
+        // Cursors over excluded posting lists, probed with ascending doc ids
+        class Exclusion
+        {
+        private:
+            std::vector<typename PostingListType::Cursor> cursors_;
+
+        public:
+            Exclusion(const HashMapType &index, const std::vector<std::string> &terms)
+            {
+                for (const auto &term : terms)
+                {
+                    const auto *posting_list_ptr = index.find(term);
+                    if (posting_list_ptr != nullptr)
+                    {
+                        cursors_.push_back((*posting_list_ptr)->cursor());
+                    }
+                }
+            }
+
+            bool excludes(const DocId &doc_id)
+            {
+                for (auto &cursor : cursors_)
+                {
+                    cursor.seek(doc_id);
+                    if (cursor.valid() && cursor.doc() == doc_id)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+        };
+
+        bool document_set_contains(const DocId &doc_id) const
+        {
+            if constexpr (posting_list::is_compressible_v<DocId>)
+            {
+                return all_documents_.contains(static_cast<uint32_t>(doc_id));
+            }
+            else
+            {
+                return all_documents_.search(doc_id);
+            }
+        }
+
+        // Check that `terms` occur in order in the document, each one at most
+        // `slop` extra positions after the previous one
+        bool matches_phrase(DocId doc_id, const std::vector<std::string> &terms, uint32_t slop,
+                            std::vector<uint32_t> &reachable, std::vector<uint32_t> &positions) const
+        {
+            const auto *first = positions_->find(terms[0], doc_id);
+            if (first == nullptr)
+            {
+                return false;
+            }
+            position_index::decode_positions(*first, reachable);
+
+            std::vector<uint32_t> next;
+            for (std::size_t i = 1; i < terms.size() && !reachable.empty(); i++)
+            {
+                const auto *encoded = positions_->find(terms[i], doc_id);
+                if (encoded == nullptr)
+                {
+                    return false;
+                }
+                position_index::decode_positions(*encoded, positions);
+
+                // Both lists are sorted, so a single forward pass is enough
+                next.clear();
+                std::size_t r = 0;
+                for (uint32_t position : positions)
+                {
+                    while (r < reachable.size() && reachable[r] + slop + 1 < position)
+                    {
+                        r++;
+                    }
+                    if (r < reachable.size() && reachable[r] < position)
+                    {
+                        next.push_back(position);
+                    }
+                }
+                reachable.swap(next);
+            }
+
+            return !reachable.empty();
+        }
 
     public:
-        BooleanIndex() : total_documents_(0), max_responses_(0) {}
-        BooleanIndex(std::size_t max_responses) : max_responses_(max_responses) {}
+        BooleanIndex() : BooleanIndex(0) {}
+        BooleanIndex(std::size_t max_responses) : BooleanIndex(max_responses, IndexOptions()) {}
+        BooleanIndex(std::size_t max_responses, IndexOptions options)
+            : total_documents_(0), max_responses_(max_responses), bitmap_min_density_(options.bitmap_min_density),
+              prefix_max_postings_(options.prefix_max_postings), prefix_max_terms_(std::max<std::size_t>(options.prefix_max_terms, 1)), completion_top_k_(options.completion_top_k),
+              completion_min_frequency_(options.completion_min_frequency)
+        {
+            if constexpr (posting_list::is_compressible_v<DocId>)
+            {
+                if (options.pair_cache.budget_bytes != 0)
+                {
+                    pair_cache_ = std::make_unique<pair_cache::PairCache<PostingListType>>(options.pair_cache);
+                }
+            }
+            if (options.positions)
+            {
+                positions_ = std::make_unique<PositionIndexType>();
+            }
+        }
+
+        // Add a document with terms
+        void add_document(DocId doc_id, const std::vector<std::string> &terms)
+        {
+            wait_for_cached_pairs();
+            all_documents_.insert(doc_id);
+            total_documents_++;
+            generation_++;
+
+            for (const auto &term : terms)
+            {
+                auto *posting_list_ptr = index_.find(term);
+
+                if (posting_list_ptr == nullptr)
+                {
+                    // Create new posting list for this term
+                    auto new_posting_list = std::make_unique<PostingListType>();
+                    new_posting_list->set_term_id(++last_term_id_);
+                    new_posting_list->insert(doc_id);
+                    index_[term] = std::move(new_posting_list);
+                }
+                else
+                {
+                    // Add to existing posting list
+                    (*posting_list_ptr)->insert(doc_id);
+                }
+            }
+
+            index_common_bigrams(doc_id, terms);
+
+            if (positions_)
+            {
+                hashmap::HashMap<std::string, std::vector<uint32_t>> term_positions;
+                for (std::size_t i = 0; i < terms.size(); i++)
+                {
+                    term_positions[terms[i]].push_back(static_cast<uint32_t>(i));
+                }
+                for (const auto &kv : term_positions)
+                {
+                    positions_->add(kv.first, doc_id, kv.second);
+                }
+            }
+        }
+
+        // Count the words `terms` were stemmed from, `surface_forms[i]` being
+        // the word of `terms[i]`. Completions suggest the most frequent word
+        // of a term instead of the term itself
+        void add_surface_forms(const std::vector<std::string> &terms, const std::vector<std::string> &surface_forms)
+        {
+            for (std::size_t i = 0; i < terms.size() && i < surface_forms.size(); i++)
+            {
+                surface_forms_[terms[i]].add(surface_forms[i]);
+            }
+        }
+
+        // Remove a document from the index
+        bool remove_document(DocId doc_id, const std::vector<std::string> &terms)
+        {
+            if (!document_set_contains(doc_id))
+            {
+                return false;
+            }
+            wait_for_cached_pairs();
+
+            for (const auto &term : terms)
+            {
+                auto *posting_list_ptr = index_.find(term);
+                if (posting_list_ptr != nullptr)
+                {
+                    (*posting_list_ptr)->remove(doc_id);
+
+                    // If posting list is now empty, we could remove the term entirely
+                    // But let's keep it for simplicity (empty posting lists are okay)
+                }
+
+                if (positions_)
+                {
+                    positions_->remove(term, doc_id);
+                }
+            }
+
+            for (std::size_t i = 0; i + 1 < terms.size(); i++)
+            {
+                if (!is_common_bigram(terms[i], terms[i + 1]))
+                {
+                    continue;
+                }
+                auto *bigram_ptr = bigrams_.find(bigram_key(terms[i], terms[i + 1]));
+                if (bigram_ptr != nullptr)
+                {
+                    (*bigram_ptr)->remove(doc_id);
+                }
+            }
+
+            all_documents_.remove(doc_id);
+            total_documents_--;
+            generation_++;
+            return true;
+        }
+
+        // Get documents containing ALL terms, in ascending doc id order.
+        // With recency-ordered ids the first max_responses_ hits are the freshest.
+        // The strategy picked for each posting list is recorded in `stats`
+        // With `filter` set only documents passing it are returned, the same
+        // goes for every query below taking a filter
+        std::vector<DocId> and_query(const std::vector<std::string> &terms,
+                                     intersection::IntersectionStats *stats = nullptr,
+                                     const QueryFilterType *filter = nullptr) const
+        {
+            if (terms.empty())
+            {
+                return {};
+            }
+
+            std::vector<const PostingListType *> posting_lists;
+            if (!collect_posting_lists(terms, posting_lists, filter))
+            {
+                // Term doesn't exist, AND query returns empty
+                return {};
+            }
+
+            std::shared_ptr<const PostingListType> cached_pair;
+            substitute_cached_pair(posting_lists, cached_pair, stats);
+            return intersect(std::move(posting_lists), accept_all, stats, filter);
+        }
+
+        // and_query into `result`, whose memory resource, typically a request
+        // arena, also holds the evaluation temporaries. Without a parallel
+        // run or a pair queued for caching nothing comes from the heap. `terms` may
+        // hold any string type
+        template <typename Terms>
+        void and_query(const Terms &terms, std::pmr::vector<DocId> &result,
+                       intersection::IntersectionStats *stats = nullptr,
+                       const QueryFilterType *filter = nullptr) const
+        {
+            result.clear();
+            if (terms.empty())
+            {
+                return;
+            }
+
+            std::pmr::vector<const PostingListType *> posting_lists(result.get_allocator().resource());
+            if (!collect_posting_lists(terms, posting_lists, filter))
+            {
+                return;
+            }
+
+            std::shared_ptr<const PostingListType> cached_pair;
+            substitute_cached_pair(posting_lists, cached_pair, stats);
+            intersect_into(posting_lists, accept_all, stats, filter, result);
+        }
+
+        // Get documents containing `terms` as a phrase. With `slop` > 0 each term
+        // may follow the previous one with up to `slop` other terms in between.
+        // Doc ids are intersected first and positions are decoded only for the
+        // candidates; adjacent pairs with a common term are read from the
+        // bigram lists. Without positional postings this degrades to an AND
+        // query over the chosen lists
+        std::vector<DocId> phrase_query(const std::vector<std::string> &terms, uint32_t slop = 0,
+                                        intersection::IntersectionStats *stats = nullptr,
+                                        const QueryFilterType *filter = nullptr) const
+        {
+            if (terms.size() < 2)
+            {
+                return and_query(terms, stats, filter);
+            }
+
+            std::vector<const PostingListType *> posting_lists;
+            bool covered_by_bigrams = false;
+            if (!plan_phrase(terms, slop, posting_lists, covered_by_bigrams, filter))
+            {
+                return {};
+            }
+
+            if (!positions_ || covered_by_bigrams)
+            {
+                return intersect(std::move(posting_lists), accept_all, stats, filter);
+            }
+
+            auto make_accept = [&]
+            {
+                return [&, reachable = std::vector<uint32_t>(), positions = std::vector<uint32_t>()](const DocId &doc_id) mutable
+                { return matches_phrase(doc_id, terms, slop, reachable, positions); };
+            };
+            return intersect(std::move(posting_lists), make_accept, stats, filter);
+        }
+
+        // Get documents containing ALL `terms` and NONE of `excluded`. With no
+        // positive terms the live document set is the base of the query
+        std::vector<DocId> and_not_query(const std::vector<std::string> &terms,
+                                         const std::vector<std::string> &excluded,
+                                         intersection::IntersectionStats *stats = nullptr,
+                                         const QueryFilterType *filter = nullptr) const
+        {
+            // Facets stand in for missing terms as the base of the query
+            if (!terms.empty() || (filter != nullptr && !filter->facets.empty()))
+            {
+                std::vector<const PostingListType *> posting_lists;
+                if (!collect_posting_lists(terms, posting_lists, filter))
+                {
+                    return {};
+                }
+
+                std::shared_ptr<const PostingListType> cached_pair;
+                substitute_cached_pair(posting_lists, cached_pair, stats);
+                auto make_accept = [&]
+                {
+                    return [exclusion = Exclusion(index_, excluded)](const DocId &doc_id) mutable
+                    { return !exclusion.excludes(doc_id); };
+                };
+                return intersect(std::move(posting_lists), make_accept, stats, filter);
+            }
+
+            Exclusion exclusion(index_, excluded);
+
+            std::vector<DocId> result;
+            deadline::Checker out_of_time(filter != nullptr ? filter->deadline : nullptr);
+            auto collect = [&](const DocId &doc_id)
+            {
+                if (in_lastmod_range(filter, doc_id) && !exclusion.excludes(doc_id))
+                {
+                    result.push_back(doc_id);
+                }
+                return (max_responses_ == 0 || result.size() < max_responses_) && !out_of_time.expired();
+            };
+
+            if constexpr (posting_list::is_compressible_v<DocId>)
+            {
+                if (filter != nullptr && filter->lastmod != nullptr)
+                {
+                    // Walk only the documents of blocks overlapping the range
+                    const auto &lastmod = *filter->lastmod;
+                    auto it = all_documents_.cursor();
+                    lastmod.column->for_each_range(lastmod.min, lastmod.max,
+                                                   [&](DocId first, DocId last, bool)
+                                                   {
+                                                       for (it.seek(first); it.valid() && it.doc() < last; it.next())
+                                                       {
+                                                           if (!collect(it.doc()))
+                                                           {
+                                                               return false;
+                                                           }
+                                                       }
+                                                       return true;
+                                                   });
+                    return result;
+                }
+                for (auto it = all_documents_.cursor(); it.valid() && collect(it.doc()); it.next())
+                {
+                }
+            }
+            else
+            {
+                for (const auto &doc_id : all_documents_)
+                {
+                    if (!collect(doc_id))
+                    {
+                        break;
+                    }
+                }
+            }
+            return result;
+        }
+
+        // Every document containing ALL `terms`, NONE of `excluded` and
+        // passing `filter` as a bitmap, not limited to max_responses_, for
+        // counting facets of the whole result with bitmap intersections.
+        // With `any_of` a document must also contain at least one of those
+        // terms, which expresses OR queries and expanded prefixes
+        roaring::RoaringBitmap match_bitmap(const std::vector<std::string> &terms,
+                                            const std::vector<std::string> &excluded = {},
+                                            const QueryFilterType *filter = nullptr,
+                                            const std::vector<std::string> *any_of = nullptr) const
+        {
+            static_assert(posting_list::is_compressible_v<DocId>, "match bitmaps need 32-bit doc ids");
+
+            std::vector<const PostingListType *> posting_lists;
+            if (!collect_posting_lists(terms, posting_lists, filter))
+            {
+                return {};
+            }
+            if (filter != nullptr)
+            {
+                posting_lists.insert(posting_lists.end(), filter->facets.begin(), filter->facets.end());
+            }
+            std::sort(posting_lists.begin(), posting_lists.end(),
+                      [](const PostingListType *a, const PostingListType *b)
+                      { return a->size() < b->size(); });
+
+            // Bitmap lists intersect container by container, the others only
+            // probe the few ids left
+            auto keep = [](roaring::RoaringBitmap &result, const PostingListType &list, bool present)
+            {
+                if (list.representation() == posting_list::Representation::Bitmap)
+                {
+                    result = present ? result & *list.bitmap() : result.and_not(*list.bitmap());
+                    return;
+                }
+                std::vector<uint32_t> ids;
+                auto cursor = list.cursor();
+                for (auto it = result.cursor(); it.valid(); it.next())
+                {
+                    cursor.seek(it.doc());
+                    if ((cursor.valid() && cursor.doc() == it.doc()) == present)
+                    {
+                        ids.push_back(it.doc());
+                    }
+                }
+                result = roaring::RoaringBitmap::from_sorted(ids);
+            };
+
+            auto to_bitmap = [](const PostingListType &list)
+            {
+                if (list.representation() == posting_list::Representation::Bitmap)
+                {
+                    return *list.bitmap();
+                }
+                auto ids = list.to_vector();
+                return roaring::RoaringBitmap::from_sorted(std::vector<uint32_t>(ids.begin(), ids.end()));
+            };
+
+            roaring::RoaringBitmap result;
+            std::size_t first = 0;
+            if (any_of != nullptr)
+            {
+                for (const auto &term : *any_of)
+                {
+                    const auto *posting_list = find_list(term, filter);
+                    if (posting_list != nullptr)
+                    {
+                        result = result | to_bitmap(*posting_list);
+                    }
+                }
+            }
+            else if (posting_lists.empty())
+            {
+                result = all_documents_;
+            }
+            else
+            {
+                result = to_bitmap(*posting_lists.front());
+                first = 1;
+            }
+            for (std::size_t i = first; i < posting_lists.size() && result.cardinality() > 0; i++)
+            {
+                keep(result, *posting_lists[i], true);
+            }
+            for (const auto &term : excluded)
+            {
+                const auto *posting_list_ptr = index_.find(term);
+                if (posting_list_ptr != nullptr)
+                {
+                    keep(result, **posting_list_ptr, false);
+                }
+            }
+
+            if (filter != nullptr && filter->lastmod != nullptr)
+            {
+                std::vector<uint32_t> ids;
+                for (auto it = result.cursor(); it.valid(); it.next())
+                {
+                    if (filter->lastmod->contains(it.doc()))
+                    {
+                        ids.push_back(it.doc());
+                    }
+                }
+                result = roaring::RoaringBitmap::from_sorted(ids);
+            }
+            return result;
+        }
 
-        // Add a document with terms
-        void add_document(DocId doc_id, const std::vector<std::string> &terms)
+        // Estimate how many documents contain ALL `terms` and NONE of
+        // `excluded` without evaluating the query: `samples` evenly spaced
+        // ids of the smallest posting list are checked against the others
+        cardinality::Estimate estimate_and_count(const std::vector<std::string> &terms,
+                                                 const std::vector<std::string> &excluded = {},
+                                                 std::size_t samples = cardinality::DEFAULT_SAMPLES) const
         {
-            all_documents_.insert(doc_id);
-            total_documents_++;
-
-            for (const auto &term : terms)
+            if (terms.empty())
             {
-                auto *skip_list_ptr = index_.find(term);
+                if (excluded.empty())
+                {
+                    return cardinality::exact(0);
+                }
 
-                if (skip_list_ptr == nullptr)
+                // Only exclusions, the live documents are the candidates
+                Exclusion exclusion(index_, excluded);
+                std::size_t hits = 0;
+                std::size_t checked = 0;
+                if constexpr (posting_list::is_compressible_v<DocId>)
                 {
-                    // Create new skip list for this term
-                    auto new_skip_list = std::make_unique<SkipListType>();
-                    new_skip_list->insert(doc_id);
-                    index_[term] = std::move(new_skip_list);
+                    std::size_t total = all_documents_.cardinality();
+                    checked = std::min(samples, total);
+                    for (std::size_t i = 0; i < checked; i++)
+                    {
+                        std::size_t rank = checked == total ? i : (2 * i + 1) * total / (2 * checked);
+                        hits += exclusion.excludes(static_cast<DocId>(all_documents_.select(rank))) ? 0 : 1;
+                    }
+                    return cardinality::from_sample(total, checked, hits);
                 }
                 else
                 {
-                    // Add to existing skip list
-                    (*skip_list_ptr)->insert(doc_id);
+                    for (const auto &doc_id : all_documents_)
+                    {
+                        hits += exclusion.excludes(doc_id) ? 0 : 1;
+                    }
+                    return cardinality::exact(hits);
                 }
             }
+
+            std::vector<const PostingListType *> posting_lists;
+            if (!collect_posting_lists(terms, posting_lists))
+            {
+                return cardinality::exact(0);
+            }
+
+            Exclusion exclusion(index_, excluded);
+            return estimate_sampled(std::move(posting_lists), [&](const DocId &doc_id)
+                                    { return !exclusion.excludes(doc_id); }, samples);
         }
 
-        // Remove a document from the index
-        bool remove_document(DocId doc_id, const std::vector<std::string> &terms)
+        // estimate_and_count without exclusions, sampling into `memory`
+        template <typename Terms>
+        cardinality::Estimate estimate_and_count_in(const Terms &terms, std::pmr::memory_resource *memory,
+                                                 std::size_t samples = cardinality::DEFAULT_SAMPLES) const
         {
-            if (!all_documents_.search(doc_id))
+            std::pmr::vector<const PostingListType *> posting_lists(memory);
+            if (terms.empty() || !collect_posting_lists(terms, posting_lists))
             {
-                return false;
+                return cardinality::exact(0);
+            }
+            return estimate_sampled(std::move(posting_lists), accept_all(), samples);
+        }
+
+        // Estimate how many documents contain `terms` as a phrase, verifying
+        // positions of the sampled candidates only
+        cardinality::Estimate estimate_phrase_count(const std::vector<std::string> &terms, uint32_t slop = 0,
+                                                    std::size_t samples = cardinality::DEFAULT_SAMPLES) const
+        {
+            if (terms.size() < 2)
+            {
+                return estimate_and_count(terms, std::vector<std::string>{}, samples);
+            }
+
+            std::vector<const PostingListType *> posting_lists;
+            bool covered_by_bigrams = false;
+            if (!plan_phrase(terms, slop, posting_lists, covered_by_bigrams))
+            {
+                return cardinality::exact(0);
+            }
+
+            if (!positions_ || covered_by_bigrams)
+            {
+                return estimate_sampled(std::move(posting_lists), accept_all(), samples);
             }
 
+            std::vector<uint32_t> reachable;
+            std::vector<uint32_t> positions;
+            return estimate_sampled(std::move(posting_lists), [&](const DocId &doc_id)
+                                    { return matches_phrase(doc_id, terms, slop, reachable, positions); }, samples);
+        }
+
+        // Estimate how many documents contain ANY term. Each list contributes
+        // the share of its sampled ids that no earlier list contains
+        cardinality::Estimate estimate_or_count(const std::vector<std::string> &terms,
+                                                std::size_t samples = cardinality::DEFAULT_SAMPLES) const
+        {
+            std::vector<const PostingListType *> posting_lists;
             for (const auto &term : terms)
             {
-                auto *skip_list_ptr = index_.find(term);
-                if (skip_list_ptr != nullptr)
+                const auto *posting_list_ptr = index_.find(term);
+                if (posting_list_ptr != nullptr)
                 {
-                    (*skip_list_ptr)->remove(doc_id);
-
-                    // If skip list is now empty, we could remove the term entirely
-                    // But let's keep it for simplicity (empty skip lists are okay)
+                    posting_lists.push_back(posting_list_ptr->get());
                 }
             }
 
-            all_documents_.remove(doc_id);
-            total_documents_--;
-            return true;
+            cardinality::Estimate result = cardinality::exact(0);
+            std::size_t largest = 0;
+            for (std::size_t i = 0; i < posting_lists.size(); i++)
+            {
+                const auto *list = posting_lists[i];
+                largest = std::max(largest, list->size());
+
+                auto ids = list->sample(samples);
+                std::size_t hits = 0;
+                for (const auto &doc_id : ids)
+                {
+                    bool seen = std::any_of(posting_lists.begin(), posting_lists.begin() + i,
+                                            [&](const PostingListType *earlier)
+                                            { return earlier->contains(doc_id); });
+                    hits += seen ? 0 : 1;
+                }
+
+                auto part = cardinality::from_sample(list->size(), ids.size(), hits);
+                result.estimate += part.estimate;
+                result.lower += part.lower;
+                result.upper += part.upper;
+                result.exact = result.exact && part.exact;
+                result.samples += part.samples;
+            }
+            result.lower = std::max(result.lower, largest);
+            result.estimate = std::clamp(result.estimate, result.lower, std::max(result.lower, result.upper));
+            return result;
         }
 
-        // Get documents containing ALL terms
-        std::vector<DocId> and_query(const std::vector<std::string> &terms) const
+        // Most frequent terms by document frequency, highest first
+        std::vector<std::string> most_frequent_terms(std::size_t count) const
         {
-            if (terms.empty())
+            std::vector<std::pair<std::size_t, const std::string *>> frequencies;
+            frequencies.reserve(index_.size());
+            for (const auto &kv : index_)
             {
-                return {};
+                frequencies.emplace_back(kv.second->size(), &kv.first);
             }
 
-            // Find the smallest posting list to intersect with others
-            std::vector<const SkipListType *> posting_lists;
-            std::size_t min_size = std::numeric_limits<std::size_t>::max();
-            const SkipListType *smallest_list = nullptr;
+            count = std::min(count, frequencies.size());
+            std::partial_sort(frequencies.begin(), frequencies.begin() + count, frequencies.end(),
+                              [](const auto &a, const auto &b)
+                              { return a.first > b.first || (a.first == b.first && *a.second < *b.second); });
+
+            std::vector<std::string> result;
+            result.reserve(count);
+            for (std::size_t i = 0; i < count; i++)
+            {
+                result.push_back(*frequencies[i].second);
+            }
+            return result;
+        }
 
+        // Index adjacent pairs containing one of `terms` as bigrams in every
+        // document added from now on. Documents added before have to be passed
+        // to index_common_bigrams
+        void set_common_terms(const std::vector<std::string> &terms)
+        {
             for (const auto &term : terms)
             {
-                const auto *skip_list_ptr = index_.find(term);
-                if (skip_list_ptr == nullptr)
+                common_terms_.insert(term, true);
+            }
+            generation_++;
+        }
+
+        // Add bigram postings of a document for the current common terms
+        void index_common_bigrams(DocId doc_id, const std::vector<std::string> &terms)
+        {
+            if (common_terms_.empty())
+            {
+                return;
+            }
+            generation_++;
+
+            for (std::size_t i = 0; i + 1 < terms.size(); i++)
+            {
+                if (!is_common_bigram(terms[i], terms[i + 1]))
                 {
-                    // Term doesn't exist, AND query returns empty
-                    return {};
+                    continue;
                 }
 
-                const auto *skip_list = skip_list_ptr->get();
-                posting_lists.push_back(skip_list);
+                auto &bigram_list = bigrams_[bigram_key(terms[i], terms[i + 1])];
+                if (bigram_list == nullptr)
+                {
+                    bigram_list = std::make_unique<PostingListType>();
+                }
+                bigram_list->insert(doc_id);
+            }
+        }
+
+        // Check if a term is indexed as part of common bigrams
+        bool is_common_term(const std::string &term) const
+        {
+            return common_terms_.find(term) != nullptr;
+        }
+
+        // Get number of distinct indexed bigrams
+        std::size_t total_bigrams() const
+        {
+            return bigrams_.size();
+        }
+
+        // Turn posting lists of terms covering at least bitmap_min_density of
+        // the documents into roaring bitmaps and delta-encode the rest with the
+        // codec that suits each best. Lists touched by later updates are
+        // decompressed until the next call
+        void compress()
+        {
+            static_assert(posting_list::is_compressible_v<DocId>, "only unsigned 32-bit doc ids can be compressed");
+            wait_for_cached_pairs();
 
-                std::size_t size = skip_list->size();
-                if (size < min_size)
+            double bitmap_min_size = bitmap_min_density_ * static_cast<double>(total_documents_);
+            auto compress_list = [&](PostingListType &list)
+            {
+                if (!list.empty() && static_cast<double>(list.size()) >= bitmap_min_size)
+                {
+                    list.compress_to_bitmap();
+                }
+                else
                 {
-                    min_size = size;
-                    smallest_list = skip_list;
+                    list.compress();
                 }
+            };
+
+            for (auto kv : index_)
+            {
+                compress_list(*kv.second);
+            }
+            for (auto kv : bigrams_)
+            {
+                compress_list(*kv.second);
             }
+            all_documents_.run_optimize();
 
-            // Intersect using the smallest list as base
-            std::vector<DocId> result;
+            build_term_dictionary();
+        }
+
+        // Rebuild the sorted dictionary used by prefix queries and the
+        // completion trie from the current terms. Terms added later are not
+        // found by prefix until the next rebuild
+        void build_term_dictionary()
+        {
+            auto terms = get_all_terms();
+            std::sort(terms.begin(), terms.end());
+            term_dictionary_ = term_dictionary::FrontCodedDictionary::build(terms);
 
-            for (const auto &doc_id : *smallest_list)
+            term_frequencies_.clear();
+            term_frequencies_.reserve(terms.size());
+            // Stems are suggested as their most frequent word, terms without
+            // counted words as they are
+            std::vector<std::pair<std::string, uint64_t>> suggested;
+            for (auto &term : terms)
             {
-                bool in_all = true;
+                std::size_t frequency = get_term_frequency(term);
+                term_frequencies_.push_back(static_cast<uint32_t>(std::min<std::size_t>(frequency, std::numeric_limits<uint32_t>::max())));
+                if (frequency >= completion_min_frequency_)
+                {
+                    const auto *forms = surface_forms_.find(term);
+                    std::string_view word = forms != nullptr ? forms->most_frequent() : std::string_view();
+                    suggested.emplace_back(word.empty() ? term : std::string(word), frequency);
+                }
+            }
 
-                for (const auto *other_list : posting_lists)
+            // A word may be a term of its own as well, it is suggested once
+            std::sort(suggested.begin(), suggested.end(),
+                      [](const auto &a, const auto &b)
+                      { return a.first < b.first || (a.first == b.first && a.second > b.second); });
+            std::vector<std::string> words;
+            std::vector<uint64_t> frequencies;
+            for (auto &kv : suggested)
+            {
+                if (!words.empty() && words.back() == kv.first)
                 {
-                    if (other_list == smallest_list)
-                        continue;
+                    continue;
+                }
+                words.push_back(std::move(kv.first));
+                frequencies.push_back(kv.second);
+            }
+            completions_ = completion::CompletionTrie::build(std::move(words), std::move(frequencies), completion_top_k_);
+        }
+
+        // Most frequent words starting with `prefix`, by document frequency of their terms
+        completion::CompletionTrie::Completions complete(std::string_view prefix) const
+        {
+            return completions_.complete(prefix);
+        }
+
+        const completion::CompletionTrie &completions() const
+        {
+            return completions_;
+        }
+
+        // Expand `prefix` to its most frequent dictionary terms, at most
+        // prefix_max_terms of them whose document frequencies add up to at
+        // most prefix_max_postings. Only the frequencies of the prefix range
+        // are scanned, through a heap of the best terms so far, and only the
+        // kept terms are decoded
+        PrefixExpansion expand_prefix(const std::string &prefix) const
+        {
+            PrefixExpansion expansion;
+            auto range = term_dictionary_.prefix_range(prefix);
+            expansion.matched_terms = range.second - range.first;
 
-                    if (!other_list->search(doc_id))
+            // (frequency, rank), more frequent and then alphabetically first is better
+            using Candidate = std::pair<uint32_t, std::size_t>;
+            auto better = [](const Candidate &a, const Candidate &b)
+            { return a.first > b.first || (a.first == b.first && a.second < b.second); };
+
+            // The worst kept candidate stays on top of the heap
+            std::vector<Candidate> kept;
+            kept.reserve(std::min(prefix_max_terms_, expansion.matched_terms));
+            for (std::size_t rank = range.first; rank < range.second; rank++)
+            {
+                Candidate candidate{term_frequencies_[rank], rank};
+                if (candidate.first == 0)
+                {
+                    continue;
+                }
+                if (kept.size() < prefix_max_terms_)
+                {
+                    kept.push_back(candidate);
+                    std::push_heap(kept.begin(), kept.end(), better);
+                }
+                else
+                {
+                    expansion.truncated = true;
+                    if (better(candidate, kept.front()))
                     {
-                        in_all = false;
-                        break;
+                        std::pop_heap(kept.begin(), kept.end(), better);
+                        kept.back() = candidate;
+                        std::push_heap(kept.begin(), kept.end(), better);
                     }
                 }
+            }
+            std::sort_heap(kept.begin(), kept.end(), better);
 
-                if (in_all)
+            for (const auto &candidate : kept)
+            {
+                if (expansion.postings + candidate.first > prefix_max_postings_)
                 {
-                    result.push_back(doc_id);
-                    if (max_responses_ != 0 && result.size() >= max_responses_)
+                    expansion.truncated = true;
+                    continue;
+                }
+                expansion.postings += candidate.first;
+                expansion.terms.push_back(term_dictionary_.term(candidate.second));
+            }
+            return expansion;
+        }
+
+        // Terms within `max_distance` edits of `term`, closest and then most
+        // frequent first
+        std::vector<FuzzyMatch> expand_fuzzy(const std::string &term, uint32_t max_distance,
+                                             std::size_t max_terms = 16) const
+        {
+            std::vector<FuzzyMatch> matches;
+            fuzzy::search(term_dictionary_, term, max_distance,
+                          [&](const std::string &candidate, uint32_t distance)
+                          {
+                              std::size_t frequency = get_term_frequency(candidate);
+                              if (frequency > 0)
+                              {
+                                  matches.push_back(FuzzyMatch{candidate, distance, frequency});
+                              }
+                          });
+
+            std::sort(matches.begin(), matches.end(),
+                      [](const FuzzyMatch &a, const FuzzyMatch &b)
+                      {
+                          if (a.distance != b.distance)
+                              return a.distance < b.distance;
+                          if (a.frequency != b.frequency)
+                              return a.frequency > b.frequency;
+                          return a.term < b.term;
+                      });
+            if (matches.size() > max_terms)
+            {
+                matches.resize(max_terms);
+            }
+            return matches;
+        }
+
+        // Replace every term missing from the index with its best fuzzy
+        // match, allowing more edits for longer terms
+        std::vector<std::string> correct_terms(const std::vector<std::string> &terms) const
+        {
+            std::vector<std::string> result = terms;
+            for (auto &term : result)
+            {
+                if (contains_term(term))
+                {
+                    continue;
+                }
+                uint32_t max_distance = fuzzy::max_distance_for(fuzzy::decode_utf8(term).size());
+                if (max_distance == 0)
+                {
+                    continue;
+                }
+                auto matches = expand_fuzzy(term, max_distance, 1);
+                if (!matches.empty())
+                {
+                    term = matches.front().term;
+                }
+            }
+            return result;
+        }
+
+        // Get documents containing ALL `terms`, ANY term starting with `prefix`
+        // and none of `excluded`
+        std::vector<DocId> prefix_query(const std::string &prefix, const std::vector<std::string> &terms = {},
+                                        const std::vector<std::string> &excluded = {},
+                                        PrefixExpansion *expansion_out = nullptr,
+                                        const QueryFilterType *filter = nullptr) const
+        {
+            PrefixExpansion expansion = expand_prefix(prefix);
+            auto result = prefix_query(expansion, terms, excluded, filter);
+            if (expansion_out != nullptr)
+            {
+                *expansion_out = std::move(expansion);
+            }
+            return result;
+        }
+
+        // prefix_query over a prefix expanded beforehand. The expanded terms
+        // are merged in one pass and required lists are probed per candidate,
+        // stopping after max_responses_ ids
+        std::vector<DocId> prefix_query(const PrefixExpansion &expansion, const std::vector<std::string> &terms,
+                                        const std::vector<std::string> &excluded,
+                                        const QueryFilterType *filter = nullptr) const
+        {
+            std::vector<DocId> result;
+            std::vector<const PostingListType *> required;
+            if (!collect_posting_lists(terms, required, filter))
+            {
+                return result;
+            }
+            if (filter != nullptr)
+            {
+                required.insert(required.end(), filter->facets.begin(), filter->facets.end());
+            }
+
+            std::vector<const PostingListType *> any_of;
+            any_of.reserve(expansion.terms.size());
+            collect_existing_lists(expansion.terms, any_of, filter);
+
+            Exclusion exclusion(index_, excluded);
+            deadline::Checker out_of_time(filter != nullptr ? filter->deadline : nullptr);
+            for_each_in_union(any_of, required, [&](const DocId &doc_id)
+                              {
+                                  if (in_lastmod_range(filter, doc_id) && !exclusion.excludes(doc_id))
+                                  {
+                                      result.push_back(doc_id);
+                                  }
+                                  return (max_responses_ == 0 || result.size() < max_responses_) && !out_of_time.expired(); });
+            return result;
+        }
+
+        // Look up every distinct term of a batch of queries once, for
+        // QueryFilter::terms of each of them
+        ResolvedTerms<DocId> resolve_terms(const std::vector<const std::vector<std::string> *> &queries) const
+        {
+            ResolvedTerms<DocId> resolved;
+            for (const auto *terms : queries)
+            {
+                for (const auto &term : *terms)
+                {
+                    if (resolved.find(term) == nullptr)
                     {
-                        break;
+                        resolved.insert(term, find_list(term, nullptr));
                     }
                 }
             }
+            return resolved;
+        }
 
-            return result;
+        // Rough number of postings a query walks, to refuse the heaviest ones
+        // before running them. An AND is driven by its rarest term, an OR
+        // reads the head of every list; no terms scans every document
+        template <typename Terms = std::vector<std::string>>
+        std::size_t estimate_cost(const Terms &terms, bool any_term, const QueryFilterType *filter = nullptr) const
+        {
+            if (terms.empty())
+            {
+                return total_documents_;
+            }
+            std::size_t smallest = std::numeric_limits<std::size_t>::max();
+            std::size_t sum = 0;
+            for (const auto &term : terms)
+            {
+                const auto *posting_list = find_list(term, filter);
+                std::size_t size = posting_list == nullptr ? 0 : posting_list->size();
+                smallest = std::min(smallest, size);
+                sum += max_responses_ == 0 ? size : std::min(size, max_responses_);
+            }
+            return any_term ? sum : smallest * terms.size();
+        }
+
+        // Run expensive queries over doc id ranges on `executor`, nullptr to
+        // keep every query on the calling thread
+        void set_parallel_executor(const parallel_executor::ParallelExecutor<DocId> *executor)
+        {
+            executor_ = executor;
+        }
+
+        // Version of the index contents, changes whenever documents are added
+        // or removed so that cached results can be told apart from fresh ones
+        uint64_t generation() const
+        {
+            return generation_;
+        }
+
+        // Get hit and memory counters of the pair intersection cache
+        pair_cache::PairCacheStats pair_cache_stats() const
+        {
+            return pair_cache_ ? pair_cache_->stats() : pair_cache::PairCacheStats();
+        }
+
+        // Wait until the pairs queued for materialization are cached.
+        // Updates wait first, the background builds read the posting lists
+        void wait_for_cached_pairs() const
+        {
+            if (pair_cache_)
+            {
+                pair_cache_->wait_idle();
+            }
+        }
+
+        // Check if positional postings are kept
+        bool has_positions() const
+        {
+            return positions_ != nullptr;
         }
 
-        // Get documents containing ANY term (OR query)
-        std::vector<DocId> or_query(const std::vector<std::string> &terms) const
+        // Get documents containing ANY term (OR query). Past `deadline` the
+        // documents found so far are kept
+        std::vector<DocId> or_query(const std::vector<std::string> &terms,
+                                    const deadline::Deadline *deadline = nullptr) const
         {
             if (terms.empty())
             {
@@ -153,25 +1618,37 @@ namespace boolean_index
             }
 
             SkipListType union_result;
+            deadline::Checker out_of_time(deadline);
+            bool expired = false;
 
             for (const auto &term : terms)
             {
-                const auto *skip_list_ptr = index_.find(term);
-                if (skip_list_ptr == nullptr)
+                const auto *posting_list_ptr = index_.find(term);
+                if (posting_list_ptr == nullptr)
                 {
                     continue; // Skip non-existent terms
                 }
 
-                const auto *skip_list = skip_list_ptr->get();
-
-                // Add all documents from this skip list to union
-                for (const auto &doc_id : *skip_list)
+                // The smallest max_responses_ ids of the union are among the
+                // smallest max_responses_ ids of each list
+                std::size_t taken = 0;
+                for (auto it = (*posting_list_ptr)->cursor(); it.valid(); it.next())
                 {
-                    union_result.insert(doc_id);
-                    if (max_responses_ != 0 && union_result.size() >= max_responses_)
+                    if (max_responses_ != 0 && taken >= max_responses_)
+                    {
+                        break;
+                    }
+                    if (out_of_time.expired())
                     {
+                        expired = true;
                         break;
                     }
+                    union_result.insert(it.doc());
+                    taken++;
+                }
+                if (expired)
+                {
+                    break;
                 }
             }
 
@@ -179,6 +1656,10 @@ namespace boolean_index
             std::vector<DocId> result;
             for (const auto &doc_id : union_result)
             {
+                if (max_responses_ != 0 && result.size() >= max_responses_)
+                {
+                    break;
+                }
                 result.push_back(doc_id);
             }
 
@@ -188,19 +1669,13 @@ namespace boolean_index
         // Get documents for a single term
         std::vector<DocId> get_documents_for_term(const std::string &term) const
         {
-            const auto *skip_list_ptr = index_.find(term);
-            if (skip_list_ptr == nullptr)
+            const auto *posting_list_ptr = index_.find(term);
+            if (posting_list_ptr == nullptr)
             {
                 return {};
             }
 
-            std::vector<DocId> result;
-            const auto *skip_list = skip_list_ptr->get();
-            for (const auto &doc_id : *skip_list)
-            {
-                result.push_back(doc_id);
-            }
-            return result;
+            return (*posting_list_ptr)->to_vector();
         }
 
         // Get all terms in the index
@@ -217,35 +1692,42 @@ namespace boolean_index
         // Get all documents in the index
         std::vector<DocId> get_all_documents() const
         {
-            std::vector<DocId> result;
-            for (const auto &doc_id : all_documents_)
+            if constexpr (posting_list::is_compressible_v<DocId>)
             {
-                result.push_back(doc_id);
+                return all_documents_.to_vector();
+            }
+            else
+            {
+                std::vector<DocId> result;
+                for (const auto &doc_id : all_documents_)
+                {
+                    result.push_back(doc_id);
+                }
+                return result;
             }
-            return result;
         }
 
         // Check if a term exists in the index
-        bool contains_term(const std::string &term) const
+        bool contains_term(std::string_view term) const
         {
-            return index_.find(term) != nullptr;
+            return index_.find_as(term) != nullptr;
         }
 
         // Check if a document exists in the index
         bool contains_document(DocId doc_id) const
         {
-            return all_documents_.search(doc_id);
+            return document_set_contains(doc_id);
         }
 
         // Get number of documents containing a term
         std::size_t get_term_frequency(const std::string &term) const
         {
-            const auto *skip_list_ptr = index_.find(term);
-            if (skip_list_ptr == nullptr)
+            const auto *posting_list_ptr = index_.find(term);
+            if (posting_list_ptr == nullptr)
             {
                 return 0;
             }
-            return skip_list_ptr->get()->size();
+            return posting_list_ptr->get()->size();
         }
 
         // Get total number of documents
@@ -271,7 +1753,7 @@ namespace boolean_index
             // Estimate memory usage
             std::size_t hashmap_memory = index_.size() * sizeof(DocId) + index_.bucket_count() * sizeof(void *);
 
-            std::size_t skiplist_memory = 0;
+            std::size_t posting_memory = 0;
             std::size_t max_list_size = 0;
             std::size_t min_list_size = std::numeric_limits<std::size_t>::max();
             std::string largest_term, smallest_term;
@@ -279,7 +1761,7 @@ namespace boolean_index
             for (const auto &kv : index_)
             {
                 std::size_t list_size = kv.second->size();
-                skiplist_memory += list_size * sizeof(DocId) * 2;
+                posting_memory += kv.second->memory_bytes();
 
                 if (list_size > max_list_size)
                 {
@@ -294,13 +1776,152 @@ namespace boolean_index
             }
 
             std::cout << "    HashMap: ~" << hashmap_memory / 1024 << " KB\n";
-            std::cout << "    SkipLists: ~" << skiplist_memory / 1024 << " KB\n";
-            std::cout << "    Total: ~" << (hashmap_memory + skiplist_memory) / 1024 << " KB\n";
+            std::cout << "    Posting lists: ~" << posting_memory / 1024 << " KB\n";
+            std::size_t positions_memory = positions_ ? positions_->encoded_bytes() : 0;
+            if (positions_)
+            {
+                std::cout << "    Positions: ~" << positions_memory / 1024 << " KB\n";
+            }
+            std::size_t bigram_memory = 0;
+            for (const auto &kv : bigrams_)
+            {
+                bigram_memory += kv.second->memory_bytes();
+            }
+            if (!common_terms_.empty())
+            {
+                std::cout << "    Bigrams: ~" << bigram_memory / 1024 << " KB ("
+                          << bigrams_.size() << " pairs over " << common_terms_.size() << " common terms)\n";
+            }
+            std::size_t pair_cache_memory = 0;
+            std::size_t dictionary_memory = term_dictionary_.memory_bytes() + term_frequencies_.capacity() * sizeof(uint32_t);
+            for (const auto &kv : surface_forms_)
+            {
+                dictionary_memory += kv.first.capacity() + sizeof(kv.second) + kv.second.memory_bytes();
+            }
+            std::cout << "    Term dictionary: ~" << dictionary_memory / 1024 << " KB ("
+                      << term_dictionary_.size() << " sorted terms)\n";
+            std::cout << "    Completion trie: ~" << completions_.memory_bytes() / 1024 << " KB ("
+                      << completions_.size() << " terms, " << completions_.node_count() << " nodes)\n";
+            if (pair_cache_)
+            {
+                auto pair_stats = pair_cache_->stats();
+                pair_cache_memory = pair_stats.bytes;
+                std::cout << "    Pair cache: ~" << pair_cache_memory / 1024 << " KB (" << pair_stats.entries << " pairs, "
+                          << pair_stats.hits << " hits, " << pair_stats.misses << " misses, "
+                          << pair_stats.evictions << " evictions)\n";
+            }
+            std::cout << "    Total: ~" << (dictionary_memory + completions_.memory_bytes() + pair_cache_memory + hashmap_memory + posting_memory + positions_memory + bigram_memory) / 1024 << " KB\n";
             std::cout << "  Term statistics:\n";
             std::cout << "    Largest term: '" << largest_term
                       << "' (" << max_list_size << " documents)\n";
             std::cout << "    Smallest term: '" << smallest_term
                       << "' (" << min_list_size << " documents)\n";
+
+            if constexpr (posting_list::is_compressible_v<DocId>)
+            {
+                print_compression_statistics();
+            }
+        }
+
+        // Print compression ratio per codec and measured decode throughput
+        void print_compression_statistics() const
+        {
+            struct CodecStatistics
+            {
+                std::size_t lists = 0;
+                std::size_t ids = 0;
+                std::size_t bytes = 0;
+                std::size_t decoded_ids = 0;
+                std::chrono::duration<double> decode_time{0};
+            };
+            std::vector<CodecStatistics> per_codec(codec::ALL_CODECS.size());
+            std::size_t uncompressed_lists = 0;
+            std::size_t bitmap_lists = 0;
+            std::size_t bitmap_ids = 0;
+            std::size_t bitmap_bytes = 0;
+            std::array<std::size_t, 3> bitmap_containers{};
+
+            std::array<uint32_t, codec::BLOCK_SIZE> buffer;
+            uint64_t checksum = 0;
+            auto account = [&](const PostingListType &list)
+            {
+                if (const auto *bitmap = list.bitmap())
+                {
+                    bitmap_lists++;
+                    bitmap_ids += bitmap->cardinality();
+                    bitmap_bytes += bitmap->memory_bytes();
+                    bitmap_containers[0] += bitmap->container_count(roaring::RoaringBitmap::ContainerType::Array);
+                    bitmap_containers[1] += bitmap->container_count(roaring::RoaringBitmap::ContainerType::Bitmap);
+                    bitmap_containers[2] += bitmap->container_count(roaring::RoaringBitmap::ContainerType::Run);
+                    return;
+                }
+
+                const auto *compressed = list.compressed();
+                if (compressed == nullptr)
+                {
+                    uncompressed_lists++;
+                    return;
+                }
+
+                auto &stats = per_codec[static_cast<std::size_t>(compressed->codec())];
+                stats.lists++;
+                stats.ids += compressed->size();
+                stats.bytes += compressed->encoded_bytes();
+
+                auto start = std::chrono::high_resolution_clock::now();
+                for (std::size_t block = 0; block < compressed->block_count(); block++)
+                {
+                    std::size_t count = compressed->decode_block(block, buffer.data());
+                    checksum += buffer[count - 1];
+                    stats.decoded_ids += count;
+                }
+                stats.decode_time += std::chrono::high_resolution_clock::now() - start;
+            };
+
+            for (const auto &kv : index_)
+            {
+                account(*kv.second);
+            }
+            for (const auto &kv : bigrams_)
+            {
+                account(*kv.second);
+            }
+
+            std::cout << "  Posting compression (blocks of " << codec::BLOCK_SIZE << " ids):\n";
+            std::cout << "    Uncompressed lists: " << uncompressed_lists << "\n";
+            for (std::size_t i = 0; i < per_codec.size(); i++)
+            {
+                const auto &stats = per_codec[i];
+                codec::Codec current = codec::ALL_CODECS[i];
+                std::cout << "    " << codec::codec_name(current)
+                          << (codec::has_simd_decode(current) ? " (simd)" : " (scalar)")
+                          << ": " << stats.lists << " lists, " << stats.ids << " ids, "
+                          << stats.bytes / 1024 << " KB";
+                if (stats.bytes > 0)
+                {
+                    double ratio = static_cast<double>(stats.ids * sizeof(uint32_t)) / stats.bytes;
+                    std::cout << ", ratio " << ratio << "x, "
+                              << static_cast<double>(stats.bytes * 8) / stats.ids << " bits/id";
+                }
+                if (stats.decode_time.count() > 0)
+                {
+                    double ids_per_second = stats.decoded_ids / stats.decode_time.count();
+                    std::cout << ", decode " << ids_per_second / 1e6 << " M ids/s ("
+                              << ids_per_second * sizeof(uint32_t) / (1024.0 * 1024 * 1024) << " GB/s raw)";
+                }
+                std::cout << "\n";
+            }
+            std::cout << "    Roaring bitmaps (df >= " << bitmap_min_density_ * 100 << "% of documents): "
+                      << bitmap_lists << " lists, " << bitmap_ids << " ids, " << bitmap_bytes / 1024 << " KB, "
+                      << bitmap_containers[0] << "/" << bitmap_containers[1] << "/" << bitmap_containers[2]
+                      << " array/bitmap/run containers";
+            if (bitmap_ids > 0)
+            {
+                std::cout << ", " << static_cast<double>(bitmap_bytes * 8) / bitmap_ids << " bits/id";
+            }
+            std::cout << "\n";
+            std::cout << "    Document set: " << all_documents_.memory_bytes() / 1024 << " KB\n";
+            spdlog::debug("decode checksum {}", checksum);
         }
 
         // Print the entire index (for debugging)
@@ -312,20 +1933,20 @@ namespace boolean_index
             for (const auto &kv : index_)
             {
                 const auto &term = kv.first;
-                const auto &skip_list = kv.second;
+                const auto &posting_list = kv.second;
 
-                std::cout << "\nTerm: '" << term << "' (" << skip_list->size() << " documents)\n";
+                std::cout << "\nTerm: '" << term << "' (" << posting_list->size() << " documents)\n";
                 std::cout << "  Documents: ";
 
                 std::size_t count = 0;
-                for (const auto &doc_id : *skip_list)
+                for (auto it = posting_list->cursor(); it.valid(); it.next())
                 {
                     if (count > 10)
                     { // Limit output
-                        std::cout << "... and " << (skip_list->size() - 10) << " more";
+                        std::cout << "... and " << (posting_list->size() - 10) << " more";
                         break;
                     }
-                    std::cout << doc_id << " ";
+                    std::cout << it.doc() << " ";
                     count++;
                 }
                 std::cout << "\n";
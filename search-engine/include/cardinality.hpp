@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace cardinality
+{
+
+    // Ids of the smallest posting list checked against the rest of a query
+    constexpr std::size_t DEFAULT_SAMPLES = 256;
+
+    // Estimated number of matching documents with a 95% confidence interval
+    struct Estimate
+    {
+        std::size_t estimate = 0;
+        std::size_t lower = 0;
+        std::size_t upper = 0;
+        // Every candidate was checked, so lower == estimate == upper
+        bool exact = false;
+        std::size_t samples = 0;
+    };
+
+    inline Estimate exact(std::size_t count)
+    {
+        Estimate result;
+        result.estimate = result.lower = result.upper = count;
+        result.exact = true;
+        result.samples = count;
+        return result;
+    }
+
+    // Scale `hits` out of `samples` drawn without replacement from
+    // `population` candidates, using the Wilson score interval narrowed by
+    // the finite population correction
+    inline Estimate from_sample(std::size_t population, std::size_t samples, std::size_t hits)
+    {
+        if (samples == 0 || samples >= population)
+        {
+            Estimate result = exact(hits);
+            result.samples = samples;
+            return result;
+        }
+
+        constexpr double z = 1.96;
+        double n = static_cast<double>(samples);
+        double p = static_cast<double>(hits) / n;
+        double denominator = 1 + z * z / n;
+        double center = (p + z * z / (2 * n)) / denominator;
+        double half_width = z * std::sqrt(p * (1 - p) / n + z * z / (4 * n * n)) / denominator;
+
+        // Shrink the interval towards the observed share as the sample covers
+        // more of the population
+        double correction = std::sqrt(static_cast<double>(population - samples) / (population - 1));
+        double low = p - (p - std::max(0.0, center - half_width)) * correction;
+        double high = p + (std::min(1.0, center + half_width) - p) * correction;
+
+        double total = static_cast<double>(population);
+        Estimate result;
+        result.samples = samples;
+        result.estimate = static_cast<std::size_t>(std::llround(p * total));
+        // Sampled hits and misses are known for sure
+        result.lower = std::max(hits, static_cast<std::size_t>(std::floor(low * total)));
+        result.upper = std::min(population - (samples - hits), static_cast<std::size_t>(std::ceil(high * total)));
+        result.estimate = std::clamp(result.estimate, result.lower, result.upper);
+        return result;
+    }
+
+} // namespace cardinality
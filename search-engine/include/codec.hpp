@@ -0,0 +1,484 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace codec
+{
+
+    // Posting lists are encoded as d-gaps in blocks of this many ids
+    constexpr std::size_t BLOCK_SIZE = 128;
+
+    enum class Codec : uint8_t
+    {
+        // 2-bit length keys for 4 values followed by 1-4 data bytes per value
+        StreamVByte,
+        // PForDelta: fixed bit width for the block plus patched exceptions,
+        // values interleaved over 4 lanes so one SIMD shift decodes 4 of them
+        BitPacking,
+    };
+
+    constexpr std::array<Codec, 2> ALL_CODECS = {Codec::StreamVByte, Codec::BitPacking};
+
+    inline const char *codec_name(Codec codec)
+    {
+        switch (codec)
+        {
+        case Codec::StreamVByte:
+            return "stream-vbyte";
+        case Codec::BitPacking:
+            return "pfor-bitpacking";
+        }
+        return "unknown";
+    }
+
+    // Whether decode_block uses a vectorized path for the codec in this build
+    inline bool has_simd_decode(Codec codec)
+    {
+        switch (codec)
+        {
+        case Codec::StreamVByte:
+#if defined(__SSSE3__)
+            return true;
+#else
+            return false;
+#endif
+        case Codec::BitPacking:
+#if defined(__SSE2__)
+            return true;
+#else
+            return false;
+#endif
+        }
+        return false;
+    }
+
+    namespace detail
+    {
+
+        inline void write_u32(std::vector<uint8_t> &out, uint32_t value)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        inline uint32_t read_u32(const uint8_t *in)
+        {
+            return static_cast<uint32_t>(in[0]) | static_cast<uint32_t>(in[1]) << 8 |
+                   static_cast<uint32_t>(in[2]) << 16 | static_cast<uint32_t>(in[3]) << 24;
+        }
+
+        inline void check_bounds(const uint8_t *in, const uint8_t *end, std::size_t bytes)
+        {
+            if (static_cast<std::size_t>(end - in) < bytes)
+            {
+                throw std::runtime_error("Truncated posting block");
+            }
+        }
+
+        // ---------------------------------------------------------------- Stream VByte
+
+        inline uint8_t byte_length(uint32_t value)
+        {
+            if (value < (1u << 8))
+                return 1;
+            if (value < (1u << 16))
+                return 2;
+            if (value < (1u << 24))
+                return 3;
+            return 4;
+        }
+
+        inline void streamvbyte_encode(const uint32_t *values, std::size_t count, std::vector<uint8_t> &out)
+        {
+            std::size_t control_offset = out.size();
+            out.resize(out.size() + (count + 3) / 4, 0);
+
+            for (std::size_t i = 0; i < count; i++)
+            {
+                uint8_t length = byte_length(values[i]);
+                out[control_offset + i / 4] |= static_cast<uint8_t>((length - 1) << (2 * (i % 4)));
+                for (uint8_t b = 0; b < length; b++)
+                {
+                    out.push_back(static_cast<uint8_t>(values[i] >> (8 * b)));
+                }
+            }
+        }
+
+        inline const uint8_t *streamvbyte_decode_scalar(const uint8_t *in, const uint8_t *end,
+                                                        std::size_t count, uint32_t *out)
+        {
+            const uint8_t *control = in;
+            const uint8_t *data = in + (count + 3) / 4;
+            check_bounds(in, end, (count + 3) / 4);
+
+            for (std::size_t i = 0; i < count; i++)
+            {
+                uint8_t length = ((control[i / 4] >> (2 * (i % 4))) & 0x3) + 1;
+                check_bounds(data, end, length);
+
+                uint32_t value = 0;
+                for (uint8_t b = 0; b < length; b++)
+                {
+                    value |= static_cast<uint32_t>(data[b]) << (8 * b);
+                }
+                out[i] = value;
+                data += length;
+            }
+            return data;
+        }
+
+#if defined(__SSSE3__)
+        // pshufb masks and data lengths for every control byte
+        struct StreamVByteTables
+        {
+            uint8_t shuffle[256][16];
+            uint8_t length[256];
+
+            StreamVByteTables()
+            {
+                for (int control = 0; control < 256; control++)
+                {
+                    uint8_t source = 0;
+                    for (int value = 0; value < 4; value++)
+                    {
+                        int bytes = ((control >> (2 * value)) & 0x3) + 1;
+                        for (int b = 0; b < 4; b++)
+                        {
+                            shuffle[control][value * 4 + b] = b < bytes ? source++ : 0xFF;
+                        }
+                    }
+                    length[control] = source;
+                }
+            }
+        };
+
+        inline const StreamVByteTables &streamvbyte_tables()
+        {
+            static const StreamVByteTables tables;
+            return tables;
+        }
+
+        inline const uint8_t *streamvbyte_decode_simd(const uint8_t *in, const uint8_t *end,
+                                                      std::size_t count, uint32_t *out)
+        {
+            const auto &tables = streamvbyte_tables();
+            const uint8_t *control = in;
+            const uint8_t *data = in + (count + 3) / 4;
+            check_bounds(in, end, (count + 3) / 4);
+
+            std::size_t i = 0;
+            // Each step loads 16 bytes, so stop while a full load is still in bounds
+            for (; i + 4 <= count && end - data >= 16; i += 4)
+            {
+                uint8_t key = control[i / 4];
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+                __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.shuffle[key]));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_shuffle_epi8(bytes, mask));
+                data += tables.length[key];
+            }
+
+            for (; i < count; i++)
+            {
+                uint8_t length = ((control[i / 4] >> (2 * (i % 4))) & 0x3) + 1;
+                check_bounds(data, end, length);
+
+                uint32_t value = 0;
+                for (uint8_t b = 0; b < length; b++)
+                {
+                    value |= static_cast<uint32_t>(data[b]) << (8 * b);
+                }
+                out[i] = value;
+                data += length;
+            }
+            return data;
+        }
+#endif
+
+        // ---------------------------------------------------------------- PFor bit packing
+
+        constexpr std::size_t LANES = 4;
+        constexpr std::size_t VALUES_PER_LANE = BLOCK_SIZE / LANES;
+
+        inline uint32_t low_mask(uint32_t bits)
+        {
+            return bits >= 32 ? ~0u : (1u << bits) - 1;
+        }
+
+        // Bit width minimizing packed size plus exception cost
+        inline uint32_t choose_bit_width(const uint32_t *values, std::size_t count)
+        {
+            std::array<std::size_t, 33> at_least_bits{};
+            for (std::size_t i = 0; i < count; i++)
+            {
+                uint32_t bits = 0;
+                while (bits < 32 && (values[i] >> bits) != 0)
+                {
+                    bits++;
+                }
+                at_least_bits[bits]++;
+            }
+
+            // exceptions(b) = number of values needing more than b bits
+            uint32_t best_bits = 32;
+            std::size_t best_cost = BLOCK_SIZE * 4;
+            std::size_t exceptions = 0;
+            for (int bits = 32; bits >= 0; bits--)
+            {
+                // Positions are stored in one byte and the high part in four
+                std::size_t cost = LANES * 4 * static_cast<std::size_t>(bits) + exceptions * 5;
+                if (cost <= best_cost)
+                {
+                    best_cost = cost;
+                    best_bits = static_cast<uint32_t>(bits);
+                }
+                exceptions += at_least_bits[bits];
+            }
+            return best_bits;
+        }
+
+        inline void bitpacking_encode(const uint32_t *values, std::size_t count, std::vector<uint8_t> &out)
+        {
+            std::array<uint32_t, BLOCK_SIZE> padded{};
+            std::memcpy(padded.data(), values, count * sizeof(uint32_t));
+
+            uint32_t bits = choose_bit_width(padded.data(), count);
+            uint32_t mask = low_mask(bits);
+
+            std::vector<uint8_t> exception_positions;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                if ((padded[i] & ~mask) != 0)
+                {
+                    exception_positions.push_back(static_cast<uint8_t>(i));
+                }
+            }
+
+            out.push_back(static_cast<uint8_t>(bits));
+            out.push_back(static_cast<uint8_t>(exception_positions.size()));
+
+            // Word w of lane l is stored at index w * LANES + l
+            std::array<uint32_t, BLOCK_SIZE> words{};
+            for (std::size_t lane = 0; lane < LANES; lane++)
+            {
+                for (std::size_t k = 0; k < VALUES_PER_LANE; k++)
+                {
+                    uint32_t value = padded[k * LANES + lane] & mask;
+                    std::size_t bit = k * bits;
+                    std::size_t word = bit / 32;
+                    std::size_t offset = bit % 32;
+
+                    words[word * LANES + lane] |= value << offset;
+                    if (offset + bits > 32)
+                    {
+                        words[(word + 1) * LANES + lane] |= value >> (32 - offset);
+                    }
+                }
+            }
+            for (std::size_t w = 0; w < bits * LANES; w++)
+            {
+                write_u32(out, words[w]);
+            }
+
+            for (uint8_t position : exception_positions)
+            {
+                out.push_back(position);
+            }
+            for (uint8_t position : exception_positions)
+            {
+                write_u32(out, bits >= 32 ? 0 : padded[position] >> bits);
+            }
+        }
+
+        inline const uint8_t *bitpacking_patch(const uint8_t *in, const uint8_t *end, uint32_t bits,
+                                               std::size_t exceptions, std::size_t count, uint32_t *out)
+        {
+            check_bounds(in, end, exceptions * 5);
+            const uint8_t *positions = in;
+            const uint8_t *high = in + exceptions;
+            for (std::size_t e = 0; e < exceptions; e++)
+            {
+                if (positions[e] < count)
+                {
+                    out[positions[e]] |= read_u32(high + 4 * e) << bits;
+                }
+            }
+            return in + exceptions * 5;
+        }
+
+        inline const uint8_t *bitpacking_decode_scalar(const uint8_t *in, const uint8_t *end,
+                                                       std::size_t count, uint32_t *out)
+        {
+            check_bounds(in, end, 2);
+            uint32_t bits = in[0];
+            std::size_t exceptions = in[1];
+            in += 2;
+            check_bounds(in, end, bits * LANES * 4);
+
+            std::array<uint32_t, BLOCK_SIZE> values;
+            uint32_t mask = low_mask(bits);
+            for (std::size_t lane = 0; lane < LANES; lane++)
+            {
+                for (std::size_t k = 0; k < VALUES_PER_LANE; k++)
+                {
+                    if (bits == 0)
+                    {
+                        values[k * LANES + lane] = 0;
+                        continue;
+                    }
+
+                    std::size_t bit = k * bits;
+                    std::size_t word = bit / 32;
+                    std::size_t offset = bit % 32;
+
+                    uint32_t value = read_u32(in + 4 * (word * LANES + lane)) >> offset;
+                    if (offset + bits > 32)
+                    {
+                        value |= read_u32(in + 4 * ((word + 1) * LANES + lane)) << (32 - offset);
+                    }
+                    values[k * LANES + lane] = value & mask;
+                }
+            }
+            std::memcpy(out, values.data(), count * sizeof(uint32_t));
+
+            return bitpacking_patch(in + bits * LANES * 4, end, bits, exceptions, count, out);
+        }
+
+#if defined(__SSE2__)
+        inline const uint8_t *bitpacking_decode_simd(const uint8_t *in, const uint8_t *end,
+                                                     std::size_t count, uint32_t *out)
+        {
+            check_bounds(in, end, 2);
+            uint32_t bits = in[0];
+            std::size_t exceptions = in[1];
+            in += 2;
+            check_bounds(in, end, bits * LANES * 4);
+
+            alignas(16) std::array<uint32_t, BLOCK_SIZE> values;
+            if (bits == 0)
+            {
+                values.fill(0);
+            }
+            else
+            {
+                const __m128i mask = _mm_set1_epi32(static_cast<int>(low_mask(bits)));
+                const __m128i *words = reinterpret_cast<const __m128i *>(in);
+                for (std::size_t k = 0; k < VALUES_PER_LANE; k++)
+                {
+                    std::size_t bit = k * bits;
+                    std::size_t word = bit / 32;
+                    int offset = static_cast<int>(bit % 32);
+
+                    // All 4 lanes share the same word and shift
+                    __m128i value = _mm_srl_epi32(_mm_loadu_si128(words + word), _mm_cvtsi32_si128(offset));
+                    if (offset + bits > 32)
+                    {
+                        __m128i carry = _mm_sll_epi32(_mm_loadu_si128(words + word + 1), _mm_cvtsi32_si128(32 - offset));
+                        value = _mm_or_si128(value, carry);
+                    }
+                    _mm_store_si128(reinterpret_cast<__m128i *>(values.data() + k * LANES), _mm_and_si128(value, mask));
+                }
+            }
+            std::memcpy(out, values.data(), count * sizeof(uint32_t));
+
+            return bitpacking_patch(in + bits * LANES * 4, end, bits, exceptions, count, out);
+        }
+#endif
+
+    } // namespace detail
+
+    // Encode up to BLOCK_SIZE values and append them to `out`
+    inline void encode_block(Codec codec, const uint32_t *values, std::size_t count, std::vector<uint8_t> &out)
+    {
+        if (count > BLOCK_SIZE)
+        {
+            throw std::invalid_argument("Posting block is larger than BLOCK_SIZE");
+        }
+
+        switch (codec)
+        {
+        case Codec::StreamVByte:
+            detail::streamvbyte_encode(values, count, out);
+            break;
+        case Codec::BitPacking:
+            detail::bitpacking_encode(values, count, out);
+            break;
+        }
+    }
+
+    // Portable decoder, returns the position right after the block
+    inline const uint8_t *decode_block_scalar(Codec codec, const uint8_t *in, const uint8_t *end,
+                                              std::size_t count, uint32_t *out)
+    {
+        switch (codec)
+        {
+        case Codec::StreamVByte:
+            return detail::streamvbyte_decode_scalar(in, end, count, out);
+        case Codec::BitPacking:
+            return detail::bitpacking_decode_scalar(in, end, count, out);
+        }
+        throw std::invalid_argument("Unknown codec");
+    }
+
+    // Fastest decoder available in this build, returns the position right after the block
+    inline const uint8_t *decode_block(Codec codec, const uint8_t *in, const uint8_t *end,
+                                       std::size_t count, uint32_t *out)
+    {
+        switch (codec)
+        {
+        case Codec::StreamVByte:
+#if defined(__SSSE3__)
+            return detail::streamvbyte_decode_simd(in, end, count, out);
+#else
+            return detail::streamvbyte_decode_scalar(in, end, count, out);
+#endif
+        case Codec::BitPacking:
+#if defined(__SSE2__)
+            return detail::bitpacking_decode_simd(in, end, count, out);
+#else
+            return detail::bitpacking_decode_scalar(in, end, count, out);
+#endif
+        }
+        throw std::invalid_argument("Unknown codec");
+    }
+
+    // Turn d-gaps into ids in place, `base` is the id preceding the block
+    inline void prefix_sum(uint32_t *values, std::size_t count, uint32_t base)
+    {
+        std::size_t i = 0;
+#if defined(__SSE2__)
+        __m128i running = _mm_set1_epi32(static_cast<int>(base));
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i gaps = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+            gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 4));
+            gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 8));
+            gaps = _mm_add_epi32(gaps, running);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i), gaps);
+            running = _mm_shuffle_epi32(gaps, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        if (i > 0)
+        {
+            base = values[i - 1];
+        }
+#endif
+        for (; i < count; i++)
+        {
+            base += values[i];
+            values[i] = base;
+        }
+    }
+
+} // namespace codec
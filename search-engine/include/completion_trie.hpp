@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace completion
+{
+
+    // Lowercase ASCII and Cyrillic letters without changing the byte length,
+    // so keystrokes can be normalized where they were received
+    inline void lowercase_in_place(std::string &text)
+    {
+        for (std::size_t i = 0; i < text.size(); i++)
+        {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            unsigned char next = i + 1 < text.size() ? static_cast<unsigned char>(text[i + 1]) : 0;
+            if (c >= 'A' && c <= 'Z')
+            {
+                text[i] = static_cast<char>(c + ('a' - 'A'));
+            }
+            else if (c == 0xD0 && next >= 0x90 && next <= 0x9F)
+            {
+                // А–П
+                text[++i] = static_cast<char>(next + 0x20);
+            }
+            else if (c == 0xD0 && next >= 0xA0 && next <= 0xAF)
+            {
+                // Р–Я
+                text[i] = static_cast<char>(0xD1);
+                text[++i] = static_cast<char>(next - 0x20);
+            }
+            else if (c == 0xD0 && next == 0x81)
+            {
+                // Ё
+                text[i] = static_cast<char>(0xD1);
+                text[++i] = static_cast<char>(0x91);
+            }
+        }
+    }
+
+    // Most frequent spellings of one term, counted in a few slots with the
+    // space saving algorithm: a new spelling takes over the least counted
+    // slot and its count, so a spelling making up more than 1/SLOTS of the
+    // occurrences is always kept
+    class SurfaceForms
+    {
+    private:
+        static constexpr std::size_t SLOTS = 4;
+
+        std::vector<std::pair<std::string, uint32_t>> forms_;
+
+    public:
+        void add(std::string_view form)
+        {
+            auto least = forms_.end();
+            for (auto it = forms_.begin(); it != forms_.end(); ++it)
+            {
+                if (it->first == form)
+                {
+                    it->second++;
+                    return;
+                }
+                if (least == forms_.end() || it->second < least->second)
+                {
+                    least = it;
+                }
+            }
+            if (forms_.size() < SLOTS)
+            {
+                forms_.emplace_back(std::string(form), 1);
+                return;
+            }
+            least->first.assign(form);
+            least->second++;
+        }
+
+        // Empty when nothing was added
+        std::string_view most_frequent() const
+        {
+            auto best = std::max_element(forms_.begin(), forms_.end(),
+                                         [](const auto &a, const auto &b)
+                                         { return a.second < b.second; });
+            return best == forms_.end() ? std::string_view() : std::string_view(best->first);
+        }
+
+        std::size_t memory_bytes() const
+        {
+            std::size_t bytes = forms_.capacity() * sizeof(forms_[0]);
+            for (const auto &form : forms_)
+            {
+                bytes += form.first.capacity();
+            }
+            return bytes;
+        }
+    };
+
+    // Radix trie over terms where every node keeps the ids of the heaviest
+    // terms below it, so completing a prefix is a walk down the trie with no
+    // ranking at query time. Nodes, edge labels and top lists live in flat
+    // arrays, children of a node are contiguous and ordered by first byte
+    class CompletionTrie
+    {
+    private:
+        struct Node
+        {
+            uint32_t label_begin;
+            uint32_t label_length;
+            uint32_t first_child;
+            uint32_t child_count;
+            uint32_t top_begin;
+            uint32_t top_count;
+        };
+
+        std::vector<std::string> terms_;
+        std::vector<uint64_t> weights_;
+        std::vector<Node> nodes_;
+        std::string labels_;
+        std::vector<uint32_t> top_;
+        std::size_t top_k_;
+
+        bool heavier(uint32_t a, uint32_t b) const
+        {
+            return weights_[a] > weights_[b] || (weights_[a] == weights_[b] && a < b);
+        }
+
+        // Fill node `index` from the terms [begin, end) sharing their first
+        // `depth` bytes
+        void build_node(uint32_t index, uint32_t begin, uint32_t end, std::size_t depth)
+        {
+            std::vector<uint32_t> candidates;
+            if (begin < end && terms_[begin].size() == depth)
+            {
+                candidates.push_back(begin++);
+            }
+
+            // One child per distinct next byte
+            std::vector<std::pair<uint32_t, uint32_t>> groups;
+            for (uint32_t i = begin; i < end;)
+            {
+                uint32_t j = i + 1;
+                while (j < end && terms_[j][depth] == terms_[i][depth])
+                {
+                    j++;
+                }
+                groups.emplace_back(i, j);
+                i = j;
+            }
+
+            uint32_t first_child = static_cast<uint32_t>(nodes_.size());
+            nodes_[index].first_child = first_child;
+            nodes_[index].child_count = static_cast<uint32_t>(groups.size());
+            nodes_.resize(nodes_.size() + groups.size());
+
+            for (std::size_t g = 0; g < groups.size(); g++)
+            {
+                // Sorted terms of a group share what its first and last share
+                const std::string &first = terms_[groups[g].first];
+                const std::string &last = terms_[groups[g].second - 1];
+                std::size_t common = depth + 1;
+                while (common < first.size() && common < last.size() && first[common] == last[common])
+                {
+                    common++;
+                }
+
+                uint32_t child = first_child + static_cast<uint32_t>(g);
+                nodes_[child].label_begin = static_cast<uint32_t>(labels_.size());
+                nodes_[child].label_length = static_cast<uint32_t>(common - depth);
+                labels_.append(first, depth, common - depth);
+                build_node(child, groups[g].first, groups[g].second, common);
+
+                const Node &built = nodes_[child];
+                candidates.insert(candidates.end(), top_.begin() + built.top_begin,
+                                  top_.begin() + built.top_begin + built.top_count);
+            }
+
+            std::size_t count = std::min(top_k_, candidates.size());
+            std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                              [this](uint32_t a, uint32_t b)
+                              { return heavier(a, b); });
+            nodes_[index].top_begin = static_cast<uint32_t>(top_.size());
+            nodes_[index].top_count = static_cast<uint32_t>(count);
+            top_.insert(top_.end(), candidates.begin(), candidates.begin() + count);
+        }
+
+    public:
+        // Ids of the heaviest completions, heaviest first
+        struct Completions
+        {
+            const uint32_t *begin_;
+            const uint32_t *end_;
+
+            const uint32_t *begin() const
+            {
+                return begin_;
+            }
+
+            const uint32_t *end() const
+            {
+                return end_;
+            }
+
+            std::size_t size() const
+            {
+                return static_cast<std::size_t>(end_ - begin_);
+            }
+
+            bool empty() const
+            {
+                return begin_ == end_;
+            }
+        };
+
+        CompletionTrie() : nodes_{Node{0, 0, 0, 0, 0, 0}}, top_k_(0) {}
+
+        // Build from ascending unique terms and their weights, keeping `top_k`
+        // completions per node
+        static CompletionTrie build(std::vector<std::string> sorted_terms, std::vector<uint64_t> weights, std::size_t top_k)
+        {
+            CompletionTrie trie;
+            trie.terms_ = std::move(sorted_terms);
+            trie.weights_ = std::move(weights);
+            trie.top_k_ = top_k;
+            if (top_k > 0)
+            {
+                trie.build_node(0, 0, static_cast<uint32_t>(trie.terms_.size()), 0);
+            }
+            trie.nodes_.shrink_to_fit();
+            trie.labels_.shrink_to_fit();
+            trie.top_.shrink_to_fit();
+            return trie;
+        }
+
+        // Heaviest terms starting with `prefix`, without allocating
+        Completions complete(std::string_view prefix) const
+        {
+            uint32_t node = 0;
+            std::size_t depth = 0;
+            while (depth < prefix.size())
+            {
+                const Node &current = nodes_[node];
+                const Node *children = nodes_.data() + current.first_child;
+                const Node *child = std::lower_bound(children, children + current.child_count, prefix[depth],
+                                                     [this](const Node &candidate, char c)
+                                                     {
+                                                         return static_cast<unsigned char>(labels_[candidate.label_begin]) <
+                                                                static_cast<unsigned char>(c);
+                                                     });
+                if (child == children + current.child_count || labels_[child->label_begin] != prefix[depth])
+                {
+                    return Completions{nullptr, nullptr};
+                }
+
+                std::size_t length = std::min<std::size_t>(child->label_length, prefix.size() - depth);
+                if (prefix.compare(depth, length, std::string_view(labels_.data() + child->label_begin, length)) != 0)
+                {
+                    return Completions{nullptr, nullptr};
+                }
+                depth += length;
+                node = static_cast<uint32_t>(child - nodes_.data());
+            }
+
+            const Node &found = nodes_[node];
+            return Completions{top_.data() + found.top_begin, top_.data() + found.top_begin + found.top_count};
+        }
+
+        const std::string &term(uint32_t id) const
+        {
+            return terms_[id];
+        }
+
+        uint64_t weight(uint32_t id) const
+        {
+            return weights_[id];
+        }
+
+        std::size_t size() const
+        {
+            return terms_.size();
+        }
+
+        std::size_t node_count() const
+        {
+            return nodes_.size();
+        }
+
+        std::size_t memory_bytes() const
+        {
+            std::size_t bytes = nodes_.capacity() * sizeof(Node) + labels_.capacity() + top_.capacity() * sizeof(uint32_t) +
+                                weights_.capacity() * sizeof(uint64_t);
+            for (const auto &term : terms_)
+            {
+                bytes += sizeof(std::string) + term.capacity();
+            }
+            return bytes;
+        }
+    };
+
+} // namespace completion
@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <iostream>
+#include <memory_resource>
+#include <string_view>
 #include <vector>
 #include <sstream>
 #include <cctype>
@@ -10,15 +12,18 @@
 #include <bsoncxx/json.hpp>
 #include <mongocxx/client.hpp>
 #include <mongocxx/instance.hpp>
+#include <mongocxx/options/find.hpp>
 #include <mongocxx/uri.hpp>
 
 #include "libstemmer.h"
 
 #include "log.hpp"
 #include "boolean_index.hpp"
+#include "document_store.hpp"
+#include "trigram_index.hpp"
 
-extern struct sb_stemmer *RU_STEMMER;
-extern struct sb_stemmer *EN_STEMMER;
+extern thread_local struct sb_stemmer *RU_STEMMER;
+extern thread_local struct sb_stemmer *EN_STEMMER;
 
 extern mongocxx::instance instance;
 extern mongocxx::uri uri;
@@ -30,19 +35,83 @@ int setup_connector(const char *mongodb_uri, const char *mongodb_db, const char
 
 std::vector<std::string> tokenize_and_stem(const std::string &text);
 
-template <typename DocId = std::string>
-bool setup_boolean_index(boolean_index::BooleanIndex<DocId> &index, mongocxx::collection collection)
+// tokenize_and_stem, with the normalized word of every term appended to
+// `surface_forms` in the same order
+std::vector<std::string> tokenize_and_stem(const std::string &text, std::vector<std::string> &surface_forms);
+
+// tokenize_and_stem into `terms`, with the normalized text and the stems
+// allocated from the memory resource of `terms`
+void tokenize_and_stem(std::string_view text, std::pmr::vector<std::pmr::string> &terms);
+
+// Normalized first word of `text` to look up as a term prefix, cut back to its
+// stem when the stem is a prefix of it
+std::string stem_prefix(const std::string &text);
+
+// Order in which internal doc ids are assigned while building the index
+enum class DocIdOrder
+{
+    // Collection scan order
+    Insertion,
+    // Descending `lastmod`, so that posting lists start with the freshest documents
+    Recency,
+};
+
+struct IndexBuildOptions
 {
+    DocIdOrder order = DocIdOrder::Recency;
+    // Number of most frequent terms whose adjacent pairs get bigram postings, 0 to disable
+    std::size_t common_bigram_terms = 0;
+    // Documents whose document frequencies pick the common terms
+    std::size_t common_terms_sample = 10000;
+    // Delta-encode the posting lists once everything is added
+    bool compress_postings = true;
+};
+
+// `trigrams`, when given, gets the raw text of every document and is finished at the end
+template <typename DocId = uint32_t>
+bool setup_boolean_index(boolean_index::BooleanIndex<DocId> &index, document_store::DocumentStore<DocId> &documents, mongocxx::collection collection, IndexBuildOptions options = {}, trigram_index::TrigramIndex<DocId> *trigrams = nullptr)
+{
+    using bsoncxx::builder::basic::kvp;
+    using bsoncxx::builder::basic::make_document;
+
     try
     {
         int count = 0;
         int bad_count = 0;
-        auto cursor = collection.find({});
+
+        mongocxx::options::find find_options;
+        if (options.order == DocIdOrder::Recency)
+        {
+            // ids are handed out sequentially, so sorting the scan is the sort pass
+            find_options.sort(make_document(kvp("lastmod", -1)));
+            find_options.allow_disk_use(true);
+        }
+        auto cursor = collection.find({}, find_options);
 
         using clock = std::chrono::high_resolution_clock;
 
         std::chrono::duration<double> time_to_build_index;
 
+        // Terms of the first documents are kept until the common terms are known
+        std::vector<std::pair<DocId, std::vector<std::string>>> sample;
+        bool sampling = options.common_bigram_terms > 0;
+        auto select_common_terms = [&]()
+        {
+            auto common_terms = index.most_frequent_terms(options.common_bigram_terms);
+            index.set_common_terms(common_terms);
+            for (const auto &[sample_doc_id, sample_terms] : sample)
+            {
+                index.index_common_bigrams(sample_doc_id, sample_terms);
+            }
+            spdlog::info("indexing bigrams of {} common terms picked from {} documents", common_terms.size(), sample.size());
+            sample.clear();
+            sample.shrink_to_fit();
+            sampling = false;
+        };
+
+        // Words the current document's terms were stemmed from
+        std::vector<std::string> surface_forms;
+
         for (auto &&doc : cursor)
         {
             auto source_elem = doc["source"];
@@ -70,17 +139,38 @@ bool setup_boolean_index(boolean_index::BooleanIndex<DocId> &index, mongocxx::co
                 continue;
             }
 
-            DocId doc_id = std::string{source_elem.get_string().value};
-            spdlog::debug("adding doc with doc_id = {} to the boolean index", doc_id);
+            int64_t lastmod = 0;
+            auto lastmod_elem = doc["lastmod"];
+            if (lastmod_elem && lastmod_elem.type() == bsoncxx::type::k_date)
+            {
+                lastmod = lastmod_elem.get_date().to_int64();
+            }
+
+            DocId doc_id = documents.add(std::string{source_elem.get_string().value}, lastmod);
+            spdlog::debug("adding doc with doc_id = {} ({}) to the boolean index", doc_id, documents.source(doc_id));
 
             std::string value = std::string{value_elem.get_string().value};
             auto start = clock::now();
-            std::vector<std::string> terms = tokenize_and_stem(value);
+            surface_forms.clear();
+            std::vector<std::string> terms = tokenize_and_stem(value, surface_forms);
             auto end = clock::now();
 
             time_to_build_index += end - start;
 
             index.add_document(doc_id, terms);
+            index.add_surface_forms(terms, surface_forms);
+            if (trigrams != nullptr)
+            {
+                trigrams->add_document(doc_id, value);
+            }
+            if (sampling)
+            {
+                sample.emplace_back(doc_id, std::move(terms));
+                if (sample.size() >= options.common_terms_sample)
+                {
+                    select_common_terms();
+                }
+            }
             count++;
             if (count % 10000 == 0)
             {
@@ -89,6 +179,26 @@ bool setup_boolean_index(boolean_index::BooleanIndex<DocId> &index, mongocxx::co
             }
         }
 
+        if (sampling)
+        {
+            select_common_terms();
+        }
+        documents.optimize();
+
+        if (trigrams != nullptr)
+        {
+            auto start = clock::now();
+            trigrams->finish();
+            spdlog::info("merged trigram postings in {}ms", std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start).count());
+        }
+
+        if (options.compress_postings)
+        {
+            auto start = clock::now();
+            index.compress();
+            spdlog::info("compressed posting lists in {}ms", std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start).count());
+        }
+
         spdlog::info("built index in {}s", std::chrono::duration_cast<std::chrono::seconds>(time_to_build_index).count());
     }
     catch (const std::exception &e)
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+namespace deadline
+{
+
+    // Loop steps between two reads of the clock
+    constexpr uint32_t CHECK_INTERVAL = 1024;
+
+    // Timeout a client asked for, bounded by the server's `limit_ms`. 0 asks
+    // for the limit itself, and a `limit_ms` of 0 leaves the client unbounded
+    inline uint32_t client_timeout(uint32_t asked_ms, uint32_t limit_ms)
+    {
+        if (asked_ms == 0)
+        {
+            return limit_ms;
+        }
+        return limit_ms == 0 ? asked_ms : std::min(asked_ms, limit_ms);
+    }
+
+    // Point in time a request has to be answered by. Long loops check it
+    // cooperatively and stop early, their result is then incomplete
+    class Deadline
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+    private:
+        Clock::time_point at_;
+
+    public:
+        // Never expires
+        Deadline() : at_(Clock::time_point::max()) {}
+
+        explicit Deadline(Clock::time_point at) : at_(at) {}
+
+        // `timeout_ms` from now, 0 for none
+        static Deadline after(uint32_t timeout_ms)
+        {
+            return timeout_ms == 0 ? Deadline() : Deadline(Clock::now() + std::chrono::milliseconds(timeout_ms));
+        }
+
+        bool is_set() const
+        {
+            return at_ != Clock::time_point::max();
+        }
+
+        bool expired() const
+        {
+            return is_set() && Clock::now() >= at_;
+        }
+
+        Clock::time_point at() const
+        {
+            return at_;
+        }
+    };
+
+    // Deadline check for a hot loop, reading the clock once every
+    // CHECK_INTERVAL calls
+    class Checker
+    {
+    private:
+        const Deadline *deadline_;
+        uint32_t countdown_ = CHECK_INTERVAL;
+
+    public:
+        // `deadline` nullptr never expires
+        explicit Checker(const Deadline *deadline) : deadline_(deadline != nullptr && deadline->is_set() ? deadline : nullptr) {}
+
+        bool expired()
+        {
+            if (deadline_ == nullptr || --countdown_ > 0)
+            {
+                return false;
+            }
+            countdown_ = CHECK_INTERVAL;
+            return deadline_->expired();
+        }
+    };
+
+    // Thrown when a request runs past its deadline
+    class TimedOut : public std::runtime_error
+    {
+    public:
+        TimedOut() : std::runtime_error("timed out") {}
+    };
+
+    // Thrown when a request is refused to keep the server responsive
+    class Overloaded : public std::runtime_error
+    {
+    public:
+        Overloaded() : std::runtime_error("overloaded") {}
+    };
+
+} // namespace deadline
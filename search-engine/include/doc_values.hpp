@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace doc_values
+{
+
+    // One value per dense doc id, stored as a column with the minimum and
+    // maximum of every block of BLOCK_DOCS ids, so a range filter can skip
+    // whole blocks without reading their values
+    template <typename DocId = uint32_t, typename Value = int64_t>
+    class DocValues
+    {
+    private:
+        static constexpr std::size_t BLOCK_DOCS = 128;
+
+        std::vector<Value> values_;
+        std::vector<Value> block_min_;
+        std::vector<Value> block_max_;
+
+    public:
+        DocValues() = default;
+
+        // Set the value of the next doc id
+        void push_back(Value value)
+        {
+            if (values_.size() % BLOCK_DOCS == 0)
+            {
+                block_min_.push_back(value);
+                block_max_.push_back(value);
+            }
+            else
+            {
+                block_min_.back() = std::min(block_min_.back(), value);
+                block_max_.back() = std::max(block_max_.back(), value);
+            }
+            values_.push_back(value);
+        }
+
+        Value operator[](DocId doc_id) const
+        {
+            return values_[doc_id];
+        }
+
+        Value at(DocId doc_id) const
+        {
+            if (doc_id >= values_.size())
+            {
+                throw std::out_of_range("Doc id has no value");
+            }
+            return values_[doc_id];
+        }
+
+        std::size_t size() const
+        {
+            return values_.size();
+        }
+
+        void reserve(std::size_t count)
+        {
+            values_.reserve(count);
+            block_min_.reserve(count / BLOCK_DOCS + 1);
+            block_max_.reserve(count / BLOCK_DOCS + 1);
+        }
+
+        // Call `visit(first, last, exact)` for the ascending doc id ranges
+        // [first, last) of consecutive blocks overlapping [min, max], `exact`
+        // when every value in the range is known to match. Stops early when
+        // `visit` returns false
+        template <typename Visit>
+        void for_each_range(Value min, Value max, Visit visit) const
+        {
+            std::size_t blocks = block_min_.size();
+            std::size_t block = 0;
+            while (block < blocks)
+            {
+                if (block_max_[block] < min || block_min_[block] > max)
+                {
+                    block++;
+                    continue;
+                }
+
+                bool exact = block_min_[block] >= min && block_max_[block] <= max;
+                std::size_t end = block + 1;
+                while (end < blocks && !(block_max_[end] < min || block_min_[end] > max) &&
+                       (block_min_[end] >= min && block_max_[end] <= max) == exact)
+                {
+                    end++;
+                }
+
+                DocId first = static_cast<DocId>(block * BLOCK_DOCS);
+                DocId last = static_cast<DocId>(std::min(end * BLOCK_DOCS, values_.size()));
+                if (!visit(first, last, exact))
+                {
+                    return;
+                }
+                block = end;
+            }
+        }
+
+        std::size_t memory_bytes() const
+        {
+            return (values_.capacity() + block_min_.capacity() + block_max_.capacity()) * sizeof(Value);
+        }
+    };
+
+    // Documents whose value in `column` lies in [min, max]
+    template <typename DocId = uint32_t, typename Value = int64_t>
+    struct RangeFilter
+    {
+        const DocValues<DocId, Value> *column = nullptr;
+        Value min = std::numeric_limits<Value>::min();
+        Value max = std::numeric_limits<Value>::max();
+
+        bool contains(DocId doc_id) const
+        {
+            if (doc_id >= column->size())
+            {
+                return false;
+            }
+            Value value = (*column)[doc_id];
+            return value >= min && value <= max;
+        }
+    };
+
+} // namespace doc_values
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "doc_values.hpp"
+#include "facets.hpp"
+
+namespace document_store
+{
+
+    // Maps dense internal doc ids to the stored document metadata
+    template <typename DocId = uint32_t>
+    class DocumentStore
+    {
+    private:
+        std::vector<std::string> sources_;
+        doc_values::DocValues<DocId, int64_t> lastmods_;
+        // `site` and `section` of every source URL
+        facets::FacetIndex<DocId> facets_;
+
+    public:
+        DocumentStore() = default;
+
+        // Store a document and assign it the next internal doc id
+        DocId add(std::string source, int64_t lastmod)
+        {
+            DocId doc_id = static_cast<DocId>(sources_.size());
+            lastmods_.push_back(lastmod);
+            facets_.add(doc_id, "site", facets::site_of(source));
+            facets_.add(doc_id, "section", facets::section_of(source));
+            sources_.push_back(std::move(source));
+            return doc_id;
+        }
+
+        const std::string &source(DocId doc_id) const
+        {
+            if (doc_id >= sources_.size())
+            {
+                throw std::out_of_range("Doc id not found in DocumentStore");
+            }
+            return sources_[doc_id];
+        }
+
+        // Last modification time in milliseconds since epoch
+        int64_t lastmod(DocId doc_id) const
+        {
+            if (doc_id >= lastmods_.size())
+            {
+                throw std::out_of_range("Doc id not found in DocumentStore");
+            }
+            return lastmods_[doc_id];
+        }
+
+        // Modification times by doc id, for range filters
+        const doc_values::DocValues<DocId, int64_t> &lastmods() const
+        {
+            return lastmods_;
+        }
+
+        // Documents by site and section, for facet filters and counts
+        const facets::FacetIndex<DocId> &facets() const
+        {
+            return facets_;
+        }
+
+        // Compact the facet bitmaps once every document is added
+        void optimize()
+        {
+            facets_.optimize();
+        }
+
+        std::size_t size() const
+        {
+            return sources_.size();
+        }
+
+        bool empty() const
+        {
+            return sources_.empty();
+        }
+
+        void reserve(std::size_t count)
+        {
+            sources_.reserve(count);
+            lastmods_.reserve(count);
+        }
+    };
+
+} // namespace document_store
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace event_loop
+{
+
+    enum Events : uint32_t
+    {
+        Readable = 1,
+        Writable = 2,
+        // Peer hung up or the socket failed, pending input may still be read
+        Closed = 4,
+    };
+
+    // Edge-triggered epoll set. Every registered fd carries a pointer to its
+    // owner's state, so a wakeup costs the number of ready fds and not the
+    // number of open ones. With edge triggering a handler has to consume
+    // everything available, readiness is only reported again on new data
+    class EpollLoop
+    {
+    private:
+        int epoll_fd_;
+        std::vector<epoll_event> events_;
+
+        static uint32_t to_epoll(uint32_t events)
+        {
+            uint32_t result = EPOLLET | EPOLLRDHUP;
+            if (events & Readable)
+            {
+                result |= EPOLLIN;
+            }
+            if (events & Writable)
+            {
+                result |= EPOLLOUT;
+            }
+            return result;
+        }
+
+        void control(int operation, int fd, void *data, uint32_t events)
+        {
+            epoll_event event{};
+            event.events = to_epoll(events);
+            event.data.ptr = data;
+            if (epoll_ctl(epoll_fd_, operation, fd, &event) < 0)
+            {
+                throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+            }
+        }
+
+    public:
+        // `max_events` bounds how many ready fds one wait() reports
+        explicit EpollLoop(std::size_t max_events = 1024) : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), events_(max_events)
+        {
+            if (epoll_fd_ < 0)
+            {
+                throw std::system_error(errno, std::generic_category(), "epoll_create1");
+            }
+        }
+
+        EpollLoop(const EpollLoop &) = delete;
+        EpollLoop &operator=(const EpollLoop &) = delete;
+
+        ~EpollLoop()
+        {
+            close(epoll_fd_);
+        }
+
+        void add(int fd, void *data, uint32_t events = Readable)
+        {
+            control(EPOLL_CTL_ADD, fd, data, events);
+        }
+
+        void modify(int fd, void *data, uint32_t events)
+        {
+            control(EPOLL_CTL_MOD, fd, data, events);
+        }
+
+        // Closing an fd removes it as well, this is for fds that stay open
+        void remove(int fd)
+        {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        }
+
+        // Wait up to `timeout_ms` and call `handle(data, events)` for every
+        // ready fd. Returns the number of ready fds, 0 on timeout or signal
+        template <typename Handler>
+        int wait(int timeout_ms, Handler handle)
+        {
+            int ready = epoll_wait(epoll_fd_, events_.data(), static_cast<int>(events_.size()), timeout_ms);
+            if (ready < 0)
+            {
+                if (errno == EINTR)
+                {
+                    return 0;
+                }
+                throw std::system_error(errno, std::generic_category(), "epoll_wait");
+            }
+
+            for (int i = 0; i < ready; i++)
+            {
+                uint32_t raw = events_[i].events;
+                uint32_t events = 0;
+                if (raw & EPOLLIN)
+                {
+                    events |= Readable;
+                }
+                if (raw & EPOLLOUT)
+                {
+                    events |= Writable;
+                }
+                if (raw & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                {
+                    events |= Closed;
+                }
+                handle(events_[i].data.ptr, events);
+            }
+            return ready;
+        }
+    };
+
+    enum class ReadStatus
+    {
+        // Everything available was read, wait for the next readiness
+        Drained,
+        // Peer closed the connection or the read failed
+        Closed,
+    };
+
+    // Append everything readable from a non-blocking socket to `buffer`, as
+    // an edge-triggered fd requires
+    template <typename Buffer>
+    ReadStatus read_available(int fd, Buffer &buffer, std::size_t chunk_bytes = 4096)
+    {
+        while (true)
+        {
+            std::size_t offset = buffer.size();
+            buffer.resize(offset + chunk_bytes);
+            ssize_t bytes_read = recv(fd, buffer.data() + offset, chunk_bytes, 0);
+            buffer.resize(offset + (bytes_read > 0 ? static_cast<std::size_t>(bytes_read) : 0));
+
+            if (bytes_read > 0)
+            {
+                continue;
+            }
+            if (bytes_read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return ReadStatus::Drained;
+            }
+            return ReadStatus::Closed;
+        }
+    }
+
+} // namespace event_loop
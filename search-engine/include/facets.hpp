@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hashmap.hpp"
+#include "posting_list.hpp"
+#include "roaring.hpp"
+
+namespace facets
+{
+
+    // Host of a URL without the scheme, port and a leading `www.`
+    inline std::string site_of(const std::string &url)
+    {
+        std::size_t begin = url.find("://");
+        begin = begin == std::string::npos ? 0 : begin + 3;
+        std::size_t end = url.find_first_of(":/?#", begin);
+        std::string host = url.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        std::transform(host.begin(), host.end(), host.begin(),
+                       [](unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+        if (host.compare(0, 4, "www.") == 0)
+        {
+            host.erase(0, 4);
+        }
+        return host;
+    }
+
+    // Site followed by the first path segment, `rbc.ru/politics`, or just the
+    // site for URLs without a path
+    inline std::string section_of(const std::string &url)
+    {
+        std::string site = site_of(url);
+        std::size_t host_begin = url.find("://");
+        host_begin = host_begin == std::string::npos ? 0 : host_begin + 3;
+        std::size_t path = url.find('/', host_begin);
+        if (path == std::string::npos)
+        {
+            return site;
+        }
+        std::size_t end = url.find_first_of("/?#", path + 1);
+        std::string segment = url.substr(path + 1, end == std::string::npos ? std::string::npos : end - path - 1);
+        return segment.empty() ? site : site + "/" + segment;
+    }
+
+    struct FacetCount
+    {
+        std::string value;
+        std::size_t count;
+    };
+
+    // Documents by facet value, each value a bitmap posting list so it can
+    // join query intersections and be counted against a result bitmap
+    template <typename DocId = uint32_t>
+    class FacetIndex
+    {
+        static_assert(posting_list::is_compressible_v<DocId>, "facet values are kept as bitmaps");
+
+    private:
+        using PostingListType = posting_list::PostingList<DocId>;
+
+        // Keyed by `field:value`
+        hashmap::HashMap<std::string, std::unique_ptr<PostingListType>> postings_;
+        // Values seen for every field
+        hashmap::HashMap<std::string, std::vector<std::string>> values_;
+
+        static std::string key(const std::string &field, const std::string &value)
+        {
+            return field + ":" + value;
+        }
+
+    public:
+        FacetIndex() = default;
+
+        void add(DocId doc_id, const std::string &field, const std::string &value)
+        {
+            std::string facet_key = key(field, value);
+            auto *list_ptr = postings_.find(facet_key);
+            if (list_ptr == nullptr)
+            {
+                auto list = std::make_unique<PostingListType>();
+                list->compress_to_bitmap();
+                postings_.insert(facet_key, std::move(list));
+                list_ptr = postings_.find(facet_key);
+                values_[field].push_back(value);
+            }
+            (*list_ptr)->insert(doc_id);
+        }
+
+        // Documents having `value` in `field`, nullptr if no document has it
+        const PostingListType *find(const std::string &field, const std::string &value) const
+        {
+            const auto *list_ptr = postings_.find(key(field, value));
+            return list_ptr == nullptr ? nullptr : list_ptr->get();
+        }
+
+        // Values of `field` in descending order of their document counts
+        std::vector<FacetCount> values(const std::string &field) const
+        {
+            std::vector<FacetCount> result;
+            const auto *values_ptr = values_.find(field);
+            if (values_ptr != nullptr)
+            {
+                for (const auto &value : *values_ptr)
+                {
+                    result.push_back(FacetCount{value, find(field, value)->size()});
+                }
+            }
+            std::sort(result.begin(), result.end(),
+                      [](const FacetCount &a, const FacetCount &b)
+                      { return a.count > b.count || (a.count == b.count && a.value < b.value); });
+            return result;
+        }
+
+        // Documents of `matches` per value of `field`, largest first, counted
+        // by intersecting bitmap containers without listing the documents
+        std::vector<FacetCount> count(const std::string &field, const roaring::RoaringBitmap &matches) const
+        {
+            std::vector<FacetCount> result;
+            const auto *values_ptr = values_.find(field);
+            if (values_ptr == nullptr)
+            {
+                return result;
+            }
+            for (const auto &value : *values_ptr)
+            {
+                std::size_t hits = find(field, value)->bitmap()->and_cardinality(matches);
+                if (hits > 0)
+                {
+                    result.push_back(FacetCount{value, hits});
+                }
+            }
+            std::sort(result.begin(), result.end(),
+                      [](const FacetCount &a, const FacetCount &b)
+                      { return a.count > b.count || (a.count == b.count && a.value < b.value); });
+            return result;
+        }
+
+        // Merge runs of consecutive ids once everything is added
+        void optimize()
+        {
+            for (auto kv : postings_)
+            {
+                kv.second->compress_to_bitmap();
+            }
+        }
+
+        std::size_t memory_bytes() const
+        {
+            std::size_t bytes = 0;
+            for (const auto &kv : postings_)
+            {
+                bytes += kv.first.capacity() + kv.second->memory_bytes();
+            }
+            return bytes;
+        }
+    };
+
+} // namespace facets
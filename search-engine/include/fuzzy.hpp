@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "term_dictionary.hpp"
+
+namespace fuzzy
+{
+
+    // Read the code point at byte `offset` and return the offset after it.
+    // Invalid bytes are read as themselves, so any byte string can be matched
+    inline std::size_t next_code_point(const std::string &text, std::size_t offset, char32_t &code_point)
+    {
+        unsigned char c = static_cast<unsigned char>(text[offset]);
+        std::size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+        if (length <= 1 || offset + length > text.size())
+        {
+            code_point = c;
+            return offset + 1;
+        }
+
+        code_point = c & (0x7F >> length);
+        for (std::size_t i = 1; i < length; i++)
+        {
+            code_point = (code_point << 6) | (static_cast<unsigned char>(text[offset + i]) & 0x3F);
+        }
+        return offset + length;
+    }
+
+    inline std::u32string decode_utf8(const std::string &text)
+    {
+        std::u32string result;
+        result.reserve(text.size());
+        for (std::size_t offset = 0; offset < text.size();)
+        {
+            char32_t code_point;
+            offset = next_code_point(text, offset, code_point);
+            result.push_back(code_point);
+        }
+        return result;
+    }
+
+    // Edit distance allowed for a term of `length` code points: short stems
+    // are too easy to turn into other words
+    inline uint32_t max_distance_for(std::size_t length)
+    {
+        return length < 4 ? 0 : length < 8 ? 1 : 2;
+    }
+
+    // Levenshtein automaton of a query term over code points. A state is the
+    // last row of the edit distance table between the query and the input
+    // read so far, with values capped at max_distance + 1
+    class LevenshteinAutomaton
+    {
+    private:
+        std::u32string query_;
+        uint32_t max_distance_;
+
+    public:
+        using State = std::vector<uint8_t>;
+
+        LevenshteinAutomaton(const std::string &query, uint32_t max_distance)
+            : query_(decode_utf8(query)), max_distance_(std::min<uint32_t>(max_distance, 254)) {}
+
+        State start() const
+        {
+            State state(query_.size() + 1);
+            for (std::size_t i = 0; i < state.size(); i++)
+            {
+                state[i] = static_cast<uint8_t>(std::min<std::size_t>(i, max_distance_ + 1));
+            }
+            return state;
+        }
+
+        State step(const State &state, char32_t c) const
+        {
+            uint8_t cap = static_cast<uint8_t>(max_distance_ + 1);
+            State next(state.size());
+            next[0] = std::min<uint8_t>(state[0] + 1, cap);
+            for (std::size_t i = 1; i < state.size(); i++)
+            {
+                uint8_t replace = state[i - 1] + (query_[i - 1] == c ? 0 : 1);
+                uint8_t best = std::min({replace, static_cast<uint8_t>(state[i] + 1), static_cast<uint8_t>(next[i - 1] + 1)});
+                next[i] = std::min(best, cap);
+            }
+            return next;
+        }
+
+        // Input read so far is within max_distance of the whole query
+        bool is_match(const State &state) const
+        {
+            return state.back() <= max_distance_;
+        }
+
+        // Some continuation of the input can still match
+        bool can_match(const State &state) const
+        {
+            return *std::min_element(state.begin(), state.end()) <= max_distance_;
+        }
+
+        uint32_t distance(const State &state) const
+        {
+            return state.back();
+        }
+    };
+
+    // Visit every dictionary term within `max_distance` edits of `query` as
+    // `visit(term, distance)`. The dictionary is walked in order reusing the
+    // automaton states of the prefix shared with the previous term, and once
+    // a prefix cannot match anymore every term starting with it is skipped
+    // with a single dictionary lookup
+    template <typename Visit>
+    void search(const term_dictionary::FrontCodedDictionary &dictionary, const std::string &query,
+                uint32_t max_distance, Visit visit)
+    {
+        LevenshteinAutomaton automaton(query, max_distance);
+        // Code points of the previous term that have a state, and where each
+        // of them ends in the term
+        std::u32string path;
+        std::vector<std::size_t> ends = {0};
+        std::vector<LevenshteinAutomaton::State> states = {automaton.start()};
+
+        auto it = dictionary.iterate();
+        while (it.valid())
+        {
+            const std::string &term = it.term();
+
+            // Keep the states of the code points shared with the previous term
+            std::size_t common = 0;
+            std::size_t offset = 0;
+            char32_t code_point = 0;
+            while (common < path.size() && offset < term.size())
+            {
+                std::size_t next = next_code_point(term, offset, code_point);
+                if (code_point != path[common] || next != ends[common + 1])
+                {
+                    break;
+                }
+                offset = next;
+                common++;
+            }
+            path.resize(common);
+            ends.resize(common + 1);
+            states.resize(common + 1);
+
+            bool dead = false;
+            while (offset < term.size() && !dead)
+            {
+                offset = next_code_point(term, offset, code_point);
+                path.push_back(code_point);
+                ends.push_back(offset);
+                states.push_back(automaton.step(states.back(), code_point));
+                dead = !automaton.can_match(states.back());
+            }
+
+            if (dead)
+            {
+                it = dictionary.iterate(dictionary.prefix_range(term.substr(0, offset)).second);
+                continue;
+            }
+
+            if (automaton.is_match(states.back()))
+            {
+                visit(term, automaton.distance(states.back()));
+            }
+            it.next();
+        }
+    }
+
+} // namespace fuzzy
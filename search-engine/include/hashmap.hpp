@@ -6,10 +6,23 @@
 #include <algorithm>
 #include <stdexcept>
 #include <iostream>
+#include <type_traits>
 
 namespace hashmap
 {
 
+    // Whether a hash function takes keys of other types, as announced by an
+    // is_transparent member type
+    template <typename Hash, typename = void>
+    struct is_transparent : std::false_type
+    {
+    };
+
+    template <typename Hash>
+    struct is_transparent<Hash, std::void_t<typename Hash::is_transparent>> : std::true_type
+    {
+    };
+
     template <typename Key, typename Value, typename Hash = std::hash<Key>>
     class HashMap
     {
@@ -194,6 +207,32 @@ namespace hashmap
             return &(it->value);
         }
 
+        // Look up by a key of another type that compares equal to Key, such
+        // as a std::string_view for std::string keys, without building a Key.
+        // A transparent Hash hashes it directly. Otherwise Hash has to be
+        // std::hash<Key> and std::hash<K> must agree with it, as it does for
+        // the standard string types
+        template <typename K>
+        const Value *find_as(const K &key) const
+        {
+            std::size_t hash;
+            if constexpr (is_transparent<Hash>::value)
+            {
+                hash = hash_function_(key);
+            }
+            else
+            {
+                static_assert(std::is_same_v<Hash, std::hash<Key>>,
+                              "find_as needs a transparent Hash or std::hash<Key>");
+                hash = std::hash<K>{}(key);
+            }
+            const auto &bucket = buckets_[hash % buckets_.capacity()];
+            auto it = std::find_if(bucket.begin(), bucket.end(),
+                                   [&](const KeyValuePair &kv)
+                                   { return kv.key == key; });
+            return it == bucket.end() ? nullptr : &(it->value);
+        }
+
         Value &operator[](const Key &key)
         {
             size_t index = bucket_index(key);
@@ -0,0 +1,399 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "protocol.hpp"
+
+namespace http
+{
+
+    // Request heads larger than this are refused
+    constexpr std::size_t MAX_HEAD_BYTES = 8192;
+
+    // Parsed request head, every view points into the parsed buffer
+    struct Request
+    {
+        std::string_view method;
+        // Path and query string as sent
+        std::string_view target;
+        std::string_view path;
+        std::string_view query;
+        bool keep_alive = true;
+        std::size_t content_length = 0;
+    };
+
+    // Whether a connection starting with `data` speaks HTTP, `size` may be
+    // shorter than the method, then it is a possible start
+    inline bool is_http(const unsigned char *data, std::size_t size)
+    {
+        const std::string_view method = "GET ";
+        std::size_t compared = std::min(size, method.size());
+        return std::memcmp(data, method.data(), compared) == 0;
+    }
+
+    inline bool equals_ignore_case(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < a.size(); i++)
+        {
+            char x = a[i] >= 'A' && a[i] <= 'Z' ? static_cast<char>(a[i] + 32) : a[i];
+            char y = b[i] >= 'A' && b[i] <= 'Z' ? static_cast<char>(b[i] + 32) : b[i];
+            if (x != y)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline std::string_view trim(std::string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r'))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    // Parse the request head at the start of `data` without copying it,
+    // setting `consumed` to the size of the head and its body. Bodies are
+    // skipped, every supported request is a GET
+    inline protocol::ParseStatus parse_request(const unsigned char *data, std::size_t size, Request &request, std::size_t &consumed)
+    {
+        std::string_view text(reinterpret_cast<const char *>(data), std::min(size, MAX_HEAD_BYTES));
+        std::size_t end = text.find("\r\n\r\n");
+        if (end == std::string_view::npos)
+        {
+            return size >= MAX_HEAD_BYTES ? protocol::ParseStatus::Invalid : protocol::ParseStatus::Incomplete;
+        }
+        std::string_view head = text.substr(0, end + 2);
+
+        // Request line: METHOD SP target SP HTTP/1.x
+        std::size_t line_end = head.find("\r\n");
+        std::string_view line = head.substr(0, line_end);
+        std::size_t first_space = line.find(' ');
+        std::size_t last_space = line.rfind(' ');
+        if (first_space == std::string_view::npos || last_space == first_space)
+        {
+            return protocol::ParseStatus::Invalid;
+        }
+        std::string_view version = line.substr(last_space + 1);
+        if (version != "HTTP/1.1" && version != "HTTP/1.0")
+        {
+            return protocol::ParseStatus::Invalid;
+        }
+        request.method = line.substr(0, first_space);
+        request.target = line.substr(first_space + 1, last_space - first_space - 1);
+        std::size_t question = request.target.find('?');
+        request.path = request.target.substr(0, question);
+        request.query = question == std::string_view::npos ? std::string_view() : request.target.substr(question + 1);
+        // 1.1 keeps the connection unless told otherwise, 1.0 closes it
+        request.keep_alive = version == "HTTP/1.1";
+        request.content_length = 0;
+
+        std::size_t position = line_end + 2;
+        while (position < head.size())
+        {
+            std::size_t next = head.find("\r\n", position);
+            std::string_view header = head.substr(position, next - position);
+            position = next + 2;
+            std::size_t colon = header.find(':');
+            if (colon == std::string_view::npos)
+            {
+                return protocol::ParseStatus::Invalid;
+            }
+            std::string_view name = header.substr(0, colon);
+            std::string_view value = trim(header.substr(colon + 1));
+            if (equals_ignore_case(name, "connection"))
+            {
+                if (equals_ignore_case(value, "close"))
+                {
+                    request.keep_alive = false;
+                }
+                else if (equals_ignore_case(value, "keep-alive"))
+                {
+                    request.keep_alive = true;
+                }
+            }
+            else if (equals_ignore_case(name, "content-length"))
+            {
+                auto [rest, error] = std::from_chars(value.data(), value.data() + value.size(), request.content_length);
+                if (error != std::errc() || rest != value.data() + value.size() || request.content_length > protocol::MAX_PAYLOAD_BYTES)
+                {
+                    return protocol::ParseStatus::Invalid;
+                }
+            }
+            else if (equals_ignore_case(name, "transfer-encoding"))
+            {
+                // Chunked bodies are not read, the stream could not be followed
+                return protocol::ParseStatus::Invalid;
+            }
+        }
+
+        std::size_t total = end + 4 + request.content_length;
+        if (size < total)
+        {
+            return protocol::ParseStatus::Incomplete;
+        }
+        consumed = total;
+        return protocol::ParseStatus::Complete;
+    }
+
+    // Find the still encoded value of `name` in a query string
+    inline bool find_parameter(std::string_view query, std::string_view name, std::string_view &value)
+    {
+        while (!query.empty())
+        {
+            std::size_t end = query.find('&');
+            std::string_view pair = query.substr(0, end);
+            std::size_t equals = pair.find('=');
+            if (pair.substr(0, equals) == name)
+            {
+                value = equals == std::string_view::npos ? std::string_view() : pair.substr(equals + 1);
+                return true;
+            }
+            query = end == std::string_view::npos ? std::string_view() : query.substr(end + 1);
+        }
+        return false;
+    }
+
+    // Decode `%XX` escapes and `+` for spaces into `out`
+    inline bool decode_component(std::string_view encoded, std::string &out)
+    {
+        auto hex = [](char c) -> int
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f')
+            {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'F')
+            {
+                return c - 'A' + 10;
+            }
+            return -1;
+        };
+
+        out.clear();
+        out.reserve(encoded.size());
+        for (std::size_t i = 0; i < encoded.size(); i++)
+        {
+            char c = encoded[i];
+            if (c == '+')
+            {
+                out += ' ';
+            }
+            else if (c == '%')
+            {
+                if (i + 2 >= encoded.size())
+                {
+                    return false;
+                }
+                int high = hex(encoded[i + 1]);
+                int low = hex(encoded[i + 2]);
+                if (high < 0 || low < 0)
+                {
+                    return false;
+                }
+                out += static_cast<char>(high * 16 + low);
+                i += 2;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+        return true;
+    }
+
+    // Status line and headers of a response with a `length` byte body
+    inline void append_head(std::string &out, int status, std::string_view reason, std::string_view content_type,
+                            std::size_t length, bool keep_alive)
+    {
+        char number[24];
+        out += "HTTP/1.1 ";
+        out.append(number, std::to_chars(number, number + sizeof(number), status).ptr);
+        out += ' ';
+        out += reason;
+        out += "\r\nContent-Type: ";
+        out += content_type;
+        out += "\r\nContent-Length: ";
+        out.append(number, std::to_chars(number, number + sizeof(number), length).ptr);
+        out += keep_alive ? "\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+    }
+
+    // JSON written straight into a string as values come, commas and
+    // escaping are handled here. Nesting is limited to 64 levels
+    class JsonWriter
+    {
+    private:
+        std::string &out_;
+        // Bit per open container, set while it has no element yet
+        uint64_t empty_ = 0;
+        unsigned depth_ = 0;
+        bool after_key_ = false;
+
+        void separate()
+        {
+            if (after_key_)
+            {
+                after_key_ = false;
+                return;
+            }
+            if (depth_ == 0)
+            {
+                return;
+            }
+            uint64_t bit = uint64_t(1) << (depth_ - 1);
+            if (empty_ & bit)
+            {
+                empty_ &= ~bit;
+            }
+            else
+            {
+                out_ += ',';
+            }
+        }
+
+        void open(char bracket)
+        {
+            separate();
+            out_ += bracket;
+            empty_ |= uint64_t(1) << depth_;
+            depth_++;
+        }
+
+        void close(char bracket)
+        {
+            depth_--;
+            out_ += bracket;
+        }
+
+        void write_string(std::string_view text)
+        {
+            static const char HEX[] = "0123456789abcdef";
+            out_ += '"';
+            std::size_t start = 0;
+            for (std::size_t i = 0; i < text.size(); i++)
+            {
+                unsigned char c = static_cast<unsigned char>(text[i]);
+                if (c >= 0x20 && c != '"' && c != '\\')
+                {
+                    continue;
+                }
+                out_.append(text.data() + start, i - start);
+                start = i + 1;
+                switch (c)
+                {
+                case '"':
+                    out_ += "\\\"";
+                    break;
+                case '\\':
+                    out_ += "\\\\";
+                    break;
+                case '\n':
+                    out_ += "\\n";
+                    break;
+                case '\r':
+                    out_ += "\\r";
+                    break;
+                case '\t':
+                    out_ += "\\t";
+                    break;
+                default:
+                    out_ += "\\u00";
+                    out_ += HEX[c >> 4];
+                    out_ += HEX[c & 15];
+                    break;
+                }
+            }
+            out_.append(text.data() + start, text.size() - start);
+            out_ += '"';
+        }
+
+    public:
+        explicit JsonWriter(std::string &out) : out_(out)
+        {
+        }
+
+        void begin_object()
+        {
+            open('{');
+        }
+
+        void end_object()
+        {
+            close('}');
+        }
+
+        void begin_array()
+        {
+            open('[');
+        }
+
+        void end_array()
+        {
+            close(']');
+        }
+
+        void key(std::string_view name)
+        {
+            separate();
+            write_string(name);
+            out_ += ':';
+            after_key_ = true;
+        }
+
+        void value(std::string_view text)
+        {
+            separate();
+            write_string(text);
+        }
+
+        void value(const char *text)
+        {
+            value(std::string_view(text));
+        }
+
+        void value(uint64_t number)
+        {
+            separate();
+            char digits[24];
+            out_.append(digits, std::to_chars(digits, digits + sizeof(digits), number).ptr);
+        }
+
+        void value(uint32_t number)
+        {
+            value(static_cast<uint64_t>(number));
+        }
+
+        void value(int64_t number)
+        {
+            separate();
+            char digits[24];
+            out_.append(digits, std::to_chars(digits, digits + sizeof(digits), number).ptr);
+        }
+
+        void value(bool flag)
+        {
+            separate();
+            out_ += flag ? "true" : "false";
+        }
+    };
+
+} // namespace http
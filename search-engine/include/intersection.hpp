@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "deadline.hpp"
+#include "posting_list.hpp"
+
+namespace intersection
+{
+
+    // How candidates from the smaller lists are checked against one list
+    enum class Strategy : uint8_t
+    {
+        // Step the cursor one id at a time, cheapest for lists of similar size
+        Merge,
+        // Seek the cursor past whole blocks or skip list levels
+        Gallop,
+        // Test membership directly in a roaring bitmap
+        BitmapProbe,
+    };
+
+    inline const char *strategy_name(Strategy strategy)
+    {
+        switch (strategy)
+        {
+        case Strategy::Merge:
+            return "merge";
+        case Strategy::Gallop:
+            return "gallop";
+        case Strategy::BitmapProbe:
+            return "bitmap-probe";
+        }
+        return "unknown";
+    }
+
+    // A list this many times longer than the candidate stream is galloped
+    constexpr std::size_t GALLOP_MIN_RATIO = 8;
+
+    // Pick a strategy for checking `candidates` ids against a list
+    inline Strategy choose_strategy(std::size_t candidates, std::size_t list_size, posting_list::Representation representation)
+    {
+        if (representation == posting_list::Representation::Bitmap)
+        {
+            return Strategy::BitmapProbe;
+        }
+        if (list_size >= candidates * GALLOP_MIN_RATIO)
+        {
+            return Strategy::Gallop;
+        }
+        return Strategy::Merge;
+    }
+
+    struct IntersectionStats
+    {
+        struct Step
+        {
+            Strategy strategy;
+            std::size_t list_size = 0;
+            // Ids checked against the list and ids found in it
+            std::size_t probes = 0;
+            std::size_t matches = 0;
+        };
+
+        // Size of the smallest list, which drives the intersection
+        std::size_t base_size = 0;
+        std::vector<Step> steps;
+        // Some list ran out before the smallest one did
+        bool exhausted_early = false;
+        // Doc id ranges evaluated in parallel, 1 for a serial run
+        std::size_t partitions = 1;
+        // Two of the query lists were replaced by their cached intersection
+        bool cached_pair = false;
+
+        // Add up the counters of a run over another doc id range
+        void merge(const IntersectionStats &other)
+        {
+            if (steps.empty())
+            {
+                *this = other;
+                return;
+            }
+            for (std::size_t i = 0; i < steps.size() && i < other.steps.size(); i++)
+            {
+                steps[i].probes += other.steps[i].probes;
+                steps[i].matches += other.steps[i].matches;
+            }
+            exhausted_early = exhausted_early || other.exhausted_early;
+        }
+
+        std::string to_string() const
+        {
+            std::string result = "base " + std::to_string(base_size);
+            for (const auto &step : steps)
+            {
+                result += ", ";
+                result += strategy_name(step.strategy);
+                result += "(" + std::to_string(step.list_size) + ": " + std::to_string(step.matches) + "/" +
+                          std::to_string(step.probes) + ")";
+            }
+            if (exhausted_early)
+            {
+                result += ", exhausted early";
+            }
+            if (cached_pair)
+            {
+                result += ", cached pair";
+            }
+            if (partitions > 1)
+            {
+                result += ", " + std::to_string(partitions) + " partitions";
+            }
+            return result;
+        }
+    };
+
+    // Intersect posting lists in ascending size order. Ids of the smallest
+    // list flow through the others one at a time, each list checked with the
+    // strategy chosen for its size and representation, so the result comes
+    // out in ascending order and stops after `limit` ids (0 for no limit) or
+    // as soon as any list is exhausted. Only ids accepted by `accept` are kept.
+    // With `first` and `last` set only ids in [*first, *last) are considered.
+    // Past `deadline` the ids found so far are kept.
+    // Ids are appended to `result`, `limit` counts only those. Cursors and
+    // counters are allocated like `result`, so a result in an arena keeps
+    // the whole run off the heap. `posting_lists` gets sorted
+    template <typename DocId, typename Accept, typename Lists, typename Result>
+    void intersect_into(Lists &posting_lists, Accept accept, std::size_t limit, Result &result,
+                        IntersectionStats *stats = nullptr, const DocId *first = nullptr, const DocId *last = nullptr,
+                        const deadline::Deadline *deadline = nullptr)
+    {
+        using PostingListType = posting_list::PostingList<DocId>;
+
+        if (posting_lists.empty())
+        {
+            return;
+        }
+
+        std::sort(posting_lists.begin(), posting_lists.end(),
+                  [](const PostingListType *a, const PostingListType *b)
+                  { return a->size() < b->size(); });
+
+        std::pmr::memory_resource *memory = arena::resource_of(result);
+        std::size_t base_size = posting_lists.front()->size();
+        std::pmr::vector<typename PostingListType::Cursor> cursors(memory);
+        std::pmr::vector<IntersectionStats::Step> steps(posting_lists.size(), memory);
+        cursors.reserve(posting_lists.size());
+        for (std::size_t i = 0; i < posting_lists.size(); i++)
+        {
+            cursors.push_back(posting_lists[i]->cursor());
+            steps[i].list_size = posting_lists[i]->size();
+            steps[i].strategy = choose_strategy(base_size, steps[i].list_size, posting_lists[i]->representation());
+        }
+
+        if (first != nullptr)
+        {
+            for (auto &cursor : cursors)
+            {
+                cursor.seek(*first);
+            }
+        }
+
+        auto &base = cursors.front();
+        bool exhausted_early = false;
+        std::size_t found = 0;
+        deadline::Checker out_of_time(deadline);
+
+        while (base.valid() && (last == nullptr || base.doc() < *last) && !out_of_time.expired())
+        {
+            DocId doc_id = base.doc();
+            bool in_all = true;
+            bool base_moved = false;
+
+            for (std::size_t i = 1; i < cursors.size() && in_all; i++)
+            {
+                auto &step = steps[i];
+                auto &cursor = cursors[i];
+                step.probes++;
+
+                if (step.strategy == Strategy::BitmapProbe)
+                {
+                    in_all = posting_lists[i]->contains(doc_id);
+                }
+                else
+                {
+                    if (step.strategy == Strategy::Gallop)
+                    {
+                        cursor.seek(doc_id);
+                    }
+                    else
+                    {
+                        while (cursor.valid() && cursor.doc() < doc_id)
+                        {
+                            cursor.next();
+                        }
+                    }
+
+                    if (!cursor.valid())
+                    {
+                        // Nothing later can be in every list
+                        exhausted_early = true;
+                        break;
+                    }
+                    if (cursor.doc() != doc_id)
+                    {
+                        // Skip the base straight to the next possible match
+                        in_all = false;
+                        base.seek(cursor.doc());
+                        base_moved = true;
+                        continue;
+                    }
+                }
+
+                if (in_all)
+                {
+                    step.matches++;
+                }
+            }
+
+            if (exhausted_early)
+            {
+                break;
+            }
+
+            if (in_all && accept(doc_id))
+            {
+                result.push_back(doc_id);
+                if (limit != 0 && ++found >= limit)
+                {
+                    break;
+                }
+            }
+
+            if (!base_moved)
+            {
+                base.next();
+            }
+        }
+
+        if (stats != nullptr)
+        {
+            stats->base_size = base_size;
+            stats->steps.assign(steps.begin() + 1, steps.end());
+            stats->exhausted_early = exhausted_early;
+        }
+    }
+
+    // intersect_into a new vector
+    template <typename DocId, typename Accept>
+    std::vector<DocId> intersect(std::vector<const posting_list::PostingList<DocId> *> posting_lists, Accept accept,
+                                 std::size_t limit, IntersectionStats *stats = nullptr,
+                                 const DocId *first = nullptr, const DocId *last = nullptr,
+                                 const deadline::Deadline *deadline = nullptr)
+    {
+        std::vector<DocId> result;
+        intersect_into<DocId>(posting_lists, accept, limit, result, stats, first, last, deadline);
+        return result;
+    }
+
+} // namespace intersection
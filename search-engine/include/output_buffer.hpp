@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace output_buffer
+{
+
+    // Response bytes as a list of pieces, each either copied into the
+    // message or a view of memory that outlives it, such as stored document
+    // sources, so a result is sent without being concatenated first
+    class Message
+    {
+    private:
+        struct Piece
+        {
+            // nullptr for bytes at `offset` in text_
+            const char *external;
+            std::size_t offset;
+            std::size_t size;
+        };
+
+        std::string text_;
+        std::vector<Piece> pieces_;
+        std::size_t size_ = 0;
+
+    public:
+        // Copy `bytes` into the message, next to the previous copied piece
+        // when there is one
+        void append(std::string_view bytes)
+        {
+            if (bytes.empty())
+            {
+                return;
+            }
+            if (!pieces_.empty() && pieces_.back().external == nullptr)
+            {
+                pieces_.back().size += bytes.size();
+            }
+            else
+            {
+                pieces_.push_back(Piece{nullptr, text_.size(), bytes.size()});
+            }
+            text_.append(bytes.data(), bytes.size());
+            size_ += bytes.size();
+        }
+
+        // Refer to `bytes` without copying, they have to stay alive and
+        // unchanged until the message is sent
+        void append_external(std::string_view bytes)
+        {
+            if (bytes.empty())
+            {
+                return;
+            }
+            pieces_.push_back(Piece{bytes.data(), 0, bytes.size()});
+            size_ += bytes.size();
+        }
+
+        // Append the pieces of `other`, copying what it copied and viewing
+        // what it views
+        void append(const Message &other)
+        {
+            for (std::size_t i = 0; i < other.piece_count(); i++)
+            {
+                if (other.pieces_[i].external == nullptr)
+                {
+                    append(other.piece(i));
+                }
+                else
+                {
+                    append_external(other.piece(i));
+                }
+            }
+        }
+
+        // Make room for `bytes` copied bytes in `pieces` pieces
+        void reserve(std::size_t bytes, std::size_t pieces = 0)
+        {
+            text_.reserve(bytes);
+            pieces_.reserve(pieces);
+        }
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        std::size_t piece_count() const
+        {
+            return pieces_.size();
+        }
+
+        std::string_view piece(std::size_t index) const
+        {
+            const Piece &piece = pieces_[index];
+            const char *data = piece.external != nullptr ? piece.external : text_.data() + piece.offset;
+            return std::string_view(data, piece.size);
+        }
+
+        std::string to_string() const
+        {
+            std::string result;
+            result.reserve(size_);
+            for (std::size_t i = 0; i < pieces_.size(); i++)
+            {
+                std::string_view bytes = piece(i);
+                result.append(bytes.data(), bytes.size());
+            }
+            return result;
+        }
+    };
+
+    enum class FlushStatus
+    {
+        // Everything queued was written
+        Done,
+        // The socket buffer is full, flush again once it is writable
+        Blocked,
+        // The peer is gone
+        Failed,
+    };
+
+    // Messages waiting to be written to a non-blocking socket, gathered
+    // straight from their pieces into one call per MAX_IOVECS pieces
+    class OutputQueue
+    {
+    private:
+        static constexpr std::size_t MAX_IOVECS = 64;
+
+        std::deque<Message> messages_;
+        // First unwritten piece of the front message and the bytes of it
+        // already written
+        std::size_t piece_ = 0;
+        std::size_t offset_ = 0;
+        std::size_t bytes_ = 0;
+
+        void consume(std::size_t written)
+        {
+            bytes_ -= written;
+            while (written > 0)
+            {
+                std::size_t left = messages_.front().piece(piece_).size() - offset_;
+                if (written < left)
+                {
+                    offset_ += written;
+                    return;
+                }
+                written -= left;
+                offset_ = 0;
+                if (++piece_ == messages_.front().piece_count())
+                {
+                    messages_.pop_front();
+                    piece_ = 0;
+                }
+            }
+        }
+
+    public:
+        void push(Message message)
+        {
+            if (message.empty())
+            {
+                return;
+            }
+            bytes_ += message.size();
+            messages_.push_back(std::move(message));
+        }
+
+        // Bytes still to be written
+        std::size_t size() const
+        {
+            return bytes_;
+        }
+
+        bool empty() const
+        {
+            return bytes_ == 0;
+        }
+
+        FlushStatus flush(int fd)
+        {
+            iovec vectors[MAX_IOVECS];
+            while (!messages_.empty())
+            {
+                int count = 0;
+                std::size_t piece = piece_;
+                std::size_t offset = offset_;
+                for (auto it = messages_.begin(); it != messages_.end() && count < static_cast<int>(MAX_IOVECS); ++it)
+                {
+                    for (; piece < it->piece_count() && count < static_cast<int>(MAX_IOVECS); piece++)
+                    {
+                        std::string_view bytes = it->piece(piece);
+                        vectors[count].iov_base = const_cast<char *>(bytes.data() + offset);
+                        vectors[count].iov_len = bytes.size() - offset;
+                        count++;
+                        offset = 0;
+                    }
+                    piece = 0;
+                }
+
+                // writev with MSG_NOSIGNAL, a vanished peer fails the call
+                // instead of raising SIGPIPE
+                msghdr header{};
+                header.msg_iov = vectors;
+                header.msg_iovlen = static_cast<std::size_t>(count);
+                ssize_t written = sendmsg(fd, &header, MSG_NOSIGNAL);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return errno == EAGAIN || errno == EWOULDBLOCK ? FlushStatus::Blocked : FlushStatus::Failed;
+                }
+                consume(static_cast<std::size_t>(written));
+            }
+            return FlushStatus::Done;
+        }
+    };
+
+} // namespace output_buffer
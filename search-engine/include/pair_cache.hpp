@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "hashmap.hpp"
+
+namespace pair_cache
+{
+
+    struct PairCacheOptions
+    {
+        // Memory for materialized pairs, 0 disables the cache
+        std::size_t budget_bytes = 0;
+        // Times a pair has to be seen before its intersection is materialized
+        uint32_t admit_after = 3;
+        // Pairs whose smaller list is shorter than this are cheap to intersect
+        std::size_t min_list_size = 1024;
+        // Pairs whose smaller list is longer than this take too long to
+        // materialize while a query waits, and would crowd out the others
+        std::size_t max_list_size = 1 << 20;
+    };
+
+    struct PairCacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t admissions = 0;
+        uint64_t evictions = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+    };
+
+    // Materialized intersections of frequently queried term pairs. A pair is
+    // identified by the term ids of its two lists. How often each pair is
+    // seen is tracked in a count-min sketch that is halved periodically, so
+    // only pairs that stay popular get admitted. Admitted pairs are built off
+    // the query path and marked in flight meanwhile, so a hot pair is built
+    // once. Cached results carry the index generation they were computed at
+    template <typename ListType>
+    class PairCache
+    {
+    private:
+        static constexpr std::size_t SKETCH_DEPTH = 4;
+        static constexpr std::size_t SKETCH_WIDTH = 4096;
+        // Halve all counters after this many observations
+        static constexpr std::size_t SKETCH_PERIOD = SKETCH_WIDTH * 8;
+
+        struct PairKey
+        {
+            uint32_t first;
+            uint32_t second;
+
+            bool operator==(const PairKey &other) const
+            {
+                return first == other.first && second == other.second;
+            }
+        };
+
+        struct PairKeyHash
+        {
+            std::size_t operator()(const PairKey &key) const
+            {
+                uint64_t packed = (static_cast<uint64_t>(key.first) << 32) | key.second;
+                return static_cast<std::size_t>(packed * 0x9e3779b97f4a7c15ULL);
+            }
+        };
+
+        struct Entry
+        {
+            PairKey key;
+            std::shared_ptr<const ListType> result;
+            uint64_t generation;
+            std::size_t bytes;
+        };
+
+        using EntryList = std::list<Entry>;
+
+        PairCacheOptions options_;
+        mutable std::mutex mutex_;
+        // Most recently used first
+        EntryList entries_;
+        hashmap::HashMap<PairKey, typename EntryList::iterator, PairKeyHash> index_;
+        std::size_t bytes_;
+        // Pairs handed out for materialization and not cached or abandoned yet
+        hashmap::HashMap<PairKey, bool, PairKeyHash> in_flight_;
+        mutable std::condition_variable idle_;
+
+        std::vector<uint8_t> sketch_;
+        std::size_t observations_;
+
+        PairCacheStats stats_;
+
+        static PairKey make_key(uint32_t a, uint32_t b)
+        {
+            return a < b ? PairKey{a, b} : PairKey{b, a};
+        }
+
+        void erase(typename EntryList::iterator it)
+        {
+            bytes_ -= it->bytes;
+            index_.erase(it->key);
+            entries_.erase(it);
+        }
+
+        // Count one more query containing the pair and return the estimated
+        // number of times it was seen recently. Called under the lock
+        uint32_t observe(const PairKey &key)
+        {
+            std::size_t hash = PairKeyHash{}(key);
+            if (++observations_ >= SKETCH_PERIOD)
+            {
+                for (auto &counter : sketch_)
+                {
+                    counter /= 2;
+                }
+                observations_ = 0;
+            }
+
+            uint32_t estimate = UINT8_MAX;
+            for (std::size_t row = 0; row < SKETCH_DEPTH; row++)
+            {
+                std::size_t column = (hash >> (row * 12)) % SKETCH_WIDTH;
+                uint8_t &counter = sketch_[row * SKETCH_WIDTH + column];
+                if (counter < UINT8_MAX)
+                {
+                    counter++;
+                }
+                estimate = std::min<uint32_t>(estimate, counter);
+            }
+            return estimate;
+        }
+
+        // Cached intersection of the pair at index `generation`, nullptr if
+        // absent. Called under the lock
+        std::shared_ptr<const ListType> find(const PairKey &key, uint64_t generation)
+        {
+            auto *it_ptr = index_.find(key);
+            if (it_ptr == nullptr || (*it_ptr)->generation != generation)
+            {
+                if (it_ptr != nullptr)
+                {
+                    erase(*it_ptr);
+                }
+                stats_.misses++;
+                return nullptr;
+            }
+
+            auto it = *it_ptr;
+            entries_.splice(entries_.begin(), entries_, it);
+            stats_.hits++;
+            return it->result;
+        }
+
+        void finish(const PairKey &key)
+        {
+            in_flight_.erase(key);
+            if (in_flight_.empty())
+            {
+                idle_.notify_all();
+            }
+        }
+
+    public:
+        // What a query's pairs found in the cache. Positions index the lists
+        // given to lookup(), `result` is nullptr when no pair is cached
+        struct Lookup
+        {
+            std::shared_ptr<const ListType> result;
+            std::size_t first = 0;
+            std::size_t second = 0;
+            // Pair the caller has to materialize and insert() or abandon(),
+            // nullptr when there is none
+            const ListType *admit_first = nullptr;
+            const ListType *admit_second = nullptr;
+        };
+
+        explicit PairCache(PairCacheOptions options)
+            : options_(options), bytes_(0), sketch_(SKETCH_DEPTH * SKETCH_WIDTH, 0), observations_(0) {}
+
+        // Pairs still being built read the lists of the index that owns the cache
+        ~PairCache()
+        {
+            wait_idle();
+        }
+
+        const PairCacheOptions &options() const
+        {
+            return options_;
+        }
+
+        // Check if a pair seen `count` times is worth materializing
+        bool should_admit(uint32_t count, std::size_t smaller_list_size) const
+        {
+            return options_.budget_bytes != 0 && count >= options_.admit_after &&
+                   smaller_list_size >= options_.min_list_size && smaller_list_size <= options_.max_list_size;
+        }
+
+        // Count every pair of `lists` as seen once more and find the most
+        // selective cached one, all under one lock. Lists without a term id
+        // are skipped. At most one pair seen often enough, neither cached nor
+        // in flight, is marked in flight and handed back for materialization
+        template <typename Lists>
+        Lookup lookup(const Lists &lists, uint64_t generation)
+        {
+            Lookup found;
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (std::size_t i = 0; i < lists.size(); i++)
+            {
+                for (std::size_t j = i + 1; j < lists.size(); j++)
+                {
+                    const ListType *first = lists[i];
+                    const ListType *second = lists[j];
+                    if (first->term_id() == 0 || second->term_id() == 0 || first->term_id() == second->term_id())
+                    {
+                        continue;
+                    }
+
+                    PairKey key = make_key(first->term_id(), second->term_id());
+                    uint32_t seen = observe(key);
+                    auto cached = find(key, generation);
+                    if (cached == nullptr)
+                    {
+                        if (found.admit_first == nullptr && in_flight_.find(key) == nullptr &&
+                            should_admit(seen, std::min(first->size(), second->size())))
+                        {
+                            in_flight_.insert(key, true);
+                            found.admit_first = first;
+                            found.admit_second = second;
+                        }
+                        continue;
+                    }
+
+                    if (found.result == nullptr || cached->size() < found.result->size())
+                    {
+                        found.result = std::move(cached);
+                        found.first = i;
+                        found.second = j;
+                    }
+                }
+            }
+            return found;
+        }
+
+        // Cache the materialized pair handed out by lookup()
+        void insert(uint32_t a, uint32_t b, uint64_t generation, std::shared_ptr<const ListType> result)
+        {
+            std::size_t bytes = result->memory_bytes() + sizeof(Entry);
+            PairKey key = make_key(a, b);
+            std::lock_guard<std::mutex> lock(mutex_);
+            finish(key);
+            if (bytes > options_.budget_bytes)
+            {
+                return;
+            }
+
+            auto *existing = index_.find(key);
+            if (existing != nullptr)
+            {
+                erase(*existing);
+            }
+
+            entries_.push_front(Entry{key, std::move(result), generation, bytes});
+            index_.insert(key, entries_.begin());
+            bytes_ += bytes;
+            stats_.admissions++;
+
+            while (bytes_ > options_.budget_bytes)
+            {
+                erase(std::prev(entries_.end()));
+                stats_.evictions++;
+            }
+        }
+
+        // Give up on a pair handed out by lookup(), a later query may hand it out again
+        void abandon(uint32_t a, uint32_t b)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finish(make_key(a, b));
+        }
+
+        // Wait until no pair is in flight
+        void wait_idle() const
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.wait(lock, [this]
+                       { return in_flight_.empty(); });
+        }
+
+        PairCacheStats stats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            PairCacheStats result = stats_;
+            result.entries = entries_.size();
+            result.bytes = bytes_;
+            return result;
+        }
+    };
+
+} // namespace pair_cache
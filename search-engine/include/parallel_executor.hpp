@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace parallel_executor
+{
+
+    struct ParallelOptions
+    {
+        // Estimated probes below which a query stays on the calling thread
+        std::size_t min_cost = 1 << 16;
+        // Doc id ranges per pool thread, more ranges balance better
+        std::size_t partitions_per_thread = 4;
+    };
+
+    // Runs one query over disjoint doc id ranges on a thread pool and
+    // concatenates the per-range results, which keeps them in ascending order.
+    // Once the ranges finished so far hold `limit` ids, later ranges that have
+    // not started yet are skipped
+    template <typename DocId = uint32_t>
+    class ParallelExecutor
+    {
+    private:
+        thread_pool::ThreadPool &pool_;
+        ParallelOptions options_;
+
+    public:
+        explicit ParallelExecutor(thread_pool::ThreadPool &pool, ParallelOptions options = {})
+            : pool_(pool), options_(options) {}
+
+        // Check if a query of estimated `cost` is worth splitting
+        bool should_parallelize(std::size_t cost) const
+        {
+            return pool_.size() > 1 && cost >= options_.min_cost;
+        }
+
+        std::size_t partition_count() const
+        {
+            return pool_.size() * options_.partitions_per_thread;
+        }
+
+        // Run `task` on the pool in the background, work for later queries
+        // that the current one does not wait for
+        template <typename Task>
+        void submit(Task task) const
+        {
+            pool_.submit(std::move(task));
+        }
+
+        // Call `evaluate(partition, first, last)` for ranges covering [0, end)
+        // and merge the returned ids in range order, at most `limit` of them
+        // (0 for no limit)
+        template <typename EvaluateRange>
+        std::vector<DocId> run(DocId end, std::size_t limit, EvaluateRange evaluate) const
+        {
+            std::size_t partitions = partition_count();
+            std::size_t width = std::max<std::size_t>((static_cast<std::size_t>(end) + partitions - 1) / partitions, 1);
+
+            std::vector<std::vector<DocId>> results(partitions);
+            std::vector<bool> finished(partitions, false);
+            std::size_t satisfied_after = partitions;
+            std::mutex mutex;
+
+            pool_.parallel_for(partitions, [&](std::size_t partition)
+                               {
+                                   {
+                                       std::lock_guard<std::mutex> lock(mutex);
+                                       if (partition > satisfied_after)
+                                       {
+                                           return;
+                                       }
+                                   }
+
+                                   std::size_t first = partition * width;
+                                   if (first >= static_cast<std::size_t>(end))
+                                   {
+                                       return;
+                                   }
+                                   std::size_t last = std::min(first + width, static_cast<std::size_t>(end));
+                                   auto ids = evaluate(partition, static_cast<DocId>(first), static_cast<DocId>(last));
+
+                                   std::lock_guard<std::mutex> lock(mutex);
+                                   results[partition] = std::move(ids);
+                                   finished[partition] = true;
+                                   if (limit == 0)
+                                   {
+                                       return;
+                                   }
+
+                                   // Find the shortest finished prefix that already has enough ids
+                                   std::size_t found = 0;
+                                   for (std::size_t i = 0; i < partitions && finished[i]; i++)
+                                   {
+                                       found += results[i].size();
+                                       if (found >= limit)
+                                       {
+                                           satisfied_after = std::min(satisfied_after, i);
+                                           break;
+                                       }
+                                   } });
+
+            std::vector<DocId> merged;
+            for (std::size_t i = 0; i < partitions && i <= satisfied_after; i++)
+            {
+                for (DocId id : results[i])
+                {
+                    if (limit != 0 && merged.size() >= limit)
+                    {
+                        return merged;
+                    }
+                    merged.push_back(id);
+                }
+            }
+            return merged;
+        }
+    };
+
+} // namespace parallel_executor
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "hashmap.hpp"
+
+namespace position_index
+{
+
+    // Positions of one term inside one document, delta + varint encoded
+    using PositionList = std::vector<unsigned char>;
+
+    // Encode ascending positions as varint deltas
+    inline PositionList encode_positions(const std::vector<uint32_t> &positions)
+    {
+        PositionList encoded;
+        encoded.reserve(positions.size());
+
+        uint32_t previous = 0;
+        for (uint32_t position : positions)
+        {
+            uint32_t delta = position - previous;
+            previous = position;
+
+            while (delta >= 0x80)
+            {
+                encoded.push_back(static_cast<unsigned char>(delta | 0x80));
+                delta >>= 7;
+            }
+            encoded.push_back(static_cast<unsigned char>(delta));
+        }
+
+        return encoded;
+    }
+
+    // Decode into `out`, reusing its storage
+    inline void decode_positions(const PositionList &encoded, std::vector<uint32_t> &out)
+    {
+        out.clear();
+
+        uint32_t previous = 0;
+        uint32_t delta = 0;
+        int shift = 0;
+        for (unsigned char byte : encoded)
+        {
+            delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (byte & 0x80)
+            {
+                shift += 7;
+                continue;
+            }
+
+            previous += delta;
+            out.push_back(previous);
+            delta = 0;
+            shift = 0;
+        }
+    }
+
+    inline std::vector<uint32_t> decode_positions(const PositionList &encoded)
+    {
+        std::vector<uint32_t> out;
+        decode_positions(encoded, out);
+        return out;
+    }
+
+    // Per-term, per-document position lists, kept apart from the doc id postings
+    // so that boolean queries never touch them
+    template <typename DocId = uint32_t>
+    class PositionIndex
+    {
+    private:
+        static constexpr std::size_t term_initial_capacity_ = 4;
+
+        using DocPositionsType = hashmap::HashMap<DocId, PositionList>;
+        using HashMapType = hashmap::HashMap<std::string, std::unique_ptr<DocPositionsType>>;
+
+        HashMapType positions_;
+        std::size_t encoded_bytes_;
+
+    public:
+        PositionIndex() : encoded_bytes_(0) {}
+
+        void add(const std::string &term, DocId doc_id, const std::vector<uint32_t> &positions)
+        {
+            auto *doc_positions_ptr = positions_.find(term);
+            if (doc_positions_ptr == nullptr)
+            {
+                positions_[term] = std::make_unique<DocPositionsType>(term_initial_capacity_);
+                doc_positions_ptr = positions_.find(term);
+            }
+
+            PositionList encoded = encode_positions(positions);
+            encoded_bytes_ += encoded.size();
+
+            auto *existing = (*doc_positions_ptr)->find(doc_id);
+            if (existing != nullptr)
+            {
+                encoded_bytes_ -= existing->size();
+            }
+            (*doc_positions_ptr)->insert(doc_id, std::move(encoded));
+        }
+
+        bool remove(const std::string &term, DocId doc_id)
+        {
+            auto *doc_positions_ptr = positions_.find(term);
+            if (doc_positions_ptr == nullptr)
+            {
+                return false;
+            }
+
+            auto *existing = (*doc_positions_ptr)->find(doc_id);
+            if (existing == nullptr)
+            {
+                return false;
+            }
+
+            encoded_bytes_ -= existing->size();
+            return (*doc_positions_ptr)->erase(doc_id);
+        }
+
+        // Encoded positions of a term in a document, nullptr if absent
+        const PositionList *find(const std::string &term, DocId doc_id) const
+        {
+            const auto *doc_positions_ptr = positions_.find(term);
+            if (doc_positions_ptr == nullptr)
+            {
+                return nullptr;
+            }
+            return (*doc_positions_ptr)->find(doc_id);
+        }
+
+        std::size_t total_terms() const
+        {
+            return positions_.size();
+        }
+
+        std::size_t encoded_bytes() const
+        {
+            return encoded_bytes_;
+        }
+    };
+
+} // namespace position_index
@@ -0,0 +1,636 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+
+#include "codec.hpp"
+#include "roaring.hpp"
+#include "skiplist.hpp"
+
+namespace posting_list
+{
+
+    // Only dense unsigned ids up to 32 bits can be delta encoded
+    template <typename DocId>
+    constexpr bool is_compressible_v = std::is_integral_v<DocId> && std::is_unsigned_v<DocId> &&
+                                       sizeof(DocId) <= sizeof(uint32_t);
+
+    // Immutable delta-encoded posting list, split into blocks of codec::BLOCK_SIZE ids
+    class CompressedPostingList
+    {
+    private:
+        codec::Codec codec_;
+        std::size_t size_;
+        std::vector<uint8_t> data_;
+        // Last id and byte offset of every block, used to skip blocks without decoding them
+        std::vector<uint32_t> block_last_;
+        std::vector<uint32_t> block_offset_;
+
+    public:
+        CompressedPostingList() : codec_(codec::Codec::StreamVByte), size_(0) {}
+
+        // Encode ascending unique ids with the given codec
+        static CompressedPostingList encode(const std::vector<uint32_t> &ids, codec::Codec codec)
+        {
+            CompressedPostingList list;
+            list.codec_ = codec;
+            list.size_ = ids.size();
+
+            std::size_t blocks = (ids.size() + codec::BLOCK_SIZE - 1) / codec::BLOCK_SIZE;
+            list.block_last_.reserve(blocks);
+            list.block_offset_.reserve(blocks);
+
+            std::array<uint32_t, codec::BLOCK_SIZE> gaps;
+            uint32_t previous = 0;
+            for (std::size_t start = 0; start < ids.size(); start += codec::BLOCK_SIZE)
+            {
+                std::size_t count = std::min(codec::BLOCK_SIZE, ids.size() - start);
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    gaps[i] = ids[start + i] - previous;
+                    previous = ids[start + i];
+                }
+
+                list.block_offset_.push_back(static_cast<uint32_t>(list.data_.size()));
+                list.block_last_.push_back(previous);
+                codec::encode_block(codec, gaps.data(), count, list.data_);
+            }
+
+            list.data_.shrink_to_fit();
+            return list;
+        }
+
+        // Encode with whichever codec gives the smallest list
+        static CompressedPostingList encode_best(const std::vector<uint32_t> &ids)
+        {
+            CompressedPostingList best;
+            bool first = true;
+            for (codec::Codec codec : codec::ALL_CODECS)
+            {
+                CompressedPostingList candidate = encode(ids, codec);
+                if (first || candidate.data_.size() < best.data_.size())
+                {
+                    best = std::move(candidate);
+                    first = false;
+                }
+            }
+            return best;
+        }
+
+        codec::Codec codec() const
+        {
+            return codec_;
+        }
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        std::size_t block_count() const
+        {
+            return block_last_.size();
+        }
+
+        // Number of ids stored in a block
+        std::size_t block_size(std::size_t block) const
+        {
+            return std::min(codec::BLOCK_SIZE, size_ - block * codec::BLOCK_SIZE);
+        }
+
+        uint32_t block_last(std::size_t block) const
+        {
+            return block_last_[block];
+        }
+
+        // Bytes taken by the encoded data and the skip tables
+        std::size_t encoded_bytes() const
+        {
+            return data_.size() + (block_last_.size() + block_offset_.size()) * sizeof(uint32_t);
+        }
+
+        // Decode one block of ids into `out`, returns the number of ids
+        std::size_t decode_block(std::size_t block, uint32_t *out) const
+        {
+            std::size_t count = block_size(block);
+            const uint8_t *begin = data_.data() + block_offset_[block];
+            codec::decode_block(codec_, begin, data_.data() + data_.size(), count, out);
+            codec::prefix_sum(out, count, block == 0 ? 0 : block_last_[block - 1]);
+            return count;
+        }
+
+        std::vector<uint32_t> decode() const
+        {
+            std::vector<uint32_t> ids(size_);
+            for (std::size_t block = 0; block < block_count(); block++)
+            {
+                decode_block(block, ids.data() + block * codec::BLOCK_SIZE);
+            }
+            return ids;
+        }
+
+        bool contains(uint32_t id) const
+        {
+            auto it = std::lower_bound(block_last_.begin(), block_last_.end(), id);
+            if (it == block_last_.end())
+            {
+                return false;
+            }
+
+            std::array<uint32_t, codec::BLOCK_SIZE> ids;
+            std::size_t count = decode_block(it - block_last_.begin(), ids.data());
+            return std::binary_search(ids.begin(), ids.begin() + count, id);
+        }
+
+        // Forward cursor decoding one block at a time
+        class Cursor
+        {
+        private:
+            const CompressedPostingList *list_;
+            std::size_t block_;
+            std::size_t position_;
+            std::size_t count_;
+            std::array<uint32_t, codec::BLOCK_SIZE> ids_;
+
+            void load(std::size_t block)
+            {
+                block_ = block;
+                position_ = 0;
+                count_ = list_ != nullptr && block_ < list_->block_count() ? list_->decode_block(block_, ids_.data()) : 0;
+            }
+
+        public:
+            // A null list gives an exhausted cursor
+            explicit Cursor(const CompressedPostingList *list) : list_(list)
+            {
+                load(0);
+            }
+
+            bool valid() const
+            {
+                return position_ < count_;
+            }
+
+            uint32_t doc() const
+            {
+                return ids_[position_];
+            }
+
+            void next()
+            {
+                if (++position_ == count_)
+                {
+                    load(block_ + 1);
+                }
+            }
+
+            // Move to the first id >= target
+            void seek(uint32_t target)
+            {
+                if (!valid() || ids_[position_] >= target)
+                {
+                    return;
+                }
+
+                if (list_->block_last_[block_] < target)
+                {
+                    auto begin = list_->block_last_.begin() + block_ + 1;
+                    auto it = std::lower_bound(begin, list_->block_last_.end(), target);
+                    load(it - list_->block_last_.begin());
+                    if (!valid())
+                    {
+                        return;
+                    }
+                }
+
+                position_ = std::lower_bound(ids_.begin() + position_, ids_.begin() + count_, target) - ids_.begin();
+            }
+        };
+
+        Cursor cursor() const
+        {
+            return Cursor(this);
+        }
+    };
+
+    enum class Representation : uint8_t
+    {
+        SkipList,
+        Compressed,
+        Bitmap,
+    };
+
+    inline const char *representation_name(Representation representation)
+    {
+        switch (representation)
+        {
+        case Representation::SkipList:
+            return "skip list";
+        case Representation::Compressed:
+            return "compressed";
+        case Representation::Bitmap:
+            return "roaring bitmap";
+        }
+        return "unknown";
+    }
+
+    // Posting list of one term. It is a skip list while the index is being
+    // built and becomes a CompressedPostingList or, for frequent terms, a
+    // RoaringBitmap after compress(); updating a compressed list turns it back
+    // into a skip list until the next compress()
+    template <typename DocId>
+    class PostingList
+    {
+    private:
+        using SkipListType = skiplist::SkipList<DocId>;
+
+        Representation representation_;
+        std::unique_ptr<SkipListType> skip_list_;
+        CompressedPostingList compressed_;
+        roaring::RoaringBitmap bitmap_;
+        uint32_t term_id_ = 0;
+
+        std::vector<uint32_t> ids() const
+        {
+            std::vector<uint32_t> result;
+            if constexpr (is_compressible_v<DocId>)
+            {
+                result.reserve(size());
+                for (auto it = cursor(); it.valid(); it.next())
+                {
+                    result.push_back(static_cast<uint32_t>(it.doc()));
+                }
+            }
+            return result;
+        }
+
+        void decompress()
+        {
+            if (representation_ == Representation::SkipList)
+            {
+                return;
+            }
+
+            skip_list_ = std::make_unique<SkipListType>();
+            if constexpr (is_compressible_v<DocId>)
+            {
+                auto decoded = representation_ == Representation::Compressed ? compressed_.decode() : bitmap_.to_vector();
+                for (uint32_t id : decoded)
+                {
+                    skip_list_->insert(static_cast<DocId>(id));
+                }
+            }
+            compressed_ = CompressedPostingList();
+            bitmap_ = roaring::RoaringBitmap();
+            representation_ = Representation::SkipList;
+        }
+
+    public:
+        PostingList() : representation_(Representation::SkipList), skip_list_(std::make_unique<SkipListType>()) {}
+
+        // Compressed list of ascending ids, built without an intermediate skip list
+        static PostingList from_sorted(const std::vector<DocId> &ids)
+        {
+            static_assert(is_compressible_v<DocId>, "only unsigned 32-bit doc ids can be compressed");
+
+            PostingList list;
+            list.compressed_ = CompressedPostingList::encode_best(std::vector<uint32_t>(ids.begin(), ids.end()));
+            list.skip_list_.reset();
+            list.representation_ = Representation::Compressed;
+            return list;
+        }
+
+        bool insert(const DocId &doc_id)
+        {
+            if constexpr (is_compressible_v<DocId>)
+            {
+                // Bitmaps take inserts in place
+                if (representation_ == Representation::Bitmap)
+                {
+                    return bitmap_.insert(static_cast<uint32_t>(doc_id));
+                }
+            }
+            decompress();
+            return skip_list_->insert(doc_id);
+        }
+
+        bool remove(const DocId &doc_id)
+        {
+            if (!contains(doc_id))
+            {
+                return false;
+            }
+            if constexpr (is_compressible_v<DocId>)
+            {
+                if (representation_ == Representation::Bitmap)
+                {
+                    return bitmap_.remove(static_cast<uint32_t>(doc_id));
+                }
+            }
+            decompress();
+            return skip_list_->remove(doc_id);
+        }
+
+        bool contains(const DocId &doc_id) const
+        {
+            if (representation_ == Representation::SkipList)
+            {
+                return skip_list_->search(doc_id);
+            }
+            if constexpr (is_compressible_v<DocId>)
+            {
+                if (representation_ == Representation::Bitmap)
+                {
+                    return bitmap_.contains(static_cast<uint32_t>(doc_id));
+                }
+                return compressed_.contains(static_cast<uint32_t>(doc_id));
+            }
+            return false;
+        }
+
+        std::size_t size() const
+        {
+            switch (representation_)
+            {
+            case Representation::SkipList:
+                return skip_list_->size();
+            case Representation::Compressed:
+                return compressed_.size();
+            case Representation::Bitmap:
+                return bitmap_.cardinality();
+            }
+            return 0;
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        Representation representation() const
+        {
+            return representation_;
+        }
+
+        // Id of the term whose postings these are, 0 for lists of no single
+        // term such as bigrams and materialized intersections
+        uint32_t term_id() const
+        {
+            return term_id_;
+        }
+
+        void set_term_id(uint32_t term_id)
+        {
+            term_id_ = term_id;
+        }
+
+        bool is_compressed() const
+        {
+            return representation_ != Representation::SkipList;
+        }
+
+        // Compressed form, nullptr unless the list is delta encoded
+        const CompressedPostingList *compressed() const
+        {
+            return representation_ == Representation::Compressed ? &compressed_ : nullptr;
+        }
+
+        // Bitmap form, nullptr unless the list is a roaring bitmap
+        const roaring::RoaringBitmap *bitmap() const
+        {
+            return representation_ == Representation::Bitmap ? &bitmap_ : nullptr;
+        }
+
+        // Convert to the delta-encoded form, picking the smallest codec
+        void compress()
+        {
+            static_assert(is_compressible_v<DocId>, "only unsigned 32-bit doc ids can be compressed");
+            if (representation_ == Representation::Compressed)
+            {
+                return;
+            }
+
+            compressed_ = CompressedPostingList::encode_best(ids());
+            skip_list_.reset();
+            bitmap_ = roaring::RoaringBitmap();
+            representation_ = Representation::Compressed;
+        }
+
+        // Convert to a roaring bitmap, which is smaller and faster to
+        // intersect once a term covers a large share of the documents
+        void compress_to_bitmap()
+        {
+            static_assert(is_compressible_v<DocId>, "only unsigned 32-bit doc ids can be compressed");
+            if (representation_ == Representation::Bitmap)
+            {
+                return;
+            }
+
+            bitmap_ = roaring::RoaringBitmap::from_sorted(ids());
+            bitmap_.run_optimize();
+            skip_list_.reset();
+            compressed_ = CompressedPostingList();
+            representation_ = Representation::Bitmap;
+        }
+
+        // Rough memory footprint in bytes
+        std::size_t memory_bytes() const
+        {
+            switch (representation_)
+            {
+            case Representation::SkipList:
+                // A skip list node holds the id plus on average two forward pointers
+                return skip_list_->size() * (sizeof(DocId) + 2 * sizeof(void *));
+            case Representation::Compressed:
+                return compressed_.encoded_bytes();
+            case Representation::Bitmap:
+                return bitmap_.memory_bytes();
+            }
+            return 0;
+        }
+
+        // Ids at `count` evenly spaced ranks, all ids if the list is not longer.
+        // Compressed lists decode only the blocks holding sampled ranks
+        std::vector<DocId> sample(std::size_t count) const
+        {
+            std::vector<DocId> result;
+            sample_into(count, result);
+            return result;
+        }
+
+        // sample() appending to `result`, which may use any allocator
+        template <typename Result>
+        void sample_into(std::size_t count, Result &result) const
+        {
+            std::size_t total = size();
+            result.reserve(result.size() + std::min(count, total));
+            if (count >= total)
+            {
+                for (auto it = cursor(); it.valid(); it.next())
+                {
+                    result.push_back(it.doc());
+                }
+                return;
+            }
+
+            auto rank_of = [&](std::size_t i)
+            { return (2 * i + 1) * total / (2 * count); };
+
+            if constexpr (is_compressible_v<DocId>)
+            {
+                if (representation_ == Representation::Bitmap)
+                {
+                    for (std::size_t i = 0; i < count; i++)
+                    {
+                        result.push_back(static_cast<DocId>(bitmap_.select(rank_of(i))));
+                    }
+                    return;
+                }
+                if (representation_ == Representation::Compressed)
+                {
+                    std::array<uint32_t, codec::BLOCK_SIZE> block_ids;
+                    std::size_t decoded_block = compressed_.block_count();
+                    for (std::size_t i = 0; i < count; i++)
+                    {
+                        std::size_t rank = rank_of(i);
+                        std::size_t block = rank / codec::BLOCK_SIZE;
+                        if (block != decoded_block)
+                        {
+                            compressed_.decode_block(block, block_ids.data());
+                            decoded_block = block;
+                        }
+                        result.push_back(static_cast<DocId>(block_ids[rank % codec::BLOCK_SIZE]));
+                    }
+                    return;
+                }
+            }
+
+            std::size_t rank = 0;
+            std::size_t next = 0;
+            for (auto it = cursor(); it.valid() && next < count; it.next(), rank++)
+            {
+                if (rank == rank_of(next))
+                {
+                    result.push_back(it.doc());
+                    next++;
+                }
+            }
+        }
+
+        std::vector<DocId> to_vector() const
+        {
+            std::vector<DocId> result;
+            result.reserve(size());
+            for (auto it = cursor(); it.valid(); it.next())
+            {
+                result.push_back(it.doc());
+            }
+            return result;
+        }
+
+        // Forward cursor over any representation
+        class Cursor
+        {
+        private:
+            Representation representation_;
+            typename SkipListType::Iterator it_;
+            const SkipListType *skip_list_;
+            CompressedPostingList::Cursor compressed_;
+            roaring::RoaringBitmap::Cursor bitmap_;
+
+        public:
+            explicit Cursor(const PostingList *list)
+                : representation_(list->representation_), it_(nullptr), skip_list_(list->skip_list_.get()),
+                  compressed_(list->representation_ == Representation::Compressed ? &list->compressed_ : nullptr),
+                  bitmap_(list->representation_ == Representation::Bitmap ? &list->bitmap_ : nullptr)
+            {
+                if (skip_list_)
+                {
+                    it_ = skip_list_->begin();
+                }
+            }
+
+            bool valid() const
+            {
+                switch (representation_)
+                {
+                case Representation::SkipList:
+                    return it_ != skip_list_->end();
+                case Representation::Compressed:
+                    return compressed_.valid();
+                case Representation::Bitmap:
+                    return bitmap_.valid();
+                }
+                return false;
+            }
+
+            DocId doc() const
+            {
+                if (representation_ == Representation::SkipList)
+                {
+                    return *it_;
+                }
+                if constexpr (is_compressible_v<DocId>)
+                {
+                    return static_cast<DocId>(representation_ == Representation::Bitmap ? bitmap_.doc() : compressed_.doc());
+                }
+                return DocId{};
+            }
+
+            void next()
+            {
+                switch (representation_)
+                {
+                case Representation::SkipList:
+                    ++it_;
+                    break;
+                case Representation::Compressed:
+                    compressed_.next();
+                    break;
+                case Representation::Bitmap:
+                    bitmap_.next();
+                    break;
+                }
+            }
+
+            // Move to the first doc id >= target
+            void seek(const DocId &target)
+            {
+                if (representation_ == Representation::SkipList)
+                {
+                    if (it_ != skip_list_->end() && *it_ < target)
+                    {
+                        it_ = skip_list_->lower_bound(target);
+                    }
+                    return;
+                }
+                if constexpr (is_compressible_v<DocId>)
+                {
+                    if (representation_ == Representation::Bitmap)
+                    {
+                        bitmap_.seek(static_cast<uint32_t>(target));
+                    }
+                    else
+                    {
+                        compressed_.seek(static_cast<uint32_t>(target));
+                    }
+                }
+            }
+        };
+
+        Cursor cursor() const
+        {
+            return Cursor(this);
+        }
+    };
+
+} // namespace posting_list
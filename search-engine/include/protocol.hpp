@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace protocol
+{
+
+    // Binary frames are a 12 byte header followed by the payload:
+    //
+    //   uint32 payload length, uint32 request id, uint8 opcode, uint8 flags,
+    //   uint16 deadline in milliseconds, all big-endian
+    //
+    // A request deadline of 0 leaves the server default, responses carry 0.
+    // A response carries the request id of its request, so a client can keep
+    // many requests in flight on one connection and match answers in any
+    // order. Payloads are limited to MAX_PAYLOAD_BYTES, so the first byte of
+    // a frame is always zero and tells it apart from a text request
+    constexpr std::size_t HEADER_BYTES = 12;
+    constexpr uint32_t MAX_PAYLOAD_BYTES = 1 << 20;
+
+    enum class Opcode : uint8_t
+    {
+        // Requests, the payload is the text of the request
+        Search = 1,
+        Complete = 2,
+        Facets = 3,
+        // Newline separated text requests, answered with every response
+        // prefixed by its uint32 length in request order
+        Batch = 4,
+        // Responses
+        Ok = 0x80,
+        Error = 0x81,
+    };
+
+    struct Frame
+    {
+        uint32_t request_id = 0;
+        Opcode opcode = Opcode::Search;
+        uint8_t flags = 0;
+        // Time the client waits for the answer, 0 for the server default,
+        // which also caps it
+        uint16_t deadline_ms = 0;
+        // Points into the parsed buffer
+        std::string_view payload;
+    };
+
+    enum class ParseStatus
+    {
+        Complete,
+        // More bytes are needed
+        Incomplete,
+        // Payload length over the limit, the stream cannot be resynchronized
+        Invalid,
+    };
+
+    inline uint32_t read_u32(const unsigned char *data)
+    {
+        return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+               (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+    }
+
+    inline void write_u32(unsigned char *data, uint32_t value)
+    {
+        data[0] = static_cast<unsigned char>(value >> 24);
+        data[1] = static_cast<unsigned char>(value >> 16);
+        data[2] = static_cast<unsigned char>(value >> 8);
+        data[3] = static_cast<unsigned char>(value);
+    }
+
+    // Whether a connection starting with `first_byte` speaks binary frames
+    inline bool is_binary(unsigned char first_byte)
+    {
+        return first_byte == 0;
+    }
+
+    inline bool is_request(Opcode opcode)
+    {
+        return opcode == Opcode::Search || opcode == Opcode::Complete || opcode == Opcode::Facets || opcode == Opcode::Batch;
+    }
+
+    // Parse the frame at the start of `data`, setting `consumed` to its size
+    // when it is complete
+    inline ParseStatus parse_frame(const unsigned char *data, std::size_t size, Frame &frame, std::size_t &consumed)
+    {
+        if (size < HEADER_BYTES)
+        {
+            return ParseStatus::Incomplete;
+        }
+        uint32_t length = read_u32(data);
+        if (length > MAX_PAYLOAD_BYTES)
+        {
+            return ParseStatus::Invalid;
+        }
+        if (size < HEADER_BYTES + length)
+        {
+            return ParseStatus::Incomplete;
+        }
+
+        frame.request_id = read_u32(data + 4);
+        frame.opcode = static_cast<Opcode>(data[8]);
+        frame.flags = data[9];
+        frame.deadline_ms = static_cast<uint16_t>((data[10] << 8) | data[11]);
+        frame.payload = std::string_view(reinterpret_cast<const char *>(data) + HEADER_BYTES, length);
+        consumed = HEADER_BYTES + length;
+        return ParseStatus::Complete;
+    }
+
+    // Fill the HEADER_BYTES of a frame header for a payload of `length` bytes
+    inline void write_header(unsigned char *header, uint32_t request_id, Opcode opcode, uint32_t length,
+                             uint16_t deadline_ms = 0)
+    {
+        write_u32(header, length);
+        write_u32(header + 4, request_id);
+        header[8] = static_cast<unsigned char>(opcode);
+        header[9] = 0;
+        header[10] = static_cast<unsigned char>(deadline_ms >> 8);
+        header[11] = static_cast<unsigned char>(deadline_ms);
+    }
+
+    // Append a frame with `payload` to `out`. Payloads over the limit are
+    // cut, the caller keeps responses below it
+    inline void append_frame(std::string &out, uint32_t request_id, Opcode opcode, std::string_view payload,
+                             uint16_t deadline_ms = 0)
+    {
+        uint32_t length = static_cast<uint32_t>(std::min<std::size_t>(payload.size(), MAX_PAYLOAD_BYTES));
+        unsigned char header[HEADER_BYTES];
+        write_header(header, request_id, opcode, length, deadline_ms);
+        out.append(reinterpret_cast<const char *>(header), HEADER_BYTES);
+        out.append(payload.data(), length);
+    }
+
+    // Take the newline terminated text request at the start of `data`. At
+    // the end of the stream the rest counts as a request without a newline
+    inline bool next_line(const unsigned char *data, std::size_t size, bool end_of_stream,
+                          std::string_view &line, std::size_t &consumed)
+    {
+        const void *newline = std::memchr(data, '\n', size);
+        if (newline == nullptr)
+        {
+            if (!end_of_stream || size == 0)
+            {
+                return false;
+            }
+            line = std::string_view(reinterpret_cast<const char *>(data), size);
+            consumed = size;
+            return true;
+        }
+
+        std::size_t length = static_cast<std::size_t>(static_cast<const unsigned char *>(newline) - data);
+        line = std::string_view(reinterpret_cast<const char *>(data), length);
+        consumed = length + 1;
+        return true;
+    }
+
+} // namespace protocol
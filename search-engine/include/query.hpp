@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "arena.hpp"
+
+namespace query
+{
+
+    enum class Operator
+    {
+        And,
+        Or,
+        Phrase,
+        // Required terms and any term starting with `prefix`
+        Prefix,
+        // Raw `text` anywhere in the document
+        Substring,
+    };
+
+    struct Query
+    {
+        Operator op = Operator::And;
+        std::vector<std::string> terms;
+        // Terms that must not occur, from `-word` tokens
+        std::vector<std::string> excluded;
+        // Extra positions allowed between consecutive phrase terms
+        uint32_t slop = 0;
+        // Term prefix from a `word*` token
+        std::string prefix;
+        // Unstemmed pattern of a substring query
+        std::string text;
+        // Allowed `lastmod` range in milliseconds since epoch, from a
+        // `since:24h` token
+        int64_t lastmod_min = std::numeric_limits<int64_t>::min();
+        int64_t lastmod_max = std::numeric_limits<int64_t>::max();
+
+        // (field, value) facets from `site:habr.com` and `section:rbc.ru/politics` tokens
+        std::vector<std::pair<std::string, std::string>> facets;
+
+        bool has_lastmod_filter() const
+        {
+            return lastmod_min != std::numeric_limits<int64_t>::min() ||
+                   lastmod_max != std::numeric_limits<int64_t>::max();
+        }
+    };
+
+    /// @brief parse a raw client query into stemmed terms and an operator
+    /// @param text: `word word` for AND, `word -word` to exclude a word,
+    /// `"word word"` for a phrase, `"word word"~N` for a proximity query,
+    /// `word wor*` for the words and any word starting with `wor`,
+    /// `'text'` for documents containing the text as is. A `since:N` token
+    /// with an `m`, `h`, `d` or `w` unit keeps documents modified in that
+    /// time and `site:host` or `section:host/segment` tokens keep documents
+    /// from there. Filters do not apply to OR and substring queries
+    Query parse_query(const std::string &text);
+
+    /// @brief canonical text of a parsed query, equal for queries that always
+    /// match the same documents
+    /// @param query: AND and OR terms are sorted and deduplicated, phrase terms
+    /// keep their order, the prefix comes last
+    std::string cache_key(const Query &query);
+
+    /// @brief append ` term` for each of `terms` to a cache key, sorted and
+    /// deduplicated unless `keep_order`
+    /// @param key: any string, its memory resource holds the sorting scratch
+    template <typename String, typename Terms>
+    void append_terms(String &key, const Terms &terms, bool keep_order)
+    {
+        std::pmr::vector<std::string_view> sorted(arena::resource_of(key));
+        sorted.reserve(terms.size());
+        for (const auto &term : terms)
+        {
+            sorted.emplace_back(term);
+        }
+        if (!keep_order)
+        {
+            std::sort(sorted.begin(), sorted.end());
+            sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        }
+        for (std::string_view term : sorted)
+        {
+            key += ' ';
+            key.append(term.data(), term.size());
+        }
+    }
+
+    /// @brief whether `text` parses into an AND of its words and nothing
+    /// else, without phrase, substring, prefix, exclusion or filter syntax.
+    /// Conservative, some such queries are reported as not plain
+    inline bool is_plain(std::string_view text)
+    {
+        return text.find_first_of("\"'*:-") == std::string_view::npos;
+    }
+
+} // namespace query
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hashmap.hpp"
+
+namespace query_cache
+{
+
+    struct CacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // Misses on entries computed before the index last changed
+        uint64_t stale = 0;
+        uint64_t insertions = 0;
+        uint64_t evictions = 0;
+        // Results too large to be cached at all
+        uint64_t rejected = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+        std::size_t budget_bytes = 0;
+
+        double hit_rate() const
+        {
+            uint64_t lookups = hits + misses;
+            return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+        }
+    };
+
+    // Query results keyed by canonical query text. Keys are spread over
+    // independently locked shards, each a segmented LRU: new entries start in
+    // a probation segment and move to the protected segment on their second
+    // hit, so a burst of one-off queries cannot flush the popular ones.
+    // Entries remember the index generation they were computed at and are
+    // dropped when looked up under a newer one
+    template <typename DocId = uint32_t>
+    class QueryCache
+    {
+    private:
+        // Share of a shard budget reserved for entries hit at least twice
+        static constexpr double PROTECTED_SHARE = 0.8;
+        // Rough bookkeeping cost of one entry besides its key and ids
+        static constexpr std::size_t ENTRY_OVERHEAD = 96;
+
+        struct Entry
+        {
+            std::string key;
+            std::vector<DocId> ids;
+            uint64_t generation;
+            std::size_t bytes;
+            bool is_protected;
+        };
+
+        using EntryList = std::list<Entry>;
+
+        struct Shard
+        {
+            std::mutex mutex;
+            // Most recently used entries first
+            EntryList probation;
+            EntryList protected_entries;
+            hashmap::HashMap<std::string, typename EntryList::iterator> entries;
+            std::size_t probation_bytes = 0;
+            std::size_t protected_bytes = 0;
+        };
+
+        std::vector<std::unique_ptr<Shard>> shards_;
+        std::size_t shard_budget_;
+
+        std::atomic<uint64_t> hits_;
+        std::atomic<uint64_t> misses_;
+        std::atomic<uint64_t> stale_;
+        std::atomic<uint64_t> insertions_;
+        std::atomic<uint64_t> evictions_;
+        std::atomic<uint64_t> rejected_;
+
+        Shard &shard_for(std::string_view key) const
+        {
+            return *shards_[std::hash<std::string_view>{}(key) % shards_.size()];
+        }
+
+        static void erase(Shard &shard, typename EntryList::iterator it)
+        {
+            shard.entries.erase(it->key);
+            if (it->is_protected)
+            {
+                shard.protected_bytes -= it->bytes;
+                shard.protected_entries.erase(it);
+            }
+            else
+            {
+                shard.probation_bytes -= it->bytes;
+                shard.probation.erase(it);
+            }
+        }
+
+        // Move a probation entry that was hit again into the protected segment,
+        // demoting the least recently used protected entries back to probation
+        void promote(Shard &shard, typename EntryList::iterator it)
+        {
+            if (it->is_protected)
+            {
+                shard.protected_entries.splice(shard.protected_entries.begin(), shard.protected_entries, it);
+                return;
+            }
+
+            shard.probation_bytes -= it->bytes;
+            shard.protected_bytes += it->bytes;
+            it->is_protected = true;
+            shard.protected_entries.splice(shard.protected_entries.begin(), shard.probation, it);
+
+            std::size_t protected_budget = static_cast<std::size_t>(shard_budget_ * PROTECTED_SHARE);
+            while (shard.protected_bytes > protected_budget && shard.protected_entries.size() > 1)
+            {
+                auto demoted = std::prev(shard.protected_entries.end());
+                demoted->is_protected = false;
+                shard.protected_bytes -= demoted->bytes;
+                shard.probation_bytes += demoted->bytes;
+                shard.probation.splice(shard.probation.begin(), shard.protected_entries, demoted);
+            }
+        }
+
+        void evict(Shard &shard)
+        {
+            while (shard.probation_bytes + shard.protected_bytes > shard_budget_)
+            {
+                EntryList &victims = shard.probation.empty() ? shard.protected_entries : shard.probation;
+                erase(shard, std::prev(victims.end()));
+                evictions_++;
+            }
+        }
+
+    public:
+        QueryCache(std::size_t budget_bytes, std::size_t shard_count = 16)
+            : shard_budget_(budget_bytes / (shard_count == 0 ? 1 : shard_count)),
+              hits_(0), misses_(0), stale_(0), insertions_(0), evictions_(0), rejected_(0)
+        {
+            for (std::size_t i = 0; i < std::max<std::size_t>(shard_count, 1); i++)
+            {
+                shards_.push_back(std::make_unique<Shard>());
+            }
+        }
+
+        // Copy the cached ids of `key` into `out` if they were computed at
+        // index `generation`. A hit allocates only what `out` needs, nothing
+        // when it is in an arena or has the capacity
+        template <typename Out>
+        bool find(std::string_view key, uint64_t generation, Out &out)
+        {
+            Shard &shard = shard_for(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            auto *it_ptr = shard.entries.find_as(key);
+            if (it_ptr == nullptr)
+            {
+                misses_++;
+                return false;
+            }
+
+            auto it = *it_ptr;
+            if (it->generation != generation)
+            {
+                erase(shard, it);
+                stale_++;
+                misses_++;
+                return false;
+            }
+
+            out.assign(it->ids.begin(), it->ids.end());
+            promote(shard, it);
+            hits_++;
+            return true;
+        }
+
+        void insert(const std::string &key, uint64_t generation, std::vector<DocId> ids)
+        {
+            std::size_t bytes = ENTRY_OVERHEAD + 2 * key.size() + ids.size() * sizeof(DocId);
+            if (bytes > shard_budget_ - static_cast<std::size_t>(shard_budget_ * PROTECTED_SHARE))
+            {
+                // Would not fit in probation without flushing it
+                rejected_++;
+                return;
+            }
+
+            Shard &shard = shard_for(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            auto *existing = shard.entries.find(key);
+            if (existing != nullptr)
+            {
+                erase(shard, *existing);
+            }
+
+            shard.probation.push_front(Entry{key, std::move(ids), generation, bytes, false});
+            shard.probation_bytes += bytes;
+            shard.entries.insert(key, shard.probation.begin());
+            insertions_++;
+
+            evict(shard);
+        }
+
+        void clear()
+        {
+            for (auto &shard : shards_)
+            {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                shard->entries.clear();
+                shard->probation.clear();
+                shard->protected_entries.clear();
+                shard->probation_bytes = 0;
+                shard->protected_bytes = 0;
+            }
+        }
+
+        CacheStats stats() const
+        {
+            CacheStats result;
+            result.hits = hits_;
+            result.misses = misses_;
+            result.stale = stale_;
+            result.insertions = insertions_;
+            result.evictions = evictions_;
+            result.rejected = rejected_;
+            result.budget_bytes = shard_budget_ * shards_.size();
+            for (const auto &shard : shards_)
+            {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                result.entries += shard->entries.size();
+                result.bytes += shard->probation_bytes + shard->protected_bytes;
+            }
+            return result;
+        }
+    };
+
+} // namespace query_cache
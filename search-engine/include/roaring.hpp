@@ -0,0 +1,805 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace roaring
+{
+
+    // Roaring bitmap over 32-bit ids: ids are split by their high 16 bits into
+    // chunks of 65536, and every chunk is stored in whichever container is the
+    // smallest for its contents (sorted array, plain bitmap or runs)
+    class RoaringBitmap
+    {
+    public:
+        enum class ContainerType : uint8_t
+        {
+            Array,
+            Bitmap,
+            Run,
+        };
+
+    private:
+        static constexpr std::size_t ARRAY_MAX = 4096;
+        static constexpr std::size_t BITMAP_WORDS = 65536 / 64;
+
+        // Covers values start..start+length inclusive
+        struct Run
+        {
+            uint16_t start;
+            uint16_t length;
+        };
+
+        struct Container
+        {
+            ContainerType type = ContainerType::Array;
+            uint32_t cardinality = 0;
+            std::vector<uint16_t> array;
+            std::vector<uint64_t> bitmap;
+            std::vector<Run> runs;
+
+            bool contains(uint16_t value) const
+            {
+                switch (type)
+                {
+                case ContainerType::Array:
+                    return std::binary_search(array.begin(), array.end(), value);
+                case ContainerType::Bitmap:
+                    return (bitmap[value / 64] >> (value % 64)) & 1;
+                case ContainerType::Run:
+                {
+                    auto it = std::upper_bound(runs.begin(), runs.end(), value,
+                                               [](uint16_t v, const Run &run)
+                                               { return v < run.start; });
+                    if (it == runs.begin())
+                    {
+                        return false;
+                    }
+                    --it;
+                    return value <= static_cast<uint32_t>(it->start) + it->length;
+                }
+                }
+                return false;
+            }
+
+            // Value of the given rank, which must be below cardinality
+            uint16_t select(uint32_t rank) const
+            {
+                switch (type)
+                {
+                case ContainerType::Array:
+                    return array[rank];
+                case ContainerType::Bitmap:
+                    for (std::size_t word = 0; word < BITMAP_WORDS; word++)
+                    {
+                        uint32_t count = static_cast<uint32_t>(__builtin_popcountll(bitmap[word]));
+                        if (rank < count)
+                        {
+                            uint64_t bits = bitmap[word];
+                            for (; rank > 0; rank--)
+                            {
+                                bits &= bits - 1;
+                            }
+                            return static_cast<uint16_t>(word * 64 + __builtin_ctzll(bits));
+                        }
+                        rank -= count;
+                    }
+                    return 0;
+                case ContainerType::Run:
+                    for (const Run &run : runs)
+                    {
+                        if (rank <= run.length)
+                        {
+                            return static_cast<uint16_t>(run.start + rank);
+                        }
+                        rank -= run.length + 1;
+                    }
+                    return 0;
+                }
+                return 0;
+            }
+
+            // Largest value, the container must not be empty
+            uint16_t maximum() const
+            {
+                switch (type)
+                {
+                case ContainerType::Array:
+                    return array.back();
+                case ContainerType::Bitmap:
+                    for (std::size_t word = BITMAP_WORDS; word-- > 0;)
+                    {
+                        if (bitmap[word] != 0)
+                        {
+                            return static_cast<uint16_t>(word * 64 + 63 - __builtin_clzll(bitmap[word]));
+                        }
+                    }
+                    return 0;
+                case ContainerType::Run:
+                    return static_cast<uint16_t>(runs.back().start + runs.back().length);
+                }
+                return 0;
+            }
+
+            // Same values as a plain bitmap
+            std::vector<uint64_t> as_bitmap() const
+            {
+                if (type == ContainerType::Bitmap)
+                {
+                    return bitmap;
+                }
+
+                std::vector<uint64_t> words(BITMAP_WORDS, 0);
+                if (type == ContainerType::Array)
+                {
+                    for (uint16_t value : array)
+                    {
+                        words[value / 64] |= uint64_t{1} << (value % 64);
+                    }
+                }
+                else
+                {
+                    for (const Run &run : runs)
+                    {
+                        uint32_t end = static_cast<uint32_t>(run.start) + run.length;
+                        for (uint32_t value = run.start; value <= end; value++)
+                        {
+                            words[value / 64] |= uint64_t{1} << (value % 64);
+                        }
+                    }
+                }
+                return words;
+            }
+
+            std::vector<uint16_t> as_array() const
+            {
+                if (type == ContainerType::Array)
+                {
+                    return array;
+                }
+
+                std::vector<uint16_t> values;
+                values.reserve(cardinality);
+                for (uint32_t value = 0; next_at_least(value, value); value++)
+                {
+                    values.push_back(static_cast<uint16_t>(value));
+                }
+                return values;
+            }
+
+            void set_bitmap(std::vector<uint64_t> words)
+            {
+                type = ContainerType::Bitmap;
+                bitmap = std::move(words);
+                array.clear();
+                array.shrink_to_fit();
+                runs.clear();
+                runs.shrink_to_fit();
+
+                cardinality = 0;
+                for (uint64_t word : bitmap)
+                {
+                    cardinality += static_cast<uint32_t>(__builtin_popcountll(word));
+                }
+            }
+
+            void set_array(std::vector<uint16_t> values)
+            {
+                type = ContainerType::Array;
+                cardinality = static_cast<uint32_t>(values.size());
+                array = std::move(values);
+                bitmap.clear();
+                bitmap.shrink_to_fit();
+                runs.clear();
+                runs.shrink_to_fit();
+            }
+
+            // Turn a sparse bitmap into an array
+            void normalize()
+            {
+                if (type == ContainerType::Bitmap && cardinality <= ARRAY_MAX)
+                {
+                    set_array(as_array());
+                }
+            }
+
+            // Switch to runs when they are smaller than the current container
+            void run_optimize()
+            {
+                std::vector<Run> candidate;
+                for (uint32_t value = 0; next_at_least(value, value); value++)
+                {
+                    if (!candidate.empty() &&
+                        static_cast<uint32_t>(candidate.back().start) + candidate.back().length + 1 == value)
+                    {
+                        candidate.back().length++;
+                    }
+                    else
+                    {
+                        candidate.push_back({static_cast<uint16_t>(value), 0});
+                    }
+                }
+
+                if (candidate.size() * sizeof(Run) < memory_bytes())
+                {
+                    type = ContainerType::Run;
+                    runs = std::move(candidate);
+                    array.clear();
+                    array.shrink_to_fit();
+                    bitmap.clear();
+                    bitmap.shrink_to_fit();
+                }
+            }
+
+            bool add(uint16_t value)
+            {
+                if (contains(value))
+                {
+                    return false;
+                }
+
+                if (type == ContainerType::Run)
+                {
+                    set_array(as_array());
+                }
+
+                if (type == ContainerType::Array)
+                {
+                    if (array.size() < ARRAY_MAX)
+                    {
+                        array.insert(std::lower_bound(array.begin(), array.end(), value), value);
+                        cardinality++;
+                        return true;
+                    }
+                    set_bitmap(as_bitmap());
+                }
+
+                bitmap[value / 64] |= uint64_t{1} << (value % 64);
+                cardinality++;
+                return true;
+            }
+
+            bool remove(uint16_t value)
+            {
+                if (!contains(value))
+                {
+                    return false;
+                }
+
+                if (type == ContainerType::Run)
+                {
+                    set_bitmap(as_bitmap());
+                }
+
+                if (type == ContainerType::Array)
+                {
+                    array.erase(std::lower_bound(array.begin(), array.end(), value));
+                    cardinality--;
+                    return true;
+                }
+
+                bitmap[value / 64] &= ~(uint64_t{1} << (value % 64));
+                cardinality--;
+                normalize();
+                return true;
+            }
+
+            // Smallest value >= low, false if there is none
+            bool next_at_least(uint32_t low, uint32_t &out) const
+            {
+                if (low > 0xFFFF)
+                {
+                    return false;
+                }
+
+                switch (type)
+                {
+                case ContainerType::Array:
+                {
+                    auto it = std::lower_bound(array.begin(), array.end(), low);
+                    if (it == array.end())
+                    {
+                        return false;
+                    }
+                    out = *it;
+                    return true;
+                }
+                case ContainerType::Bitmap:
+                {
+                    std::size_t word = low / 64;
+                    uint64_t bits = bitmap[word] & (~uint64_t{0} << (low % 64));
+                    while (bits == 0)
+                    {
+                        if (++word == BITMAP_WORDS)
+                        {
+                            return false;
+                        }
+                        bits = bitmap[word];
+                    }
+                    out = static_cast<uint32_t>(word * 64 + __builtin_ctzll(bits));
+                    return true;
+                }
+                case ContainerType::Run:
+                {
+                    // Runs are disjoint and sorted, so their ends are sorted too
+                    auto it = std::lower_bound(runs.begin(), runs.end(), low,
+                                               [](const Run &run, uint32_t v)
+                                               { return static_cast<uint32_t>(run.start) + run.length < v; });
+                    if (it == runs.end())
+                    {
+                        return false;
+                    }
+                    out = std::max<uint32_t>(it->start, low);
+                    return true;
+                }
+                }
+                return false;
+            }
+
+            std::size_t memory_bytes() const
+            {
+                return array.size() * sizeof(uint16_t) + bitmap.size() * sizeof(uint64_t) + runs.size() * sizeof(Run);
+            }
+        };
+
+        static Container and_containers(const Container &a, const Container &b)
+        {
+            Container result;
+            if (a.type == ContainerType::Array || b.type == ContainerType::Array)
+            {
+                const Container &small = a.type == ContainerType::Array ? a : b;
+                const Container &other = a.type == ContainerType::Array ? b : a;
+
+                std::vector<uint16_t> values;
+                for (uint16_t value : small.array)
+                {
+                    if (other.contains(value))
+                    {
+                        values.push_back(value);
+                    }
+                }
+                result.set_array(std::move(values));
+                return result;
+            }
+
+            std::vector<uint64_t> words = a.as_bitmap();
+            std::vector<uint64_t> other = b.as_bitmap();
+            for (std::size_t i = 0; i < BITMAP_WORDS; i++)
+            {
+                words[i] &= other[i];
+            }
+            result.set_bitmap(std::move(words));
+            result.normalize();
+            return result;
+        }
+
+        static Container or_containers(const Container &a, const Container &b)
+        {
+            Container result;
+            if (a.type == ContainerType::Array && b.type == ContainerType::Array &&
+                a.cardinality + b.cardinality <= ARRAY_MAX)
+            {
+                std::vector<uint16_t> values;
+                values.reserve(a.cardinality + b.cardinality);
+                std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(values));
+                result.set_array(std::move(values));
+                return result;
+            }
+
+            std::vector<uint64_t> words = a.as_bitmap();
+            std::vector<uint64_t> other = b.as_bitmap();
+            for (std::size_t i = 0; i < BITMAP_WORDS; i++)
+            {
+                words[i] |= other[i];
+            }
+            result.set_bitmap(std::move(words));
+            result.normalize();
+            return result;
+        }
+
+        static Container and_not_containers(const Container &a, const Container &b)
+        {
+            Container result;
+            if (a.type == ContainerType::Array)
+            {
+                std::vector<uint16_t> values;
+                for (uint16_t value : a.array)
+                {
+                    if (!b.contains(value))
+                    {
+                        values.push_back(value);
+                    }
+                }
+                result.set_array(std::move(values));
+                return result;
+            }
+
+            std::vector<uint64_t> words = a.as_bitmap();
+            std::vector<uint64_t> other = b.as_bitmap();
+            for (std::size_t i = 0; i < BITMAP_WORDS; i++)
+            {
+                words[i] &= ~other[i];
+            }
+            result.set_bitmap(std::move(words));
+            result.normalize();
+            return result;
+        }
+
+        static std::size_t and_cardinality_containers(const Container &a, const Container &b)
+        {
+            if (a.type == ContainerType::Array || b.type == ContainerType::Array)
+            {
+                const Container &small = a.type == ContainerType::Array ? a : b;
+                const Container &other = a.type == ContainerType::Array ? b : a;
+
+                std::size_t count = 0;
+                for (uint16_t value : small.array)
+                {
+                    count += other.contains(value);
+                }
+                return count;
+            }
+
+            if (a.type == ContainerType::Bitmap && b.type == ContainerType::Bitmap)
+            {
+                std::size_t count = 0;
+                for (std::size_t i = 0; i < BITMAP_WORDS; i++)
+                {
+                    count += __builtin_popcountll(a.bitmap[i] & b.bitmap[i]);
+                }
+                return count;
+            }
+            return and_containers(a, b).cardinality;
+        }
+
+        std::vector<uint16_t> keys_;
+        std::vector<Container> containers_;
+
+        // Index of the container for `key`, or where it would be inserted
+        std::size_t container_index(uint16_t key) const
+        {
+            return std::lower_bound(keys_.begin(), keys_.end(), key) - keys_.begin();
+        }
+
+        void append(uint16_t key, Container container)
+        {
+            if (container.cardinality > 0)
+            {
+                keys_.push_back(key);
+                containers_.push_back(std::move(container));
+            }
+        }
+
+    public:
+        RoaringBitmap() = default;
+
+        // Build from ascending unique ids
+        static RoaringBitmap from_sorted(const std::vector<uint32_t> &ids)
+        {
+            RoaringBitmap result;
+            std::size_t begin = 0;
+            while (begin < ids.size())
+            {
+                uint16_t key = static_cast<uint16_t>(ids[begin] >> 16);
+                std::size_t end = begin;
+                while (end < ids.size() && (ids[end] >> 16) == key)
+                {
+                    end++;
+                }
+
+                Container container;
+                if (end - begin <= ARRAY_MAX)
+                {
+                    std::vector<uint16_t> values;
+                    values.reserve(end - begin);
+                    for (std::size_t i = begin; i < end; i++)
+                    {
+                        values.push_back(static_cast<uint16_t>(ids[i]));
+                    }
+                    container.set_array(std::move(values));
+                }
+                else
+                {
+                    std::vector<uint64_t> words(BITMAP_WORDS, 0);
+                    for (std::size_t i = begin; i < end; i++)
+                    {
+                        uint16_t low = static_cast<uint16_t>(ids[i]);
+                        words[low / 64] |= uint64_t{1} << (low % 64);
+                    }
+                    container.set_bitmap(std::move(words));
+                }
+                result.append(key, std::move(container));
+                begin = end;
+            }
+            return result;
+        }
+
+        bool insert(uint32_t id)
+        {
+            uint16_t key = static_cast<uint16_t>(id >> 16);
+            std::size_t index = container_index(key);
+            if (index == keys_.size() || keys_[index] != key)
+            {
+                keys_.insert(keys_.begin() + index, key);
+                containers_.insert(containers_.begin() + index, Container());
+            }
+            return containers_[index].add(static_cast<uint16_t>(id));
+        }
+
+        bool remove(uint32_t id)
+        {
+            uint16_t key = static_cast<uint16_t>(id >> 16);
+            std::size_t index = container_index(key);
+            if (index == keys_.size() || keys_[index] != key)
+            {
+                return false;
+            }
+
+            bool removed = containers_[index].remove(static_cast<uint16_t>(id));
+            if (containers_[index].cardinality == 0)
+            {
+                keys_.erase(keys_.begin() + index);
+                containers_.erase(containers_.begin() + index);
+            }
+            return removed;
+        }
+
+        bool contains(uint32_t id) const
+        {
+            uint16_t key = static_cast<uint16_t>(id >> 16);
+            std::size_t index = container_index(key);
+            return index < keys_.size() && keys_[index] == key && containers_[index].contains(static_cast<uint16_t>(id));
+        }
+
+        std::size_t cardinality() const
+        {
+            std::size_t total = 0;
+            for (const auto &container : containers_)
+            {
+                total += container.cardinality;
+            }
+            return total;
+        }
+
+        bool empty() const
+        {
+            return containers_.empty();
+        }
+
+        // Convert containers to runs wherever that is smaller
+        void run_optimize()
+        {
+            for (auto &container : containers_)
+            {
+                container.run_optimize();
+            }
+        }
+
+        std::size_t memory_bytes() const
+        {
+            std::size_t total = keys_.size() * sizeof(uint16_t) + containers_.size() * sizeof(Container);
+            for (const auto &container : containers_)
+            {
+                total += container.memory_bytes();
+            }
+            return total;
+        }
+
+        // Id of the given rank in ascending order, which must be below cardinality()
+        uint32_t select(std::size_t rank) const
+        {
+            for (std::size_t i = 0; i < containers_.size(); i++)
+            {
+                if (rank < containers_[i].cardinality)
+                {
+                    return static_cast<uint32_t>(keys_[i]) << 16 | containers_[i].select(static_cast<uint32_t>(rank));
+                }
+                rank -= containers_[i].cardinality;
+            }
+            return 0;
+        }
+
+        // Largest id, the bitmap must not be empty
+        uint32_t maximum() const
+        {
+            return static_cast<uint32_t>(keys_.back()) << 16 | containers_.back().maximum();
+        }
+
+        std::size_t container_count() const
+        {
+            return containers_.size();
+        }
+
+        std::size_t container_count(ContainerType type) const
+        {
+            return std::count_if(containers_.begin(), containers_.end(),
+                                 [type](const Container &container)
+                                 { return container.type == type; });
+        }
+
+        std::vector<uint32_t> to_vector() const
+        {
+            std::vector<uint32_t> result;
+            result.reserve(cardinality());
+            for (auto it = cursor(); it.valid(); it.next())
+            {
+                result.push_back(it.doc());
+            }
+            return result;
+        }
+
+        RoaringBitmap operator&(const RoaringBitmap &other) const
+        {
+            RoaringBitmap result;
+            std::size_t i = 0, j = 0;
+            while (i < keys_.size() && j < other.keys_.size())
+            {
+                if (keys_[i] < other.keys_[j])
+                {
+                    i++;
+                }
+                else if (keys_[i] > other.keys_[j])
+                {
+                    j++;
+                }
+                else
+                {
+                    result.append(keys_[i], and_containers(containers_[i], other.containers_[j]));
+                    i++;
+                    j++;
+                }
+            }
+            return result;
+        }
+
+        RoaringBitmap operator|(const RoaringBitmap &other) const
+        {
+            RoaringBitmap result;
+            std::size_t i = 0, j = 0;
+            while (i < keys_.size() || j < other.keys_.size())
+            {
+                if (j == other.keys_.size() || (i < keys_.size() && keys_[i] < other.keys_[j]))
+                {
+                    result.append(keys_[i], containers_[i]);
+                    i++;
+                }
+                else if (i == keys_.size() || keys_[i] > other.keys_[j])
+                {
+                    result.append(other.keys_[j], other.containers_[j]);
+                    j++;
+                }
+                else
+                {
+                    result.append(keys_[i], or_containers(containers_[i], other.containers_[j]));
+                    i++;
+                    j++;
+                }
+            }
+            return result;
+        }
+
+        // Ids in this bitmap but not in `other`
+        RoaringBitmap and_not(const RoaringBitmap &other) const
+        {
+            RoaringBitmap result;
+            std::size_t j = 0;
+            for (std::size_t i = 0; i < keys_.size(); i++)
+            {
+                while (j < other.keys_.size() && other.keys_[j] < keys_[i])
+                {
+                    j++;
+                }
+
+                if (j < other.keys_.size() && other.keys_[j] == keys_[i])
+                {
+                    result.append(keys_[i], and_not_containers(containers_[i], other.containers_[j]));
+                }
+                else
+                {
+                    result.append(keys_[i], containers_[i]);
+                }
+            }
+            return result;
+        }
+
+        // Size of the intersection without materializing it
+        std::size_t and_cardinality(const RoaringBitmap &other) const
+        {
+            std::size_t count = 0;
+            std::size_t i = 0, j = 0;
+            while (i < keys_.size() && j < other.keys_.size())
+            {
+                if (keys_[i] < other.keys_[j])
+                {
+                    i++;
+                }
+                else if (keys_[i] > other.keys_[j])
+                {
+                    j++;
+                }
+                else
+                {
+                    count += and_cardinality_containers(containers_[i], other.containers_[j]);
+                    i++;
+                    j++;
+                }
+            }
+            return count;
+        }
+
+        class Cursor
+        {
+        private:
+            const RoaringBitmap *bitmap_;
+            std::size_t container_;
+            uint32_t low_;
+
+            // Settle on the first value >= low_ starting at container_
+            void settle()
+            {
+                while (bitmap_ != nullptr && container_ < bitmap_->containers_.size())
+                {
+                    if (bitmap_->containers_[container_].next_at_least(low_, low_))
+                    {
+                        return;
+                    }
+                    container_++;
+                    low_ = 0;
+                }
+            }
+
+        public:
+            // A null bitmap gives an exhausted cursor
+            explicit Cursor(const RoaringBitmap *bitmap) : bitmap_(bitmap), container_(0), low_(0)
+            {
+                settle();
+            }
+
+            bool valid() const
+            {
+                return bitmap_ != nullptr && container_ < bitmap_->containers_.size();
+            }
+
+            uint32_t doc() const
+            {
+                return static_cast<uint32_t>(bitmap_->keys_[container_]) << 16 | low_;
+            }
+
+            void next()
+            {
+                low_++;
+                settle();
+            }
+
+            // Move to the first id >= target
+            void seek(uint32_t target)
+            {
+                if (!valid() || doc() >= target)
+                {
+                    return;
+                }
+
+                uint16_t key = static_cast<uint16_t>(target >> 16);
+                if (bitmap_->keys_[container_] < key)
+                {
+                    auto begin = bitmap_->keys_.begin() + container_;
+                    container_ = std::lower_bound(begin, bitmap_->keys_.end(), key) - bitmap_->keys_.begin();
+                    low_ = 0;
+                }
+                if (valid() && bitmap_->keys_[container_] == key)
+                {
+                    low_ = target & 0xFFFF;
+                }
+                settle();
+            }
+        };
+
+        Cursor cursor() const
+        {
+            return Cursor(this);
+        }
+    };
+
+} // namespace roaring
@@ -2,47 +2,411 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstring>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
-#include <sys/select.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <csignal>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
 #include <spdlog/spdlog.h>
 
+#include "arena.hpp"
 #include "boolean_index.hpp"
+#include "deadline.hpp"
+#include "document_store.hpp"
+#include "event_loop.hpp"
+#include "hashmap.hpp"
+#include "http.hpp"
+#include "output_buffer.hpp"
+#include "protocol.hpp"
+#include "query.hpp"
+#include "query_cache.hpp"
+#include "thread_pool.hpp"
+#include "trigram_index.hpp"
+#ifdef SEARCH_ENGINE_IO_URING
+#include "uring_loop.hpp"
+#endif
+
+/// @brief how event loops wait for sockets
+enum class IoBackend
+{
+    /// @brief readiness from edge-triggered epoll, then a read per socket
+    Epoll,
+    /// @brief completions from io_uring with multishot accepts and receives,
+    /// epoll is used instead where the build or kernel lacks it
+    IoUring,
+};
+
+struct ServerOptions
+{
+    /// @brief event loop threads, each with its own listening socket on the
+    /// port, the kernel spreads new connections between them
+    std::size_t reactors = 1;
+    /// @brief threads evaluating queries, 0 to evaluate them on the event
+    /// loop that received them
+    std::size_t query_workers = 0;
+    /// @brief queries of one event loop waiting for a worker, beyond that
+    /// the event loop evaluates them itself and stops reading meanwhile
+    std::size_t max_queued_queries = 256;
+    /// @brief unsent response bytes of a connection before its requests are
+    /// no longer read
+    std::size_t max_output_bytes = 4 << 20;
+    IoBackend backend = IoBackend::Epoll;
+    /// @brief time a request may take from its arrival, 0 for no limit.
+    /// Clients may ask for less, not more. Later answers are replaced by a
+    /// timed out error
+    uint32_t request_timeout_ms = 1000;
+    /// @brief answer overloaded instead of evaluating on the event loop when
+    /// every query worker queue is full
+    bool shed_load = false;
+    /// @brief postings a query may be estimated to walk before it is refused
+    /// as overloaded, 0 for no limit
+    std::size_t max_query_cost = 0;
+    /// @brief time a new client may stay silent before it is taken for a
+    /// text client and greeted, text clients may wait for the greeting
+    /// before they send. 0 greets every client on accept as a text client,
+    /// binary and HTTP clients are then not told apart
+    uint32_t greeting_delay_ms = 50;
+};
+
+/// @brief how a connection delimits requests, told by its first byte
+enum class WireFormat
+{
+    Unknown,
+    /// @brief one request per line, answered in order
+    Text,
+    /// @brief protocol frames, answered in any order with their request ids
+    Binary,
+    /// @brief HTTP/1.1 GET requests with JSON responses, answered in order
+    Http,
+};
+
+/// @brief state of one client connection
+struct Connection
+{
+    int fd;
+    /// @brief tells apart connections that got the same fd
+    uint64_t id;
+    WireFormat format = WireFormat::Unknown;
+    /// @brief bytes received and not yet parsed into requests
+    std::vector<unsigned char> input;
+    /// @brief responses not yet accepted by the socket
+    output_buffer::OutputQueue output;
+    /// @brief requests handed to query workers and not answered yet
+    std::size_t pending = 0;
+    /// @brief waiting for the socket to become writable
+    bool writing = false;
+    /// @brief too much output is queued, input is left unread
+    bool paused = false;
+    /// @brief the client hung up, close once pending responses are sent
+    bool closing = false;
+    /// @brief a multishot receive is armed on the io_uring backend
+    bool receiving = false;
+    /// @brief the last request was taken, later input is dropped
+    bool input_done = false;
+    /// @brief closed during the current event batch, its later events in
+    /// the batch are skipped
+    bool closed = false;
+    /// @brief the text protocol greeting was queued
+    bool greeted = false;
+};
+
+/// @brief connection still silent since its accept, greeted as a text
+/// client at `due`
+struct SilentConnection
+{
+    int fd;
+    uint64_t connection_id;
+    std::chrono::steady_clock::time_point due;
+};
+
+/// @brief request taken off a connection
+struct Request
+{
+    int fd;
+    uint64_t connection_id;
+    WireFormat format;
+    uint32_t request_id;
+    protocol::Opcode opcode;
+    /// @brief text line, frame payload, or HTTP method and target
+    std::string payload;
+    /// @brief false if the HTTP client asked to close after this request
+    bool keep_alive = true;
+    /// @brief when the answer is due, counted from the request's arrival
+    deadline::Deadline deadline;
+};
+
+/// @brief requests answered with an error instead of results
+struct RequestStats
+{
+    /// @brief past their deadline, waiting or evaluating
+    uint64_t timed_out = 0;
+    /// @brief refused for a full queue or an expensive query
+    uint64_t overloaded = 0;
+};
+
+/// @brief documents matching a query and how many match in total
+struct SearchResult
+{
+    std::vector<uint32_t> documents;
+    /// @brief exact unless `documents` was cut at the response limit
+    cardinality::Estimate count;
+    bool cached = false;
+};
+
+/// @brief hits and count of a query of plain words, all of it in one memory
+/// resource
+struct PlainSearch
+{
+    explicit PlainSearch(std::pmr::memory_resource *memory) : terms(memory), cache_key(memory), documents(memory) {}
+
+    std::pmr::vector<std::pmr::string> terms;
+    /// @brief same key as query::cache_key of the parsed query
+    std::pmr::string cache_key;
+    std::pmr::vector<uint32_t> documents;
+    cardinality::Estimate count;
+    /// @brief index generation `documents` was computed at
+    uint64_t generation = 0;
+    bool cached = false;
+};
+
+/// @brief response computed by a query worker for a connection
+struct CompletedRequest
+{
+    int fd;
+    uint64_t connection_id;
+    output_buffer::Message response;
+};
+
+/// @brief event loop thread with its own listening socket and connections
+struct Reactor
+{
+    std::size_t index = 0;
+    int listen_fd = -1;
+    /// @brief eventfd query workers signal when they complete a request
+    int wake_fd = -1;
+    /// @brief the epoll set, or nullptr when `ring` serves the reactor
+    std::unique_ptr<event_loop::EpollLoop> loop;
+#ifdef SEARCH_ENGINE_IO_URING
+    std::unique_ptr<uring::UringLoop> ring;
+    /// @brief counter the ring reads from `wake_fd`
+    uint64_t wake_count = 0;
+#endif
+    /// @brief open connections by fd, the loop hands out pointers to them
+    hashmap::HashMap<int, std::unique_ptr<Connection>> connections;
+    /// @brief connections closed during the current event batch, kept until
+    /// it ends since events later in the batch still point at them
+    std::vector<std::unique_ptr<Connection>> closed;
+    /// @brief connections waiting for their greeting, oldest first
+    std::deque<SilentConnection> silent;
+    uint64_t next_connection_id = 0;
+
+    std::mutex completed_mutex;
+    std::vector<CompletedRequest> completed;
+    std::atomic<std::size_t> queued{0};
+};
 
 class MinimalAsyncServer
 {
 private:
-    int server_fd_;
     int port_;
-    fd_set master_fds_;
-    int max_fd_;
-    std::vector<int> client_fds_;
-    boolean_index::BooleanIndex<std::string> &index_;
+    ServerOptions options_;
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+    std::unique_ptr<thread_pool::ThreadPool> workers_;
+    boolean_index::BooleanIndex<uint32_t> &index_;
+    const document_store::DocumentStore<uint32_t> &documents_;
 
     int64_t max_response_count_;
 
+    query_cache::QueryCache<uint32_t> cache_;
+
+    const trigram_index::TrigramIndex<uint32_t> *trigrams_;
+
+    std::atomic<uint64_t> timed_out_{0};
+    std::atomic<uint64_t> overloaded_{0};
+
+    /// @brief parse a query and correct its misspelled required terms
+    /// @param any_term: match documents with any of the plain terms
+    query::Query parse_request(const std::string &text, bool any_term = false) const;
+
+    /// @brief evaluate a parsed query through the result cache
+    /// @param terms: posting lists looked up for a batch, nullptr to look them up
+    /// @param deadline: nullptr for no limit
+    /// @throws deadline::TimedOut past `deadline`, deadline::Overloaded if
+    /// the query is estimated over the cost limit
+    SearchResult search(const query::Query &parsed, const boolean_index::ResolvedTerms<uint32_t> *terms = nullptr,
+                        const deadline::Deadline *deadline = nullptr);
+
+    /// @brief count line and a line per hit of a search
+    output_buffer::Message format_search(const SearchResult &found) const;
+
+    /// @brief format_search of `size` hits at `documents`
+    output_buffer::Message format_hits(const cardinality::Estimate &count, const uint32_t *documents, std::size_t size) const;
+
+    /// @brief answer a query of plain words by evaluate_plain() in the
+    /// request arena, only the response and cached ids go to the heap
+    /// @return false if the query needs the general path
+    /// @throws deadline::TimedOut, deadline::Overloaded as search() does
+    bool search_plain(std::string_view text, const deadline::Deadline *deadline, output_buffer::Message &response);
+
+    /// @brief number of documents per site matching a parsed query, one
+    /// `site count` line each
+    /// @param terms: posting lists looked up for a batch, nullptr to look them up
+    /// @throws deadline::TimedOut past `deadline`
+    output_buffer::Message facet_counts(const query::Query &parsed, const boolean_index::ResolvedTerms<uint32_t> *terms = nullptr,
+                                        const deadline::Deadline *deadline = nullptr);
+
+    /// @brief answer `/search` with a JSON object of the count and hits
+    /// @param query: query string of the request target
+    output_buffer::Message handle_http_search(std::string_view query, bool keep_alive, const deadline::Deadline *deadline = nullptr);
+
+    /// @brief resolve the date range and facets of a query into `filter`
+    /// @param lastmod: storage for the date range `filter` points to
+    /// @return false if a facet value has no documents, so nothing can match
+    bool make_filter(const query::Query &parsed, doc_values::RangeFilter<uint32_t, int64_t> &lastmod, boolean_index::QueryFilter<uint32_t> &filter) const;
+
+    /// @brief open the listening socket, event loop and wakeup fd of a reactor
+    bool start_reactor(Reactor &reactor);
+
+    /// @brief serve the connections of a reactor until the server stops
+    void run_reactor(Reactor &reactor);
+
+    /// @brief track an accepted client and start reading from it
+    void add_client(Reactor &reactor, int client_fd);
+
+    /// @brief queue the text protocol greeting once per connection
+    void greet(Connection &connection) const;
+
+    /// @brief greet the connections that stayed silent past their delay
+    /// @return milliseconds until the next one is due, at most `timeout_ms`
+    int greet_silent(Reactor &reactor, int timeout_ms);
+
+    /// @brief answer the requests buffered for a connection and send what is ready
+    /// @return false if the connection was closed
+    bool handle_input(Reactor &reactor, Connection &connection);
+
+#ifdef SEARCH_ENGINE_IO_URING
+    /// @brief set up the io_uring of a reactor with its accept and wakeup read
+    /// @return false if io_uring is unavailable
+    bool start_ring(Reactor &reactor);
+
+    /// @brief arm the multishot receive of a connection
+    void receive(Reactor &reactor, Connection &connection);
+
+    /// @brief handle an accept, receive, writability or wakeup completion
+    void handle_completion_event(Reactor &reactor, const uring::Completion &completion);
+#endif
+
+    /// @brief parse and evaluate the complete requests buffered for a connection
+    /// @return false if the connection broke the protocol and was closed
+    bool dispatch(Reactor &reactor, Connection &connection);
+
+    /// @brief evaluate a request on a query worker if there is one with room
+    /// in its queue, on the event loop otherwise
+    void submit(Reactor &reactor, Connection &connection, Request request);
+
+    /// @brief evaluate a request into the bytes to send back, or a timed out
+    /// or overloaded error
+    output_buffer::Message respond(const Request &request);
+
+    /// @brief error response for a request that is not answered, counted
+    /// @param timed_out: past its deadline, else overloaded
+    output_buffer::Message reject(const Request &request, bool timed_out);
+
+    /// @brief write queued output and wait for writability while some is left
+    /// @return false if the client is gone and was closed
+    bool flush_output(Reactor &reactor, Connection &connection);
+
+    /// @brief close a connection the client hung up once everything is answered
+    /// @return true if it was closed
+    bool close_if_done(Reactor &reactor, Connection &connection);
+
+    /// @brief continue writing and resume reading once the backlog is small
+    /// @return false if the connection was closed
+    bool handle_writable(Reactor &reactor, Connection &connection);
+
+    /// @brief send the responses query workers completed for a reactor
+    void deliver_completed(Reactor &reactor);
+
 public:
-    MinimalAsyncServer(int port, int64_t max_response_count, boolean_index::BooleanIndex<std::string> &index);
+    /// @param cache_bytes: memory budget of the query result cache
+    /// @param options: event loop and query worker threads
+    MinimalAsyncServer(int port, int64_t max_response_count, boolean_index::BooleanIndex<uint32_t> &index, const document_store::DocumentStore<uint32_t> &documents, std::size_t cache_bytes, ServerOptions options = {});
     ~MinimalAsyncServer();
 
     bool start();
 
-    /// @brief generate a response for the client request
-    /// @param client_fd: fd of the client
+    /// @brief read everything the client sent and generate a response, on
+    /// io_uring received bytes are already buffered and reading is re-armed
+    /// @param connection: connection reported readable
     /// @return boolean: true if client is still alive, false if it was closed
-    bool handle_client_data(int client_fd);
+    bool handle_client_data(Reactor &reactor, Connection &connection);
+
+    /// @brief evaluate a text request, safe to call from several threads
+    /// @param client_fd: fd of the client, for logging
+    /// @param deadline: nullptr for no limit
+    /// @return response to send
+    /// @throws deadline::TimedOut past `deadline`, deadline::Overloaded for a
+    /// query over the cost limit, as do the other handlers
+    output_buffer::Message handle_request(int client_fd, std::string request, const deadline::Deadline *deadline = nullptr);
+
+    /// @brief answer a search query with a count line and a line per hit
+    output_buffer::Message handle_search(std::string text, const deadline::Deadline *deadline = nullptr);
+
+    /// @brief evaluate a query of plain words through the result cache, with
+    /// every temporary in the memory resource of `found`. Nothing is
+    /// inserted into the cache
+    /// @return false if the query needs the general path: it has no terms
+    /// or one of them is not indexed and may be a misspelling
+    /// @throws deadline::TimedOut, deadline::Overloaded as search() does
+    bool evaluate_plain(std::string_view text, const deadline::Deadline *deadline, PlainSearch &found);
+
+    /// @brief answer an HTTP request, `GET /search?q=...&op=and|or&limit=N`
+    /// with JSON results or `GET /health`, safe to call from several threads
+    /// @param request_line: method and target separated by a space
+    /// @param keep_alive: false to announce the connection is closed after it
+    output_buffer::Message handle_http(std::string request_line, bool keep_alive, const deadline::Deadline *deadline = nullptr);
+
+    /// @brief answer a `facets:` request with the number of documents per site
+    /// matching the rest of it, largest first, one `site count` line each
+    /// @param text: query without the `facets:` marker
+    output_buffer::Message handle_facets(std::string text, const deadline::Deadline *deadline = nullptr);
+
+    /// @brief answer newline separated text requests together: every
+    /// distinct query is parsed once, every distinct term looked up once and
+    /// identical requests evaluated once
+    /// @return each response prefixed by its big-endian uint32 length
+    output_buffer::Message handle_batch(std::string text, const deadline::Deadline *deadline = nullptr);
+
+    /// @brief answer a `complete:` request with the most frequent terms
+    /// starting with its last word, one `words term` line each
+    /// @param text: request without the `complete:` marker
+    output_buffer::Message handle_completion(std::string text);
+
+    /// @brief get hit rate and memory usage of the query result cache
+    query_cache::CacheStats cache_stats() const;
+
+    /// @brief get the number of timed out and overloaded requests
+    RequestStats request_stats() const;
 
-    void handle_request(int client_fd, std::vector<unsigned char> request);
+    /// @brief serve substring queries from a finished trigram index
+    /// @param trigrams: nullptr to answer them with no results
+    void set_trigram_index(const trigram_index::TrigramIndex<uint32_t> *trigrams);
 
-    void close_client(int client_fd);
+    void close_client(Reactor &reactor, int client_fd);
 
-    void accept_new_client();
+    /// @brief accept every pending connection
+    void accept_new_client(Reactor &reactor);
 
     void run();
 
@@ -254,6 +254,23 @@ namespace skiplist
             return Iterator(header_->forward[0]);
         }
 
+        // Iterator to the first element not less than value
+        Iterator lower_bound(const T &value) const
+        {
+            auto current = header_;
+
+            for (int i = current_level_; i >= 0; i--)
+            {
+                while (current->forward[i] != nullptr &&
+                       current->forward[i]->value < value)
+                {
+                    current = current->forward[i];
+                }
+            }
+
+            return Iterator(current->forward[0]);
+        }
+
         Iterator end() const
         {
             return Iterator(nullptr);
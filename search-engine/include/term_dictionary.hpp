@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace term_dictionary
+{
+
+    // Sorted term dictionary with front coding: terms are grouped in blocks of
+    // BLOCK_TERMS, the first term of a block is stored whole and every other
+    // one as the length of the prefix it shares with its predecessor plus the
+    // remaining suffix. Lookups binary search the block heads and scan one
+    // block, prefix ranges come out as contiguous ranks
+    class FrontCodedDictionary
+    {
+    private:
+        static constexpr std::size_t BLOCK_TERMS = 16;
+
+        std::vector<char> data_;
+        std::vector<uint32_t> block_offsets_;
+        std::size_t size_;
+
+        static void write_varint(std::vector<char> &out, uint32_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back(static_cast<char>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        uint32_t read_varint(std::size_t &offset) const
+        {
+            uint32_t value = 0;
+            int shift = 0;
+            while (true)
+            {
+                unsigned char byte = static_cast<unsigned char>(data_[offset++]);
+                value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                {
+                    return value;
+                }
+                shift += 7;
+            }
+        }
+
+        std::string block_head(std::size_t block) const
+        {
+            std::size_t offset = block_offsets_[block];
+            uint32_t length = read_varint(offset);
+            return std::string(data_.data() + offset, length);
+        }
+
+        // Block whose head is the last one <= key, 0 if every head is greater
+        std::size_t find_block(const std::string &key) const
+        {
+            std::size_t low = 0;
+            std::size_t high = block_offsets_.size();
+            while (high - low > 1)
+            {
+                std::size_t middle = (low + high) / 2;
+                if (block_head(middle) <= key)
+                {
+                    low = middle;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            return low;
+        }
+
+    public:
+        // Sequential decoder over consecutive ranks
+        class Iterator
+        {
+        private:
+            const FrontCodedDictionary *dictionary_;
+            std::size_t rank_;
+            std::size_t offset_;
+            std::string term_;
+
+            void decode()
+            {
+                if (!valid())
+                {
+                    return;
+                }
+                if (rank_ % BLOCK_TERMS == 0)
+                {
+                    offset_ = dictionary_->block_offsets_[rank_ / BLOCK_TERMS];
+                    uint32_t length = dictionary_->read_varint(offset_);
+                    term_.assign(dictionary_->data_.data() + offset_, length);
+                    offset_ += length;
+                    return;
+                }
+
+                uint32_t shared = dictionary_->read_varint(offset_);
+                uint32_t suffix = dictionary_->read_varint(offset_);
+                term_.resize(shared);
+                term_.append(dictionary_->data_.data() + offset_, suffix);
+                offset_ += suffix;
+            }
+
+        public:
+            Iterator(const FrontCodedDictionary *dictionary, std::size_t rank)
+                : dictionary_(dictionary), rank_(rank - rank % BLOCK_TERMS), offset_(0)
+            {
+                // Decode from the block head up to the requested rank
+                decode();
+                while (valid() && rank_ < rank)
+                {
+                    next();
+                }
+            }
+
+            bool valid() const
+            {
+                return rank_ < dictionary_->size_;
+            }
+
+            std::size_t rank() const
+            {
+                return rank_;
+            }
+
+            const std::string &term() const
+            {
+                return term_;
+            }
+
+            void next()
+            {
+                rank_++;
+                decode();
+            }
+        };
+
+        FrontCodedDictionary() : size_(0) {}
+
+        // Build from ascending unique terms
+        static FrontCodedDictionary build(const std::vector<std::string> &sorted_terms)
+        {
+            FrontCodedDictionary dictionary;
+            dictionary.size_ = sorted_terms.size();
+            dictionary.block_offsets_.reserve((sorted_terms.size() + BLOCK_TERMS - 1) / BLOCK_TERMS);
+
+            for (std::size_t i = 0; i < sorted_terms.size(); i++)
+            {
+                const std::string &term = sorted_terms[i];
+                if (i % BLOCK_TERMS == 0)
+                {
+                    dictionary.block_offsets_.push_back(static_cast<uint32_t>(dictionary.data_.size()));
+                    write_varint(dictionary.data_, static_cast<uint32_t>(term.size()));
+                    dictionary.data_.insert(dictionary.data_.end(), term.begin(), term.end());
+                    continue;
+                }
+
+                const std::string &previous = sorted_terms[i - 1];
+                std::size_t shared = 0;
+                std::size_t limit = std::min(previous.size(), term.size());
+                while (shared < limit && previous[shared] == term[shared])
+                {
+                    shared++;
+                }
+                write_varint(dictionary.data_, static_cast<uint32_t>(shared));
+                write_varint(dictionary.data_, static_cast<uint32_t>(term.size() - shared));
+                dictionary.data_.insert(dictionary.data_.end(), term.begin() + shared, term.end());
+            }
+
+            dictionary.data_.shrink_to_fit();
+            return dictionary;
+        }
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        std::size_t memory_bytes() const
+        {
+            return data_.size() + block_offsets_.size() * sizeof(uint32_t);
+        }
+
+        Iterator iterate(std::size_t rank = 0) const
+        {
+            return Iterator(this, std::min(rank, size_));
+        }
+
+        std::string term(std::size_t rank) const
+        {
+            return iterate(rank).term();
+        }
+
+        // Rank of the first term >= key, size() if there is none
+        std::size_t lower_bound(const std::string &key) const
+        {
+            if (empty())
+            {
+                return 0;
+            }
+
+            std::size_t block = find_block(key);
+            for (auto it = iterate(block * BLOCK_TERMS); it.valid(); it.next())
+            {
+                if (it.term() >= key)
+                {
+                    return it.rank();
+                }
+            }
+            return size_;
+        }
+
+        bool contains(const std::string &term) const
+        {
+            std::size_t rank = lower_bound(term);
+            return rank < size_ && this->term(rank) == term;
+        }
+
+        // Ranks [first, second) of the terms starting with `prefix`
+        std::pair<std::size_t, std::size_t> prefix_range(const std::string &prefix) const
+        {
+            std::size_t begin = lower_bound(prefix);
+
+            // Smallest string greater than every string starting with prefix
+            std::string upper = prefix;
+            while (!upper.empty() && static_cast<unsigned char>(upper.back()) == 0xFF)
+            {
+                upper.pop_back();
+            }
+            if (upper.empty())
+            {
+                return {begin, size_};
+            }
+            upper.back() = static_cast<char>(static_cast<unsigned char>(upper.back()) + 1);
+
+            return {begin, std::max(begin, lower_bound(upper))};
+        }
+    };
+
+} // namespace term_dictionary
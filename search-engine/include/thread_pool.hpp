@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace thread_pool
+{
+
+    // Fixed-size pool where every worker owns a task deque. Workers take
+    // their own tasks oldest first and steal the newest tasks of others once
+    // they run dry, so a batch submitted in order is started roughly in order
+    class ThreadPool
+    {
+    private:
+        using Task = std::function<void()>;
+
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::vector<std::thread> threads_;
+
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_;
+        std::size_t pending_;
+        bool stopping_;
+        std::atomic<std::size_t> next_worker_;
+
+        bool pop_own(std::size_t index, Task &task)
+        {
+            Worker &worker = *workers_[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.tasks.empty())
+            {
+                return false;
+            }
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+            return true;
+        }
+
+        bool steal(std::size_t thief, Task &task)
+        {
+            for (std::size_t offset = 1; offset <= workers_.size(); offset++)
+            {
+                Worker &victim = *workers_[(thief + offset) % workers_.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty())
+                {
+                    task = std::move(victim.tasks.back());
+                    victim.tasks.pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool take(std::size_t index, Task &task)
+        {
+            if (workers_.empty() || !(pop_own(index, task) || steal(index, task)))
+            {
+                return false;
+            }
+
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            pending_--;
+            return true;
+        }
+
+        void work(std::size_t index)
+        {
+            Task task;
+            while (true)
+            {
+                if (take(index, task))
+                {
+                    task();
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(sleep_mutex_);
+                wake_.wait(lock, [this]
+                           { return pending_ > 0 || stopping_; });
+                if (stopping_ && pending_ == 0)
+                {
+                    return;
+                }
+            }
+        }
+
+    public:
+        // A pool of zero threads runs everything on the calling thread
+        explicit ThreadPool(std::size_t threads) : pending_(0), stopping_(false), next_worker_(0)
+        {
+            for (std::size_t i = 0; i < threads; i++)
+            {
+                workers_.push_back(std::make_unique<Worker>());
+            }
+            for (std::size_t i = 0; i < threads; i++)
+            {
+                threads_.emplace_back([this, i]
+                                      { work(i); });
+            }
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            for (auto &thread : threads_)
+            {
+                thread.join();
+            }
+        }
+
+        std::size_t size() const
+        {
+            return threads_.size();
+        }
+
+        // Queue a task on the next worker in round-robin order
+        void submit(Task task)
+        {
+            if (workers_.empty())
+            {
+                task();
+                return;
+            }
+
+            Worker &worker = *workers_[next_worker_++ % workers_.size()];
+            {
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                worker.tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex_);
+                pending_++;
+            }
+            wake_.notify_one();
+        }
+
+        // Run `body(i)` for i in [0, count) and wait for all of them. The
+        // calling thread steals tasks too instead of idling, and the first
+        // exception thrown by a task is rethrown here
+        template <typename Body>
+        void parallel_for(std::size_t count, Body body)
+        {
+            struct Batch
+            {
+                std::mutex mutex;
+                std::condition_variable done;
+                std::size_t remaining;
+                std::exception_ptr error;
+            };
+            auto batch = std::make_shared<Batch>();
+            batch->remaining = count;
+
+            for (std::size_t i = 0; i < count; i++)
+            {
+                submit([batch, &body, i]
+                       {
+                           std::exception_ptr error;
+                           try
+                           {
+                               body(i);
+                           }
+                           catch (...)
+                           {
+                               error = std::current_exception();
+                           }
+
+                           std::lock_guard<std::mutex> lock(batch->mutex);
+                           if (error && !batch->error)
+                           {
+                               batch->error = error;
+                           }
+                           if (--batch->remaining == 0)
+                           {
+                               batch->done.notify_all();
+                           } });
+            }
+
+            Task task;
+            while (take(0, task))
+            {
+                task();
+            }
+
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            batch->done.wait(lock, [&]
+                             { return batch->remaining == 0; });
+            if (batch->error)
+            {
+                std::rethrow_exception(batch->error);
+            }
+        }
+    };
+
+} // namespace thread_pool
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "deadline.hpp"
+#include "hashmap.hpp"
+#include "intersection.hpp"
+#include "posting_list.hpp"
+
+namespace trigram_index
+{
+
+    // Bytes of stored text a candidate check may scan between two reads of
+    // the clock, and the scanned bytes counted as one posting by estimate_cost()
+    constexpr std::size_t VERIFY_CHECK_BYTES = 1 << 20;
+    constexpr std::size_t TEXT_BYTES_PER_POSTING = 64;
+
+    struct TrigramIndexOptions
+    {
+        // (trigram, document) pairs buffered before they are compressed into
+        // a segment, 8 bytes each
+        std::size_t buffer_postings = 1 << 24;
+        // Text kept per document for verification, longer documents are only
+        // searchable in their beginning
+        std::size_t max_text_bytes = 1 << 16;
+        // Trigrams occurring in at least this share of documents become bitmaps
+        double bitmap_min_density = 1.0 / 32;
+    };
+
+    // Lowercase ASCII and Cyrillic letters and collapse whitespace runs into
+    // single spaces, punctuation and digits are kept as they are
+    inline std::string normalize(const std::string &text)
+    {
+        std::string out;
+        out.reserve(text.size());
+        for (std::size_t i = 0; i < text.size(); i++)
+        {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v')
+            {
+                if (!out.empty() && out.back() != ' ')
+                {
+                    out.push_back(' ');
+                }
+                continue;
+            }
+            if (c >= 'A' && c <= 'Z')
+            {
+                out.push_back(static_cast<char>(c + ('a' - 'A')));
+                continue;
+            }
+
+            unsigned char next = i + 1 < text.size() ? static_cast<unsigned char>(text[i + 1]) : 0;
+            if (c == 0xD0 && next >= 0x90 && next <= 0x9F)
+            {
+                // А–П
+                out.push_back(static_cast<char>(0xD0));
+                out.push_back(static_cast<char>(next + 0x20));
+                i++;
+            }
+            else if (c == 0xD0 && next >= 0xA0 && next <= 0xAF)
+            {
+                // Р–Я
+                out.push_back(static_cast<char>(0xD1));
+                out.push_back(static_cast<char>(next - 0x20));
+                i++;
+            }
+            else if (c == 0xD0 && next == 0x81)
+            {
+                // Ё
+                out.push_back(static_cast<char>(0xD1));
+                out.push_back(static_cast<char>(0x91));
+                i++;
+            }
+            else
+            {
+                out.push_back(static_cast<char>(c));
+            }
+        }
+        if (!out.empty() && out.back() == ' ')
+        {
+            out.pop_back();
+        }
+        return out;
+    }
+
+    // Distinct byte trigrams of `text` packed into 24 bits each
+    inline std::vector<uint32_t> trigrams(const std::string &text)
+    {
+        std::vector<uint32_t> result;
+        if (text.size() < 3)
+        {
+            return result;
+        }
+        result.reserve(text.size() - 2);
+        for (std::size_t i = 0; i + 2 < text.size(); i++)
+        {
+            result.push_back((static_cast<uint32_t>(static_cast<unsigned char>(text[i])) << 16) |
+                             (static_cast<uint32_t>(static_cast<unsigned char>(text[i + 1])) << 8) |
+                             static_cast<uint32_t>(static_cast<unsigned char>(text[i + 2])));
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    // Substring index over lightly normalized document text. Every document
+    // is indexed by the byte trigrams of its text; a pattern is looked up by
+    // intersecting the postings of its trigrams and checking each candidate
+    // against the stored text. While building, (trigram, document) pairs
+    // collect in a fixed size buffer that is flushed into compressed
+    // segments, which finish() merges one trigram at a time
+    template <typename DocId = uint32_t>
+    class TrigramIndex
+    {
+        static_assert(posting_list::is_compressible_v<DocId>, "trigram postings are built compressed");
+
+    private:
+        using PostingListType = posting_list::PostingList<DocId>;
+        using Postings = hashmap::HashMap<uint32_t, std::unique_ptr<PostingListType>>;
+
+        TrigramIndexOptions options_;
+        std::size_t max_responses_;
+
+        // Texts by doc id, empty for ids that were never added
+        std::vector<std::string> texts_;
+        std::size_t documents_;
+        std::size_t text_bytes_;
+
+        // Trigram in the high half, doc id in the low one
+        std::vector<uint64_t> buffer_;
+        std::vector<Postings> segments_;
+        Postings postings_;
+        bool finished_;
+
+        void flush()
+        {
+            if (buffer_.empty())
+            {
+                return;
+            }
+
+            // Pairs of one document are added together and doc ids increase,
+            // so sorting groups each trigram with its ids in order
+            std::sort(buffer_.begin(), buffer_.end());
+            Postings segment;
+            std::vector<DocId> ids;
+            for (std::size_t i = 0; i < buffer_.size();)
+            {
+                uint32_t trigram = static_cast<uint32_t>(buffer_[i] >> 32);
+                ids.clear();
+                for (; i < buffer_.size() && static_cast<uint32_t>(buffer_[i] >> 32) == trigram; i++)
+                {
+                    ids.push_back(static_cast<DocId>(buffer_[i] & 0xFFFFFFFF));
+                }
+                segment.insert(trigram, std::make_unique<PostingListType>(PostingListType::from_sorted(ids)));
+            }
+            segments_.push_back(std::move(segment));
+            buffer_.clear();
+        }
+
+        // Posting lists of the trigrams of a normalized pattern, false when
+        // it has none or one of them occurs nowhere
+        bool find_lists(const std::string &normalized, std::vector<const PostingListType *> &lists) const
+        {
+            for (uint32_t trigram : trigrams(normalized))
+            {
+                const auto *list_ptr = postings_.find(trigram);
+                if (list_ptr == nullptr)
+                {
+                    return false;
+                }
+                lists.push_back(list_ptr->get());
+            }
+            return !lists.empty();
+        }
+
+    public:
+        TrigramIndex(std::size_t max_responses = 0, TrigramIndexOptions options = {})
+            : options_(options), max_responses_(max_responses), documents_(0), text_bytes_(0), finished_(false)
+        {
+            buffer_.reserve(std::min<std::size_t>(options_.buffer_postings, 1 << 20));
+        }
+
+        // Index the text of a document, doc ids have to be added in ascending order
+        void add_document(DocId doc_id, const std::string &text)
+        {
+            if (finished_)
+            {
+                throw std::logic_error("trigram index is already finished");
+            }
+            if (doc_id < texts_.size())
+            {
+                throw std::invalid_argument("trigram index documents must be added in ascending doc id order");
+            }
+
+            std::string normalized = normalize(text);
+            if (normalized.size() > options_.max_text_bytes)
+            {
+                normalized.resize(options_.max_text_bytes);
+            }
+
+            auto document_trigrams = trigrams(normalized);
+            if (buffer_.size() + document_trigrams.size() > options_.buffer_postings)
+            {
+                flush();
+            }
+            for (uint32_t trigram : document_trigrams)
+            {
+                buffer_.push_back((static_cast<uint64_t>(trigram) << 32) | static_cast<uint64_t>(doc_id));
+            }
+
+            text_bytes_ += normalized.size();
+            texts_.resize(static_cast<std::size_t>(doc_id) + 1);
+            texts_[doc_id] = std::move(normalized);
+            documents_++;
+        }
+
+        // Merge the segments into one posting list per trigram. Doc ids of a
+        // later segment are all greater, so the lists just concatenate
+        void finish()
+        {
+            if (finished_)
+            {
+                return;
+            }
+            flush();
+            buffer_.shrink_to_fit();
+            texts_.shrink_to_fit();
+
+            std::vector<uint32_t> keys;
+            for (const auto &segment : segments_)
+            {
+                for (const auto &kv : segment)
+                {
+                    keys.push_back(kv.first);
+                }
+            }
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+            std::vector<DocId> ids;
+            for (uint32_t trigram : keys)
+            {
+                ids.clear();
+                for (auto &segment : segments_)
+                {
+                    auto *list_ptr = segment.find(trigram);
+                    if (list_ptr != nullptr)
+                    {
+                        for (auto it = (*list_ptr)->cursor(); it.valid(); it.next())
+                        {
+                            ids.push_back(it.doc());
+                        }
+                        segment.erase(trigram);
+                    }
+                }
+
+                auto list = std::make_unique<PostingListType>(PostingListType::from_sorted(ids));
+                if (static_cast<double>(ids.size()) >= options_.bitmap_min_density * documents_)
+                {
+                    list->compress_to_bitmap();
+                }
+                postings_.insert(trigram, std::move(list));
+            }
+            segments_.clear();
+            segments_.shrink_to_fit();
+            finished_ = true;
+        }
+
+        // Documents whose text contains `pattern` after normalization, in doc
+        // id order. Patterns shorter than three bytes have no trigrams and
+        // match nothing. Past `deadline` the documents found so far are kept
+        std::vector<DocId> substring_query(const std::string &pattern,
+                                           intersection::IntersectionStats *stats = nullptr,
+                                           const deadline::Deadline *deadline = nullptr) const
+        {
+            if (!finished_)
+            {
+                throw std::logic_error("trigram index is not finished");
+            }
+
+            std::string normalized = normalize(pattern);
+            std::vector<const PostingListType *> lists;
+            if (!find_lists(normalized, lists))
+            {
+                return {};
+            }
+
+            // A candidate scans up to max_text_bytes, so the clock is read by
+            // scanned bytes rather than by candidates. Once expired the rest
+            // is rejected unread until the intersection notices the deadline
+            bool expired = false;
+            std::size_t scanned = 0;
+            auto verify = [&](const DocId &doc_id)
+            {
+                if (expired)
+                {
+                    return false;
+                }
+                const std::string &text = texts_[doc_id];
+                scanned += text.size();
+                if (deadline != nullptr && scanned >= VERIFY_CHECK_BYTES)
+                {
+                    scanned = 0;
+                    expired = deadline->expired();
+                }
+                return text.find(normalized) != std::string::npos;
+            };
+            return intersection::intersect<DocId>(std::move(lists), verify, max_responses_, stats, nullptr, nullptr,
+                                                  deadline);
+        }
+
+        // Rough number of postings substring_query() walks, to refuse the
+        // heaviest patterns before running them. The rarest trigram drives
+        // the intersection and every candidate's text is scanned, counted
+        // in TEXT_BYTES_PER_POSTING units of an average document
+        std::size_t estimate_cost(const std::string &pattern) const
+        {
+            if (!finished_ || documents_ == 0)
+            {
+                return 0;
+            }
+
+            std::vector<const PostingListType *> lists;
+            if (!find_lists(normalize(pattern), lists))
+            {
+                return 0;
+            }
+            std::size_t smallest = std::numeric_limits<std::size_t>::max();
+            for (const auto *list : lists)
+            {
+                smallest = std::min(smallest, list->size());
+            }
+            std::size_t average_text = text_bytes_ / documents_;
+            return smallest * lists.size() + smallest * (average_text / TEXT_BYTES_PER_POSTING);
+        }
+
+        std::size_t document_count() const
+        {
+            return documents_;
+        }
+
+        std::size_t trigram_count() const
+        {
+            return postings_.size();
+        }
+
+        std::size_t memory_bytes() const
+        {
+            std::size_t bytes = 0;
+            for (const auto &kv : postings_)
+            {
+                bytes += kv.second->memory_bytes() + sizeof(uint32_t) + sizeof(std::unique_ptr<PostingListType>);
+            }
+            for (const auto &text : texts_)
+            {
+                bytes += sizeof(std::string) + text.capacity();
+            }
+            return bytes;
+        }
+
+        void print_statistics() const
+        {
+            std::size_t bitmaps = 0;
+            std::size_t text_bytes = 0;
+            for (const auto &kv : postings_)
+            {
+                bitmaps += kv.second->representation() == posting_list::Representation::Bitmap ? 1 : 0;
+            }
+            for (const auto &text : texts_)
+            {
+                text_bytes += text.size();
+            }
+
+            std::cout << "Trigram Index Statistics:\n";
+            std::cout << "  Documents: " << documents_ << "\n";
+            std::cout << "  Trigrams: " << postings_.size() << " (" << bitmaps << " bitmaps)\n";
+            std::cout << "  Stored text: ~" << text_bytes / 1024 << " KB\n";
+            std::cout << "  Total: ~" << memory_bytes() / 1024 << " KB\n";
+        }
+    };
+
+} // namespace trigram_index
@@ -0,0 +1,415 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace uring
+{
+
+    struct Completion
+    {
+        uint64_t user_data;
+        // Bytes or fd on success, minus errno on failure
+        int32_t result;
+        uint32_t flags;
+
+        // The request stays armed and completes again
+        bool more() const
+        {
+            return flags & IORING_CQE_F_MORE;
+        }
+
+        bool has_buffer() const
+        {
+            return flags & IORING_CQE_F_BUFFER;
+        }
+
+        uint16_t buffer_id() const
+        {
+            return static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+    };
+
+    // io_uring instance driven through the kernel interface directly. Requests
+    // are prepared into the submission queue and submitted in one batch by
+    // the next wait(), together with waiting for their completions. Sockets
+    // are read with multishot receives into a ring of provided buffers
+    // registered with the kernel, so one armed request keeps delivering data
+    // without a syscall per read. Requires Linux 6.0, the constructor throws
+    // std::system_error where the kernel or its sandbox cannot run it
+    class UringLoop
+    {
+    private:
+        static constexpr uint16_t BUFFER_GROUP = 0;
+
+        int ring_fd_;
+        void *ring_ = MAP_FAILED;
+        std::size_t ring_bytes_ = 0;
+        io_uring_sqe *sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+        std::size_t sqes_bytes_ = 0;
+
+        unsigned *sq_head_;
+        unsigned *sq_tail_;
+        unsigned sq_mask_;
+        unsigned sq_entries_;
+        unsigned sq_local_tail_;
+        unsigned to_submit_ = 0;
+
+        unsigned *cq_head_;
+        unsigned *cq_tail_;
+        unsigned cq_mask_;
+        io_uring_cqe *cqes_;
+
+        io_uring_buf_ring *buffer_ring_ = static_cast<io_uring_buf_ring *>(MAP_FAILED);
+        std::size_t buffer_ring_bytes_ = 0;
+        std::vector<char> buffers_;
+        unsigned buffer_count_;
+        unsigned buffer_size_;
+        uint16_t buffer_tail_ = 0;
+
+        [[noreturn]] static void fail(const char *what, int error)
+        {
+            throw std::system_error(error, std::generic_category(), what);
+        }
+
+        int enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *argument, std::size_t argument_bytes)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, argument, argument_bytes));
+        }
+
+        io_uring_sqe *next_sqe()
+        {
+            if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+            {
+                submit();
+            }
+            io_uring_sqe *sqe = &sqes_[sq_local_tail_ & sq_mask_];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sq_local_tail_++;
+            to_submit_++;
+            return sqe;
+        }
+
+        void add_buffer(uint16_t id)
+        {
+            // Indexed from the mapping, the header's flexible array gets
+            // shifted by an empty struct when compiled as C++
+            io_uring_buf *buffer = reinterpret_cast<io_uring_buf *>(buffer_ring_) + (buffer_tail_ & (buffer_count_ - 1));
+            buffer->addr = reinterpret_cast<uint64_t>(buffers_.data() + static_cast<std::size_t>(id) * buffer_size_);
+            buffer->len = buffer_size_;
+            buffer->bid = id;
+            buffer_tail_++;
+        }
+
+        void publish_buffers()
+        {
+            __atomic_store_n(&buffer_ring_->tail, buffer_tail_, __ATOMIC_RELEASE);
+        }
+
+        void release()
+        {
+            if (buffer_ring_ != MAP_FAILED)
+            {
+                munmap(buffer_ring_, buffer_ring_bytes_);
+            }
+            if (sqes_ != MAP_FAILED)
+            {
+                munmap(sqes_, sqes_bytes_);
+            }
+            if (ring_ != MAP_FAILED)
+            {
+                munmap(ring_, ring_bytes_);
+            }
+            if (ring_fd_ >= 0)
+            {
+                close(ring_fd_);
+            }
+        }
+
+        void setup(unsigned entries)
+        {
+            io_uring_params params{};
+            ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (ring_fd_ < 0)
+            {
+                fail("io_uring_setup", errno);
+            }
+            uint32_t required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+            if ((params.features & required) != required)
+            {
+                fail("io_uring features", ENOSYS);
+            }
+
+            std::size_t sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            std::size_t cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            ring_bytes_ = std::max(sq_bytes, cq_bytes);
+            ring_ = mmap(nullptr, ring_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+            if (ring_ == MAP_FAILED)
+            {
+                fail("mmap io_uring", errno);
+            }
+            sqes_bytes_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+            if (sqes_ == MAP_FAILED)
+            {
+                fail("mmap io_uring", errno);
+            }
+
+            char *ring = static_cast<char *>(ring_);
+            sq_head_ = reinterpret_cast<unsigned *>(ring + params.sq_off.head);
+            sq_tail_ = reinterpret_cast<unsigned *>(ring + params.sq_off.tail);
+            sq_mask_ = *reinterpret_cast<unsigned *>(ring + params.sq_off.ring_mask);
+            sq_entries_ = params.sq_entries;
+            sq_local_tail_ = *sq_tail_;
+            // Submission entries are used in ring order
+            unsigned *array = reinterpret_cast<unsigned *>(ring + params.sq_off.array);
+            for (unsigned i = 0; i < sq_entries_; i++)
+            {
+                array[i] = i;
+            }
+
+            cq_head_ = reinterpret_cast<unsigned *>(ring + params.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned *>(ring + params.cq_off.tail);
+            cq_mask_ = *reinterpret_cast<unsigned *>(ring + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe *>(ring + params.cq_off.cqes);
+        }
+
+        void setup_buffers()
+        {
+            buffer_ring_bytes_ = buffer_count_ * sizeof(io_uring_buf);
+            buffer_ring_ = static_cast<io_uring_buf_ring *>(mmap(nullptr, buffer_ring_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (buffer_ring_ == MAP_FAILED)
+            {
+                fail("mmap buffer ring", errno);
+            }
+
+            io_uring_buf_reg registration{};
+            registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+            registration.ring_entries = buffer_count_;
+            registration.bgid = BUFFER_GROUP;
+            if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+            {
+                fail("io_uring_register", errno);
+            }
+
+            buffers_.resize(static_cast<std::size_t>(buffer_count_) * buffer_size_);
+            for (unsigned id = 0; id < buffer_count_; id++)
+            {
+                add_buffer(static_cast<uint16_t>(id));
+            }
+            publish_buffers();
+        }
+
+        // Multishot receive only exists since 6.0, older kernels fail it at
+        // completion time, so one is tried on a socket pair before serving
+        void probe()
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0)
+            {
+                fail("socketpair", errno);
+            }
+            bool received = false;
+            bool ended = false;
+            auto handle = [&](const Completion &completion)
+            {
+                received = received || completion.result == 1;
+                ended = ended || !completion.more();
+                if (completion.has_buffer())
+                {
+                    recycle(completion.buffer_id());
+                }
+            };
+
+            receive_multishot(fds[0], 0);
+            if (write(fds[1], "x", 1) == 1)
+            {
+                for (int attempt = 0; attempt < 10 && !received && !ended; attempt++)
+                {
+                    wait(100, handle);
+                }
+            }
+            // The receive ends with the shutdown, its buffers have to be back
+            // before serving
+            shutdown(fds[0], SHUT_RDWR);
+            for (int attempt = 0; attempt < 10 && !ended; attempt++)
+            {
+                wait(100, handle);
+            }
+            close(fds[0]);
+            close(fds[1]);
+            if (!received)
+            {
+                fail("io_uring multishot receive", EINVAL);
+            }
+        }
+
+    public:
+        // `buffer_count` has to be a power of two below 32768
+        explicit UringLoop(unsigned entries = 4096, unsigned buffer_count = 4096, unsigned buffer_size = 4096)
+            : ring_fd_(-1), buffer_count_(buffer_count), buffer_size_(buffer_size)
+        {
+            try
+            {
+                setup(entries);
+                setup_buffers();
+                probe();
+            }
+            catch (...)
+            {
+                release();
+                throw;
+            }
+        }
+
+        UringLoop(const UringLoop &) = delete;
+        UringLoop &operator=(const UringLoop &) = delete;
+
+        ~UringLoop()
+        {
+            release();
+        }
+
+        // Accept connections until cancelled, each completion carries a
+        // non-blocking client fd
+        void accept_multishot(int fd, uint64_t user_data)
+        {
+            io_uring_sqe *sqe = next_sqe();
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = fd;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            sqe->user_data = user_data;
+        }
+
+        // Receive into provided buffers until the peer closes, the receive is
+        // cancelled or the buffers run out (-ENOBUFS)
+        void receive_multishot(int fd, uint64_t user_data)
+        {
+            io_uring_sqe *sqe = next_sqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = fd;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = BUFFER_GROUP;
+            sqe->user_data = user_data;
+        }
+
+        // Complete once `fd` is writable
+        void poll_writable(int fd, uint64_t user_data)
+        {
+            io_uring_sqe *sqe = next_sqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            sqe->poll32_events = POLLOUT;
+            sqe->user_data = user_data;
+        }
+
+        void read(int fd, void *data, unsigned size, uint64_t user_data)
+        {
+            io_uring_sqe *sqe = next_sqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(data);
+            sqe->len = size;
+            sqe->off = static_cast<uint64_t>(-1);
+            sqe->user_data = user_data;
+        }
+
+        // Cancel the request submitted with `target`, its last completion
+        // reports -ECANCELED unless it completed before
+        void cancel(uint64_t target, uint64_t user_data)
+        {
+            io_uring_sqe *sqe = next_sqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = target;
+            sqe->user_data = user_data;
+        }
+
+        // Bytes a receive completion left in provided buffer `id`
+        std::string_view buffer(uint16_t id, std::size_t size) const
+        {
+            return std::string_view(buffers_.data() + static_cast<std::size_t>(id) * buffer_size_, size);
+        }
+
+        // Give a provided buffer back once its bytes are copied out
+        void recycle(uint16_t id)
+        {
+            add_buffer(id);
+            publish_buffers();
+        }
+
+        // Submit the prepared requests without waiting
+        void submit()
+        {
+            __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+            while (to_submit_ > 0)
+            {
+                int submitted = enter(to_submit_, 0, 0, nullptr, 0);
+                if (submitted < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    fail("io_uring_enter", errno);
+                }
+                to_submit_ -= std::min<unsigned>(to_submit_, static_cast<unsigned>(submitted));
+            }
+        }
+
+        // Submit the prepared requests, wait up to `timeout_ms` for a
+        // completion and call `handle(completion)` for every one available.
+        // Returns the number handled, 0 on timeout or signal
+        template <typename Handler>
+        int wait(int timeout_ms, Handler handle)
+        {
+            __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+            __kernel_timespec timeout{};
+            timeout.tv_sec = timeout_ms / 1000;
+            timeout.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+            io_uring_getevents_arg argument{};
+            argument.ts = reinterpret_cast<uint64_t>(&timeout);
+
+            bool ready = __atomic_load_n(cq_head_, __ATOMIC_RELAXED) != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            int submitted = enter(to_submit_, ready ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argument, sizeof(argument));
+            if (submitted < 0 && errno != EINTR && errno != ETIME && errno != EBUSY)
+            {
+                fail("io_uring_enter", errno);
+            }
+            if (submitted > 0)
+            {
+                to_submit_ -= std::min<unsigned>(to_submit_, static_cast<unsigned>(submitted));
+            }
+
+            int handled = 0;
+            unsigned head = __atomic_load_n(cq_head_, __ATOMIC_RELAXED);
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            while (head != tail)
+            {
+                const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                Completion completion{cqe.user_data, cqe.res, cqe.flags};
+                head++;
+                // Released first, handlers may prepare requests that need room
+                __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+                handle(completion);
+                handled++;
+                tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            }
+            return handled;
+        }
+    };
+
+} // namespace uring
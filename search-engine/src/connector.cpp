@@ -6,8 +6,10 @@ mongocxx::client client;
 mongocxx::database db;
 mongocxx::collection collection;
 
-struct sb_stemmer *RU_STEMMER = sb_stemmer_new("ru", NULL);
-struct sb_stemmer *EN_STEMMER = sb_stemmer_new("en", NULL);
+// A stemmer keeps its work buffer inside, so every thread that parses
+// queries gets its own
+thread_local struct sb_stemmer *RU_STEMMER = sb_stemmer_new("ru", NULL);
+thread_local struct sb_stemmer *EN_STEMMER = sb_stemmer_new("en", NULL);
 
 int setup_connector(const char *mongodb_uri, const char *mongodb_db, const char *mongodb_collection)
 {
@@ -39,7 +41,7 @@ inline size_t utf8_char_len(unsigned char c)
     return 1;     // invalid
 }
 
-inline bool is_russian_token(const std::string &token)
+inline bool is_russian_token(std::string_view token)
 {
     for (unsigned char c : token)
     {
@@ -49,10 +51,12 @@ inline bool is_russian_token(const std::string &token)
     return false;
 }
 
-inline std::string normalize_text_utf8(const std::string &input)
+// Lowercase letters and digits, everything else turned into spaces. `out`
+// may be a string with any allocator
+template <typename String>
+void normalize_text_utf8(std::string_view input, String &out)
 {
-    std::string out;
-    out.reserve(input.size());
+    out.reserve(out.size() + input.size());
 
     for (size_t i = 0; i < input.size();)
     {
@@ -95,19 +99,32 @@ inline std::string normalize_text_utf8(const std::string &input)
             i += len;
         }
     }
+}
 
+inline std::string normalize_text_utf8(const std::string &input)
+{
+    std::string out;
+    normalize_text_utf8(input, out);
     return out;
 }
 
-std::vector<std::string> tokenize_and_stem(const std::string &text)
+// Stem the space separated tokens of normalized text, keeping stems longer
+// than two bytes. The token of every kept stem goes to `surface_forms`
+template <typename Terms>
+void stem_tokens(std::string_view normalized, Terms &terms, std::vector<std::string> *surface_forms = nullptr)
 {
-    std::vector<std::string> terms;
-    std::string token;
-
-    auto flush = [&](void)
+    std::size_t start = 0;
+    while (start < normalized.size())
     {
+        std::size_t end = normalized.find(' ', start);
+        if (end == std::string_view::npos)
+        {
+            end = normalized.size();
+        }
+        std::string_view token = normalized.substr(start, end - start);
+        start = end + 1;
         if (token.empty())
-            return;
+            continue;
 
         sb_stemmer *stemmer = is_russian_token(token) ? RU_STEMMER : EN_STEMMER;
 
@@ -119,24 +136,58 @@ std::vector<std::string> tokenize_and_stem(const std::string &text)
             if (len > 2)
             {
                 terms.emplace_back(reinterpret_cast<const char *>(stemmed), len);
+                if (surface_forms != nullptr)
+                {
+                    surface_forms->emplace_back(token);
+                }
             }
         }
+    }
+}
 
-        token.clear();
-    };
+std::vector<std::string> tokenize_and_stem(const std::string &text)
+{
+    std::vector<std::string> terms;
+    stem_tokens(normalize_text_utf8(text), terms);
+    return terms;
+}
 
-    for (char c : normalize_text_utf8(text))
+std::vector<std::string> tokenize_and_stem(const std::string &text, std::vector<std::string> &surface_forms)
+{
+    std::vector<std::string> terms;
+    stem_tokens(normalize_text_utf8(text), terms, &surface_forms);
+    return terms;
+}
+
+void tokenize_and_stem(std::string_view text, std::pmr::vector<std::pmr::string> &terms)
+{
+    std::pmr::string normalized(terms.get_allocator().resource());
+    normalize_text_utf8(text, normalized);
+    stem_tokens(normalized, terms);
+}
+
+std::string stem_prefix(const std::string &text)
+{
+    std::istringstream tokens(normalize_text_utf8(text));
+    std::string token;
+    tokens >> token;
+    if (token.empty())
+        return token;
+
+    sb_stemmer *stemmer = is_russian_token(token) ? RU_STEMMER : EN_STEMMER;
+
+    const sb_symbol *stemmed = sb_stemmer_stem(stemmer, reinterpret_cast<const sb_symbol *>(token.data()), static_cast<int>(token.size()));
+
+    // Indexed terms are stems, so a full word is cut back to its stem to match
+    // its other forms. A partial word may stem to something that is not its
+    // prefix, then it is looked up as typed
+    if (stemmed)
     {
-        if (c != ' ')
+        std::string stem(reinterpret_cast<const char *>(stemmed), sb_stemmer_length(stemmer));
+        if (token.compare(0, stem.size(), stem) == 0)
         {
-            token.push_back(c);
-        }
-        else
-        {
-            flush();
+            return stem;
         }
     }
-    flush();
-
-    return terms;
+    return token;
 }
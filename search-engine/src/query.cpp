@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+
+#include "connector.hpp"
+#include "query.hpp"
+
+namespace query
+{
+
+    namespace
+    {
+        // Milliseconds in `since:` units, 0 for an unknown unit
+        int64_t unit_milliseconds(char unit)
+        {
+            switch (unit)
+            {
+            case 'm':
+                return 60 * 1000;
+            case 'h':
+                return 60 * 60 * 1000;
+            case 'd':
+                return 24 * 60 * 60 * 1000;
+            case 'w':
+                return 7 * 24 * 60 * 60 * 1000;
+            default:
+                return 0;
+            }
+        }
+
+        // Parse `24h` into the earliest allowed lastmod. Now is rounded down
+        // to the minute, so repeated queries share a cache key for a minute
+        bool parse_since(const std::string &value, int64_t &lastmod_min)
+        {
+            char *end = nullptr;
+            long long amount = std::strtoll(value.c_str(), &end, 10);
+            if (end == value.c_str() || amount < 0 || end + 1 != value.c_str() + value.size())
+            {
+                return false;
+            }
+            int64_t unit = unit_milliseconds(*end);
+            if (unit == 0 || amount > std::numeric_limits<int64_t>::max() / (2 * unit))
+            {
+                return false;
+            }
+
+            auto now = std::chrono::duration_cast<std::chrono::minutes>(
+                std::chrono::system_clock::now().time_since_epoch());
+            lastmod_min = std::chrono::duration_cast<std::chrono::milliseconds>(now).count() - amount * unit;
+            return true;
+        }
+
+        // Apply a `since:`, `site:` or `section:` token to `query`, false
+        // for any other token
+        bool parse_filter(const std::string &token, Query &query)
+        {
+            if (token.compare(0, 6, "since:") == 0 && parse_since(token.substr(6), query.lastmod_min))
+            {
+                return true;
+            }
+            std::size_t colon = token.find(':');
+            if (colon == std::string::npos || colon + 1 >= token.size())
+            {
+                return false;
+            }
+            std::string field = token.substr(0, colon);
+            if (field != "site" && field != "section")
+            {
+                return false;
+            }
+            std::string value = token.substr(colon + 1);
+            std::transform(value.begin(), value.end(), value.begin(),
+                           [](unsigned char c)
+                           { return static_cast<char>(std::tolower(c)); });
+            if (value.compare(0, 4, "www.") == 0)
+            {
+                value.erase(0, 4);
+            }
+            query.facets.emplace_back(std::move(field), std::move(value));
+            return true;
+        }
+    }
+
+    Query parse_query(const std::string &text)
+    {
+        Query result;
+
+        if (text.size() >= 2 && text.front() == '\'' && text.back() == '\'')
+        {
+            result.op = Operator::Substring;
+            result.text = text.substr(1, text.size() - 2);
+            return result;
+        }
+
+        std::size_t close = text.rfind('"');
+        if (text.size() >= 2 && text.front() == '"' && close != 0)
+        {
+            result.op = Operator::Phrase;
+            result.terms = tokenize_and_stem(text.substr(1, close - 1));
+
+            // Optional `~N` proximity suffix, then filters
+            if (close + 1 < text.size() && text[close + 1] == '~')
+            {
+                result.slop = static_cast<uint32_t>(std::strtoul(text.c_str() + close + 2, nullptr, 10));
+            }
+            std::istringstream tokens(text.substr(close + 1));
+            std::string token;
+            while (tokens >> token)
+            {
+                parse_filter(token, result);
+            }
+            return result;
+        }
+
+        // `-word` tokens are excluded, everything else is required
+        std::string required;
+        std::string excluded;
+        std::istringstream tokens(text);
+        std::string token;
+        while (tokens >> token)
+        {
+            if (parse_filter(token, result))
+            {
+                continue;
+            }
+            if (token.size() > 1 && token.back() == '*' && result.prefix.empty())
+            {
+                result.prefix = stem_prefix(token.substr(0, token.size() - 1));
+                if (!result.prefix.empty())
+                {
+                    result.op = Operator::Prefix;
+                }
+            }
+            else if (token.size() > 1 && token.front() == '-')
+            {
+                excluded += token.substr(1);
+                excluded += ' ';
+            }
+            else
+            {
+                required += token;
+                required += ' ';
+            }
+        }
+
+        result.terms = tokenize_and_stem(required);
+        result.excluded = tokenize_and_stem(excluded);
+        return result;
+    }
+
+    std::string cache_key(const Query &query)
+    {
+        std::string key;
+        switch (query.op)
+        {
+        case Operator::And:
+            key = "and";
+            break;
+        case Operator::Or:
+            key = "or";
+            break;
+        case Operator::Phrase:
+            key = "phrase~" + std::to_string(query.slop);
+            break;
+        case Operator::Prefix:
+            key = "prefix";
+            break;
+        case Operator::Substring:
+            return "substring " + query.text;
+        }
+
+        append_terms(key, query.terms, query.op == Operator::Phrase);
+        if (!query.excluded.empty())
+        {
+            key += " -";
+            append_terms(key, query.excluded, false);
+        }
+        if (query.op == Operator::Prefix)
+        {
+            key += " " + query.prefix + "*";
+        }
+        auto facets = query.facets;
+        std::sort(facets.begin(), facets.end());
+        for (const auto &[field, value] : facets)
+        {
+            key += " " + field + ":" + value;
+        }
+        if (query.has_lastmod_filter())
+        {
+            key += " lastmod:" + std::to_string(query.lastmod_min) + ".." + std::to_string(query.lastmod_max);
+        }
+        return key;
+    }
+
+} // namespace query
@@ -1,11 +1,14 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <iterator>
+#include <sstream>
 #include <cstring>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
-#include <sys/select.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <algorithm>
@@ -20,20 +23,64 @@
 
 #include "connector.hpp"
 #include "log.hpp"
+#include "query.hpp"
 #include "server.hpp"
 
-volatile sig_atomic_t stop_flag = 0;
+// Set by signals and read by every event loop thread, lock-free so the
+// handler can store it
+std::atomic<bool> stop_flag{false};
+
+// Temporaries of the plain query being evaluated, one arena per event loop
+// and query worker thread, reset once the query is answered
+thread_local arena::Arena request_arena;
+
+// Wake eventfd of the event loop on the thread that called run(), -1 when
+// none is running. A signal may reach any thread, so the handler wakes that
+// loop, which wakes the others on its way out
+std::atomic<int> signal_wake_fd{-1};
 
 void signal_handler(int signal)
 {
-    stop_flag = 1;
+    stop_flag = true;
+    int fd = signal_wake_fd.load();
+    if (fd >= 0)
+    {
+        // write() is async-signal-safe, errno is restored for the interrupted code
+        int saved_errno = errno;
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = write(fd, &one, sizeof(one));
+        errno = saved_errno;
+    }
 }
 
-MinimalAsyncServer::MinimalAsyncServer(int port, int64_t max_response_count, boolean_index::BooleanIndex<std::string> &index) : port_(port), max_response_count_(max_response_count), index_(index), server_fd_(-1), max_fd_(0)
+#ifdef SEARCH_ENGINE_IO_URING
+namespace
+{
+    enum class RingOperation : uint8_t
+    {
+        Accept,
+        Receive,
+        Writable,
+        Wake,
+        Cancel,
+    };
+
+    // Completions carry their operation, fd and the low bits of the
+    // connection id, which tell a stale completion from one of a new
+    // connection that got the same fd
+    uint64_t ring_tag(RingOperation operation, int fd, uint64_t connection_id = 0)
+    {
+        return static_cast<uint64_t>(operation) | (static_cast<uint64_t>(fd & 0xffffff) << 8) | (connection_id << 32);
+    }
+} // namespace
+#endif
+
+MinimalAsyncServer::MinimalAsyncServer(int port, int64_t max_response_count, boolean_index::BooleanIndex<uint32_t> &index, const document_store::DocumentStore<uint32_t> &documents, std::size_t cache_bytes, ServerOptions options) : port_(port), options_(options), max_response_count_(max_response_count), index_(index), documents_(documents), cache_(cache_bytes), trigrams_(nullptr)
 {
     std::signal(SIGINT, signal_handler);
     std::signal(SIGTERM, signal_handler);
-    FD_ZERO(&master_fds_);
+    // A client closing early must fail its send, not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
 }
 
 MinimalAsyncServer::~MinimalAsyncServer()
@@ -43,25 +90,59 @@ MinimalAsyncServer::~MinimalAsyncServer()
 
 bool MinimalAsyncServer::start()
 {
-    server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd_ < 0)
+#ifndef SEARCH_ENGINE_IO_URING
+    if (options_.backend == IoBackend::IoUring)
+    {
+        spdlog::warn("built without io_uring, using epoll");
+        options_.backend = IoBackend::Epoll;
+    }
+#endif
+
+    std::size_t reactors = std::max<std::size_t>(options_.reactors, 1);
+    for (std::size_t i = 0; i < reactors; i++)
+    {
+        auto reactor = std::make_unique<Reactor>();
+        reactor->index = i;
+        if (!start_reactor(*reactor))
+        {
+            stop();
+            return false;
+        }
+        reactors_.push_back(std::move(reactor));
+    }
+
+    if (options_.query_workers > 0)
+    {
+        workers_ = std::make_unique<thread_pool::ThreadPool>(options_.query_workers);
+    }
+
+    spdlog::info("async server listening on port {} with {} {} event loops and {} query workers", port_, reactors,
+                 options_.backend == IoBackend::IoUring ? "io_uring" : "epoll", options_.query_workers);
+    return true;
+}
+
+bool MinimalAsyncServer::start_reactor(Reactor &reactor)
+{
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server_fd < 0)
     {
         perror("socket");
         return false;
     }
 
-    if (fcntl(server_fd_, F_SETFL, O_NONBLOCK) < 0)
+    int yes = 1;
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0)
     {
-        perror("fcntl");
-        close(server_fd_);
+        perror("setsockopt");
+        close(server_fd);
         return false;
     }
 
-    int yes = 1;
-    if (setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0)
+    // Every reactor binds the port itself and the kernel balances accepts
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0)
     {
         perror("setsockopt");
-        close(server_fd_);
+        close(server_fd);
         return false;
     }
 
@@ -70,225 +151,1573 @@ bool MinimalAsyncServer::start()
     addr.sin_addr.s_addr = INADDR_ANY;
     addr.sin_port = htons(port_);
 
-    if (bind(server_fd_, (sockaddr *)&addr, sizeof(addr)) < 0)
+    if (bind(server_fd, (sockaddr *)&addr, sizeof(addr)) < 0)
     {
         perror("bind");
-        close(server_fd_);
+        close(server_fd);
         return false;
     }
 
-    if (listen(server_fd_, 128) < 0)
+    if (listen(server_fd, SOMAXCONN) < 0)
     {
         perror("listen");
-        close(server_fd_);
+        close(server_fd);
+        return false;
+    }
+
+    int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0)
+    {
+        perror("eventfd");
+        close(server_fd);
         return false;
     }
 
-    FD_SET(server_fd_, &master_fds_);
-    max_fd_ = server_fd_;
+    reactor.listen_fd = server_fd;
+    reactor.wake_fd = wake_fd;
+#ifdef SEARCH_ENGINE_IO_URING
+    if (options_.backend == IoBackend::IoUring && start_ring(reactor))
+    {
+        return true;
+    }
+#endif
 
-    spdlog::info("async server listening on port {}", port_);
+    try
+    {
+        reactor.loop = std::make_unique<event_loop::EpollLoop>();
+        // The listening socket and the wakeup fd are told apart from
+        // connections by their addresses in the reactor
+        reactor.loop->add(server_fd, &reactor.listen_fd);
+        reactor.loop->add(wake_fd, &reactor.wake_fd);
+    }
+    catch (const std::system_error &e)
+    {
+        spdlog::error("setting up event loop failed with error {}", e.what());
+        reactor.loop.reset();
+        close(wake_fd);
+        close(server_fd);
+        reactor.listen_fd = -1;
+        reactor.wake_fd = -1;
+        return false;
+    }
     return true;
 }
 
 #define SEARCH_ENGINE_SERVER_BUFFER_SIZE 4096
+// Receive buffers of an io_uring reactor, shared by its connections
+#define SEARCH_ENGINE_SERVER_RING_BUFFERS 1024
 
-/// @brief generate a response for the client request
-/// @param client_fd: fd of the client
-/// @return boolean: true if client is still alive, false if it was closed
-bool MinimalAsyncServer::handle_client_data(int client_fd)
+#ifdef SEARCH_ENGINE_IO_URING
+bool MinimalAsyncServer::start_ring(Reactor &reactor)
 {
-    unsigned char buffer[SEARCH_ENGINE_SERVER_BUFFER_SIZE];
-    ssize_t bytes_read = recv(client_fd, buffer, SEARCH_ENGINE_SERVER_BUFFER_SIZE, 0);
-
-    if (bytes_read <= 0)
+    try
     {
-        spdlog::info("client {} disconnected", client_fd);
-        close_client(client_fd);
+        reactor.ring = std::make_unique<uring::UringLoop>(4096, SEARCH_ENGINE_SERVER_RING_BUFFERS, SEARCH_ENGINE_SERVER_BUFFER_SIZE);
+    }
+    catch (const std::system_error &e)
+    {
+        // The other reactors would fail the same way
+        spdlog::warn("io_uring unavailable ({}), using epoll", e.what());
+        options_.backend = IoBackend::Epoll;
         return false;
     }
 
-    std::vector<unsigned char> request = std::vector<unsigned char>();
-    request.reserve(SEARCH_ENGINE_SERVER_BUFFER_SIZE);
-    size_t req_offset = 0;
+    reactor.ring->accept_multishot(reactor.listen_fd, ring_tag(RingOperation::Accept, reactor.listen_fd));
+    reactor.ring->read(reactor.wake_fd, &reactor.wake_count, sizeof(reactor.wake_count), ring_tag(RingOperation::Wake, reactor.wake_fd));
+    return true;
+}
+
+void MinimalAsyncServer::receive(Reactor &reactor, Connection &connection)
+{
+    reactor.ring->receive_multishot(connection.fd, ring_tag(RingOperation::Receive, connection.fd, connection.id));
+    connection.receiving = true;
+}
+
+void MinimalAsyncServer::handle_completion_event(Reactor &reactor, const uring::Completion &completion)
+{
+    auto operation = static_cast<RingOperation>(completion.user_data & 0xff);
+    int fd = static_cast<int>((completion.user_data >> 8) & 0xffffff);
+    uint32_t connection_id = static_cast<uint32_t>(completion.user_data >> 32);
+
+    switch (operation)
+    {
+    case RingOperation::Accept:
+        if (completion.result >= 0)
+        {
+            add_client(reactor, completion.result);
+        }
+        else if (completion.result != -ECANCELED)
+        {
+            spdlog::warn("accept failed: {}", strerror(-completion.result));
+        }
+        if (!completion.more())
+        {
+            reactor.ring->accept_multishot(reactor.listen_fd, completion.user_data);
+        }
+        return;
+    case RingOperation::Wake:
+        deliver_completed(reactor);
+        reactor.ring->read(reactor.wake_fd, &reactor.wake_count, sizeof(reactor.wake_count), completion.user_data);
+        return;
+    case RingOperation::Cancel:
+        return;
+    default:
+        break;
+    }
 
-    do
+    auto *connection_ptr = reactor.connections.find(fd);
+    if (connection_ptr == nullptr || static_cast<uint32_t>((*connection_ptr)->id) != connection_id)
     {
-        for (size_t i = 0; i < bytes_read; i++)
+        // Left over from a closed connection, its buffer still goes back
+        if (completion.has_buffer())
         {
-            request.push_back(buffer[i]);
+            reactor.ring->recycle(completion.buffer_id());
         }
-        size_t bytes_read = recv(client_fd, buffer, SEARCH_ENGINE_SERVER_BUFFER_SIZE, 0);
-    } while (bytes_read == SEARCH_ENGINE_SERVER_BUFFER_SIZE);
+        return;
+    }
 
-    handle_request(client_fd, request);
+    Connection &connection = **connection_ptr;
+    if (operation == RingOperation::Writable)
+    {
+        connection.writing = false;
+        handle_writable(reactor, connection);
+        return;
+    }
 
-    return true;
+    if (completion.result > 0)
+    {
+        // Input is buffered even while paused, bytes in flight when the
+        // receive was cancelled still arrive
+        std::string_view bytes = reactor.ring->buffer(completion.buffer_id(), static_cast<std::size_t>(completion.result));
+        connection.input.insert(connection.input.end(), bytes.begin(), bytes.end());
+        reactor.ring->recycle(completion.buffer_id());
+    }
+    else if (completion.result != -ENOBUFS && completion.result != -ECANCELED)
+    {
+        spdlog::info("client {} disconnected", fd);
+        connection.closing = true;
+    }
+    if (!completion.more())
+    {
+        // Out of buffers, or cancelled for a paused connection that may have
+        // resumed since
+        connection.receiving = false;
+        if (!connection.paused && !connection.closing)
+        {
+            receive(reactor, connection);
+        }
+    }
+    handle_input(reactor, connection);
 }
+#endif
 
-void MinimalAsyncServer::handle_request(int client_fd, std::vector<unsigned char> request)
+/// @brief read everything the client sent and generate a response
+/// @param connection: connection reported readable
+/// @return boolean: true if client is still alive, false if it was closed
+bool MinimalAsyncServer::handle_client_data(Reactor &reactor, Connection &connection)
 {
-    std::string s = std::string(request.begin(), request.end());
-    s.erase(s.begin(), std::find_if_not(s.begin(), s.end(), ::isspace));
-    s.erase(std::find_if_not(s.rbegin(), s.rend(), ::isspace).base(), s.end());
-
-    spdlog::info("client {}: {:?}", client_fd, s);
-
-    using bsoncxx::builder::basic::kvp;
-    using bsoncxx::builder::basic::make_document;
+    int client_fd = connection.fd;
+    if (connection.paused)
+    {
+        // Reading resumes once the client takes its responses
+        return true;
+    }
 
-    using clock = std::chrono::high_resolution_clock;
+#ifdef SEARCH_ENGINE_IO_URING
+    if (reactor.ring != nullptr)
+    {
+        // Completions buffer the input, a receive ended by the pause starts again
+        if (!connection.receiving && !connection.closing)
+        {
+            receive(reactor, connection);
+        }
+        return handle_input(reactor, connection);
+    }
+#endif
 
-    auto start = clock::now();
-    auto result = index_.and_query(tokenize_and_stem(s));
-    auto end = clock::now();
+    // Edge-triggered, so the socket is drained before waiting again
+    auto status = event_loop::read_available(client_fd, connection.input, SEARCH_ENGINE_SERVER_BUFFER_SIZE);
+    if (status == event_loop::ReadStatus::Closed)
+    {
+        spdlog::info("client {} disconnected", client_fd);
+        connection.closing = true;
+    }
+    return handle_input(reactor, connection);
+}
 
-    spdlog::info("search took {}μs", std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+bool MinimalAsyncServer::handle_input(Reactor &reactor, Connection &connection)
+{
+    if (!dispatch(reactor, connection) || !flush_output(reactor, connection))
+    {
+        return false;
+    }
+    return !close_if_done(reactor, connection);
+}
 
-    std::string response;
-    response.reserve(1024);
-    int64_t response_count = 0;
-    for (auto &doc : result)
+bool MinimalAsyncServer::dispatch(Reactor &reactor, Connection &connection)
+{
+    std::size_t offset = 0;
+    while (offset < connection.input.size() && !connection.input_done)
     {
-        if (response_count >= max_response_count_)
+        if (connection.output.size() >= options_.max_output_bytes)
         {
-            break;
+            // Stop taking requests from a client that does not read its answers
+            if (!flush_output(reactor, connection))
+            {
+                return false;
+            }
+            if (connection.output.size() >= options_.max_output_bytes)
+            {
+#ifdef SEARCH_ENGINE_IO_URING
+                if (reactor.ring != nullptr && connection.receiving && !connection.paused)
+                {
+                    reactor.ring->cancel(ring_tag(RingOperation::Receive, connection.fd, connection.id),
+                                         ring_tag(RingOperation::Cancel, connection.fd, connection.id));
+                }
+#endif
+                connection.paused = true;
+                break;
+            }
         }
 
-        std::string partial_printing;
-        partial_printing.reserve(100);
+        const unsigned char *data = connection.input.data() + offset;
+        std::size_t size = connection.input.size() - offset;
+        std::size_t consumed = 0;
+
+        if (connection.format == WireFormat::Unknown)
+        {
+            if (http::is_http(data, size))
+            {
+                // Too short to tell a GET from a text query starting with "GE"
+                if (size < 4 && !connection.closing)
+                {
+                    break;
+                }
+                connection.format = size < 4 ? WireFormat::Text : WireFormat::Http;
+            }
+            else
+            {
+                connection.format = protocol::is_binary(data[0]) ? WireFormat::Binary : WireFormat::Text;
+            }
+            if (connection.format == WireFormat::Text)
+            {
+                greet(connection);
+            }
+        }
 
-        for (size_t i = 0; i < doc.size(); i++)
+        Request request{connection.fd, connection.id, connection.format, 0, protocol::Opcode::Search, {}, true, {}};
+        if (request.format == WireFormat::Binary)
         {
-            if (i < 100)
+            protocol::Frame frame;
+            auto status = protocol::parse_frame(data, size, frame, consumed);
+            if (status == protocol::ParseStatus::Incomplete)
+            {
+                break;
+            }
+            if (status == protocol::ParseStatus::Invalid)
             {
-                partial_printing.push_back(doc[i]);
+                spdlog::warn("client {} sent a frame over {} bytes, closing", connection.fd, protocol::MAX_PAYLOAD_BYTES);
+                std::string response;
+                protocol::append_frame(response, protocol::read_u32(data + 4), protocol::Opcode::Error, "frame too large");
+                send(connection.fd, static_cast<const void *>(response.data()), response.size(), MSG_DONTWAIT);
+                close_client(reactor, connection.fd);
+                return false;
             }
-            response.push_back(doc[i]);
+            request.request_id = frame.request_id;
+            request.opcode = frame.opcode;
+            request.payload = std::string(frame.payload);
+            request.deadline = deadline::Deadline::after(deadline::client_timeout(frame.deadline_ms, options_.request_timeout_ms));
         }
-        response.push_back('\n');
-        spdlog::info("{}", partial_printing);
-        response_count++;
+        else if (request.format == WireFormat::Http)
+        {
+            // Responses carry no id, so one request is answered at a time
+            if (connection.pending > 0)
+            {
+                break;
+            }
+            http::Request head;
+            auto status = http::parse_request(data, size, head, consumed);
+            if (status == protocol::ParseStatus::Incomplete)
+            {
+                break;
+            }
+            if (status == protocol::ParseStatus::Invalid)
+            {
+                spdlog::warn("client {} sent a malformed HTTP request, closing", connection.fd);
+                std::string response;
+                http::append_head(response, 400, "Bad Request", "text/plain", 12, false);
+                response += "bad request\n";
+                output_buffer::Message message;
+                message.append(response);
+                connection.output.push(std::move(message));
+                connection.closing = true;
+                connection.input_done = true;
+                break;
+            }
+            request.payload.reserve(head.method.size() + 1 + head.target.size());
+            request.payload.append(head.method.data(), head.method.size());
+            request.payload += ' ';
+            request.payload.append(head.target.data(), head.target.size());
+            request.keep_alive = head.keep_alive;
+            uint32_t timeout_ms = 0;
+            std::string_view timeout;
+            if (http::find_parameter(head.query, "timeout_ms", timeout))
+            {
+                // Unparsable values keep the default
+                std::from_chars(timeout.data(), timeout.data() + timeout.size(), timeout_ms);
+            }
+            // A client may shorten its deadline, not lift it
+            request.deadline = deadline::Deadline::after(deadline::client_timeout(timeout_ms, options_.request_timeout_ms));
+            if (!head.keep_alive)
+            {
+                // Answered, then the connection is closed
+                connection.closing = true;
+                connection.input_done = true;
+            }
+        }
+        else
+        {
+            // Text responses carry no id, so one line is answered at a time
+            if (connection.pending > 0)
+            {
+                break;
+            }
+            std::string_view line;
+            if (!protocol::next_line(data, size, connection.closing, line, consumed))
+            {
+                if (size > protocol::MAX_PAYLOAD_BYTES)
+                {
+                    spdlog::warn("client {} sent a line over {} bytes, closing", connection.fd, protocol::MAX_PAYLOAD_BYTES);
+                    close_client(reactor, connection.fd);
+                    return false;
+                }
+                break;
+            }
+            request.payload = std::string(line);
+            request.deadline = deadline::Deadline::after(options_.request_timeout_ms);
+        }
+
+        offset += consumed;
+        submit(reactor, connection, std::move(request));
     }
 
-    send(client_fd, static_cast<const void *>(response.data()), response.size(), 0);
+    if (connection.input_done)
+    {
+        connection.input.clear();
+        return true;
+    }
+    connection.input.erase(connection.input.begin(), connection.input.begin() + offset);
+    return true;
 }
 
-void MinimalAsyncServer::close_client(int client_fd)
+void MinimalAsyncServer::submit(Reactor &reactor, Connection &connection, Request request)
 {
-    close(client_fd);
-    FD_CLR(client_fd, &master_fds_);
+    if (workers_ != nullptr && reactor.queued.load(std::memory_order_relaxed) < options_.max_queued_queries)
+    {
+        connection.pending++;
+        reactor.queued.fetch_add(1, std::memory_order_relaxed);
+        workers_->submit([this, &reactor, request = std::move(request)]
+                         {
+                             output_buffer::Message response = respond(request);
+                             reactor.queued.fetch_sub(1, std::memory_order_relaxed);
+                             {
+                                 std::lock_guard<std::mutex> lock(reactor.completed_mutex);
+                                 reactor.completed.push_back(CompletedRequest{request.fd, request.connection_id, std::move(response)});
+                             }
+                             uint64_t one = 1;
+                             if (write(reactor.wake_fd, &one, sizeof(one)) < 0)
+                             {
+                                 spdlog::warn("waking event loop {} failed: {}", reactor.index, strerror(errno));
+                             } });
+        return;
+    }
+
+    if (workers_ != nullptr && options_.shed_load)
+    {
+        // Refusing is cheap, the event loop stays free for other clients
+        connection.output.push(reject(request, false));
+        return;
+    }
+
+    // No worker or a full queue: the event loop evaluates the request and
+    // reads nothing meanwhile, which pushes back on clients
+    connection.output.push(respond(request));
+}
 
-    auto it = std::find(client_fds_.begin(), client_fds_.end(), client_fd);
-    if (it != client_fds_.end())
+output_buffer::Message MinimalAsyncServer::respond(const Request &request)
+{
+    // Spent its time waiting in a queue, the client has likely given up
+    if (request.deadline.expired())
+    {
+        return reject(request, true);
+    }
+    try
+    {
+        if (request.format == WireFormat::Text)
+        {
+            return handle_request(request.fd, request.payload, &request.deadline);
+        }
+        if (request.format == WireFormat::Http)
+        {
+            return handle_http(request.payload, request.keep_alive, &request.deadline);
+        }
+    }
+    catch (const deadline::TimedOut &)
+    {
+        return reject(request, true);
+    }
+    catch (const deadline::Overloaded &)
     {
-        std::iter_swap(it, client_fds_.end() - 1);
-        client_fds_.pop_back();
+        return reject(request, false);
     }
 
-    if (client_fd == max_fd_)
+    spdlog::info("client {} request {}: opcode {} {:?}", request.fd, request.request_id, static_cast<int>(request.opcode), request.payload);
+    output_buffer::Message payload;
+    protocol::Opcode status = protocol::Opcode::Ok;
+    try
     {
-        max_fd_ = server_fd_;
-        for (int fd : client_fds_)
+        switch (request.opcode)
         {
-            if (fd > max_fd_)
-                max_fd_ = fd;
+        case protocol::Opcode::Search:
+            payload = handle_search(request.payload, &request.deadline);
+            break;
+        case protocol::Opcode::Complete:
+            payload = handle_completion(request.payload);
+            break;
+        case protocol::Opcode::Facets:
+            payload = handle_facets(request.payload, &request.deadline);
+            break;
+        case protocol::Opcode::Batch:
+            payload = handle_batch(request.payload, &request.deadline);
+            break;
+        default:
+            status = protocol::Opcode::Error;
+            payload.append_external("unknown opcode");
+            break;
         }
     }
+    catch (const deadline::TimedOut &)
+    {
+        return reject(request, true);
+    }
+    catch (const deadline::Overloaded &)
+    {
+        return reject(request, false);
+    }
+    if (payload.size() > protocol::MAX_PAYLOAD_BYTES)
+    {
+        status = protocol::Opcode::Error;
+        payload = output_buffer::Message();
+        payload.append_external("response too large");
+    }
+
+    unsigned char header[protocol::HEADER_BYTES];
+    protocol::write_header(header, request.request_id, status, static_cast<uint32_t>(payload.size()));
+    output_buffer::Message response;
+    response.append(std::string_view(reinterpret_cast<const char *>(header), protocol::HEADER_BYTES));
+    response.append(payload);
+    return response;
 }
 
-void MinimalAsyncServer::accept_new_client()
+output_buffer::Message MinimalAsyncServer::reject(const Request &request, bool timed_out)
 {
-    sockaddr_in client_addr{};
-    socklen_t addr_len = sizeof(client_addr);
+    (timed_out ? timed_out_ : overloaded_).fetch_add(1, std::memory_order_relaxed);
+    spdlog::warn("client {} request {} {}", request.fd, request.request_id, timed_out ? "timed out" : "overloaded");
 
-    int client_fd = accept(server_fd_, (sockaddr *)&client_addr, &addr_len);
+    output_buffer::Message response;
+    if (request.format == WireFormat::Binary)
+    {
+        std::string frame;
+        protocol::append_frame(frame, request.request_id, protocol::Opcode::Error, timed_out ? "timed out" : "overloaded");
+        response.append(frame);
+    }
+    else if (request.format == WireFormat::Http)
+    {
+        std::string_view body = timed_out ? "{\"error\":\"timed out\"}\n" : "{\"error\":\"overloaded\"}\n";
+        std::string head;
+        http::append_head(head, timed_out ? 504 : 503, timed_out ? "Gateway Timeout" : "Service Unavailable",
+                          "application/json", body.size(), request.keep_alive);
+        response.append(head);
+        response.append_external(body);
+    }
+    else
+    {
+        response.append_external(timed_out ? "timed out\n" : "overloaded\n");
+    }
+    return response;
+}
 
-    if (client_fd >= 0)
+bool MinimalAsyncServer::flush_output(Reactor &reactor, Connection &connection)
+{
+    auto status = connection.output.flush(connection.fd);
+    if (status == output_buffer::FlushStatus::Failed)
     {
-        fcntl(client_fd, F_SETFL, O_NONBLOCK);
-        FD_SET(client_fd, &master_fds_);
-        client_fds_.push_back(client_fd);
+        spdlog::info("client {} stopped reading, closing", connection.fd);
+        close_client(reactor, connection.fd);
+        return false;
+    }
 
-        if (client_fd > max_fd_)
+    // Writability is only waited for while something is left to write
+    bool blocked = status == output_buffer::FlushStatus::Blocked;
+#ifdef SEARCH_ENGINE_IO_URING
+    if (reactor.ring != nullptr)
+    {
+        // A one-shot poll, its completion clears `writing`
+        if (blocked && !connection.writing)
         {
-            max_fd_ = client_fd;
+            reactor.ring->poll_writable(connection.fd, ring_tag(RingOperation::Writable, connection.fd, connection.id));
+            connection.writing = true;
         }
-
-        spdlog::info("new client connected: {}", client_fd);
-        const char *welcome = "Welcome to async server!\n";
-        send(client_fd, welcome, strlen(welcome), 0);
+        return true;
+    }
+#endif
+    if (blocked != connection.writing)
+    {
+        try
+        {
+            uint32_t events = event_loop::Readable;
+            if (blocked)
+            {
+                events |= event_loop::Writable;
+            }
+            reactor.loop->modify(connection.fd, &connection, events);
+        }
+        catch (const std::system_error &e)
+        {
+            spdlog::warn("dropping client {}: {}", connection.fd, e.what());
+            close_client(reactor, connection.fd);
+            return false;
+        }
+        connection.writing = blocked;
     }
+    return true;
 }
 
-void MinimalAsyncServer::run()
+bool MinimalAsyncServer::close_if_done(Reactor &reactor, Connection &connection)
 {
-    if (!start())
+    if (connection.closing && connection.pending == 0 && connection.output.empty())
     {
-        return;
+        close_client(reactor, connection.fd);
+        return true;
     }
+    return false;
+}
 
-    spdlog::info("server running. Press Ctrl+C to stop.");
-
-    while (!stop_flag)
+bool MinimalAsyncServer::handle_writable(Reactor &reactor, Connection &connection)
+{
+    if (!flush_output(reactor, connection))
     {
-        fd_set read_fds = master_fds_;
-
-        struct timeval timeout;
-        timeout.tv_sec = 5;
-        timeout.tv_usec = 0;
-
-        int activity = select(max_fd_ + 1, &read_fds, nullptr, nullptr, &timeout);
+        return false;
+    }
+    if (connection.paused && connection.output.size() < options_.max_output_bytes)
+    {
+        // Input that arrived meanwhile was not read, edge triggering will
+        // not report it again
+        connection.paused = false;
+        return handle_client_data(reactor, connection);
+    }
+    return !close_if_done(reactor, connection);
+}
 
-        if (activity < 0)
-        {
-            if (errno == EINTR)
-            {
-                continue;
-            }
+void MinimalAsyncServer::deliver_completed(Reactor &reactor)
+{
+    uint64_t signals;
+    while (read(reactor.wake_fd, &signals, sizeof(signals)) > 0)
+    {
+    }
 
-            perror("select");
-            break;
-        }
+    std::vector<CompletedRequest> completed;
+    {
+        std::lock_guard<std::mutex> lock(reactor.completed_mutex);
+        completed.swap(reactor.completed);
+    }
 
-        if (FD_ISSET(server_fd_, &read_fds))
+    for (auto &request : completed)
+    {
+        auto *connection_ptr = reactor.connections.find(request.fd);
+        if (connection_ptr == nullptr || (*connection_ptr)->id != request.connection_id)
         {
-            accept_new_client();
+            // Closed while the request was evaluated
+            continue;
         }
 
-        for (size_t i = 0; i < client_fds_.size();)
+        Connection &connection = **connection_ptr;
+        connection.output.push(std::move(request.response));
+        connection.pending--;
+        // Text lines waiting for this answer go next
+        if (!dispatch(reactor, connection) || !flush_output(reactor, connection))
         {
-            int client_fd = client_fds_[i];
-            if (FD_ISSET(client_fd, &read_fds))
-            {
-                if (handle_client_data(client_fd))
-                {
-                    i++;
-                }
-            }
-            else
-            {
-                i++;
-            }
+            continue;
         }
+        close_if_done(reactor, connection);
     }
-
-    spdlog::info("shutting down server...");
 }
 
-void MinimalAsyncServer::stop()
+output_buffer::Message MinimalAsyncServer::handle_request(int client_fd, std::string request, const deadline::Deadline *deadline)
 {
-    for (int client_fd : client_fds_)
+    std::string s = std::move(request);
+    s.erase(s.begin(), std::find_if_not(s.begin(), s.end(), ::isspace));
+    s.erase(std::find_if_not(s.rbegin(), s.rend(), ::isspace).base(), s.end());
+
+    spdlog::info("client {}: {:?}", client_fd, s);
+
+    const std::string_view complete_marker = "complete:";
+    if (s.compare(0, complete_marker.size(), complete_marker) == 0)
+    {
+        return handle_completion(s.substr(complete_marker.size()));
+    }
+    const std::string_view facets_marker = "facets:";
+    if (s.compare(0, facets_marker.size(), facets_marker) == 0)
     {
-        close(client_fd);
+        return handle_facets(s.substr(facets_marker.size()), deadline);
     }
-    client_fds_.clear();
+    return handle_search(std::move(s), deadline);
+}
 
-    if (server_fd_ != -1)
+output_buffer::Message MinimalAsyncServer::handle_search(std::string s, const deadline::Deadline *deadline)
+{
+    output_buffer::Message response;
+    if (query::is_plain(s) && search_plain(s, deadline, response))
     {
-        close(server_fd_);
-        server_fd_ = -1;
+        return response;
     }
+    return format_search(search(parse_request(s), nullptr, deadline));
+}
 
-    FD_ZERO(&master_fds_);
-}
\ No newline at end of file
+bool MinimalAsyncServer::search_plain(std::string_view text, const deadline::Deadline *deadline, output_buffer::Message &response)
+{
+    arena::Scope scope(request_arena);
+    PlainSearch found(&request_arena);
+    if (!evaluate_plain(text, deadline, found))
+    {
+        return false;
+    }
+    if (!found.cached)
+    {
+        // The cache keeps its own copy on the heap
+        cache_.insert(std::string(found.cache_key), found.generation,
+                      std::vector<uint32_t>(found.documents.begin(), found.documents.end()));
+    }
+    response = format_hits(found.count, found.documents.data(), found.documents.size());
+    return true;
+}
+
+bool MinimalAsyncServer::evaluate_plain(std::string_view text, const deadline::Deadline *deadline, PlainSearch &found)
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    auto start = clock::now();
+    std::pmr::memory_resource *memory = found.documents.get_allocator().resource();
+    auto &terms = found.terms;
+    tokenize_and_stem(text, terms);
+    if (terms.empty())
+    {
+        return false;
+    }
+    for (const auto &term : terms)
+    {
+        if (!index_.contains_term(term))
+        {
+            return false;
+        }
+    }
+
+    found.cache_key = "and";
+    query::append_terms(found.cache_key, terms, false);
+    auto &result = found.documents;
+    found.generation = index_.generation();
+    found.cached = cache_.find(found.cache_key, found.generation, result);
+    if (!found.cached)
+    {
+        if (options_.max_query_cost != 0)
+        {
+            std::size_t cost = index_.estimate_cost(terms, false);
+            if (cost > options_.max_query_cost)
+            {
+                spdlog::info("query cost {} over {}", cost, options_.max_query_cost);
+                throw deadline::Overloaded();
+            }
+        }
+        boolean_index::QueryFilter<uint32_t> filter;
+        filter.deadline = deadline;
+        index_.and_query(terms, result, nullptr, &filter);
+        if (deadline != nullptr && deadline->expired())
+        {
+            throw deadline::TimedOut();
+        }
+    }
+
+    found.count = cardinality::exact(result.size());
+    if (static_cast<int64_t>(result.size()) >= max_response_count_)
+    {
+        auto &count = found.count;
+        count = index_.estimate_and_count_in(terms, memory);
+        count.lower = std::max(count.lower, result.size());
+        count.estimate = std::max(count.estimate, count.lower);
+        count.upper = std::max(count.upper, count.estimate);
+    }
+    auto end = clock::now();
+
+    spdlog::info("search took {}μs{}", std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(), found.cached ? " (cached)" : "");
+    return true;
+}
+
+output_buffer::Message MinimalAsyncServer::format_search(const SearchResult &found) const
+{
+    return format_hits(found.count, found.documents.data(), found.documents.size());
+}
+
+output_buffer::Message MinimalAsyncServer::format_hits(const cardinality::Estimate &count, const uint32_t *documents, std::size_t size) const
+{
+    // Hits are sent straight from the document store, the count line is
+    // formatted on the stack
+    output_buffer::Message response;
+    fmt::memory_buffer count_line;
+    if (count.exact)
+    {
+        fmt::format_to(std::back_inserter(count_line), "{} results", count.estimate);
+    }
+    else
+    {
+        fmt::format_to(std::back_inserter(count_line), "about {} results ({}-{})", count.estimate, count.lower, count.upper);
+    }
+    std::string_view line(count_line.data(), count_line.size());
+    spdlog::info("{}", line);
+    // The count line and its newline, then each hit and its newline
+    std::size_t hits = std::min<std::size_t>(size, static_cast<std::size_t>(std::max<int64_t>(max_response_count_, 0)));
+    response.reserve(line.size(), 2 + 2 * hits);
+    response.append(line);
+    response.append_external("\n");
+
+    int64_t response_count = 0;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        uint32_t doc_id = documents[i];
+        if (response_count >= max_response_count_)
+        {
+            break;
+        }
+
+        const std::string &doc = documents_.source(doc_id);
+        response.append_external(doc);
+        response.append_external("\n");
+        spdlog::info("{}", std::string_view(doc).substr(0, 100));
+        response_count++;
+    }
+
+    return response;
+}
+
+output_buffer::Message MinimalAsyncServer::handle_http(std::string request_line, bool keep_alive, const deadline::Deadline *deadline)
+{
+    std::string_view line = request_line;
+    std::size_t space = line.find(' ');
+    std::string_view method = line.substr(0, space);
+    std::string_view target = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+    std::size_t question = target.find('?');
+    std::string_view path = target.substr(0, question);
+
+    spdlog::info("http {} {}", method, target);
+
+    int status = 200;
+    std::string_view reason = "OK";
+    std::string_view body;
+    std::string health;
+    if (method != "GET")
+    {
+        status = 405;
+        reason = "Method Not Allowed";
+        body = "{\"error\":\"method not allowed\"}";
+    }
+    else if (path == "/search")
+    {
+        return handle_http_search(question == std::string_view::npos ? std::string_view() : target.substr(question + 1), keep_alive, deadline);
+    }
+    else if (path == "/health")
+    {
+        RequestStats stats = request_stats();
+        http::JsonWriter json(health);
+        json.begin_object();
+        json.key("status");
+        json.value("ok");
+        json.key("timed_out");
+        json.value(stats.timed_out);
+        json.key("overloaded");
+        json.value(stats.overloaded);
+        json.end_object();
+        body = health;
+    }
+    else
+    {
+        status = 404;
+        reason = "Not Found";
+        body = "{\"error\":\"not found\"}";
+    }
+
+    std::string head;
+    http::append_head(head, status, reason, "application/json", body.size(), keep_alive);
+    output_buffer::Message response;
+    response.append(head);
+    // Bodies are literals, except the health counters
+    response.append(body);
+    return response;
+}
+
+output_buffer::Message MinimalAsyncServer::handle_http_search(std::string_view query, bool keep_alive, const deadline::Deadline *deadline)
+{
+    std::string text;
+    std::string_view value;
+    const char *error = nullptr;
+    bool any_term = false;
+    int64_t limit = max_response_count_;
+    if (!http::find_parameter(query, "q", value) || !http::decode_component(value, text))
+    {
+        error = "missing or malformed q";
+    }
+    else if (http::find_parameter(query, "op", value) && value != "and" && !(any_term = value == "or"))
+    {
+        error = "op must be and or or";
+    }
+    else if (http::find_parameter(query, "limit", value))
+    {
+        auto [rest, failure] = std::from_chars(value.data(), value.data() + value.size(), limit);
+        if (failure != std::errc() || rest != value.data() + value.size() || limit < 0)
+        {
+            error = "limit must be a non-negative number";
+        }
+        // The index keeps at most the response count of hits
+        limit = std::min(limit, max_response_count_);
+    }
+
+    std::string body;
+    http::JsonWriter json(body);
+    int status = 200;
+    if (error != nullptr)
+    {
+        status = 400;
+        json.begin_object();
+        json.key("error");
+        json.value(error);
+        json.end_object();
+    }
+    else
+    {
+        using clock = std::chrono::high_resolution_clock;
+        auto start = clock::now();
+        SearchResult found = search(parse_request(text, any_term), nullptr, deadline);
+        auto end = clock::now();
+
+        std::size_t hits = std::min(found.documents.size(), static_cast<std::size_t>(limit));
+        body.reserve(128 + hits * 96);
+        json.begin_object();
+        json.key("query");
+        json.value(std::string_view(text));
+        json.key("count");
+        json.value(static_cast<uint64_t>(found.count.estimate));
+        json.key("exact");
+        json.value(found.count.exact);
+        if (!found.count.exact)
+        {
+            json.key("lower");
+            json.value(static_cast<uint64_t>(found.count.lower));
+            json.key("upper");
+            json.value(static_cast<uint64_t>(found.count.upper));
+        }
+        json.key("took_us");
+        json.value(static_cast<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()));
+        json.key("results");
+        json.begin_array();
+        for (std::size_t i = 0; i < hits; i++)
+        {
+            json.begin_object();
+            json.key("id");
+            json.value(found.documents[i]);
+            json.key("url");
+            json.value(std::string_view(documents_.source(found.documents[i])));
+            json.end_object();
+        }
+        json.end_array();
+        json.end_object();
+    }
+    body += '\n';
+
+    std::string head;
+    http::append_head(head, status, status == 200 ? "OK" : "Bad Request", "application/json", body.size(), keep_alive);
+    output_buffer::Message response;
+    response.reserve(head.size() + body.size());
+    response.append(head);
+    response.append(body);
+    return response;
+}
+
+SearchResult MinimalAsyncServer::search(const query::Query &parsed, const boolean_index::ResolvedTerms<uint32_t> *terms,
+                                        const deadline::Deadline *deadline)
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    auto start = clock::now();
+    std::string cache_key = query::cache_key(parsed);
+    std::vector<uint32_t> result;
+    intersection::IntersectionStats stats;
+    boolean_index::PrefixExpansion expansion;
+    doc_values::RangeFilter<uint32_t, int64_t> lastmod_filter;
+    boolean_index::QueryFilter<uint32_t> query_filter;
+    bool satisfiable = make_filter(parsed, lastmod_filter, query_filter);
+    bool filtered = parsed.has_lastmod_filter() || !parsed.facets.empty();
+    query_filter.terms = terms;
+    query_filter.deadline = deadline;
+    const auto *filter = filtered || terms != nullptr || deadline != nullptr ? &query_filter : nullptr;
+    uint64_t generation = index_.generation();
+    bool cached = cache_.find(cache_key, generation, result);
+    if (!cached && satisfiable && parsed.op == query::Operator::Prefix)
+    {
+        // Expanded once, for the cost check and the evaluation
+        expansion = index_.expand_prefix(parsed.prefix);
+    }
+    if (!cached && satisfiable && options_.max_query_cost != 0 &&
+        (parsed.op == query::Operator::And || parsed.op == query::Operator::Or || parsed.op == query::Operator::Phrase ||
+         parsed.op == query::Operator::Prefix || (parsed.op == query::Operator::Substring && trigrams_ != nullptr)))
+    {
+        std::size_t cost = 0;
+        if (parsed.op == query::Operator::Substring)
+        {
+            cost = trigrams_->estimate_cost(parsed.text);
+        }
+        else if (parsed.op == query::Operator::Prefix)
+        {
+            // The union of the expanded terms is merged, required terms are probed
+            cost = expansion.terms.empty() ? 0 : index_.estimate_cost(expansion.terms, true, filter);
+            if (!parsed.terms.empty())
+            {
+                cost += index_.estimate_cost(parsed.terms, false, filter);
+            }
+        }
+        else
+        {
+            cost = index_.estimate_cost(parsed.terms, parsed.op == query::Operator::Or, filter);
+        }
+        if (cost > options_.max_query_cost)
+        {
+            spdlog::info("query cost {} over {}", cost, options_.max_query_cost);
+            throw deadline::Overloaded();
+        }
+    }
+    if (!cached && satisfiable)
+    {
+        switch (parsed.op)
+        {
+        case query::Operator::Phrase:
+            result = index_.phrase_query(parsed.terms, parsed.slop, &stats, filter);
+            break;
+        case query::Operator::Or:
+            result = index_.or_query(parsed.terms, deadline);
+            break;
+        case query::Operator::Substring:
+            if (trigrams_ != nullptr)
+            {
+                result = trigrams_->substring_query(parsed.text, &stats, deadline);
+            }
+            break;
+        case query::Operator::Prefix:
+            result = index_.prefix_query(expansion, parsed.terms, parsed.excluded, filter);
+            spdlog::info("prefix {}* expanded to {} of {} terms, {} postings{}", parsed.prefix, expansion.terms.size(),
+                         expansion.matched_terms, expansion.postings, expansion.truncated ? " (truncated)" : "");
+            break;
+        default:
+            // A date filter alone selects from every document
+            if (parsed.excluded.empty() && !(parsed.terms.empty() && filtered))
+            {
+                result = index_.and_query(parsed.terms, &stats, filter);
+            }
+            else
+            {
+                result = index_.and_not_query(parsed.terms, parsed.excluded, &stats, filter);
+            }
+            break;
+        }
+        // Evaluation stopped early, the result is incomplete and not cached
+        if (deadline != nullptr && deadline->expired())
+        {
+            throw deadline::TimedOut();
+        }
+        cache_.insert(cache_key, generation, result);
+    }
+    auto end = clock::now();
+
+    spdlog::info("search took {}μs{}", std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(), cached ? " (cached)" : "");
+    if (!stats.steps.empty())
+    {
+        spdlog::info("intersection: {}", stats.to_string());
+    }
+    // stats() locks every shard, so only pay for it when it gets logged
+    if (spdlog::should_log(spdlog::level::debug))
+    {
+        auto cache = cache_.stats();
+        spdlog::debug("query cache: {:.1f}% hits, {} stale, {} entries, {} KB of {} KB",
+                      cache.hit_rate() * 100, cache.stale, cache.entries, cache.bytes / 1024, cache.budget_bytes / 1024);
+    }
+
+    // Exact when the hits were not truncated, else a sampled estimate
+    cardinality::Estimate count = cardinality::exact(result.size());
+    if (static_cast<int64_t>(result.size()) >= max_response_count_)
+    {
+        switch (parsed.op)
+        {
+        case query::Operator::Phrase:
+            count = index_.estimate_phrase_count(parsed.terms, parsed.slop);
+            break;
+        case query::Operator::Or:
+            count = index_.estimate_or_count(parsed.terms);
+            break;
+        case query::Operator::Substring:
+            // Verified matches are not sampled, only bounded. Without a
+            // trigram index nothing matched and the count stays exact
+            if (trigrams_ != nullptr)
+            {
+                count.exact = false;
+                count.upper = trigrams_->document_count();
+            }
+            break;
+        case query::Operator::Prefix:
+            if (cached)
+            {
+                expansion = index_.expand_prefix(parsed.prefix);
+            }
+            count = index_.estimate_or_count(expansion.terms);
+            if (!parsed.terms.empty() || !parsed.excluded.empty())
+            {
+                // Only an upper bound, required and excluded terms shrink it
+                count.estimate = count.lower = 0;
+                count.exact = false;
+            }
+            break;
+        default:
+            count = index_.estimate_and_count(parsed.terms, parsed.excluded);
+            break;
+        }
+        if (filtered && parsed.op != query::Operator::Or && parsed.op != query::Operator::Substring)
+        {
+            // Samples ignore the date filter, so they only bound the count from above
+            count.estimate = count.lower = 0;
+            count.exact = false;
+        }
+        count.lower = std::max(count.lower, result.size());
+        count.estimate = std::max(count.estimate, count.lower);
+        count.upper = std::max(count.upper, count.estimate);
+    }
+
+    return SearchResult{std::move(result), count, cached};
+}
+
+query::Query MinimalAsyncServer::parse_request(const std::string &text, bool any_term) const
+{
+    query::Query parsed = query::parse_query(text);
+    if (any_term && parsed.op == query::Operator::And && parsed.excluded.empty() && parsed.facets.empty() &&
+        !parsed.has_lastmod_filter())
+    {
+        // OR queries take no filters or exclusions, so only plain terms turn
+        // into one
+        parsed.op = query::Operator::Or;
+    }
+    if (parsed.op != query::Operator::Or && parsed.op != query::Operator::Substring)
+    {
+        // A misspelled required term would empty the result
+        auto corrected = index_.correct_terms(parsed.terms);
+        for (std::size_t i = 0; i < corrected.size(); i++)
+        {
+            if (corrected[i] != parsed.terms[i])
+            {
+                spdlog::info("corrected term {} to {}", parsed.terms[i], corrected[i]);
+            }
+        }
+        parsed.terms = std::move(corrected);
+    }
+    return parsed;
+}
+
+bool MinimalAsyncServer::make_filter(const query::Query &parsed, doc_values::RangeFilter<uint32_t, int64_t> &lastmod, boolean_index::QueryFilter<uint32_t> &filter) const
+{
+    if (parsed.has_lastmod_filter())
+    {
+        lastmod = doc_values::RangeFilter<uint32_t, int64_t>{&documents_.lastmods(), parsed.lastmod_min, parsed.lastmod_max};
+        filter.lastmod = &lastmod;
+    }
+    for (const auto &[field, value] : parsed.facets)
+    {
+        const auto *list = documents_.facets().find(field, value);
+        if (list == nullptr)
+        {
+            return false;
+        }
+        filter.facets.push_back(list);
+    }
+    return true;
+}
+
+output_buffer::Message MinimalAsyncServer::handle_facets(std::string text, const deadline::Deadline *deadline)
+{
+    return facet_counts(parse_request(text), nullptr, deadline);
+}
+
+output_buffer::Message MinimalAsyncServer::facet_counts(const query::Query &parsed, const boolean_index::ResolvedTerms<uint32_t> *terms,
+                                                        const deadline::Deadline *deadline)
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    auto start = clock::now();
+    doc_values::RangeFilter<uint32_t, int64_t> lastmod_filter;
+    boolean_index::QueryFilter<uint32_t> filter;
+    filter.terms = terms;
+    if (parsed.op == query::Operator::Phrase || parsed.op == query::Operator::Substring)
+    {
+        // Matches are only verified up to the response limit, so no bitmap
+        // of all of them exists to count
+        output_buffer::Message response;
+        response.append_external("facets are not counted for phrase or substring queries\n");
+        return response;
+    }
+
+    std::vector<facets::FacetCount> counts;
+    if (make_filter(parsed, lastmod_filter, filter))
+    {
+        // Built like the hits of search(): OR takes any term, a prefix any of
+        // the terms it expands to on top of the required ones
+        roaring::RoaringBitmap matches;
+        switch (parsed.op)
+        {
+        case query::Operator::Or:
+            matches = index_.match_bitmap({}, {}, nullptr, &parsed.terms);
+            break;
+        case query::Operator::Prefix:
+        {
+            auto expansion = index_.expand_prefix(parsed.prefix);
+            matches = index_.match_bitmap(parsed.terms, parsed.excluded, &filter, &expansion.terms);
+            break;
+        }
+        default:
+            matches = index_.match_bitmap(parsed.terms, parsed.excluded, &filter);
+            break;
+        }
+        counts = documents_.facets().count("site", matches);
+    }
+    if (deadline != nullptr && deadline->expired())
+    {
+        throw deadline::TimedOut();
+    }
+    auto end = clock::now();
+
+    std::string text_response;
+    text_response.reserve(32 + counts.size() * 32);
+    fmt::format_to(std::back_inserter(text_response), "{} sites\n", counts.size());
+    for (const auto &count : counts)
+    {
+        fmt::format_to(std::back_inserter(text_response), "{} {}\n", count.value, count.count);
+    }
+    output_buffer::Message response;
+    response.append(text_response);
+
+    spdlog::info("facet counts took {}μs, {} sites", std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(), counts.size());
+    return response;
+}
+
+output_buffer::Message MinimalAsyncServer::handle_batch(std::string text, const deadline::Deadline *deadline)
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    enum class Kind
+    {
+        Search,
+        Facets,
+        Complete,
+    };
+    struct Item
+    {
+        Kind kind;
+        // Query text, or the completion request without its marker
+        std::string text;
+        std::size_t query = 0;
+    };
+
+    auto start = clock::now();
+    const std::string_view complete_marker = "complete:";
+    const std::string_view facets_marker = "facets:";
+    std::vector<Item> items;
+    // Queries by text, a search and the facets of the same text parse once
+    hashmap::HashMap<std::string, std::size_t> query_ids;
+    std::vector<query::Query> queries;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        line.erase(line.begin(), std::find_if_not(line.begin(), line.end(), ::isspace));
+        line.erase(std::find_if_not(line.rbegin(), line.rend(), ::isspace).base(), line.end());
+
+        Item item{Kind::Search, std::move(line)};
+        if (item.text.compare(0, complete_marker.size(), complete_marker) == 0)
+        {
+            item.kind = Kind::Complete;
+            item.text.erase(0, complete_marker.size());
+            items.push_back(std::move(item));
+            continue;
+        }
+        if (item.text.compare(0, facets_marker.size(), facets_marker) == 0)
+        {
+            item.kind = Kind::Facets;
+            item.text.erase(0, facets_marker.size());
+        }
+        const auto *known = query_ids.find(item.text);
+        if (known != nullptr)
+        {
+            item.query = *known;
+        }
+        else
+        {
+            item.query = queries.size();
+            query_ids.insert(item.text, item.query);
+            queries.push_back(parse_request(item.text));
+        }
+        items.push_back(std::move(item));
+    }
+
+    std::vector<const std::vector<std::string> *> term_lists;
+    term_lists.reserve(queries.size());
+    for (const auto &parsed : queries)
+    {
+        term_lists.push_back(&parsed.terms);
+    }
+    auto terms = index_.resolve_terms(term_lists);
+
+    // Identical requests share their response, responses are never empty
+    std::vector<output_buffer::Message> searches(queries.size());
+    std::vector<output_buffer::Message> facet_responses(queries.size());
+    output_buffer::Message response;
+    for (auto &item : items)
+    {
+        output_buffer::Message completion;
+        const output_buffer::Message *section = &completion;
+        switch (item.kind)
+        {
+        case Kind::Search:
+            if (searches[item.query].empty())
+            {
+                searches[item.query] = format_search(search(queries[item.query], &terms, deadline));
+            }
+            section = &searches[item.query];
+            break;
+        case Kind::Facets:
+            if (facet_responses[item.query].empty())
+            {
+                facet_responses[item.query] = facet_counts(queries[item.query], &terms, deadline);
+            }
+            section = &facet_responses[item.query];
+            break;
+        case Kind::Complete:
+            completion = handle_completion(std::move(item.text));
+            break;
+        }
+
+        unsigned char length[4];
+        protocol::write_u32(length, static_cast<uint32_t>(section->size()));
+        response.append(std::string_view(reinterpret_cast<const char *>(length), sizeof(length)));
+        response.append(*section);
+    }
+    auto end = clock::now();
+
+    spdlog::info("batch of {} requests, {} distinct queries, {} distinct terms took {}μs", items.size(), queries.size(),
+                 terms.size(), std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    return response;
+}
+
+output_buffer::Message MinimalAsyncServer::handle_completion(std::string text)
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    auto start = clock::now();
+    completion::lowercase_in_place(text);
+    std::size_t last_word = text.rfind(' ');
+    last_word = last_word == std::string::npos ? 0 : last_word + 1;
+    std::string_view words(text.data(), last_word);
+    auto completions = index_.complete(std::string_view(text).substr(last_word));
+
+    // Terms are sent from the completion trie, only the typed words are copied
+    output_buffer::Message response;
+    response.reserve(32 + completions.size() * (words.size() + 1));
+    response.append(fmt::format("{} completions\n", completions.size()));
+    for (uint32_t id : completions)
+    {
+        response.append(words);
+        response.append_external(index_.completions().term(id));
+        response.append("\n");
+    }
+    auto end = clock::now();
+
+    spdlog::info("completion took {}μs, {} results", std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(), completions.size());
+    return response;
+}
+
+RequestStats MinimalAsyncServer::request_stats() const
+{
+    return RequestStats{timed_out_.load(std::memory_order_relaxed), overloaded_.load(std::memory_order_relaxed)};
+}
+
+query_cache::CacheStats MinimalAsyncServer::cache_stats() const
+{
+    return cache_.stats();
+}
+
+void MinimalAsyncServer::set_trigram_index(const trigram_index::TrigramIndex<uint32_t> *trigrams)
+{
+    trigrams_ = trigrams;
+}
+
+void MinimalAsyncServer::close_client(Reactor &reactor, int client_fd)
+{
+#ifdef SEARCH_ENGINE_IO_URING
+    if (reactor.ring != nullptr)
+    {
+        // Ends the receive and poll armed on the socket, they keep it open
+        // past close()
+        shutdown(client_fd, SHUT_RDWR);
+    }
+#endif
+    // Closing the fd also drops it from the epoll set, but events already
+    // taken from it may follow in the same batch
+    close(client_fd);
+    auto *connection_ptr = reactor.connections.find(client_fd);
+    if (connection_ptr != nullptr)
+    {
+        (*connection_ptr)->closed = true;
+        reactor.closed.push_back(std::move(*connection_ptr));
+        reactor.connections.erase(client_fd);
+    }
+}
+
+void MinimalAsyncServer::accept_new_client(Reactor &reactor)
+{
+    // Edge-triggered, so the backlog is accepted until it is empty
+    while (true)
+    {
+        sockaddr_in client_addr{};
+        socklen_t addr_len = sizeof(client_addr);
+
+        int client_fd = accept4(reactor.listen_fd, (sockaddr *)&client_addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                spdlog::warn("accept failed: {}", strerror(errno));
+            }
+            return;
+        }
+
+        add_client(reactor, client_fd);
+    }
+}
+
+void MinimalAsyncServer::add_client(Reactor &reactor, int client_fd)
+{
+    auto connection = std::make_unique<Connection>();
+    connection->fd = client_fd;
+    connection->id = reactor.next_connection_id++;
+#ifdef SEARCH_ENGINE_IO_URING
+    if (reactor.ring != nullptr)
+    {
+        receive(reactor, *connection);
+    }
+    else
+#endif
+    {
+        try
+        {
+            reactor.loop->add(client_fd, connection.get());
+        }
+        catch (const std::system_error &e)
+        {
+            spdlog::warn("dropping client {}: {}", client_fd, e.what());
+            close(client_fd);
+            return;
+        }
+    }
+    Connection &added = *connection;
+    reactor.connections.insert(client_fd, std::move(connection));
+
+    spdlog::info("new client connected: {} (event loop {})", client_fd, reactor.index);
+
+    if (options_.greeting_delay_ms == 0)
+    {
+        added.format = WireFormat::Text;
+        greet(added);
+        flush_output(reactor, added);
+        return;
+    }
+    // Binary and HTTP clients speak first, a text client may wait to be greeted
+    auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(options_.greeting_delay_ms);
+    reactor.silent.push_back({client_fd, added.id, due});
+}
+
+void MinimalAsyncServer::greet(Connection &connection) const
+{
+    if (connection.greeted)
+    {
+        return;
+    }
+    output_buffer::Message welcome;
+    welcome.append_external("Welcome to async server!\n");
+    connection.output.push(std::move(welcome));
+    connection.greeted = true;
+}
+
+int MinimalAsyncServer::greet_silent(Reactor &reactor, int timeout_ms)
+{
+    auto now = std::chrono::steady_clock::now();
+    while (!reactor.silent.empty())
+    {
+        const SilentConnection &silent = reactor.silent.front();
+        if (silent.due > now)
+        {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(silent.due - now).count() + 1;
+            return static_cast<int>(std::min<int64_t>(wait, timeout_ms));
+        }
+
+        auto *connection_ptr = reactor.connections.find(silent.fd);
+        reactor.silent.pop_front();
+        if (connection_ptr == nullptr || (*connection_ptr)->id != silent.connection_id)
+        {
+            continue;
+        }
+        Connection &connection = **connection_ptr;
+        // Anything received, even too little to tell its format, means the
+        // client did not wait for a greeting
+        if (connection.closed || connection.format != WireFormat::Unknown || !connection.input.empty())
+        {
+            continue;
+        }
+        connection.format = WireFormat::Text;
+        greet(connection);
+        if (flush_output(reactor, connection))
+        {
+            close_if_done(reactor, connection);
+        }
+    }
+    return timeout_ms;
+}
+
+void MinimalAsyncServer::run_reactor(Reactor &reactor)
+{
+    auto handle_event = [this, &reactor](void *data, uint32_t events)
+    {
+        if (data == &reactor.listen_fd)
+        {
+            accept_new_client(reactor);
+            return;
+        }
+        if (data == &reactor.wake_fd)
+        {
+            deliver_completed(reactor);
+            return;
+        }
+        auto &connection = *static_cast<Connection *>(data);
+        if (connection.closed)
+        {
+            return;
+        }
+        if ((events & event_loop::Writable) && !handle_writable(reactor, connection))
+        {
+            return;
+        }
+        // Hangups are read too, the client may have sent a request before closing
+        if (events & (event_loop::Readable | event_loop::Closed))
+        {
+            handle_client_data(reactor, connection);
+        }
+    };
+
+    while (!stop_flag)
+    {
+        try
+        {
+            // Woken in time for the next greeting of a silent client
+            int timeout_ms = greet_silent(reactor, 5000);
+#ifdef SEARCH_ENGINE_IO_URING
+            if (reactor.ring != nullptr)
+            {
+                reactor.ring->wait(timeout_ms, [this, &reactor](const uring::Completion &completion)
+                                   { handle_completion_event(reactor, completion); });
+            }
+            else
+#endif
+            {
+                reactor.loop->wait(timeout_ms, handle_event);
+            }
+        }
+        catch (const std::system_error &e)
+        {
+            spdlog::error("event loop {} failed with error {}", reactor.index, e.what());
+            stop_flag = true;
+        }
+        // No event of the batch refers to them anymore
+        reactor.closed.clear();
+    }
+}
+
+void MinimalAsyncServer::run()
+{
+    if (!start())
+    {
+        return;
+    }
+
+    spdlog::info("server running. Press Ctrl+C to stop.");
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < reactors_.size(); i++)
+    {
+        threads.emplace_back([this, &reactor = *reactors_[i]]
+                             { run_reactor(reactor); });
+    }
+    signal_wake_fd = reactors_[0]->wake_fd;
+    run_reactor(*reactors_[0]);
+    signal_wake_fd = -1;
+
+    // The signal woke a single thread, the others are woken to see the flag
+    for (const auto &reactor : reactors_)
+    {
+        uint64_t one = 1;
+        if (write(reactor->wake_fd, &one, sizeof(one)) < 0)
+        {
+            spdlog::warn("waking event loop {} failed: {}", reactor->index, strerror(errno));
+        }
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    spdlog::info("shutting down server...");
+}
+
+void MinimalAsyncServer::stop()
+{
+    // Queued queries finish first, they refer to their reactors
+    workers_.reset();
+
+    for (const auto &reactor : reactors_)
+    {
+        for (const auto &kv : reactor->connections)
+        {
+            close(kv.first);
+        }
+        reactor->connections.clear();
+        reactor->loop.reset();
+#ifdef SEARCH_ENGINE_IO_URING
+        reactor->ring.reset();
+#endif
+        close(reactor->listen_fd);
+        close(reactor->wake_fd);
+    }
+    reactors_.clear();
+}
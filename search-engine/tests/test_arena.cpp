@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+#include "arena.hpp"
+
+using namespace arena;
+
+namespace
+{
+    // Heap allocations made through operator new while counting is on
+    std::atomic<bool> counting{false};
+    std::atomic<std::size_t> allocations{0};
+
+    void *allocate(std::size_t size, std::size_t alignment)
+    {
+        if (counting.load(std::memory_order_relaxed))
+        {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        size = size == 0 ? 1 : size;
+        void *pointer = alignment <= alignof(std::max_align_t) ? std::malloc(size)
+                                                               : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        if (pointer == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return pointer;
+    }
+
+    // Kept out of line, so that GCC does not see free() taking pointers
+    // from operator new and warn about a mismatched delete
+    [[gnu::noinline]] void deallocate(void *pointer) noexcept
+    {
+        std::free(pointer);
+    }
+
+    // Heap allocations made by `run`
+    template <typename Run>
+    std::size_t count_allocations(Run run)
+    {
+        allocations = 0;
+        counting = true;
+        run();
+        counting = false;
+        return allocations;
+    }
+}
+
+void *operator new(std::size_t size)
+{
+    return allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *pointer) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept
+{
+    deallocate(pointer);
+}
+
+TEST(ArenaTest, AllocatesFromTheBlockAndResets)
+{
+    Arena memory(1024);
+    std::pmr::vector<uint32_t> ids(&memory);
+    ids.reserve(100);
+    EXPECT_GE(memory.used(), 400u);
+    void *first = ids.data();
+
+    memory.reset();
+    EXPECT_EQ(memory.used(), 0u);
+    std::pmr::vector<uint32_t> again(&memory);
+    again.reserve(100);
+    // The same bytes serve the next request
+    EXPECT_EQ(static_cast<void *>(again.data()), first);
+
+    void *aligned = memory.allocate(64, 64);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(aligned) % 64, 0u);
+}
+
+TEST(ArenaTest, GrowsToWhatARequestNeeded)
+{
+    Arena memory(256);
+    auto request = [&]
+    {
+        Scope scope(memory);
+        std::pmr::vector<uint64_t> ids(&memory);
+        for (uint64_t i = 0; i < 1000; i++)
+        {
+            ids.push_back(i);
+        }
+        std::pmr::string text(200, 'x', &memory);
+        EXPECT_EQ(ids.back(), 999u);
+    };
+
+    // The first request spills to the heap and the block grows after it
+    EXPECT_GT(count_allocations(request), 0u);
+    EXPECT_GE(memory.capacity(), 8000u);
+    EXPECT_EQ(memory.used(), 0u);
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_EQ(count_allocations(request), 0u);
+    }
+}
+
+TEST(ArenaTest, ResourceOf)
+{
+    Arena memory;
+    std::pmr::vector<int> in_arena(&memory);
+    std::vector<int> on_heap;
+    EXPECT_EQ(resource_of(in_arena), &memory);
+    EXPECT_EQ(resource_of(on_heap), std::pmr::new_delete_resource());
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -3,6 +3,8 @@
 #include <vector>
 #include <algorithm>
 #include "boolean_index.hpp"
+#include "facets.hpp"
+#include "thread_pool.hpp"
 
 using namespace boolean_index;
 
@@ -243,6 +245,774 @@ TEST(BooleanIndexTest, StringDocumentIds)
     EXPECT_EQ(result[0], "doc3.html");
 }
 
+TEST(BooleanIndexTest, RecencyOrderedEarlyTermination)
+{
+    // Doc ids assigned newest first, so smaller ids are fresher documents
+    BooleanIndex<uint32_t> index(2);
+
+    index.add_document(4, {"rate", "dollar"});
+    index.add_document(0, {"rate", "dollar", "bank"});
+    index.add_document(3, {"rate", "bank"});
+    index.add_document(1, {"rate", "dollar"});
+    index.add_document(2, {"bank"});
+
+    auto and_result = index.and_query({"rate", "dollar"});
+    EXPECT_EQ(and_result, (std::vector<uint32_t>{0, 1}));
+
+    auto or_result = index.or_query({"dollar", "bank"});
+    EXPECT_EQ(or_result, (std::vector<uint32_t>{0, 1}));
+
+    auto or_result_reversed = index.or_query({"bank", "dollar"});
+    EXPECT_EQ(or_result_reversed, (std::vector<uint32_t>{0, 1}));
+}
+
+TEST(BooleanIndexTest, PhraseQuery)
+{
+    IndexOptions options;
+    options.positions = true;
+    BooleanIndex<uint32_t> index(0, options);
+
+    index.add_document(1, {"central", "bank", "rate"});
+    index.add_document(2, {"bank", "central", "office"});
+    index.add_document(3, {"central", "city", "bank"});
+    index.add_document(4, {"central", "bank", "central", "bank"});
+
+    EXPECT_TRUE(index.has_positions());
+
+    // AND matches every document, the phrase only adjacent ordered terms
+    EXPECT_EQ(index.and_query({"central", "bank"}).size(), 4);
+    EXPECT_EQ(index.phrase_query({"central", "bank"}), (std::vector<uint32_t>{1, 4}));
+    EXPECT_EQ(index.phrase_query({"central", "bank", "rate"}), (std::vector<uint32_t>{1}));
+
+    // Proximity: one extra term allowed between them
+    EXPECT_EQ(index.phrase_query({"central", "bank"}, 1), (std::vector<uint32_t>{1, 3, 4}));
+
+    EXPECT_TRUE(index.phrase_query({"bank", "rate", "central"}).empty());
+    EXPECT_TRUE(index.phrase_query({"central", "missing"}).empty());
+
+    index.remove_document(1, {"central", "bank", "rate"});
+    EXPECT_EQ(index.phrase_query({"central", "bank"}), (std::vector<uint32_t>{4}));
+}
+
+TEST(BooleanIndexTest, PhraseQueryWithoutPositions)
+{
+    BooleanIndex<uint32_t> index;
+
+    index.add_document(1, {"central", "bank"});
+    index.add_document(2, {"bank", "central"});
+
+    // Falls back to the AND approximation
+    EXPECT_FALSE(index.has_positions());
+    EXPECT_EQ(index.phrase_query({"central", "bank"}).size(), 2);
+}
+
+TEST(BooleanIndexTest, CommonBigrams)
+{
+    IndexOptions options;
+    options.positions = true;
+    BooleanIndex<uint32_t> index(0, options);
+
+    index.add_document(1, {"after", "election", "after", "rate"});
+    index.add_document(2, {"election", "after", "vote"});
+    index.add_document(3, {"after", "vote", "rate"});
+
+    auto common = index.most_frequent_terms(1);
+    ASSERT_EQ(common.size(), 1);
+    EXPECT_EQ(common[0], "after");
+
+    // Backfill documents added before the common terms were known
+    index.set_common_terms(common);
+    index.index_common_bigrams(1, {"after", "election", "after", "rate"});
+    index.index_common_bigrams(2, {"election", "after", "vote"});
+    index.index_common_bigrams(3, {"after", "vote", "rate"});
+
+    index.add_document(4, {"after", "election", "vote"});
+
+    EXPECT_TRUE(index.is_common_term("after"));
+    EXPECT_EQ(index.total_bigrams(), 4);
+
+    EXPECT_EQ(index.phrase_query({"after", "election"}), (std::vector<uint32_t>{1, 4}));
+    EXPECT_EQ(index.phrase_query({"after", "vote"}), (std::vector<uint32_t>{2, 3}));
+    EXPECT_EQ(index.phrase_query({"after", "vote", "rate"}), (std::vector<uint32_t>{3}));
+    EXPECT_TRUE(index.phrase_query({"vote", "after"}).empty());
+
+    // Proximity queries skip bigrams and use positions
+    EXPECT_EQ(index.phrase_query({"after", "vote"}, 1), (std::vector<uint32_t>{2, 3, 4}));
+
+    index.remove_document(4, {"after", "election", "vote"});
+    EXPECT_EQ(index.phrase_query({"after", "election"}), (std::vector<uint32_t>{1}));
+}
+
+TEST(BooleanIndexTest, CommonBigramsWithoutPositions)
+{
+    BooleanIndex<uint32_t> index;
+    index.set_common_terms({"after"});
+
+    index.add_document(1, {"after", "election"});
+    index.add_document(2, {"election", "after"});
+
+    // Two-term phrases are answered exactly from the bigram list
+    EXPECT_EQ(index.phrase_query({"after", "election"}), (std::vector<uint32_t>{1}));
+    EXPECT_EQ(index.phrase_query({"election", "after"}), (std::vector<uint32_t>{2}));
+}
+
+TEST(BooleanIndexTest, CompressedPostings)
+{
+    IndexOptions options;
+    options.positions = true;
+    BooleanIndex<uint32_t> index(0, options);
+
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        std::vector<std::string> terms = {"common"};
+        if (i % 3 == 0)
+            terms.push_back("three");
+        if (i % 5 == 0)
+            terms.push_back("five");
+        if (i % 3 == 0 && i % 5 == 0)
+        {
+            terms.push_back("fifteen");
+            terms.push_back("common");
+        }
+        index.add_document(i, terms);
+    }
+
+    auto before_and = index.and_query({"three", "five"});
+    auto before_or = index.or_query({"fifteen", "five"});
+    auto before_phrase = index.phrase_query({"fifteen", "common"});
+
+    index.compress();
+
+    EXPECT_EQ(index.and_query({"three", "five"}), before_and);
+    EXPECT_EQ(index.and_query({"three", "five"}).size(), 67);
+    EXPECT_EQ(index.or_query({"fifteen", "five"}), before_or);
+    EXPECT_EQ(index.phrase_query({"fifteen", "common"}), before_phrase);
+    EXPECT_EQ(index.get_term_frequency("common"), 1000);
+
+    // Updates after compression
+    index.remove_document(15, {"common", "three", "five", "fifteen", "common"});
+    index.add_document(1000, {"common", "three", "five"});
+    auto result = index.and_query({"three", "five"});
+    EXPECT_EQ(result.size(), 67);
+    EXPECT_EQ(result.front(), 0);
+    EXPECT_EQ(result[1], 30);
+    EXPECT_EQ(result.back(), 1000);
+}
+
+TEST(BooleanIndexTest, MixedRepresentationsAndNot)
+{
+    IndexOptions options;
+    options.bitmap_min_density = 0.25;
+    BooleanIndex<uint32_t> index(0, options);
+
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        std::vector<std::string> terms = {"common"};
+        if (i % 3 == 0)
+            terms.push_back("three");
+        if (i % 5 == 0)
+            terms.push_back("five");
+        if (i % 15 == 0)
+            terms.push_back("fifteen");
+        index.add_document(i, terms);
+    }
+
+    auto before_and = index.and_query({"three", "five"});
+    auto before_not = index.and_not_query({"three"}, {"five"});
+    auto before_not_only = index.and_not_query({}, {"three", "five"});
+    EXPECT_EQ(before_not.size(), 334 - 67);
+    EXPECT_EQ(before_not_only.size(), 1000 - 334 - 200 + 67);
+
+    index.compress();
+
+    EXPECT_EQ(index.and_query({"three", "five"}), before_and);
+    EXPECT_EQ(index.and_query({"fifteen", "common"}).size(), 67);
+    EXPECT_EQ(index.or_query({"fifteen", "five"}), index.get_documents_for_term("five"));
+    EXPECT_EQ(index.and_not_query({"three"}, {"five"}), before_not);
+    EXPECT_EQ(index.and_not_query({}, {"three", "five"}), before_not_only);
+    EXPECT_TRUE(index.and_not_query({"fifteen"}, {"three"}).empty());
+    EXPECT_TRUE(index.and_not_query({"missing"}, {"three"}).empty());
+    EXPECT_EQ(index.and_not_query({"fifteen"}, {"missing"}).size(), 67);
+
+    // Bitmap lists take updates in place
+    index.remove_document(3, {"common", "three"});
+    index.add_document(1001, {"common", "three"});
+    EXPECT_FALSE(index.contains_document(3));
+    EXPECT_TRUE(index.contains_document(1001));
+    EXPECT_EQ(index.get_term_frequency("three"), 334);
+    EXPECT_EQ(index.and_not_query({"three"}, {"five"}).back(), 1001);
+}
+
+TEST(BooleanIndexTest, ParallelQueries)
+{
+    thread_pool::ThreadPool pool(4);
+    parallel_executor::ParallelOptions parallel_options;
+    parallel_options.min_cost = 1000;
+    parallel_executor::ParallelExecutor<uint32_t> executor(pool, parallel_options);
+
+    for (std::size_t max_responses : {0, 10})
+    {
+        IndexOptions options;
+        options.positions = true;
+        BooleanIndex<uint32_t> index(max_responses, options);
+        for (uint32_t i = 0; i < 20000; i++)
+        {
+            std::vector<std::string> terms = {"common"};
+            if (i % 3 == 0)
+                terms.push_back("three");
+            if (i % 7 == 0)
+                terms.push_back("seven");
+            if (i % 7 < 2)
+                terms.push_back("after");
+            if (i % 5000 == 0)
+                terms.push_back("rare");
+            index.add_document(i, terms);
+        }
+        index.compress();
+
+        auto serial_and = index.and_query({"three", "seven", "common"});
+        auto serial_phrase = index.phrase_query({"seven", "after"});
+        auto serial_not = index.and_not_query({"three"}, {"seven"});
+        auto serial_rare = index.and_query({"rare", "common"});
+
+        index.set_parallel_executor(&executor);
+        intersection::IntersectionStats stats;
+        EXPECT_EQ(index.and_query({"three", "seven", "common"}, &stats), serial_and);
+        // With a limit of 10 the scan stops after about 30 candidates of
+        // "seven", too few to split
+        EXPECT_EQ(stats.partitions, max_responses == 0 ? executor.partition_count() : 1);
+        EXPECT_EQ(index.phrase_query({"seven", "after"}), serial_phrase);
+        EXPECT_EQ(index.and_not_query({"three"}, {"seven"}), serial_not);
+
+        // Cheap queries stay on the calling thread
+        stats = intersection::IntersectionStats();
+        EXPECT_EQ(index.and_query({"rare", "common"}, &stats), serial_rare);
+        EXPECT_EQ(serial_rare.size(), 4);
+        EXPECT_EQ(stats.partitions, 1);
+
+        if (max_responses != 0)
+        {
+            EXPECT_EQ(serial_and.size(), max_responses);
+        }
+        else
+        {
+            EXPECT_EQ(serial_and.size(), 953);
+            EXPECT_EQ(serial_phrase.size(), 2858);
+        }
+    }
+}
+
+TEST(BooleanIndexTest, PairIntersectionCache)
+{
+    thread_pool::ThreadPool pool(2);
+    parallel_executor::ParallelExecutor<uint32_t> executor(pool);
+    IndexOptions options;
+    options.pair_cache.budget_bytes = 1 << 20;
+    options.pair_cache.admit_after = 2;
+    options.pair_cache.min_list_size = 100;
+    BooleanIndex<uint32_t> index(0, options);
+    index.set_parallel_executor(&executor);
+
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        std::vector<std::string> terms;
+        if (i % 2 == 0)
+            terms.push_back("kurs");
+        if (i % 3 == 0)
+            terms.push_back("dollar");
+        if (i % 5 == 0)
+            terms.push_back("five");
+        if (i % 7 == 0)
+            terms.push_back("seven");
+        index.add_document(i, terms);
+    }
+    index.compress();
+
+    auto expected = index.and_query({"kurs", "dollar", "five"});
+    EXPECT_EQ(expected.size(), 167);
+
+    // First sightings only count the pairs
+    index.wait_for_cached_pairs();
+    EXPECT_EQ(index.pair_cache_stats().entries, 0);
+
+    // The second query with "kurs dollar" queues the pair and intersects
+    // the lists itself, the queries after it use the pair
+    intersection::IntersectionStats stats;
+    EXPECT_EQ(index.and_query({"kurs", "dollar", "seven"}, &stats).size(), 120);
+    EXPECT_FALSE(stats.cached_pair);
+    index.wait_for_cached_pairs();
+    EXPECT_EQ(index.pair_cache_stats().entries, 1);
+
+    stats = intersection::IntersectionStats();
+    EXPECT_EQ(index.and_query({"kurs", "dollar", "seven"}, &stats).size(), 120);
+    EXPECT_TRUE(stats.cached_pair);
+    index.wait_for_cached_pairs();
+
+    // That query also queued "kurs seven". A query queues one pair at a
+    // time, the others follow on later sightings
+    EXPECT_EQ(index.pair_cache_stats().entries, 2);
+    for (int i = 0; i < 3; i++)
+    {
+        stats = intersection::IntersectionStats();
+        EXPECT_EQ(index.and_query({"dollar", "kurs", "five"}, &stats), expected);
+        EXPECT_TRUE(stats.cached_pair);
+        index.wait_for_cached_pairs();
+    }
+    EXPECT_EQ(index.pair_cache_stats().entries, 4);
+
+    stats = intersection::IntersectionStats();
+    EXPECT_EQ(index.and_not_query({"kurs", "dollar"}, {"five"}, &stats).size(), 834 - 167);
+    EXPECT_TRUE(stats.cached_pair);
+    EXPECT_GT(index.pair_cache_stats().hits, 0);
+
+    // Pairs are keyed by term ids, the same pair in another batch of
+    // resolved lists finds the same entry
+    stats = intersection::IntersectionStats();
+    EXPECT_EQ(index.and_query({"five", "dollar"}, &stats).size(), 334);
+    EXPECT_TRUE(stats.cached_pair);
+
+    // Updates make cached pairs stale
+    index.add_document(5000, {"kurs", "dollar", "five"});
+    stats = intersection::IntersectionStats();
+    auto updated = index.and_query({"kurs", "dollar", "five"}, &stats);
+    EXPECT_EQ(updated.size(), 168);
+    EXPECT_EQ(updated.back(), 5000);
+
+    // Small pairs are cheap to intersect and never cached
+    BooleanIndex<uint32_t> small(0, options);
+    small.set_parallel_executor(&executor);
+    small.add_document(1, {"a", "b"});
+    for (int i = 0; i < 5; i++)
+    {
+        EXPECT_EQ(small.and_query({"a", "b"}).size(), 1);
+    }
+    small.wait_for_cached_pairs();
+    EXPECT_EQ(small.pair_cache_stats().entries, 0);
+
+    // Nor are pairs too large to materialize
+    IndexOptions capped = options;
+    capped.pair_cache.max_list_size = 1000;
+    BooleanIndex<uint32_t> large(0, capped);
+    large.set_parallel_executor(&executor);
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        large.add_document(i, {"a", "b"});
+    }
+    large.compress();
+    for (int i = 0; i < 5; i++)
+    {
+        EXPECT_EQ(large.and_query({"a", "b"}).size(), 5000);
+    }
+    large.wait_for_cached_pairs();
+    EXPECT_EQ(large.pair_cache_stats().entries, 0);
+
+    // Without an executor to build them on, pairs are never cached
+    BooleanIndex<uint32_t> serial(0, options);
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        serial.add_document(i, {"a", "b"});
+    }
+    serial.compress();
+    for (int i = 0; i < 5; i++)
+    {
+        EXPECT_EQ(serial.and_query({"a", "b"}).size(), 5000);
+    }
+    EXPECT_EQ(serial.pair_cache_stats().entries, 0);
+}
+
+TEST(BooleanIndexTest, EstimateCounts)
+{
+    IndexOptions options;
+    options.positions = true;
+    BooleanIndex<uint32_t> index(10, options);
+    for (uint32_t i = 0; i < 30000; i++)
+    {
+        std::vector<std::string> terms;
+        if (i % 2 == 0)
+            terms.push_back("two");
+        if (i % 3 == 0)
+            terms.push_back("three");
+        if (i % 5 == 0)
+            terms.push_back("five");
+        if (i % 5 == 0)
+            terms.push_back("after");
+        if (i < 100)
+            terms.push_back("rare");
+        index.add_document(i, terms);
+    }
+    index.compress();
+
+    auto check = [](const cardinality::Estimate &estimate, std::size_t actual)
+    {
+        EXPECT_LE(estimate.lower, actual);
+        EXPECT_GE(estimate.upper, actual);
+        EXPECT_NEAR(static_cast<double>(estimate.estimate), static_cast<double>(actual), actual * 0.15 + 1);
+    };
+
+    check(index.estimate_and_count({"two", "three"}), 5000);
+    check(index.estimate_and_count({"two", "three"}, {"five"}), 4000);
+    check(index.estimate_and_count({}, {"two"}), 15000);
+    check(index.estimate_phrase_count({"five", "after"}), 6000);
+    check(index.estimate_phrase_count({"five"}), 6000);
+    check(index.estimate_or_count({"two", "three"}), 20000);
+
+    auto rare = index.estimate_and_count({"rare", "two"});
+    EXPECT_TRUE(rare.exact);
+    EXPECT_EQ(rare.estimate, 50);
+    EXPECT_EQ(index.estimate_and_count({"missing", "two"}).estimate, 0);
+}
+
+TEST(BooleanIndexTest, PrefixQuery)
+{
+    IndexOptions options;
+    options.prefix_max_postings = 150;
+    BooleanIndex<uint32_t> index(0, options);
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        std::vector<std::string> terms = {i % 2 == 0 ? "search" : "seal"};
+        if (i % 10 == 0)
+            terms.push_back("seat");
+        if (i % 3 == 0)
+            terms.push_back("engine");
+        terms.push_back("other");
+        index.add_document(i, terms);
+    }
+
+    // Not in the dictionary before it is built
+    EXPECT_TRUE(index.prefix_query("sea").empty());
+    index.compress();
+
+    auto expansion = index.expand_prefix("sea");
+    EXPECT_EQ(expansion.matched_terms, 3u);
+    // "search" and "seal" take 100 postings, "seat" still fits
+    EXPECT_EQ(expansion.terms, (std::vector<std::string>{"seal", "search", "seat"}));
+    EXPECT_FALSE(expansion.truncated);
+
+    EXPECT_EQ(index.prefix_query("sear"), index.and_query({"search"}));
+    EXPECT_EQ(index.prefix_query("sea").size(), 100u);
+    EXPECT_EQ(index.prefix_query("sea", {"engine"}, {"search"}), index.and_not_query({"engine"}, {"search"}));
+    EXPECT_TRUE(index.prefix_query("x").empty());
+    EXPECT_TRUE(index.prefix_query("sea", {"missing"}).empty());
+
+    IndexOptions tight;
+    tight.prefix_max_postings = 60;
+    BooleanIndex<uint32_t> limited(3, tight);
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        std::vector<std::string> terms = {i % 2 == 0 ? "search" : "seal"};
+        if (i % 10 == 0)
+            terms.push_back("seat");
+        limited.add_document(i, terms);
+    }
+    limited.compress();
+
+    boolean_index::PrefixExpansion kept;
+    auto result = limited.prefix_query("sea", {}, {}, &kept);
+    EXPECT_TRUE(kept.truncated);
+    EXPECT_EQ(kept.terms, (std::vector<std::string>{"seal", "seat"}));
+    EXPECT_EQ(result, (std::vector<uint32_t>{0, 1, 3}));
+
+    // Many rare terms stay within the term budget, the most frequent first
+    IndexOptions few;
+    few.prefix_max_terms = 4;
+    BooleanIndex<uint32_t> wide(0, few);
+    for (uint32_t i = 0; i < 2000; i++)
+    {
+        std::vector<std::string> terms = {"p" + std::to_string(i % 500)};
+        if (i % 100 == 0)
+            terms.push_back("popular" + std::to_string(i % 300));
+        if (i % 3 == 0)
+            terms.push_back("three");
+        wide.add_document(i, terms);
+    }
+    wide.compress();
+
+    auto capped = wide.expand_prefix("p");
+    EXPECT_EQ(capped.matched_terms, 503u);
+    EXPECT_TRUE(capped.truncated);
+    EXPECT_EQ(capped.terms, (std::vector<std::string>{"popular0", "popular100", "popular200", "p0"}));
+
+    // The merged union with a required term matches the union of the ANDs
+    boolean_index::PrefixExpansion all_p;
+    auto merged = wide.prefix_query("p", {"three"}, {}, &all_p);
+    std::vector<uint32_t> expected;
+    for (const auto &term : all_p.terms)
+    {
+        auto part = wide.and_query({term, "three"});
+        expected.insert(expected.end(), part.begin(), part.end());
+    }
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+    EXPECT_EQ(merged, expected);
+    EXPECT_FALSE(merged.empty());
+}
+
+TEST(BooleanIndexTest, FuzzyCorrection)
+{
+    BooleanIndex<uint32_t> index(0);
+    for (uint32_t i = 0; i < 30; i++)
+    {
+        std::vector<std::string> terms = {"engine"};
+        terms.push_back(i < 20 ? "search" : "starch");
+        if (i < 5)
+            terms.push_back("serche");
+        // "поиск"
+        terms.push_back("\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba");
+        index.add_document(i, terms);
+    }
+    index.compress();
+
+    auto matches = index.expand_fuzzy("serch", 2);
+    ASSERT_EQ(matches.size(), 3u);
+    // Closest first, then most frequent
+    EXPECT_EQ(matches[0].term, "search");
+    EXPECT_EQ(matches[1].term, "serche");
+    EXPECT_EQ(matches[1].distance, 1u);
+    EXPECT_GT(matches[0].frequency, matches[1].frequency);
+    EXPECT_EQ(matches[2].term, "starch");
+    EXPECT_EQ(matches[2].distance, 2u);
+    EXPECT_EQ(index.expand_fuzzy("serch", 1).size(), 2u);
+
+    // Misspelled "поск" and "serch" are corrected, short terms are left alone
+    auto corrected = index.correct_terms({"serch", "\xd0\xbf\xd0\xbe\xd1\x81\xd0\xba", "eng", "engine"});
+    EXPECT_EQ(corrected, (std::vector<std::string>{"search", "\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba", "eng", "engine"}));
+    EXPECT_EQ(index.and_query(corrected).size(), 0u);
+    EXPECT_EQ(index.and_query({"search", "engine"}).size(), 20u);
+}
+
+TEST(BooleanIndexTest, Completions)
+{
+    BooleanIndex<uint32_t> index(0);
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        std::vector<std::string> terms = {"search"};
+        if (i < 10)
+            terms.push_back("seat");
+        if (i < 5)
+            terms.push_back("seal");
+        // Seen once, not suggested
+        if (i == 0)
+            terms.push_back("seam");
+        index.add_document(i, terms);
+    }
+    index.compress();
+
+    std::vector<std::string> suggested;
+    for (uint32_t id : index.complete("se"))
+    {
+        suggested.push_back(index.completions().term(id));
+    }
+    EXPECT_EQ(suggested, (std::vector<std::string>{"search", "seat", "seal"}));
+    EXPECT_TRUE(index.complete("seam").empty());
+}
+
+TEST(BooleanIndexTest, CompletionsSuggestWords)
+{
+    BooleanIndex<uint32_t> index(0);
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        std::vector<std::string> terms = {"search", "engin"};
+        std::vector<std::string> words = {i % 4 == 0 ? "searches" : "searching", "engine"};
+        if (i < 5)
+        {
+            // No words counted, suggested as it is
+            terms.push_back("seal");
+        }
+        index.add_document(i, terms);
+        index.add_surface_forms(terms, words);
+    }
+    index.compress();
+
+    std::vector<std::string> suggested;
+    for (uint32_t id : index.complete("se"))
+    {
+        suggested.push_back(index.completions().term(id));
+    }
+    EXPECT_EQ(suggested, (std::vector<std::string>{"searching", "seal"}));
+    ASSERT_EQ(index.complete("engine").size(), 1u);
+    EXPECT_EQ(index.completions().term(index.complete("engine").begin()[0]), "engine");
+    EXPECT_TRUE(index.complete("searche").empty());
+    // Queries still match the stems
+    EXPECT_EQ(index.and_query({"search", "engin"}).size(), 20u);
+}
+
+TEST(BooleanIndexTest, LastmodFilter)
+{
+    IndexOptions options;
+    options.positions = true;
+    BooleanIndex<uint32_t> index(5, options);
+    doc_values::DocValues<uint32_t, int64_t> lastmods;
+    for (uint32_t i = 0; i < 2000; i++)
+    {
+        // Newest documents first, one per minute
+        lastmods.push_back(1000000 - static_cast<int64_t>(i) * 60);
+        std::vector<std::string> terms = {"news"};
+        terms.push_back(i % 3 == 0 ? "sport" : "politics");
+        terms.push_back("today");
+        index.add_document(i, terms);
+    }
+    index.compress();
+
+    auto in_range = [&](int64_t min, int64_t max, std::vector<uint32_t> ids)
+    {
+        for (auto doc_id : ids)
+        {
+            EXPECT_GE(lastmods[doc_id], min);
+            EXPECT_LE(lastmods[doc_id], max);
+        }
+        return ids;
+    };
+
+    doc_values::RangeFilter<uint32_t, int64_t> older{&lastmods, 1000000 - 1500 * 60, 1000000 - 1000 * 60};
+    QueryFilter<uint32_t> older_filter;
+    older_filter.lastmod = &older;
+    EXPECT_EQ(in_range(older.min, older.max, index.and_query({"sport"}, nullptr, &older_filter)),
+              (std::vector<uint32_t>{1002, 1005, 1008, 1011, 1014}));
+    EXPECT_EQ(index.and_not_query({"news"}, {"sport"}, nullptr, &older_filter),
+              (std::vector<uint32_t>{1000, 1001, 1003, 1004, 1006}));
+    EXPECT_EQ(index.and_not_query({}, {}, nullptr, &older_filter), (std::vector<uint32_t>{1000, 1001, 1002, 1003, 1004}));
+    EXPECT_EQ(index.phrase_query({"politics", "today"}, 0, nullptr, &older_filter),
+              (std::vector<uint32_t>{1000, 1001, 1003, 1004, 1006}));
+    EXPECT_EQ(index.prefix_query("spo", {}, {}, nullptr, &older_filter), (std::vector<uint32_t>{1002, 1005, 1008, 1011, 1014}));
+
+    intersection::IntersectionStats stats;
+    doc_values::RangeFilter<uint32_t, int64_t> recent{&lastmods, 1000000 - 10 * 60, 2000000};
+    QueryFilter<uint32_t> recent_filter;
+    recent_filter.lastmod = &recent;
+    EXPECT_EQ(index.and_query({"sport", "news"}, &stats, &recent_filter), (std::vector<uint32_t>{0, 3, 6, 9}));
+    // Only the first block of ids was looked at
+    EXPECT_LE(stats.base_size, 667u);
+    EXPECT_LE(stats.steps.back().probes, 128u);
+
+    doc_values::RangeFilter<uint32_t, int64_t> future{&lastmods, 3000000, 4000000};
+    QueryFilter<uint32_t> future_filter;
+    future_filter.lastmod = &future;
+    EXPECT_TRUE(index.and_query({"news"}, nullptr, &future_filter).empty());
+}
+
+TEST(BooleanIndexTest, FacetFilter)
+{
+    IndexOptions options;
+    options.positions = true;
+    BooleanIndex<uint32_t> index(0, options);
+    facets::FacetIndex<uint32_t> sites;
+    for (uint32_t i = 0; i < 3000; i++)
+    {
+        std::vector<std::string> terms = {"news"};
+        terms.push_back(i % 2 == 0 ? "sport" : "politics");
+        index.add_document(i, terms);
+        sites.add(i, "site", i % 3 == 0 ? "rbc.ru" : "lenta.ru");
+    }
+    index.compress();
+    sites.optimize();
+
+    QueryFilter<uint32_t> rbc;
+    rbc.facets.push_back(sites.find("site", "rbc.ru"));
+    auto sport = index.and_query({"sport"}, nullptr, &rbc);
+    ASSERT_EQ(sport.size(), 500u);
+    for (auto doc_id : sport)
+    {
+        EXPECT_EQ(doc_id % 6, 0u);
+    }
+    EXPECT_EQ(index.and_not_query({"news"}, {"sport"}, nullptr, &rbc).size(), 500u);
+    EXPECT_EQ(index.and_not_query({}, {}, nullptr, &rbc).size(), 1000u);
+
+    // Counting per site goes through the match bitmap without a result list
+    auto matches = index.match_bitmap({"news"}, {"politics"});
+    EXPECT_EQ(matches.cardinality(), 1500u);
+    auto counts = sites.count("site", matches);
+    ASSERT_EQ(counts.size(), 2u);
+    EXPECT_EQ(counts[0].value, "lenta.ru");
+    EXPECT_EQ(counts[0].count, 1000u);
+    EXPECT_EQ(counts[1].value, "rbc.ru");
+    EXPECT_EQ(counts[1].count, 500u);
+
+    EXPECT_EQ(index.match_bitmap({"sport"}, {}, &rbc).cardinality(), 500u);
+    EXPECT_EQ(index.match_bitmap({"missing"}).cardinality(), 0u);
+
+    // OR queries and prefixes count every document with any of their terms
+    std::vector<std::string> any = {"missing", "sport", "politics"};
+    EXPECT_EQ(index.match_bitmap({}, {}, nullptr, &any).cardinality(), 3000u);
+    auto expansion = index.expand_prefix("spo");
+    ASSERT_EQ(expansion.terms, std::vector<std::string>{"sport"});
+    EXPECT_EQ(index.match_bitmap({"news"}, {}, &rbc, &expansion.terms).cardinality(), 500u);
+    std::vector<std::string> none;
+    EXPECT_EQ(index.match_bitmap({"news"}, {}, nullptr, &none).cardinality(), 0u);
+}
+
+TEST(BooleanIndexTest, ResolvedTerms)
+{
+    IndexOptions options;
+    options.positions = true;
+    BooleanIndex<uint32_t> index(0, options);
+    for (uint32_t i = 0; i < 2000; i++)
+    {
+        std::vector<std::string> terms = {"news", i % 2 == 0 ? "sport" : "politics"};
+        if (i % 5 == 0)
+        {
+            terms.push_back("football");
+        }
+        index.add_document(i, terms);
+    }
+    index.compress();
+
+    // Queries of a batch share one lookup per distinct term
+    std::vector<std::string> main_query = {"news", "sport"};
+    std::vector<std::string> related = {"sport", "football"};
+    std::vector<std::string> missing = {"news", "missing"};
+    auto resolved = index.resolve_terms({&main_query, &related, &missing});
+    EXPECT_EQ(resolved.size(), 4u);
+    ASSERT_NE(resolved.find("missing"), nullptr);
+    EXPECT_EQ(*resolved.find("missing"), nullptr);
+
+    QueryFilter<uint32_t> batch;
+    batch.terms = &resolved;
+    EXPECT_EQ(index.and_query(main_query, nullptr, &batch), index.and_query(main_query));
+    EXPECT_EQ(index.and_query(related, nullptr, &batch).size(), 200u);
+    EXPECT_TRUE(index.and_query(missing, nullptr, &batch).empty());
+    EXPECT_EQ(index.phrase_query(main_query, 0, nullptr, &batch), index.phrase_query(main_query));
+    EXPECT_EQ(index.and_not_query({"news"}, {"politics"}, nullptr, &batch).size(), 1000u);
+    EXPECT_EQ(index.match_bitmap(related, {}, &batch).cardinality(), 200u);
+    // Terms outside the batch are still looked up in the index
+    EXPECT_EQ(index.and_query({"politics"}, nullptr, &batch).size(), 1000u);
+}
+
+TEST(BooleanIndexTest, DeadlineAndCost)
+{
+    BooleanIndex<uint32_t> index;
+    for (uint32_t i = 0; i < 20000; i++)
+    {
+        std::vector<std::string> terms = {"news", i % 2 == 0 ? "sport" : "politics"};
+        if (i % 10 == 0)
+        {
+            terms.push_back("football");
+        }
+        index.add_document(i, terms);
+    }
+
+    // Evaluation past the deadline stops early with what it found so far
+    QueryFilter<uint32_t> late;
+    deadline::Deadline passed(deadline::Deadline::Clock::now() - std::chrono::milliseconds(1));
+    late.deadline = &passed;
+    EXPECT_EQ(index.and_query({"news", "sport"}).size(), 10000u);
+    EXPECT_LT(index.and_query({"news", "sport"}, nullptr, &late).size(), 10000u);
+    EXPECT_LT(index.and_not_query({"news"}, {"politics"}, nullptr, &late).size(), 10000u);
+    EXPECT_EQ(index.or_query({"sport", "politics"}).size(), 20000u);
+    EXPECT_LT(index.or_query({"sport", "politics"}, &passed).size(), 20000u);
+
+    QueryFilter<uint32_t> in_time;
+    deadline::Deadline later = deadline::Deadline::after(60000);
+    in_time.deadline = &later;
+    EXPECT_EQ(index.and_query({"news", "sport"}, nullptr, &in_time).size(), 10000u);
+    EXPECT_EQ(index.or_query({"sport", "politics"}, &later).size(), 20000u);
+
+    // An AND is as cheap as its rarest term, an OR reads every list
+    EXPECT_EQ(index.estimate_cost({"news", "football"}, false), 4000u);
+    EXPECT_EQ(index.estimate_cost({"news", "football"}, true), 22000u);
+    EXPECT_EQ(index.estimate_cost({"news", "missing"}, false), 0u);
+    EXPECT_EQ(index.estimate_cost({}, false), 20000u);
+}
+
 // Main function for Google Test
 int main(int argc, char **argv)
 {
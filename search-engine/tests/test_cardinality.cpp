@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "cardinality.hpp"
+#include "posting_list.hpp"
+
+using namespace cardinality;
+
+TEST(CardinalityTest, ExactWhenWholePopulationIsSampled)
+{
+    auto estimate = from_sample(100, 100, 37);
+    EXPECT_TRUE(estimate.exact);
+    EXPECT_EQ(estimate.estimate, 37);
+    EXPECT_EQ(estimate.lower, 37);
+    EXPECT_EQ(estimate.upper, 37);
+}
+
+TEST(CardinalityTest, BoundsContainEstimate)
+{
+    for (std::size_t hits : {0, 1, 64, 128, 255, 256})
+    {
+        auto estimate = from_sample(100000, 256, hits);
+        EXPECT_FALSE(estimate.exact);
+        EXPECT_LE(estimate.lower, estimate.estimate);
+        EXPECT_LE(estimate.estimate, estimate.upper);
+        EXPECT_GE(estimate.lower, hits);
+        EXPECT_LE(estimate.upper, 100000 - (256 - hits));
+    }
+
+    auto half = from_sample(100000, 256, 128);
+    EXPECT_EQ(half.estimate, 50000);
+    // About +-6% for 256 samples at p = 0.5
+    EXPECT_NEAR(static_cast<double>(half.lower), 44000, 1000);
+    EXPECT_NEAR(static_cast<double>(half.upper), 56000, 1000);
+
+    // Larger samples of a small population give tighter bounds
+    auto dense = from_sample(300, 256, 128);
+    EXPECT_LT(dense.upper - dense.lower, 40);
+}
+
+TEST(CardinalityTest, PostingListSampleRanks)
+{
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        ids.push_back(i * 3 + (i % 3));
+    }
+
+    posting_list::PostingList<uint32_t> list;
+    for (uint32_t id : ids)
+    {
+        list.insert(id);
+    }
+
+    std::vector<uint32_t> expected;
+    for (std::size_t i = 0; i < 100; i++)
+    {
+        expected.push_back(ids[(2 * i + 1) * ids.size() / 200]);
+    }
+
+    EXPECT_EQ(list.sample(100), expected);
+    list.compress();
+    EXPECT_EQ(list.sample(100), expected);
+    list.compress_to_bitmap();
+    EXPECT_EQ(list.sample(100), expected);
+    EXPECT_EQ(list.sample(20000), ids);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include "codec.hpp"
+
+using namespace codec;
+
+namespace
+{
+    std::vector<uint32_t> random_gaps(std::size_t count, uint32_t max_gap, uint32_t seed)
+    {
+        std::mt19937 generator(seed);
+        std::uniform_int_distribution<uint32_t> distribution(0, max_gap);
+        std::vector<uint32_t> gaps(count);
+        for (auto &gap : gaps)
+        {
+            gap = distribution(generator);
+        }
+        return gaps;
+    }
+
+    void expect_round_trip(Codec codec, const std::vector<uint32_t> &values)
+    {
+        std::vector<uint8_t> encoded;
+        encode_block(codec, values.data(), values.size(), encoded);
+
+        std::vector<uint32_t> decoded(values.size());
+        const uint8_t *end = decode_block(codec, encoded.data(), encoded.data() + encoded.size(), values.size(), decoded.data());
+        EXPECT_EQ(decoded, values) << codec_name(codec);
+        EXPECT_EQ(end, encoded.data() + encoded.size()) << codec_name(codec);
+
+        std::vector<uint32_t> decoded_scalar(values.size());
+        decode_block_scalar(codec, encoded.data(), encoded.data() + encoded.size(), values.size(), decoded_scalar.data());
+        EXPECT_EQ(decoded_scalar, values) << codec_name(codec);
+    }
+}
+
+TEST(CodecTest, RoundTripFullBlocks)
+{
+    for (Codec codec : ALL_CODECS)
+    {
+        expect_round_trip(codec, random_gaps(BLOCK_SIZE, 10, 1));
+        expect_round_trip(codec, random_gaps(BLOCK_SIZE, 1000, 2));
+        expect_round_trip(codec, random_gaps(BLOCK_SIZE, 0xFFFFFFFFu, 3));
+        expect_round_trip(codec, std::vector<uint32_t>(BLOCK_SIZE, 0));
+        expect_round_trip(codec, std::vector<uint32_t>(BLOCK_SIZE, 1));
+    }
+}
+
+TEST(CodecTest, RoundTripPartialBlocks)
+{
+    for (Codec codec : ALL_CODECS)
+    {
+        for (std::size_t count : {1, 3, 4, 5, 17, 127})
+        {
+            expect_round_trip(codec, random_gaps(count, 300, static_cast<uint32_t>(count)));
+        }
+    }
+}
+
+TEST(CodecTest, BitPackingExceptions)
+{
+    // Mostly small gaps with a few outliers are packed narrow and patched
+    std::vector<uint32_t> values(BLOCK_SIZE, 3);
+    values[7] = 100000;
+    values[64] = 0xFFFFFFFFu;
+    values[127] = 70000;
+
+    std::vector<uint8_t> encoded;
+    encode_block(Codec::BitPacking, values.data(), values.size(), encoded);
+    EXPECT_LT(encoded.size(), BLOCK_SIZE);
+
+    expect_round_trip(Codec::BitPacking, values);
+}
+
+TEST(CodecTest, StreamVByteSize)
+{
+    std::vector<uint32_t> values = {1, 2, 300, 70000, 0x1000000};
+
+    std::vector<uint8_t> encoded;
+    encode_block(Codec::StreamVByte, values.data(), values.size(), encoded);
+
+    // Two control bytes plus 1 + 1 + 2 + 3 + 4 data bytes
+    EXPECT_EQ(encoded.size(), 2 + 11);
+}
+
+TEST(CodecTest, TruncatedInputThrows)
+{
+    std::vector<uint32_t> values = random_gaps(BLOCK_SIZE, 1000, 4);
+    for (Codec codec : ALL_CODECS)
+    {
+        std::vector<uint8_t> encoded;
+        encode_block(codec, values.data(), values.size(), encoded);
+
+        std::vector<uint32_t> decoded(values.size());
+        EXPECT_THROW(decode_block(codec, encoded.data(), encoded.data() + encoded.size() / 2, values.size(), decoded.data()),
+                     std::runtime_error);
+    }
+}
+
+TEST(CodecTest, PrefixSum)
+{
+    std::vector<uint32_t> values = {5, 1, 1, 3, 0, 2, 10};
+    prefix_sum(values.data(), values.size(), 100);
+    EXPECT_EQ(values, (std::vector<uint32_t>{105, 106, 107, 110, 110, 112, 122}));
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
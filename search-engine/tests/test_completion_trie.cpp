@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "completion_trie.hpp"
+
+using namespace completion;
+
+namespace
+{
+    std::vector<std::string> terms_of(const CompletionTrie &trie, CompletionTrie::Completions completions)
+    {
+        std::vector<std::string> result;
+        for (uint32_t id : completions)
+        {
+            result.push_back(trie.term(id));
+        }
+        return result;
+    }
+}
+
+TEST(CompletionTrieTest, TopCompletions)
+{
+    auto trie = CompletionTrie::build({"engine", "sea", "seal", "search", "seat", "\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba"},
+                                      {7, 5, 1, 9, 5, 3}, 3);
+    ASSERT_EQ(trie.size(), 6u);
+
+    // Heaviest first, equal weights in term order
+    EXPECT_EQ(terms_of(trie, trie.complete("se")), (std::vector<std::string>{"search", "sea", "seat"}));
+    EXPECT_EQ(terms_of(trie, trie.complete("sea")), (std::vector<std::string>{"search", "sea", "seat"}));
+    EXPECT_EQ(terms_of(trie, trie.complete("seal")), (std::vector<std::string>{"seal"}));
+    EXPECT_EQ(terms_of(trie, trie.complete("")), (std::vector<std::string>{"search", "engine", "sea"}));
+    EXPECT_EQ(terms_of(trie, trie.complete("\xd0\xbf")), (std::vector<std::string>{"\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba"}));
+    EXPECT_TRUE(trie.complete("sealed").empty());
+    EXPECT_TRUE(trie.complete("x").empty());
+    EXPECT_EQ(trie.weight(trie.complete("eng").begin()[0]), 7u);
+
+    EXPECT_TRUE(CompletionTrie().complete("a").empty());
+    EXPECT_TRUE(CompletionTrie::build({}, {}, 3).complete("").empty());
+}
+
+TEST(CompletionTrieTest, MatchesScan)
+{
+    std::mt19937 generator(11);
+    std::vector<std::string> terms;
+    for (int i = 0; i < 3000; i++)
+    {
+        std::string term;
+        std::size_t length = 1 + generator() % 8;
+        for (std::size_t j = 0; j < length; j++)
+        {
+            term.push_back(static_cast<char>('a' + generator() % 4));
+        }
+        terms.push_back(term);
+    }
+    terms.push_back("\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba");
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    std::vector<uint64_t> weights;
+    for (std::size_t i = 0; i < terms.size(); i++)
+    {
+        weights.push_back(generator() % 50);
+    }
+    auto trie = CompletionTrie::build(terms, weights, 5);
+    EXPECT_LT(trie.node_count(), 2 * terms.size());
+
+    for (std::string prefix : {"", "a", "ab", "dcb", "abcdabcd", "abcdabcda", "e", "\xd0\xbf\xd0\xbe"})
+    {
+        std::vector<std::size_t> matching;
+        for (std::size_t i = 0; i < terms.size(); i++)
+        {
+            if (terms[i].compare(0, prefix.size(), prefix) == 0)
+            {
+                matching.push_back(i);
+            }
+        }
+        std::stable_sort(matching.begin(), matching.end(), [&](std::size_t a, std::size_t b)
+                         { return weights[a] > weights[b]; });
+        std::vector<std::string> expected;
+        for (std::size_t i = 0; i < std::min<std::size_t>(5, matching.size()); i++)
+        {
+            expected.push_back(terms[matching[i]]);
+        }
+
+        EXPECT_EQ(terms_of(trie, trie.complete(prefix)), expected) << prefix;
+    }
+}
+
+TEST(CompletionTrieTest, SurfaceForms)
+{
+    SurfaceForms forms;
+    EXPECT_TRUE(forms.most_frequent().empty());
+    for (int i = 0; i < 10; i++)
+    {
+        forms.add("programming");
+        // More spellings than slots, each seen once
+        forms.add("program" + std::to_string(i));
+    }
+    forms.add("programs");
+    EXPECT_EQ(forms.most_frequent(), "programming");
+}
+
+TEST(CompletionTrieTest, LowercaseInPlace)
+{
+    // "ПоИсК Ёлка ABC"
+    std::string text = "\xd0\x9f\xd0\xbe\xd0\x98\xd1\x81\xd0\x9a \xd0\x81\xd0\xbb\xd0\xba\xd0\xb0 ABC";
+    completion::lowercase_in_place(text);
+    EXPECT_EQ(text, "\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba \xd1\x91\xd0\xbb\xd0\xba\xd0\xb0 abc");
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
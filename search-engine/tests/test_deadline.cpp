@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include "deadline.hpp"
+
+using namespace deadline;
+
+TEST(DeadlineTest, DefaultNeverExpires)
+{
+    Deadline none;
+    EXPECT_FALSE(none.is_set());
+    EXPECT_FALSE(none.expired());
+    EXPECT_FALSE(Deadline::after(0).is_set());
+
+    Checker checker(&none);
+    for (uint32_t i = 0; i < 3 * CHECK_INTERVAL; i++)
+    {
+        ASSERT_FALSE(checker.expired());
+    }
+    Checker no_deadline(nullptr);
+    EXPECT_FALSE(no_deadline.expired());
+}
+
+TEST(DeadlineTest, Expires)
+{
+    Deadline soon = Deadline::after(5);
+    EXPECT_TRUE(soon.is_set());
+    EXPECT_FALSE(soon.expired());
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(soon.expired());
+}
+
+TEST(DeadlineTest, ClientTimeoutsStayWithinTheLimit)
+{
+    EXPECT_EQ(client_timeout(0, 1000), 1000u);
+    EXPECT_EQ(client_timeout(200, 1000), 200u);
+    EXPECT_EQ(client_timeout(4000000000u, 1000), 1000u);
+    EXPECT_EQ(client_timeout(0, 0), 0u);
+    EXPECT_EQ(client_timeout(200, 0), 200u);
+}
+
+TEST(DeadlineTest, CheckerReadsTheClockEveryInterval)
+{
+    Deadline passed(Deadline::Clock::now() - std::chrono::milliseconds(1));
+    Checker checker(&passed);
+    // Only every CHECK_INTERVAL-th call looks at the clock
+    for (uint32_t i = 1; i < CHECK_INTERVAL; i++)
+    {
+        ASSERT_FALSE(checker.expired());
+    }
+    EXPECT_TRUE(checker.expired());
+}
+
+TEST(DeadlineTest, Errors)
+{
+    EXPECT_THROW(throw TimedOut(), std::runtime_error);
+    try
+    {
+        throw Overloaded();
+    }
+    catch (const std::runtime_error &error)
+    {
+        EXPECT_STREQ(error.what(), "overloaded");
+    }
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include "doc_values.hpp"
+
+using namespace doc_values;
+
+TEST(DocValuesTest, RangesCoverMatches)
+{
+    std::mt19937 generator(5);
+    DocValues<uint32_t, int64_t> column;
+    std::vector<int64_t> values;
+    // Descending like recency ordered ids, with some noise
+    for (uint32_t doc_id = 0; doc_id < 5000; doc_id++)
+    {
+        int64_t value = 100000 - static_cast<int64_t>(doc_id) * 20 + static_cast<int64_t>(generator() % 500);
+        column.push_back(value);
+        values.push_back(value);
+    }
+    ASSERT_EQ(column.size(), values.size());
+
+    for (auto [min, max] : std::vector<std::pair<int64_t, int64_t>>{{95000, 200000}, {40000, 60000}, {0, 1000}, {-5, -1}})
+    {
+        RangeFilter<uint32_t, int64_t> filter{&column, min, max};
+        std::vector<uint32_t> expected;
+        for (uint32_t doc_id = 0; doc_id < values.size(); doc_id++)
+        {
+            if (values[doc_id] >= min && values[doc_id] <= max)
+            {
+                expected.push_back(doc_id);
+            }
+        }
+
+        std::vector<uint32_t> found;
+        std::size_t visited = 0;
+        uint32_t previous_last = 0;
+        column.for_each_range(min, max, [&](uint32_t first, uint32_t last, bool exact)
+                              {
+                                  EXPECT_LE(previous_last, first);
+                                  previous_last = last;
+                                  visited += last - first;
+                                  for (uint32_t doc_id = first; doc_id < last; doc_id++)
+                                  {
+                                      if (exact)
+                                      {
+                                          EXPECT_TRUE(filter.contains(doc_id));
+                                      }
+                                      if (filter.contains(doc_id))
+                                      {
+                                          found.push_back(doc_id);
+                                      }
+                                  }
+                                  return true; });
+        EXPECT_EQ(found, expected);
+        // Blocks far outside the range are never visited
+        EXPECT_LT(visited, expected.size() + 1024);
+    }
+}
+
+TEST(DocValuesTest, StopsEarly)
+{
+    DocValues<uint32_t, int64_t> column;
+    for (uint32_t doc_id = 0; doc_id < 1000; doc_id++)
+    {
+        column.push_back(doc_id % 2 == 0 ? 1 : 5);
+    }
+    int calls = 0;
+    column.for_each_range(0, 10, [&](uint32_t first, uint32_t last, bool exact)
+                          {
+                              EXPECT_EQ(first, 0u);
+                              EXPECT_EQ(last, 1000u);
+                              EXPECT_TRUE(exact);
+                              calls++;
+                              return false; });
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(column.at(3), 5);
+    EXPECT_THROW(column.at(1000), std::out_of_range);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
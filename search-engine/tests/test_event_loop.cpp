@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "event_loop.hpp"
+
+using namespace event_loop;
+
+namespace
+{
+    struct SocketPair
+    {
+        int fds[2];
+
+        SocketPair()
+        {
+            socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+            fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        }
+
+        ~SocketPair()
+        {
+            close(fds[0]);
+            if (fds[1] >= 0)
+            {
+                close(fds[1]);
+            }
+        }
+
+        int server() const
+        {
+            return fds[0];
+        }
+
+        void send_text(const std::string &text)
+        {
+            ASSERT_EQ(write(fds[1], text.data(), text.size()), static_cast<ssize_t>(text.size()));
+        }
+
+        void close_client()
+        {
+            close(fds[1]);
+            fds[1] = -1;
+        }
+    };
+
+    std::vector<std::pair<void *, uint32_t>> ready(EpollLoop &loop, int timeout_ms = 0)
+    {
+        std::vector<std::pair<void *, uint32_t>> result;
+        loop.wait(timeout_ms, [&](void *data, uint32_t events)
+                  { result.emplace_back(data, events); });
+        return result;
+    }
+}
+
+TEST(EventLoopTest, ReportsOnlyReadyFds)
+{
+    EpollLoop loop;
+    std::vector<std::unique_ptr<SocketPair>> pairs;
+    for (int i = 0; i < 100; i++)
+    {
+        pairs.push_back(std::make_unique<SocketPair>());
+        loop.add(pairs.back()->server(), pairs.back().get());
+    }
+    EXPECT_TRUE(ready(loop).empty());
+
+    pairs[42]->send_text("query");
+    pairs[7]->send_text("query");
+    auto events = ready(loop, 100);
+    ASSERT_EQ(events.size(), 2u);
+    for (const auto &[data, flags] : events)
+    {
+        EXPECT_TRUE(data == pairs[42].get() || data == pairs[7].get());
+        EXPECT_TRUE(flags & Readable);
+        EXPECT_FALSE(flags & Closed);
+    }
+}
+
+TEST(EventLoopTest, EdgeTriggered)
+{
+    EpollLoop loop;
+    SocketPair pair;
+    loop.add(pair.server(), &pair);
+
+    pair.send_text("first");
+    EXPECT_EQ(ready(loop, 100).size(), 1u);
+    // Unread input is not reported again
+    EXPECT_TRUE(ready(loop).empty());
+
+    std::string input;
+    EXPECT_EQ(read_available(pair.server(), input), ReadStatus::Drained);
+    EXPECT_EQ(input, "first");
+
+    pair.send_text("second");
+    EXPECT_EQ(ready(loop, 100).size(), 1u);
+    EXPECT_EQ(read_available(pair.server(), input), ReadStatus::Drained);
+    EXPECT_EQ(input, "firstsecond");
+}
+
+TEST(EventLoopTest, ReadAvailableDrainsUntilClose)
+{
+    EpollLoop loop;
+    SocketPair pair;
+    loop.add(pair.server(), &pair);
+
+    // Several chunks arrive before the client hangs up
+    std::string request(10000, 'x');
+    pair.send_text(request);
+    pair.close_client();
+
+    auto events = ready(loop, 100);
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_TRUE(events[0].second & Closed);
+
+    std::vector<unsigned char> input;
+    EXPECT_EQ(read_available(pair.server(), input, 1024), ReadStatus::Closed);
+    EXPECT_EQ(std::string(input.begin(), input.end()), request);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
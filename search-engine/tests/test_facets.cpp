@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "facets.hpp"
+
+using namespace facets;
+
+TEST(FacetsTest, SiteAndSection)
+{
+    EXPECT_EQ(site_of("https://www.RBC.ru/politics/2024/item?id=1"), "rbc.ru");
+    EXPECT_EQ(site_of("http://lenta.ru:8080/news"), "lenta.ru");
+    EXPECT_EQ(site_of("lenta.ru/news"), "lenta.ru");
+    EXPECT_EQ(section_of("https://www.rbc.ru/politics/2024/item"), "rbc.ru/politics");
+    EXPECT_EQ(section_of("https://rbc.ru/sport?page=2"), "rbc.ru/sport");
+    EXPECT_EQ(section_of("https://rbc.ru/"), "rbc.ru");
+    EXPECT_EQ(section_of("https://rbc.ru"), "rbc.ru");
+}
+
+TEST(FacetsTest, FindAndCount)
+{
+    FacetIndex<uint32_t> index;
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        index.add(i, "site", i % 4 == 0 ? "rbc.ru" : "lenta.ru");
+    }
+    index.optimize();
+
+    ASSERT_NE(index.find("site", "rbc.ru"), nullptr);
+    EXPECT_EQ(index.find("site", "rbc.ru")->size(), 2500u);
+    EXPECT_EQ(index.find("site", "ria.ru"), nullptr);
+    EXPECT_EQ(index.find("section", "rbc.ru"), nullptr);
+
+    auto all = index.values("site");
+    ASSERT_EQ(all.size(), 2u);
+    EXPECT_EQ(all[0].value, "lenta.ru");
+    EXPECT_EQ(all[0].count, 7500u);
+
+    roaring::RoaringBitmap matches;
+    for (uint32_t i = 0; i < 10000; i += 2)
+    {
+        matches.insert(i);
+    }
+    auto counts = index.count("site", matches);
+    ASSERT_EQ(counts.size(), 2u);
+    EXPECT_EQ(counts[0].value, "lenta.ru");
+    EXPECT_EQ(counts[0].count, 2500u);
+    EXPECT_EQ(counts[1].value, "rbc.ru");
+    EXPECT_EQ(counts[1].count, 2500u);
+    EXPECT_TRUE(index.count("section", matches).empty());
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "fuzzy.hpp"
+
+using namespace fuzzy;
+
+namespace
+{
+    uint32_t levenshtein(const std::u32string &a, const std::u32string &b)
+    {
+        std::vector<uint32_t> row(b.size() + 1);
+        for (std::size_t j = 0; j <= b.size(); j++)
+        {
+            row[j] = static_cast<uint32_t>(j);
+        }
+        for (std::size_t i = 1; i <= a.size(); i++)
+        {
+            uint32_t diagonal = row[0];
+            row[0] = static_cast<uint32_t>(i);
+            for (std::size_t j = 1; j <= b.size(); j++)
+            {
+                uint32_t above = row[j];
+                row[j] = std::min({row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] == b[j - 1] ? 0 : 1)});
+                diagonal = above;
+            }
+        }
+        return row[b.size()];
+    }
+
+    // Terms over a small mixed Latin and Cyrillic alphabet, so that many of
+    // them are close to each other
+    std::vector<std::string> random_terms(uint32_t seed, std::size_t count)
+    {
+        const std::vector<std::string> letters = {"a", "b", "c", "\xd0\xb0", "\xd0\xb1", "\xd1\x8f"};
+        std::mt19937 generator(seed);
+        std::vector<std::string> terms;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            std::string term;
+            std::size_t length = 1 + generator() % 7;
+            for (std::size_t j = 0; j < length; j++)
+            {
+                term += letters[generator() % letters.size()];
+            }
+            terms.push_back(term);
+        }
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        return terms;
+    }
+}
+
+TEST(FuzzyTest, DecodeUtf8)
+{
+    EXPECT_EQ(decode_utf8("a\xd0\xbf\xd1\x8f"), (std::u32string{U'a', U'п', U'я'}));
+    // A broken sequence is read byte by byte
+    EXPECT_EQ(decode_utf8("\xd0"), (std::u32string{0xD0}));
+}
+
+TEST(FuzzyTest, AutomatonDistance)
+{
+    LevenshteinAutomaton automaton("\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba", 2);
+    auto run = [&](const std::string &input)
+    {
+        auto state = automaton.start();
+        for (char32_t c : decode_utf8(input))
+        {
+            state = automaton.step(state, c);
+        }
+        return state;
+    };
+
+    EXPECT_EQ(automaton.distance(run("\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba")), 0u);
+    // One Cyrillic letter replaced is one edit, not two byte edits
+    EXPECT_EQ(automaton.distance(run("\xd0\xbf\xd0\xbe\xd0\xb5\xd1\x81\xd0\xba")), 1u);
+    EXPECT_EQ(automaton.distance(run("\xd0\xbf\xd0\xb8\xd1\x81\xd0\xba")), 1u);
+    EXPECT_FALSE(automaton.is_match(run("abc")));
+    EXPECT_FALSE(automaton.can_match(run("xyz")));
+    EXPECT_TRUE(automaton.can_match(run("\xd0\xbf\xd0\xbe")));
+}
+
+TEST(FuzzyTest, SearchMatchesBruteForce)
+{
+    auto terms = random_terms(3, 4000);
+    auto dictionary = term_dictionary::FrontCodedDictionary::build(terms);
+
+    std::mt19937 generator(4);
+    for (int round = 0; round < 30; round++)
+    {
+        const std::string &query = terms[generator() % terms.size()];
+        for (uint32_t max_distance : {0u, 1u, 2u})
+        {
+            std::vector<std::pair<std::string, uint32_t>> expected;
+            for (const auto &term : terms)
+            {
+                uint32_t distance = levenshtein(decode_utf8(query), decode_utf8(term));
+                if (distance <= max_distance)
+                {
+                    expected.emplace_back(term, distance);
+                }
+            }
+
+            std::vector<std::pair<std::string, uint32_t>> actual;
+            search(dictionary, query, max_distance, [&](const std::string &term, uint32_t distance)
+                   { actual.emplace_back(term, distance); });
+            EXPECT_EQ(actual, expected) << query << " " << max_distance;
+        }
+    }
+}
+
+TEST(FuzzyTest, SearchSkipsLargeDictionary)
+{
+    // A million terms that mostly share no prefix with the query
+    std::vector<std::string> terms;
+    for (uint32_t i = 0; i < 1000000; i++)
+    {
+        terms.push_back("t" + std::to_string(i * 7919u % 1000003u));
+    }
+    terms.push_back("searching");
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    auto dictionary = term_dictionary::FrontCodedDictionary::build(terms);
+
+    std::vector<std::string> found;
+    auto start = std::chrono::steady_clock::now();
+    search(dictionary, "serching", 2, [&](const std::string &term, uint32_t)
+           { found.push_back(term); });
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(found, (std::vector<std::string>{"searching"}));
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 200);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include "hashmap.hpp"
 
@@ -236,6 +237,37 @@ TEST(HashMapTest, CustomHashFunction)
     EXPECT_EQ(*map.find(p2), "point two");
 }
 
+// Transparent hash that disagrees with std::hash
+struct LengthHash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view key) const
+    {
+        return key.size() * 7919;
+    }
+};
+
+TEST(HashMapTest, FindAs)
+{
+    HashMap<std::string, int> map;
+    map.insert("apple", 1);
+    map.insert("banana", 2);
+
+    EXPECT_EQ(*map.find_as(std::string_view("apple")), 1);
+    EXPECT_EQ(*map.find_as(std::string_view("banana")), 2);
+    EXPECT_EQ(map.find_as(std::string_view("cherry")), nullptr);
+
+    // A transparent hash is used for the other key type too
+    HashMap<std::string, int, LengthHash> by_length;
+    for (int i = 0; i < 100; i++)
+    {
+        by_length.insert(std::string(i + 1, 'a'), i);
+    }
+    EXPECT_EQ(*by_length.find_as(std::string_view("aaaa")), 3);
+    EXPECT_EQ(by_length.find_as(std::string_view("bbbb")), nullptr);
+}
+
 TEST(HashMapTest, LoadFactorAndBucketStats)
 {
     HashMap<int, int> map(8);
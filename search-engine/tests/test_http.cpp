@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "http.hpp"
+
+using namespace http;
+
+namespace
+{
+    const unsigned char *bytes(const std::string &text)
+    {
+        return reinterpret_cast<const unsigned char *>(text.data());
+    }
+}
+
+TEST(HttpTest, ParsesPipelinedRequests)
+{
+    std::string input = "GET /search?q=news+sport&limit=5 HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                        "GET /health HTTP/1.1\r\nConnection: Close\r\n\r\n";
+    Request request;
+    std::size_t consumed = 0;
+    ASSERT_EQ(parse_request(bytes(input), input.size(), request, consumed), protocol::ParseStatus::Complete);
+    EXPECT_EQ(request.method, "GET");
+    EXPECT_EQ(request.path, "/search");
+    EXPECT_EQ(request.query, "q=news+sport&limit=5");
+    EXPECT_TRUE(request.keep_alive);
+    // Views point into the input
+    EXPECT_EQ(request.target.data(), input.data() + 4);
+
+    std::size_t offset = consumed;
+    ASSERT_EQ(parse_request(bytes(input) + offset, input.size() - offset, request, consumed), protocol::ParseStatus::Complete);
+    EXPECT_EQ(request.path, "/health");
+    EXPECT_TRUE(request.query.empty());
+    EXPECT_FALSE(request.keep_alive);
+    EXPECT_EQ(offset + consumed, input.size());
+}
+
+TEST(HttpTest, IncompleteAndInvalidRequests)
+{
+    Request request;
+    std::size_t consumed = 0;
+    std::string partial = "GET /search?q=a HTTP/1.1\r\nHost: x\r\n";
+    EXPECT_EQ(parse_request(bytes(partial), partial.size(), request, consumed), protocol::ParseStatus::Incomplete);
+
+    // The body has to arrive before the request counts as complete
+    std::string with_body = "GET /health HTTP/1.1\r\nContent-Length: 4\r\n\r\nab";
+    EXPECT_EQ(parse_request(bytes(with_body), with_body.size(), request, consumed), protocol::ParseStatus::Incomplete);
+    with_body += "cd";
+    ASSERT_EQ(parse_request(bytes(with_body), with_body.size(), request, consumed), protocol::ParseStatus::Complete);
+    EXPECT_EQ(consumed, with_body.size());
+
+    std::string old_version = "GET / HTTP/1.0\r\n\r\n";
+    ASSERT_EQ(parse_request(bytes(old_version), old_version.size(), request, consumed), protocol::ParseStatus::Complete);
+    EXPECT_FALSE(request.keep_alive);
+
+    for (std::string bad : {"GET /\r\n\r\n", "GET / SPDY/3\r\n\r\n", "GET / HTTP/1.1\r\nno colon\r\n\r\n",
+                            "GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n", "GET / HTTP/1.1\r\nContent-Length: x\r\n\r\n"})
+    {
+        EXPECT_EQ(parse_request(bytes(bad), bad.size(), request, consumed), protocol::ParseStatus::Invalid) << bad;
+    }
+    std::string huge = "GET / HTTP/1.1\r\nX: " + std::string(MAX_HEAD_BYTES, 'x');
+    EXPECT_EQ(parse_request(bytes(huge), huge.size(), request, consumed), protocol::ParseStatus::Invalid);
+}
+
+TEST(HttpTest, QueryParameters)
+{
+    std::string_view value;
+    EXPECT_TRUE(find_parameter("q=a&op=or&limit=3", "op", value));
+    EXPECT_EQ(value, "or");
+    EXPECT_TRUE(find_parameter("flag&q=x", "flag", value));
+    EXPECT_TRUE(value.empty());
+    EXPECT_FALSE(find_parameter("query=a", "q", value));
+
+    std::string decoded;
+    EXPECT_TRUE(decode_component("%22new+york%22%7E2", decoded));
+    EXPECT_EQ(decoded, "\"new york\"~2");
+    EXPECT_TRUE(decode_component("%D0%BC%D0%B8%D1%80", decoded));
+    EXPECT_EQ(decoded, "мир");
+    EXPECT_FALSE(decode_component("%2", decoded));
+    EXPECT_FALSE(decode_component("%zz", decoded));
+}
+
+TEST(HttpTest, JsonWriter)
+{
+    std::string out;
+    JsonWriter json(out);
+    json.begin_object();
+    json.key("query");
+    json.value("say \"hi\"\\\n\x01");
+    json.key("count");
+    json.value(uint64_t(42));
+    json.key("exact");
+    json.value(false);
+    json.key("results");
+    json.begin_array();
+    for (uint32_t id : {1u, 2u})
+    {
+        json.begin_object();
+        json.key("id");
+        json.value(id);
+        json.end_object();
+    }
+    json.end_array();
+    json.key("empty");
+    json.begin_array();
+    json.end_array();
+    json.end_object();
+    EXPECT_EQ(out, R"({"query":"say \"hi\"\\\n\u0001","count":42,"exact":false,"results":[{"id":1},{"id":2}],"empty":[]})");
+}
+
+TEST(HttpTest, ResponseHead)
+{
+    std::string head;
+    append_head(head, 200, "OK", "application/json", 17, true);
+    EXPECT_EQ(head, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 17\r\n\r\n");
+    head.clear();
+    append_head(head, 404, "Not Found", "application/json", 0, false);
+    EXPECT_EQ(head, "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <vector>
+#include "intersection.hpp"
+
+using namespace intersection;
+using posting_list::PostingList;
+using posting_list::Representation;
+
+namespace
+{
+    std::vector<uint32_t> random_ids(std::size_t count, uint32_t max_gap, uint32_t seed)
+    {
+        std::mt19937 generator(seed);
+        std::uniform_int_distribution<uint32_t> distribution(1, max_gap);
+        std::vector<uint32_t> ids;
+        uint32_t id = 0;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            id += distribution(generator);
+            ids.push_back(id);
+        }
+        return ids;
+    }
+
+    PostingList<uint32_t> make_list(const std::vector<uint32_t> &ids, Representation representation)
+    {
+        PostingList<uint32_t> list;
+        for (uint32_t id : ids)
+        {
+            list.insert(id);
+        }
+        if (representation == Representation::Compressed)
+        {
+            list.compress();
+        }
+        else if (representation == Representation::Bitmap)
+        {
+            list.compress_to_bitmap();
+        }
+        return list;
+    }
+
+    auto accept_all = [](uint32_t)
+    { return true; };
+}
+
+TEST(IntersectionTest, ChooseStrategy)
+{
+    EXPECT_EQ(choose_strategy(100, 150, Representation::SkipList), Strategy::Merge);
+    EXPECT_EQ(choose_strategy(100, 150, Representation::Compressed), Strategy::Merge);
+    EXPECT_EQ(choose_strategy(100, 100 * GALLOP_MIN_RATIO, Representation::Compressed), Strategy::Gallop);
+    EXPECT_EQ(choose_strategy(100, 150, Representation::Bitmap), Strategy::BitmapProbe);
+    EXPECT_EQ(choose_strategy(1, 1000000, Representation::Bitmap), Strategy::BitmapProbe);
+}
+
+TEST(IntersectionTest, MatchesSetIntersectionAcrossRepresentations)
+{
+    const Representation representations[] = {Representation::SkipList, Representation::Compressed, Representation::Bitmap};
+
+    auto rare = random_ids(200, 500, 1);
+    auto medium = random_ids(1000, 100, 2);
+    auto dense = random_ids(20000, 6, 3);
+
+    std::vector<uint32_t> expected;
+    std::set_intersection(rare.begin(), rare.end(), medium.begin(), medium.end(), std::back_inserter(expected));
+    std::vector<uint32_t> tmp;
+    std::set_intersection(expected.begin(), expected.end(), dense.begin(), dense.end(), std::back_inserter(tmp));
+    expected.swap(tmp);
+    ASSERT_FALSE(expected.empty());
+
+    for (auto a : representations)
+    {
+        for (auto b : representations)
+        {
+            for (auto c : representations)
+            {
+                auto rare_list = make_list(rare, a);
+                auto medium_list = make_list(medium, b);
+                auto dense_list = make_list(dense, c);
+
+                IntersectionStats stats;
+                auto result = intersect<uint32_t>({&dense_list, &rare_list, &medium_list}, accept_all, 0, &stats);
+                EXPECT_EQ(result, expected);
+
+                // Lists are processed smallest first
+                EXPECT_EQ(stats.base_size, rare.size());
+                ASSERT_EQ(stats.steps.size(), 2);
+                EXPECT_EQ(stats.steps[0].list_size, medium.size());
+                EXPECT_EQ(stats.steps[1].list_size, dense.size());
+                EXPECT_EQ(stats.steps[1].matches, expected.size());
+                EXPECT_EQ(stats.steps[0].strategy, b == Representation::Bitmap ? Strategy::BitmapProbe : Strategy::Merge);
+                EXPECT_EQ(stats.steps[1].strategy, c == Representation::Bitmap ? Strategy::BitmapProbe : Strategy::Gallop);
+            }
+        }
+    }
+}
+
+TEST(IntersectionTest, LimitAndAccept)
+{
+    std::vector<uint32_t> evens, threes;
+    for (uint32_t i = 0; i < 3000; i++)
+    {
+        if (i % 2 == 0)
+            evens.push_back(i);
+        if (i % 3 == 0)
+            threes.push_back(i);
+    }
+    auto a = make_list(evens, Representation::Compressed);
+    auto b = make_list(threes, Representation::SkipList);
+
+    auto result = intersect<uint32_t>({&a, &b}, [](uint32_t id)
+                                      { return id % 4 == 0; }, 5);
+    EXPECT_EQ(result, (std::vector<uint32_t>{0, 12, 24, 36, 48}));
+}
+
+TEST(IntersectionTest, EarlyExit)
+{
+    auto small_list = make_list({1, 2, 3, 1000000}, Representation::SkipList);
+    auto large_list = make_list(random_ids(10000, 10, 4), Representation::Compressed);
+    auto empty_list = make_list({}, Representation::SkipList);
+
+    IntersectionStats stats;
+    auto result = intersect<uint32_t>({&large_list, &small_list}, accept_all, 0, &stats);
+    EXPECT_TRUE(stats.exhausted_early);
+    EXPECT_LT(stats.steps[0].probes, 4);
+
+    result = intersect<uint32_t>({&large_list, &small_list, &empty_list}, accept_all, 0, &stats);
+    EXPECT_TRUE(result.empty());
+    EXPECT_EQ(stats.base_size, 0);
+    EXPECT_EQ(stats.steps[0].probes + stats.steps[1].probes, 0);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "output_buffer.hpp"
+
+using namespace output_buffer;
+
+namespace
+{
+    std::string read_all(int fd)
+    {
+        std::string result;
+        char buffer[4096];
+        ssize_t bytes_read;
+        while ((bytes_read = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+        {
+            result.append(buffer, static_cast<std::size_t>(bytes_read));
+        }
+        return result;
+    }
+}
+
+TEST(OutputBufferTest, MessagePieces)
+{
+    std::string source = "https://example.com/a";
+    Message message;
+    message.append("2 results");
+    message.append("\n");
+    message.append_external(source);
+    message.append_external("\n");
+    message.append("tail");
+
+    // Copied bytes next to each other share a piece
+    EXPECT_EQ(message.piece_count(), 4u);
+    EXPECT_EQ(message.piece(0), "2 results\n");
+    EXPECT_EQ(message.piece(1).data(), source.data());
+    EXPECT_EQ(message.size(), 10 + source.size() + 1 + 4);
+    EXPECT_EQ(message.to_string(), "2 results\nhttps://example.com/a\ntail");
+
+    Message framed;
+    framed.append("header");
+    framed.append(message);
+    EXPECT_EQ(framed.to_string(), "header2 results\nhttps://example.com/a\ntail");
+    EXPECT_EQ(framed.piece(1).data(), source.data());
+}
+
+TEST(OutputBufferTest, FlushUntilBlocked)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    // Many small pieces, more than one writev takes
+    std::vector<std::string> sources;
+    for (int i = 0; i < 20000; i++)
+    {
+        sources.push_back("https://example.com/" + std::to_string(i));
+    }
+    OutputQueue queue;
+    std::string expected;
+    for (std::size_t i = 0; i < sources.size(); i += 100)
+    {
+        Message message;
+        message.append(std::to_string(i) + " results\n");
+        for (std::size_t j = i; j < i + 100; j++)
+        {
+            message.append_external(sources[j]);
+            message.append_external("\n");
+        }
+        expected += message.to_string();
+        queue.push(std::move(message));
+    }
+    EXPECT_EQ(queue.size(), expected.size());
+
+    std::string received;
+    FlushStatus status = queue.flush(fds[0]);
+    EXPECT_EQ(status, FlushStatus::Blocked);
+    while (status == FlushStatus::Blocked)
+    {
+        received += read_all(fds[1]);
+        status = queue.flush(fds[0]);
+    }
+    EXPECT_EQ(status, FlushStatus::Done);
+    EXPECT_TRUE(queue.empty());
+    received += read_all(fds[1]);
+    EXPECT_EQ(received, expected);
+
+    close(fds[1]);
+    Message message;
+    message.append("lost");
+    queue.push(std::move(message));
+    EXPECT_EQ(queue.flush(fds[0]), FlushStatus::Failed);
+    close(fds[0]);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "position_index.hpp"
+
+using namespace position_index;
+
+TEST(PositionIndexTest, EncodeDecodeRoundTrip)
+{
+    std::vector<uint32_t> positions = {0, 1, 5, 127, 128, 300, 70000, 4000000000u};
+
+    PositionList encoded = encode_positions(positions);
+    EXPECT_EQ(decode_positions(encoded), positions);
+
+    // Small gaps take one byte each
+    PositionList small = encode_positions({3, 4, 10, 20});
+    EXPECT_EQ(small.size(), 4);
+
+    EXPECT_TRUE(decode_positions(encode_positions({})).empty());
+}
+
+TEST(PositionIndexTest, AddFindRemove)
+{
+    PositionIndex<uint32_t> index;
+
+    index.add("bank", 1, {0, 7});
+    index.add("bank", 2, {3});
+    index.add("rate", 1, {1});
+
+    EXPECT_EQ(index.total_terms(), 2);
+
+    const auto *bank_1 = index.find("bank", 1);
+    ASSERT_NE(bank_1, nullptr);
+    EXPECT_EQ(decode_positions(*bank_1), (std::vector<uint32_t>{0, 7}));
+
+    EXPECT_EQ(index.find("bank", 3), nullptr);
+    EXPECT_EQ(index.find("dollar", 1), nullptr);
+
+    std::size_t bytes_before = index.encoded_bytes();
+    EXPECT_TRUE(index.remove("bank", 1));
+    EXPECT_FALSE(index.remove("bank", 1));
+    EXPECT_EQ(index.find("bank", 1), nullptr);
+    EXPECT_LT(index.encoded_bytes(), bytes_before);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
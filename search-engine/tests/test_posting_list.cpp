@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "posting_list.hpp"
+
+using namespace posting_list;
+
+namespace
+{
+    std::vector<uint32_t> random_ids(std::size_t count, uint32_t max_gap, uint32_t seed)
+    {
+        std::mt19937 generator(seed);
+        std::uniform_int_distribution<uint32_t> distribution(1, max_gap);
+        std::vector<uint32_t> ids;
+        uint32_t id = 0;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            ids.push_back(id);
+            id += distribution(generator);
+        }
+        return ids;
+    }
+}
+
+TEST(PostingListTest, CompressedRoundTrip)
+{
+    auto ids = random_ids(1000, 50, 1);
+
+    for (codec::Codec codec : codec::ALL_CODECS)
+    {
+        auto list = CompressedPostingList::encode(ids, codec);
+        EXPECT_EQ(list.size(), ids.size());
+        EXPECT_EQ(list.block_count(), 8);
+        EXPECT_EQ(list.decode(), ids);
+        EXPECT_LT(list.encoded_bytes(), ids.size() * sizeof(uint32_t));
+    }
+
+    auto best = CompressedPostingList::encode_best(ids);
+    EXPECT_EQ(best.decode(), ids);
+
+    EXPECT_TRUE(CompressedPostingList::encode({}, codec::Codec::BitPacking).decode().empty());
+}
+
+TEST(PostingListTest, CompressedContainsAndSeek)
+{
+    auto ids = random_ids(700, 20, 2);
+    auto list = CompressedPostingList::encode_best(ids);
+
+    for (uint32_t id = 0; id <= ids.back() + 5; id++)
+    {
+        bool expected = std::binary_search(ids.begin(), ids.end(), id);
+        ASSERT_EQ(list.contains(id), expected) << id;
+    }
+
+    auto cursor = list.cursor();
+    for (uint32_t target : {0u, 1u, ids[130], ids[130] + 1, ids[500], ids.back()})
+    {
+        cursor.seek(target);
+        auto expected = std::lower_bound(ids.begin(), ids.end(), target);
+        ASSERT_TRUE(cursor.valid());
+        EXPECT_EQ(cursor.doc(), *expected);
+    }
+
+    cursor.seek(ids.back() + 1);
+    EXPECT_FALSE(cursor.valid());
+}
+
+TEST(PostingListTest, CompressAndUpdate)
+{
+    PostingList<uint32_t> list;
+    for (uint32_t id : {40u, 10u, 30u, 20u})
+    {
+        list.insert(id);
+    }
+    EXPECT_FALSE(list.is_compressed());
+
+    list.compress();
+    EXPECT_TRUE(list.is_compressed());
+    EXPECT_EQ(list.size(), 4);
+    EXPECT_TRUE(list.contains(30));
+    EXPECT_FALSE(list.contains(35));
+    EXPECT_EQ(list.to_vector(), (std::vector<uint32_t>{10, 20, 30, 40}));
+
+    // Updates go back to the skip list form
+    EXPECT_FALSE(list.remove(35));
+    EXPECT_TRUE(list.is_compressed());
+    EXPECT_TRUE(list.remove(20));
+    EXPECT_TRUE(list.insert(25));
+    EXPECT_FALSE(list.is_compressed());
+    EXPECT_EQ(list.to_vector(), (std::vector<uint32_t>{10, 25, 30, 40}));
+}
+
+TEST(PostingListTest, CursorOverBothForms)
+{
+    auto ids = random_ids(300, 7, 3);
+
+    PostingList<uint32_t> list;
+    for (uint32_t id : ids)
+    {
+        list.insert(id);
+    }
+
+    for (int round = 0; round < 2; round++)
+    {
+        auto cursor = list.cursor();
+        cursor.seek(ids[200]);
+        ASSERT_TRUE(cursor.valid());
+        EXPECT_EQ(cursor.doc(), ids[200]);
+        cursor.next();
+        EXPECT_EQ(cursor.doc(), ids[201]);
+
+        list.compress();
+    }
+}
+
+TEST(PostingListTest, StringDocIds)
+{
+    PostingList<std::string> list;
+    list.insert("b.html");
+    list.insert("a.html");
+
+    auto cursor = list.cursor();
+    cursor.seek("aa");
+    ASSERT_TRUE(cursor.valid());
+    EXPECT_EQ(cursor.doc(), "b.html");
+}
+
+
+TEST(PostingListTest, BitmapRepresentation)
+{
+    auto ids = random_ids(5000, 3, 6);
+    PostingList<uint32_t> list;
+    for (uint32_t id : ids)
+    {
+        list.insert(id);
+    }
+
+    list.compress_to_bitmap();
+    EXPECT_EQ(list.representation(), Representation::Bitmap);
+    EXPECT_NE(list.bitmap(), nullptr);
+    EXPECT_EQ(list.compressed(), nullptr);
+    EXPECT_EQ(list.to_vector(), ids);
+    EXPECT_LT(list.memory_bytes(), ids.size() * sizeof(uint32_t));
+
+    auto cursor = list.cursor();
+    cursor.seek(ids[1234] - 1);
+    ASSERT_TRUE(cursor.valid());
+    EXPECT_EQ(cursor.doc(), ids[1234 - (ids[1234] - 1 == ids[1233] ? 1 : 0)]);
+
+    // Switching representations keeps the contents
+    list.compress();
+    EXPECT_EQ(list.representation(), Representation::Compressed);
+    EXPECT_EQ(list.to_vector(), ids);
+
+    list.compress_to_bitmap();
+    EXPECT_TRUE(list.insert(ids.back() + 1));
+    EXPECT_TRUE(list.remove(ids.front()));
+    EXPECT_EQ(list.representation(), Representation::Bitmap);
+    EXPECT_EQ(list.size(), ids.size());
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "protocol.hpp"
+
+using namespace protocol;
+
+namespace
+{
+    const unsigned char *bytes(const std::string &text)
+    {
+        return reinterpret_cast<const unsigned char *>(text.data());
+    }
+}
+
+TEST(ProtocolTest, FrameRoundTrip)
+{
+    std::string buffer;
+    append_frame(buffer, 7, Opcode::Search, "news sport");
+    ASSERT_EQ(buffer.size(), HEADER_BYTES + 10);
+    EXPECT_TRUE(is_binary(static_cast<unsigned char>(buffer[0])));
+
+    Frame frame;
+    std::size_t consumed = 0;
+    ASSERT_EQ(parse_frame(bytes(buffer), buffer.size(), frame, consumed), ParseStatus::Complete);
+    EXPECT_EQ(consumed, buffer.size());
+    EXPECT_EQ(frame.request_id, 7u);
+    EXPECT_EQ(frame.opcode, Opcode::Search);
+    EXPECT_EQ(frame.payload, "news sport");
+
+    // Every proper prefix waits for more bytes
+    for (std::size_t size = 0; size < buffer.size(); size++)
+    {
+        EXPECT_EQ(parse_frame(bytes(buffer), size, frame, consumed), ParseStatus::Incomplete);
+    }
+}
+
+TEST(ProtocolTest, FrameDeadline)
+{
+    std::string buffer;
+    append_frame(buffer, 1, Opcode::Search, "news", 300);
+    append_frame(buffer, 2, Opcode::Search, "sport");
+
+    Frame frame;
+    std::size_t consumed = 0;
+    ASSERT_EQ(parse_frame(bytes(buffer), buffer.size(), frame, consumed), ParseStatus::Complete);
+    EXPECT_EQ(frame.deadline_ms, 300u);
+    ASSERT_EQ(parse_frame(bytes(buffer) + consumed, buffer.size() - consumed, frame, consumed), ParseStatus::Complete);
+    EXPECT_EQ(frame.deadline_ms, 0u);
+}
+
+TEST(ProtocolTest, PipelinedFrames)
+{
+    std::string buffer;
+    for (uint32_t id = 0; id < 100; id++)
+    {
+        append_frame(buffer, id, id % 2 ? Opcode::Complete : Opcode::Facets, std::string(id, 'x'));
+    }
+    append_frame(buffer, 100, Opcode::Search, "");
+
+    std::size_t offset = 0;
+    uint32_t expected = 0;
+    Frame frame;
+    std::size_t consumed = 0;
+    while (parse_frame(bytes(buffer) + offset, buffer.size() - offset, frame, consumed) == ParseStatus::Complete)
+    {
+        EXPECT_EQ(frame.request_id, expected);
+        EXPECT_EQ(frame.payload.size(), expected == 100 ? 0u : expected);
+        offset += consumed;
+        expected++;
+    }
+    EXPECT_EQ(expected, 101u);
+    EXPECT_EQ(offset, buffer.size());
+}
+
+TEST(ProtocolTest, OversizedFrame)
+{
+    unsigned char header[HEADER_BYTES] = {};
+    write_u32(header, MAX_PAYLOAD_BYTES + 1);
+    Frame frame;
+    std::size_t consumed = 0;
+    EXPECT_EQ(parse_frame(header, HEADER_BYTES, frame, consumed), ParseStatus::Invalid);
+    EXPECT_FALSE(is_binary(static_cast<unsigned char>('n')));
+}
+
+TEST(ProtocolTest, TextLines)
+{
+    std::string buffer = "news sport\r\ncomplete:sp\npartial";
+    std::string_view line;
+    std::size_t consumed = 0;
+    std::size_t offset = 0;
+    std::vector<std::string> lines;
+    while (next_line(bytes(buffer) + offset, buffer.size() - offset, false, line, consumed))
+    {
+        lines.emplace_back(line);
+        offset += consumed;
+    }
+    EXPECT_EQ(lines, (std::vector<std::string>{"news sport\r", "complete:sp"}));
+
+    // The unterminated rest is a request once the client hangs up
+    ASSERT_TRUE(next_line(bytes(buffer) + offset, buffer.size() - offset, true, line, consumed));
+    EXPECT_EQ(line, "partial");
+    EXPECT_FALSE(next_line(bytes(buffer), 0, true, line, consumed));
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
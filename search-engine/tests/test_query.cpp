@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "connector.hpp"
+#include "query.hpp"
+
+using namespace query;
+
+TEST(QueryTest, TermsAndFilters)
+{
+    Query parsed = parse_query("news -sport site:WWW.Example.com since:24h");
+    EXPECT_EQ(parsed.op, Operator::And);
+    EXPECT_EQ(parsed.terms, tokenize_and_stem("news"));
+    EXPECT_EQ(parsed.excluded, tokenize_and_stem("sport"));
+    ASSERT_EQ(parsed.facets.size(), 1u);
+    EXPECT_EQ(parsed.facets[0], std::make_pair(std::string("site"), std::string("example.com")));
+    EXPECT_TRUE(parsed.has_lastmod_filter());
+}
+
+TEST(QueryTest, PhraseFollowedByFilters)
+{
+    Query parsed = parse_query("\"foo bar\" since:24h section:news");
+    EXPECT_EQ(parsed.op, Operator::Phrase);
+    EXPECT_EQ(parsed.terms, tokenize_and_stem("foo bar"));
+    EXPECT_EQ(parsed.slop, 0u);
+    EXPECT_TRUE(parsed.has_lastmod_filter());
+    ASSERT_EQ(parsed.facets.size(), 1u);
+    EXPECT_EQ(parsed.facets[0], std::make_pair(std::string("section"), std::string("news")));
+
+    // The slop comes first, other words after the phrase are ignored
+    Query near = parse_query("\"foo bar\"~3 site:example.com baz");
+    EXPECT_EQ(near.op, Operator::Phrase);
+    EXPECT_EQ(near.slop, 3u);
+    EXPECT_EQ(near.terms, tokenize_and_stem("foo bar"));
+    ASSERT_EQ(near.facets.size(), 1u);
+    EXPECT_FALSE(near.has_lastmod_filter());
+
+    // Filtered and unfiltered phrases are cached apart
+    EXPECT_NE(cache_key(parsed), cache_key(parse_query("\"foo bar\"")));
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "boolean_index.hpp"
+#include "query_cache.hpp"
+
+using namespace query_cache;
+
+TEST(QueryCacheTest, HitMissAndStaleGenerations)
+{
+    QueryCache<uint32_t> cache(1 << 20, 4);
+    std::vector<uint32_t> out;
+
+    EXPECT_FALSE(cache.find("and a b", 0, out));
+    cache.insert("and a b", 0, {1, 2, 3});
+    ASSERT_TRUE(cache.find("and a b", 0, out));
+    EXPECT_EQ(out, (std::vector<uint32_t>{1, 2, 3}));
+
+    // A newer index generation makes the entry stale
+    EXPECT_FALSE(cache.find("and a b", 1, out));
+    EXPECT_FALSE(cache.find("and a b", 0, out));
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 3);
+    EXPECT_EQ(stats.stale, 1);
+    EXPECT_EQ(stats.entries, 0);
+    EXPECT_EQ(stats.bytes, 0);
+    EXPECT_DOUBLE_EQ(stats.hit_rate(), 0.25);
+}
+
+TEST(QueryCacheTest, MemoryBudget)
+{
+    const std::size_t budget = 64 * 1024;
+    QueryCache<uint32_t> cache(budget, 1);
+    std::vector<uint32_t> ids(100, 7);
+
+    for (int i = 0; i < 1000; i++)
+    {
+        cache.insert("key " + std::to_string(i), 0, ids);
+        EXPECT_LE(cache.stats().bytes, budget);
+    }
+    auto stats = cache.stats();
+    EXPECT_GT(stats.evictions, 0);
+    EXPECT_EQ(stats.insertions, 1000);
+    EXPECT_EQ(stats.entries, stats.insertions - stats.evictions);
+
+    // Results larger than the probation segment are not cached at all
+    cache.insert("huge", 0, std::vector<uint32_t>(budget, 1));
+    std::vector<uint32_t> out;
+    EXPECT_FALSE(cache.find("huge", 0, out));
+    EXPECT_EQ(cache.stats().rejected, 1);
+}
+
+TEST(QueryCacheTest, ProtectedEntriesSurviveScans)
+{
+    QueryCache<uint32_t> cache(64 * 1024, 1);
+    std::vector<uint32_t> out;
+    std::vector<uint32_t> ids(100, 1);
+
+    cache.insert("popular", 0, ids);
+    ASSERT_TRUE(cache.find("popular", 0, out));
+
+    // A long run of one-off queries only cycles through probation
+    for (int i = 0; i < 1000; i++)
+    {
+        cache.insert("once " + std::to_string(i), 0, ids);
+    }
+    EXPECT_TRUE(cache.find("popular", 0, out));
+    EXPECT_FALSE(cache.find("once 0", 0, out));
+    EXPECT_TRUE(cache.find("once 999", 0, out));
+}
+
+TEST(QueryCacheTest, ConcurrentShards)
+{
+    QueryCache<uint32_t> cache(1 << 20);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&cache, t]
+                             {
+                                 std::vector<uint32_t> out;
+                                 for (int i = 0; i < 2000; i++)
+                                 {
+                                     std::string key = "key " + std::to_string(i % 50);
+                                     if (!cache.find(key, 0, out))
+                                     {
+                                         cache.insert(key, 0, {static_cast<uint32_t>(i % 50)});
+                                     }
+                                     else
+                                     {
+                                         EXPECT_EQ(out, std::vector<uint32_t>{static_cast<uint32_t>(i % 50)});
+                                     }
+                                 } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.hits + stats.misses, 8000);
+    EXPECT_EQ(stats.entries, 50);
+}
+
+TEST(QueryCacheTest, IndexGenerationChangesOnUpdates)
+{
+    boolean_index::BooleanIndex<uint32_t> index;
+    uint64_t generation = index.generation();
+
+    index.add_document(1, {"a"});
+    EXPECT_NE(index.generation(), generation);
+    generation = index.generation();
+
+    EXPECT_FALSE(index.remove_document(2, {"a"}));
+    EXPECT_EQ(index.generation(), generation);
+
+    index.and_query({"a"});
+    index.compress();
+    EXPECT_EQ(index.generation(), generation);
+
+    EXPECT_TRUE(index.remove_document(1, {"a"}));
+    EXPECT_NE(index.generation(), generation);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
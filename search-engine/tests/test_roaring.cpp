@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <vector>
+#include "roaring.hpp"
+
+using namespace roaring;
+
+namespace
+{
+    // Mix of sparse, dense and run-shaped chunks
+    std::vector<uint32_t> mixed_ids(uint32_t seed)
+    {
+        std::mt19937 generator(seed);
+        std::vector<uint32_t> ids;
+        for (uint32_t id = 0; id < 65536; id += 1 + generator() % 1000)
+        {
+            ids.push_back(id);
+        }
+        for (uint32_t id = 65536; id < 2 * 65536; id++)
+        {
+            if (generator() % 2 == 0)
+            {
+                ids.push_back(id);
+            }
+        }
+        for (uint32_t id = 3 * 65536 + 100; id < 3 * 65536 + 30000; id++)
+        {
+            ids.push_back(id);
+        }
+        return ids;
+    }
+
+    std::vector<uint32_t> intersection(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+    {
+        std::vector<uint32_t> result;
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        return result;
+    }
+}
+
+TEST(RoaringTest, RoundTripAcrossContainerTypes)
+{
+    auto ids = mixed_ids(1);
+    auto bitmap = RoaringBitmap::from_sorted(ids);
+    bitmap.run_optimize();
+
+    EXPECT_EQ(bitmap.cardinality(), ids.size());
+    EXPECT_EQ(bitmap.container_count(), 3);
+    EXPECT_EQ(bitmap.container_count(RoaringBitmap::ContainerType::Array), 1);
+    EXPECT_EQ(bitmap.container_count(RoaringBitmap::ContainerType::Bitmap), 1);
+    EXPECT_EQ(bitmap.container_count(RoaringBitmap::ContainerType::Run), 1);
+    EXPECT_EQ(bitmap.to_vector(), ids);
+    EXPECT_LT(bitmap.memory_bytes(), ids.size() * sizeof(uint32_t));
+
+    for (uint32_t id : ids)
+    {
+        EXPECT_TRUE(bitmap.contains(id));
+    }
+    EXPECT_FALSE(bitmap.contains(2 * 65536 + 5));
+    EXPECT_FALSE(bitmap.contains(3 * 65536 + 99));
+}
+
+TEST(RoaringTest, InsertAndRemove)
+{
+    RoaringBitmap bitmap;
+    EXPECT_TRUE(bitmap.empty());
+
+    for (uint32_t id = 0; id < 10000; id += 2)
+    {
+        EXPECT_TRUE(bitmap.insert(id));
+    }
+    EXPECT_FALSE(bitmap.insert(0));
+    EXPECT_EQ(bitmap.cardinality(), 5000);
+
+    bitmap.run_optimize();
+    EXPECT_TRUE(bitmap.insert(1));
+    EXPECT_TRUE(bitmap.remove(2));
+    EXPECT_FALSE(bitmap.remove(2));
+    EXPECT_TRUE(bitmap.contains(1));
+    EXPECT_FALSE(bitmap.contains(2));
+    EXPECT_EQ(bitmap.cardinality(), 5000);
+
+    for (uint32_t id = 0; id < 10000; id++)
+    {
+        bitmap.remove(id);
+    }
+    EXPECT_TRUE(bitmap.empty());
+    EXPECT_EQ(bitmap.container_count(), 0);
+}
+
+TEST(RoaringTest, SetOperations)
+{
+    auto a_ids = mixed_ids(2);
+    auto b_ids = mixed_ids(3);
+    auto a = RoaringBitmap::from_sorted(a_ids);
+    auto b = RoaringBitmap::from_sorted(b_ids);
+    b.run_optimize();
+
+    auto expected_and = intersection(a_ids, b_ids);
+    EXPECT_EQ((a & b).to_vector(), expected_and);
+    EXPECT_EQ(a.and_cardinality(b), expected_and.size());
+
+    std::vector<uint32_t> expected_or;
+    std::set_union(a_ids.begin(), a_ids.end(), b_ids.begin(), b_ids.end(), std::back_inserter(expected_or));
+    EXPECT_EQ((a | b).to_vector(), expected_or);
+
+    std::vector<uint32_t> expected_and_not;
+    std::set_difference(a_ids.begin(), a_ids.end(), b_ids.begin(), b_ids.end(), std::back_inserter(expected_and_not));
+    EXPECT_EQ(a.and_not(b).to_vector(), expected_and_not);
+}
+
+TEST(RoaringTest, CursorSeek)
+{
+    auto ids = mixed_ids(4);
+    auto bitmap = RoaringBitmap::from_sorted(ids);
+    bitmap.run_optimize();
+
+    std::mt19937 generator(5);
+    auto cursor = bitmap.cursor();
+    uint32_t target = 0;
+    while (true)
+    {
+        target += generator() % 3000;
+        cursor.seek(target);
+
+        auto expected = std::lower_bound(ids.begin(), ids.end(), target);
+        if (expected == ids.end())
+        {
+            EXPECT_FALSE(cursor.valid());
+            break;
+        }
+        ASSERT_TRUE(cursor.valid());
+        EXPECT_EQ(cursor.doc(), *expected);
+    }
+
+    EXPECT_FALSE(RoaringBitmap::Cursor(nullptr).valid());
+}
+
+TEST(RoaringTest, SelectAndMaximum)
+{
+    auto ids = mixed_ids(6);
+    auto bitmap = RoaringBitmap::from_sorted(ids);
+    bitmap.run_optimize();
+
+    for (std::size_t rank = 0; rank < ids.size(); rank += 97)
+    {
+        EXPECT_EQ(bitmap.select(rank), ids[rank]);
+    }
+    EXPECT_EQ(bitmap.select(ids.size() - 1), ids.back());
+    EXPECT_EQ(bitmap.maximum(), ids.back());
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,447 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <spdlog/sinks/null_sink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "connector.hpp"
+#include "server.hpp"
+
+extern std::atomic<bool> stop_flag;
+
+namespace
+{
+    constexpr int PORT = 19871;
+
+    // Heap allocations made through operator new while counting is on
+    std::atomic<bool> counting{false};
+    std::atomic<std::size_t> allocations{0};
+
+    void *allocate(std::size_t size, std::size_t alignment)
+    {
+        if (counting.load(std::memory_order_relaxed))
+        {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        size = size == 0 ? 1 : size;
+        void *pointer = alignment <= alignof(std::max_align_t) ? std::malloc(size)
+                                                               : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        if (pointer == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return pointer;
+    }
+
+    // Kept out of line, so that GCC does not see free() taking pointers
+    // from operator new and warn about a mismatched delete
+    [[gnu::noinline]] void deallocate(void *pointer) noexcept
+    {
+        std::free(pointer);
+    }
+
+    // Heap allocations made by `run`
+    template <typename Run>
+    std::size_t count_allocations(Run run)
+    {
+        allocations = 0;
+        counting = true;
+        run();
+        counting = false;
+        return allocations;
+    }
+
+    int connect_to_server()
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(PORT);
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Read until the server closes the connection or `timeout` passes
+    std::string read_all(int fd, std::chrono::seconds timeout = std::chrono::seconds(10))
+    {
+        std::string received;
+        char buffer[4096];
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n > 0)
+            {
+                received.append(buffer, n);
+            }
+            else if (n == 0)
+            {
+                break;
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        return received;
+    }
+
+    // Read up to and including the first newline, or what arrived by `timeout`
+    std::string read_line(int fd, std::chrono::seconds timeout = std::chrono::seconds(10))
+    {
+        std::string received;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (std::chrono::steady_clock::now() < deadline && received.find('\n') == std::string::npos)
+        {
+            char c;
+            ssize_t n = recv(fd, &c, 1, MSG_DONTWAIT);
+            if (n > 0)
+            {
+                received.push_back(c);
+            }
+            else if (n == 0)
+            {
+                break;
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        return received;
+    }
+
+    // Index of `count` documents on "news" and either "sport" or "politics",
+    // stemmed as the connector does so that queries find them
+    void build(boolean_index::BooleanIndex<uint32_t> &index, document_store::DocumentStore<uint32_t> &documents,
+               uint32_t count)
+    {
+        const std::vector<std::string> sport = tokenize_and_stem(std::string("news sport"));
+        const std::vector<std::string> politics = tokenize_and_stem(std::string("news politics"));
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t id = documents.add("https://site" + std::to_string(i % 3) + ".ru/" + std::to_string(i), 1000 + i);
+            index.add_document(id, i % 2 == 0 ? sport : politics);
+        }
+        index.compress();
+        documents.optimize();
+    }
+
+    // Runs a server until the test ends
+    class RunningServer
+    {
+    private:
+        MinimalAsyncServer &server_;
+        std::thread thread_;
+
+    public:
+        explicit RunningServer(MinimalAsyncServer &server) : server_(server)
+        {
+            stop_flag = false;
+            thread_ = std::thread([this]
+                                  { server_.run(); });
+            for (int attempt = 0; attempt < 200; attempt++)
+            {
+                int fd = connect_to_server();
+                if (fd >= 0)
+                {
+                    close(fd);
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        ~RunningServer()
+        {
+            stop_flag = true;
+            // A new connection wakes the event loop to see the flag
+            int fd = connect_to_server();
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            thread_.join();
+        }
+    };
+}
+
+void *operator new(std::size_t size)
+{
+    return allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *pointer) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept
+{
+    deallocate(pointer);
+}
+
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept
+{
+    deallocate(pointer);
+}
+
+TEST(ServerTest, ConnectionClosesInTheBatchItsAnswerArrives)
+{
+    spdlog::set_level(spdlog::level::warn);
+    boolean_index::BooleanIndex<uint32_t> index(10);
+    document_store::DocumentStore<uint32_t> documents;
+    build(index, documents, 1000);
+
+    ServerOptions options;
+    options.reactors = 1;
+    options.query_workers = 2;
+    MinimalAsyncServer server(PORT, 10, index, documents, 1 << 20, options);
+    RunningServer running(server);
+
+    // Each client hangs up right after its query, so its answer from a
+    // worker and its reset keep landing in the same epoll batch. Delivering
+    // the answer closes the connection before the batch reaches its reset
+    for (int round = 0; round < 20; round++)
+    {
+        std::vector<int> clients;
+        for (int i = 0; i < 64; i++)
+        {
+            int fd = connect_to_server();
+            ASSERT_GE(fd, 0);
+            const std::string query = "news sport\n";
+            ASSERT_EQ(send(fd, query.data(), query.size(), 0), static_cast<ssize_t>(query.size()));
+            shutdown(fd, SHUT_WR);
+            clients.push_back(fd);
+        }
+        for (std::size_t i = 0; i < clients.size(); i++)
+        {
+            if (i % 2 == 0)
+            {
+                linger reset{1, 0};
+                setsockopt(clients[i], SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+            }
+            else
+            {
+                // Answered in full before the server closes
+                std::string answer = read_all(clients[i]);
+                EXPECT_EQ(std::count(answer.begin(), answer.end(), '\n'), 12);
+            }
+            close(clients[i]);
+        }
+    }
+
+    int fd = connect_to_server();
+    ASSERT_GE(fd, 0);
+    const std::string query = "news politics\n";
+    send(fd, query.data(), query.size(), 0);
+    shutdown(fd, SHUT_WR);
+    std::string answer = read_all(fd);
+    close(fd);
+    EXPECT_EQ(answer.rfind("Welcome", 0), 0u);
+    EXPECT_NE(answer.find("results"), std::string::npos);
+    EXPECT_EQ(std::count(answer.begin(), answer.end(), '\n'), 12);
+}
+
+TEST(ServerTest, SilentClientsAreGreetedAsTextClients)
+{
+    spdlog::set_level(spdlog::level::warn);
+    boolean_index::BooleanIndex<uint32_t> index(10);
+    document_store::DocumentStore<uint32_t> documents;
+    build(index, documents, 100);
+
+    for (uint32_t delay : {50u, 0u})
+    {
+        ServerOptions options;
+        options.greeting_delay_ms = delay;
+        MinimalAsyncServer server(PORT, 10, index, documents, 1 << 20, options);
+        RunningServer running(server);
+
+        // A client waiting for the greeting before its first query
+        int fd = connect_to_server();
+        ASSERT_GE(fd, 0);
+        EXPECT_EQ(read_line(fd), "Welcome to async server!\n") << delay;
+        const std::string query = "news sport\n";
+        send(fd, query.data(), query.size(), 0);
+        shutdown(fd, SHUT_WR);
+        std::string answer = read_all(fd);
+        close(fd);
+        EXPECT_NE(answer.find("results"), std::string::npos) << delay;
+        EXPECT_EQ(answer.find("Welcome"), std::string::npos) << delay;
+    }
+
+    // An HTTP client speaks first and gets no greeting
+    ServerOptions options;
+    MinimalAsyncServer server(PORT, 10, index, documents, 1 << 20, options);
+    RunningServer running(server);
+    int fd = connect_to_server();
+    ASSERT_GE(fd, 0);
+    const std::string request = "GET /search?q=news HTTP/1.1\r\nConnection: close\r\n\r\n";
+    send(fd, request.data(), request.size(), 0);
+    std::string answer = read_all(fd);
+    close(fd);
+    EXPECT_EQ(answer.rfind("HTTP/1.1 200", 0), 0u);
+}
+
+TEST(ServerTest, SignalStopsEveryEventLoopPromptly)
+{
+    spdlog::set_level(spdlog::level::warn);
+    boolean_index::BooleanIndex<uint32_t> index(10);
+    document_store::DocumentStore<uint32_t> documents;
+    build(index, documents, 100);
+
+    ServerOptions options;
+    options.reactors = 4;
+    MinimalAsyncServer server(PORT, 10, index, documents, 1 << 20, options);
+    stop_flag = false;
+    std::thread thread([&server]
+                       { server.run(); });
+    for (int attempt = 0; attempt < 200; attempt++)
+    {
+        int fd = connect_to_server();
+        if (fd >= 0)
+        {
+            close(fd);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    // Every loop is idle in its wait
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // Handled on this thread, none of the event loops sees it
+    auto start = std::chrono::steady_clock::now();
+    std::raise(SIGTERM);
+    thread.join();
+    auto stopped_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_LT(stopped_ms, 1000);
+}
+
+TEST(ServerTest, PlainQueriesOnlyAllocateTheirResponse)
+{
+    // Logged at info into a sink that drops it, so the log calls format
+    // their lines as in production
+    auto previous_logger = spdlog::default_logger();
+    auto logger = std::make_shared<spdlog::logger>("null", std::make_shared<spdlog::sinks::null_sink_mt>());
+    logger->set_level(spdlog::level::info);
+    spdlog::set_default_logger(logger);
+
+    boolean_index::BooleanIndex<uint32_t> index(10);
+    document_store::DocumentStore<uint32_t> documents;
+    build(index, documents, 20000);
+    MinimalAsyncServer server(PORT, 10, index, documents, 1 << 20);
+    deadline::Deadline deadline = deadline::Deadline::after(60000);
+    arena::Arena memory;
+
+    const std::vector<std::string> queries = {"news sport", "sport news politics", "politics"};
+    // The topics match every other document, so the counts below cover
+    // full evaluations and count estimates, not just empty lookups
+    const std::vector<std::size_t> matches = {10, 0, 10};
+    std::size_t found_total = 0;
+    std::size_t last_found = 0;
+    auto evaluate = [&](const std::string &text, bool cached)
+    {
+        arena::Scope scope(memory);
+        PlainSearch found(&memory);
+        ASSERT_TRUE(server.evaluate_plain(text, &deadline, found));
+        EXPECT_EQ(found.cached, cached);
+        last_found = found.documents.size();
+        found_total += found.documents.size() + found.count.estimate;
+    };
+
+    // Warm up: the arena grows to what the queries need
+    for (std::size_t i = 0; i < queries.size(); i++)
+    {
+        evaluate(queries[i], false);
+        EXPECT_EQ(last_found, matches[i]) << queries[i];
+    }
+    // Tokens, cache key and lookup, evaluation, count samples and the log
+    // line stay in the arena on a miss
+    EXPECT_EQ(count_allocations([&]
+                                {
+                                    for (int round = 0; round < 100; round++)
+                                    {
+                                        for (const auto &text : queries)
+                                        {
+                                            evaluate(text, false);
+                                        }
+                                    } }),
+              0u);
+
+    // The full path caches the results, then hits stay in the arena too
+    for (const auto &text : queries)
+    {
+        server.handle_search(text, &deadline);
+    }
+    EXPECT_EQ(count_allocations([&]
+                                {
+                                    for (int round = 0; round < 100; round++)
+                                    {
+                                        for (const auto &text : queries)
+                                        {
+                                            evaluate(text, true);
+                                        }
+                                    } }),
+              0u);
+    EXPECT_GT(found_total, 0u);
+
+    // A cached query through the full path allocates what its response
+    // holds and nothing else
+    output_buffer::Message response;
+    std::string text = "news sport";
+    std::size_t allocated = count_allocations([&]
+                                              { response = server.handle_search(std::move(text), &deadline); });
+    EXPECT_EQ(allocated, count_allocations([&]
+                                           { output_buffer::Message copy = response; }));
+    std::string answer = response.to_string();
+    EXPECT_EQ(answer.rfind("about", 0), 0u);
+    EXPECT_EQ(std::count(answer.begin(), answer.end(), '\n'), 11);
+
+    spdlog::set_default_logger(previous_logger);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "term_dictionary.hpp"
+
+using namespace term_dictionary;
+
+namespace
+{
+    std::vector<std::string> random_terms(uint32_t seed, std::size_t count)
+    {
+        std::mt19937 generator(seed);
+        std::vector<std::string> terms;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            std::string term;
+            std::size_t length = 1 + generator() % 10;
+            for (std::size_t j = 0; j < length; j++)
+            {
+                term.push_back(static_cast<char>('a' + generator() % 6));
+            }
+            terms.push_back(term);
+        }
+        // Cyrillic terms are compared bytewise like any other
+        terms.push_back("\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba");
+        terms.push_back("\xd0\xbf\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba\xd0\xb0");
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        return terms;
+    }
+}
+
+TEST(TermDictionaryTest, IterateAndLookup)
+{
+    auto terms = random_terms(1, 5000);
+    auto dictionary = FrontCodedDictionary::build(terms);
+    ASSERT_EQ(dictionary.size(), terms.size());
+
+    std::vector<std::string> decoded;
+    for (auto it = dictionary.iterate(); it.valid(); it.next())
+    {
+        EXPECT_EQ(it.rank(), decoded.size());
+        decoded.push_back(it.term());
+    }
+    EXPECT_EQ(decoded, terms);
+
+    for (std::size_t rank = 0; rank < terms.size(); rank += 37)
+    {
+        EXPECT_EQ(dictionary.term(rank), terms[rank]);
+        EXPECT_EQ(dictionary.lower_bound(terms[rank]), rank);
+        EXPECT_TRUE(dictionary.contains(terms[rank]));
+    }
+    EXPECT_FALSE(dictionary.contains("zzz"));
+    EXPECT_EQ(dictionary.lower_bound("\xff"), terms.size());
+    EXPECT_EQ(dictionary.lower_bound(""), 0u);
+
+    // Shared prefixes are stored once
+    std::size_t raw = 0;
+    for (const auto &term : terms)
+    {
+        raw += term.size();
+    }
+    EXPECT_LT(dictionary.memory_bytes(), raw);
+}
+
+TEST(TermDictionaryTest, PrefixRange)
+{
+    auto terms = random_terms(2, 3000);
+    auto dictionary = FrontCodedDictionary::build(terms);
+
+    for (std::string prefix : {"a", "ab", "fff", "cad", "z", "", "\xd0\xbf\xd0\xbe"})
+    {
+        std::vector<std::string> expected;
+        for (const auto &term : terms)
+        {
+            if (term.compare(0, prefix.size(), prefix) == 0)
+            {
+                expected.push_back(term);
+            }
+        }
+
+        auto range = dictionary.prefix_range(prefix);
+        std::vector<std::string> actual;
+        for (auto it = dictionary.iterate(range.first); it.valid() && it.rank() < range.second; it.next())
+        {
+            actual.push_back(it.term());
+        }
+        EXPECT_EQ(actual, expected) << prefix;
+    }
+}
+
+TEST(TermDictionaryTest, Empty)
+{
+    FrontCodedDictionary dictionary;
+    EXPECT_TRUE(dictionary.empty());
+    EXPECT_FALSE(dictionary.iterate().valid());
+    EXPECT_FALSE(dictionary.contains("a"));
+    auto range = dictionary.prefix_range("a");
+    EXPECT_EQ(range.first, range.second);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "parallel_executor.hpp"
+#include "thread_pool.hpp"
+
+using namespace thread_pool;
+using parallel_executor::ParallelExecutor;
+using parallel_executor::ParallelOptions;
+
+TEST(ThreadPoolTest, ParallelForRunsEveryIndexOnce)
+{
+    for (std::size_t threads : {0, 1, 4})
+    {
+        ThreadPool pool(threads);
+        std::vector<std::atomic<int>> hits(1000);
+
+        pool.parallel_for(hits.size(), [&](std::size_t i)
+                          { hits[i]++; });
+
+        for (const auto &hit : hits)
+        {
+            EXPECT_EQ(hit.load(), 1);
+        }
+    }
+}
+
+TEST(ThreadPoolTest, ParallelForRethrows)
+{
+    ThreadPool pool(3);
+    std::atomic<int> finished{0};
+
+    EXPECT_THROW(pool.parallel_for(100, [&](std::size_t i)
+                                   {
+                                       if (i == 42)
+                                       {
+                                           throw std::runtime_error("task failed");
+                                       }
+                                       finished++; }),
+                 std::runtime_error);
+    EXPECT_EQ(finished.load(), 99);
+
+    // The pool stays usable after a failed batch
+    pool.parallel_for(10, [&](std::size_t)
+                      { finished++; });
+    EXPECT_EQ(finished.load(), 109);
+}
+
+TEST(ThreadPoolTest, ExecutorMergesRangesInOrder)
+{
+    ThreadPool pool(4);
+    ParallelOptions options;
+    options.min_cost = 100;
+    ParallelExecutor<uint32_t> executor(pool, options);
+
+    EXPECT_FALSE(executor.should_parallelize(99));
+    EXPECT_TRUE(executor.should_parallelize(100));
+    EXPECT_EQ(executor.partition_count(), 16);
+
+    // Every third id in each range
+    auto evaluate = [](std::size_t, uint32_t first, uint32_t last)
+    {
+        std::vector<uint32_t> ids;
+        for (uint32_t id = first; id < last; id++)
+        {
+            if (id % 3 == 0)
+                ids.push_back(id);
+        }
+        return ids;
+    };
+
+    auto all = executor.run(1000, 0, evaluate);
+    ASSERT_EQ(all.size(), 334);
+    for (std::size_t i = 0; i < all.size(); i++)
+    {
+        EXPECT_EQ(all[i], i * 3);
+    }
+
+    auto limited = executor.run(1000, 5, evaluate);
+    EXPECT_EQ(limited, (std::vector<uint32_t>{0, 3, 6, 9, 12}));
+
+    // Fewer ids than ranges
+    EXPECT_EQ(executor.run(4, 0, evaluate), (std::vector<uint32_t>{0, 3}));
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "trigram_index.hpp"
+
+using namespace trigram_index;
+
+TEST(TrigramIndexTest, Normalize)
+{
+    EXPECT_EQ(normalize("  Boost::Asio\t1.85\n"), "boost::asio 1.85");
+    // "ПРИВЕТ Ёж" -> "привет ёж"
+    EXPECT_EQ(normalize("\xd0\x9f\xd0\xa0\xd0\x98\xd0\x92\xd0\x95\xd0\xa2 \xd0\x81\xd0\xb6"),
+              "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 \xd1\x91\xd0\xb6");
+    EXPECT_EQ(trigrams("abcab"), (std::vector<uint32_t>{0x616263, 0x626361, 0x636162}));
+    EXPECT_TRUE(trigrams("ab").empty());
+}
+
+TEST(TrigramIndexTest, SubstringQuery)
+{
+    TrigramIndexOptions options;
+    // Flush after every couple of documents to merge several segments
+    options.buffer_postings = 40;
+    TrigramIndex<uint32_t> index(0, options);
+    index.add_document(0, "Released version 1.2.3 of the parser");
+    index.add_document(1, "std::vector<int> v; v.push_back(1);");
+    index.add_document(2, "version 1.2 only, then 3");
+    index.add_document(4, "Call std::VECTOR::push_back here");
+    index.add_document(5, "\xd0\x9f\xd0\xbe\xd0\xb8\xd1\x81\xd0\xba\xd0\xbe\xd0\xb2\xd1\x8b\xd0\xb9 \xd0\xb8\xd0\xbd\xd0\xb4\xd0\xb5\xd0\xba\xd1\x81");
+    index.add_document(6, "abcab");
+    EXPECT_THROW(index.add_document(3, "late"), std::invalid_argument);
+    EXPECT_THROW(index.substring_query("version"), std::logic_error);
+    index.finish();
+
+    EXPECT_EQ(index.substring_query("1.2.3"), (std::vector<uint32_t>{0}));
+    EXPECT_EQ(index.substring_query("version 1.2"), (std::vector<uint32_t>{0, 2}));
+    EXPECT_EQ(index.substring_query("std::vector"), (std::vector<uint32_t>{1, 4}));
+    EXPECT_EQ(index.substring_query("push_back(1)"), (std::vector<uint32_t>{1}));
+    // Both trigrams of "cabc" occur in "abcab", the pattern itself does not
+    EXPECT_TRUE(index.substring_query("cabc").empty());
+    EXPECT_EQ(index.substring_query("bca"), (std::vector<uint32_t>{6}));
+    EXPECT_EQ(index.substring_query("\xd0\xb8\xd0\xbd\xd0\xb4\xd0\xb5\xd0\xba\xd1\x81"), (std::vector<uint32_t>{5}));
+    EXPECT_TRUE(index.substring_query("ab").empty());
+    EXPECT_TRUE(index.substring_query("missing").empty());
+    EXPECT_EQ(index.document_count(), 6u);
+}
+
+TEST(TrigramIndexTest, MatchesScan)
+{
+    std::mt19937 generator(7);
+    TrigramIndexOptions options;
+    options.buffer_postings = 5000;
+    TrigramIndex<uint32_t> index(0, options);
+
+    std::vector<std::string> texts;
+    for (uint32_t doc_id = 0; doc_id < 2000; doc_id++)
+    {
+        std::string text;
+        for (int i = 0; i < 60; i++)
+        {
+            text.push_back("abc.:_ 1"[generator() % 8]);
+        }
+        index.add_document(doc_id, text);
+        texts.push_back(normalize(text));
+    }
+    index.finish();
+
+    for (std::string pattern : {"abc", "a.b", "1_:", "cab.a", "ba ba", ".:_1a"})
+    {
+        std::vector<uint32_t> expected;
+        for (uint32_t doc_id = 0; doc_id < texts.size(); doc_id++)
+        {
+            if (texts[doc_id].find(pattern) != std::string::npos)
+            {
+                expected.push_back(doc_id);
+            }
+        }
+        EXPECT_EQ(index.substring_query(pattern), expected) << pattern;
+    }
+
+    TrigramIndex<uint32_t> limited(3, options);
+    for (uint32_t doc_id = 0; doc_id < 100; doc_id++)
+    {
+        limited.add_document(doc_id, doc_id % 2 == 0 ? "even text" : "odd text");
+    }
+    limited.finish();
+    EXPECT_EQ(limited.substring_query("odd"), (std::vector<uint32_t>{1, 3, 5}));
+}
+
+TEST(TrigramIndexTest, DeadlineAndCost)
+{
+    TrigramIndex<uint32_t> index;
+    for (uint32_t doc_id = 0; doc_id < 4000; doc_id++)
+    {
+        std::string text(1024, 'x');
+        text += doc_id % 2 == 0 ? " needle" : " thread";
+        index.add_document(doc_id, text);
+    }
+    index.finish();
+
+    // Past the deadline the documents found so far are kept
+    deadline::Deadline passed(deadline::Deadline::Clock::now() - std::chrono::milliseconds(1));
+    deadline::Deadline later = deadline::Deadline::after(60000);
+    EXPECT_EQ(index.substring_query("needle").size(), 2000u);
+    EXPECT_LT(index.substring_query("needle", nullptr, &passed).size(), 2000u);
+    EXPECT_EQ(index.substring_query("needle", nullptr, &later).size(), 2000u);
+
+    // The rarest trigram's list, once per trigram plus the candidates' text
+    EXPECT_EQ(index.estimate_cost("needle"), 2000u * 4 + 2000u * (1031 / TEXT_BYTES_PER_POSTING));
+    EXPECT_GT(index.estimate_cost("xxxxx"), index.estimate_cost("needle"));
+    EXPECT_EQ(index.estimate_cost("missing"), 0u);
+    EXPECT_EQ(index.estimate_cost("ab"), 0u);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "uring_loop.hpp"
+
+using namespace uring;
+
+namespace
+{
+    // Kernels without multishot receives, or sandboxes blocking io_uring,
+    // skip the tests
+    std::unique_ptr<UringLoop> make_loop(unsigned buffer_count = 16, unsigned buffer_size = 64)
+    {
+        try
+        {
+            return std::make_unique<UringLoop>(64, buffer_count, buffer_size);
+        }
+        catch (const std::system_error &)
+        {
+            return nullptr;
+        }
+    }
+
+    std::vector<Completion> completions(UringLoop &loop, int timeout_ms = 100)
+    {
+        std::vector<Completion> result;
+        loop.wait(timeout_ms, [&](const Completion &completion)
+                  { result.push_back(completion); });
+        return result;
+    }
+
+    struct SocketPair
+    {
+        int fds[2];
+
+        SocketPair()
+        {
+            socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+        }
+
+        ~SocketPair()
+        {
+            close(fds[0]);
+            close(fds[1]);
+        }
+    };
+}
+
+TEST(UringLoopTest, MultishotReceiveRecyclesBuffers)
+{
+    auto loop = make_loop(4, 64);
+    if (loop == nullptr)
+    {
+        GTEST_SKIP() << "io_uring unavailable";
+    }
+    SocketPair pair;
+    loop->receive_multishot(pair.fds[0], 7);
+
+    // More messages than buffers, each one is given back after copying
+    std::string received;
+    for (int i = 0; i < 20; i++)
+    {
+        std::string message = "query " + std::to_string(i) + "\n";
+        ASSERT_EQ(write(pair.fds[1], message.data(), message.size()), static_cast<ssize_t>(message.size()));
+        for (const auto &completion : completions(*loop))
+        {
+            EXPECT_EQ(completion.user_data, 7u);
+            ASSERT_GT(completion.result, 0);
+            ASSERT_TRUE(completion.has_buffer());
+            EXPECT_TRUE(completion.more());
+            received += loop->buffer(completion.buffer_id(), static_cast<std::size_t>(completion.result));
+            loop->recycle(completion.buffer_id());
+        }
+    }
+    std::string expected;
+    for (int i = 0; i < 20; i++)
+    {
+        expected += "query " + std::to_string(i) + "\n";
+    }
+    EXPECT_EQ(received, expected);
+
+    // The peer hanging up ends the receive
+    shutdown(pair.fds[1], SHUT_WR);
+    auto last = completions(*loop);
+    ASSERT_EQ(last.size(), 1u);
+    EXPECT_EQ(last[0].result, 0);
+    EXPECT_FALSE(last[0].more());
+}
+
+TEST(UringLoopTest, CancelEndsReceive)
+{
+    auto loop = make_loop();
+    if (loop == nullptr)
+    {
+        GTEST_SKIP() << "io_uring unavailable";
+    }
+    SocketPair pair;
+    loop->receive_multishot(pair.fds[0], 1);
+    EXPECT_TRUE(completions(*loop, 10).empty());
+
+    loop->cancel(1, 2);
+    bool cancelled = false;
+    for (const auto &completion : completions(*loop))
+    {
+        if (completion.user_data == 1)
+        {
+            EXPECT_EQ(completion.result, -ECANCELED);
+            EXPECT_FALSE(completion.more());
+            cancelled = true;
+        }
+    }
+    EXPECT_TRUE(cancelled);
+}
+
+TEST(UringLoopTest, PollWritableAndRead)
+{
+    auto loop = make_loop();
+    if (loop == nullptr)
+    {
+        GTEST_SKIP() << "io_uring unavailable";
+    }
+    SocketPair pair;
+    loop->poll_writable(pair.fds[0], 3);
+    auto ready = completions(*loop);
+    ASSERT_EQ(ready.size(), 1u);
+    EXPECT_EQ(ready[0].user_data, 3u);
+    EXPECT_TRUE(ready[0].result & POLLOUT);
+
+    int wake_fd = eventfd(0, EFD_NONBLOCK);
+    uint64_t count = 0;
+    loop->read(wake_fd, &count, sizeof(count), 4);
+    EXPECT_TRUE(completions(*loop, 10).empty());
+    uint64_t one = 1;
+    ASSERT_EQ(write(wake_fd, &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+    auto woken = completions(*loop);
+    ASSERT_EQ(woken.size(), 1u);
+    EXPECT_EQ(woken[0].result, static_cast<int32_t>(sizeof(count)));
+    EXPECT_EQ(count, 1u);
+    close(wake_fd);
+}
+
+TEST(UringLoopTest, MultishotAccept)
+{
+    auto loop = make_loop();
+    if (loop == nullptr)
+    {
+        GTEST_SKIP() << "io_uring unavailable";
+    }
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    ASSERT_EQ(listen(listen_fd, 16), 0);
+    socklen_t length = sizeof(addr);
+    getsockname(listen_fd, reinterpret_cast<sockaddr *>(&addr), &length);
+    loop->accept_multishot(listen_fd, 9);
+
+    std::vector<int> clients;
+    for (int i = 0; i < 3; i++)
+    {
+        clients.push_back(socket(AF_INET, SOCK_STREAM, 0));
+        ASSERT_EQ(connect(clients.back(), reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    }
+    std::vector<int> accepted;
+    for (int attempt = 0; attempt < 10 && accepted.size() < clients.size(); attempt++)
+    {
+        for (const auto &completion : completions(*loop))
+        {
+            EXPECT_EQ(completion.user_data, 9u);
+            ASSERT_GE(completion.result, 0);
+            EXPECT_TRUE(completion.more());
+            accepted.push_back(completion.result);
+        }
+    }
+    EXPECT_EQ(accepted.size(), clients.size());
+
+    for (int fd : accepted)
+    {
+        close(fd);
+    }
+    for (int fd : clients)
+    {
+        close(fd);
+    }
+    close(listen_fd);
+}
+
+TEST(UringLoopTest, WaitTimesOut)
+{
+    auto loop = make_loop();
+    if (loop == nullptr)
+    {
+        GTEST_SKIP() << "io_uring unavailable";
+    }
+    EXPECT_EQ(loop->wait(10, [](const Completion &) {}), 0);
+}
+
+// Main function for Google Test
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}